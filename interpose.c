@@ -9,26 +9,33 @@
  *
  * Reads configuration from environment variables:
  *   RMP_TARGET    - target directory (e.g., /tmp/myapp-v1)
- *   RMP_MAPPINGS  - colon-separated patterns (e.g., $HOME/.claude*:/tmp/.stuff*)
+ *   RMP_MAPPINGS  - colon-separated patterns (e.g., $HOME/.claude*:/tmp/.stuff*),
+ *                   each optionally "<pattern>=<dir>" with its own target
  *   RMP_DEBUG_LOG - log file path (enables debug logging when set)
  *   RMP_CONFIG    - base config directory (default: ~/.remapper/)
  *   RMP_CACHE     - cache directory (default: $RMP_CONFIG/cache/)
+ *   RMP_PRESIGN   - "0" disables background re-signing of bundle siblings
+ *   RMP_PRESIGN_JOBS - background re-signing threads (default: 2)
+ *   RMP_HEATMAP   - report file: count the rewritten calls per path into it
+ *   RMP_TRACE     - trace file: record every path given to try_rewrite()
  *
- * Each mapping is split into (parent_dir, glob). When any intercepted filesystem
- * call receives a path starting with parent_dir whose next component matches glob,
- * the parent_dir prefix is replaced with RMP_TARGET.
+ * The patterns and the matching are in interpose_rewrite.c, the path
+ * behind each open fd in interpose_fdpath.c, and the merged listing of
+ * a directory that mappings sit in, in interpose_dirlist.c.
  */
 
+#include <pthread.h>
 #include "interpose.h"
 
 /*** Global state *********************************/
 
-pattern_t g_patterns[MAX_PATTERNS];
-int       g_num_patterns = 0;
-char      g_target[PATH_MAX];  // includes trailing '/'
 int       g_initialized = 0;
-int       g_debug = 0;
-FILE     *g_debug_fp = NULL;  // stderr or file
+rmp_heat_t *g_heat = NULL;
+rmp_trace_t *g_trace = NULL;
+
+static char g_heat_file[PATH_MAX];
+static void heat_init(void);
+static void trace_init(void);
 
 /*** Initialiser (runs when dylib is loaded) ******/
 
@@ -47,79 +54,116 @@ static void remapper_init(void) {
     const char *target = getenv("RMP_TARGET");
     const char *pats   = getenv("RMP_MAPPINGS");
     if (!target || !pats) return;
-
-    // Copy target, ensure trailing slash
-    size_t tlen = strlen(target);
-    if (tlen == 0 || tlen >= sizeof(g_target) - 1) return;
-    memcpy(g_target, target, tlen);
-    if (g_target[tlen - 1] != '/') g_target[tlen++] = '/';
-    g_target[tlen] = '\0';
-
-    // Parse colon-separated patterns
-    char buf[PATH_MAX * 16];
-    strncpy(buf, pats, sizeof(buf) - 1);
-    buf[sizeof(buf) - 1] = '\0';
-
-    char *saveptr = NULL;
-    char *tok = strtok_r(buf, ":", &saveptr);
-    while (tok && g_num_patterns < MAX_PATTERNS) {
-        // trim spaces
-        while (*tok == ' ') tok++;
-        size_t toklen = strlen(tok);
-        while (toklen > 0 && tok[toklen - 1] == ' ') tok[--toklen] = '\0';
-        if (toklen == 0) { tok = strtok_r(NULL, ":", &saveptr); continue; }
-
-        // split at last '/' → (parent_dir, glob_component)
-        char *last_slash = strrchr(tok, '/');
-        if (last_slash && last_slash != tok) {
-            size_t plen = (size_t)(last_slash - tok + 1);  // includes '/'
-            if (plen < PATH_MAX && (toklen - plen) < 256) {
-                memcpy(g_patterns[g_num_patterns].parent, tok, plen);
-                g_patterns[g_num_patterns].parent[plen] = '\0';
-                g_patterns[g_num_patterns].parent_len = plen;
-                strcpy(g_patterns[g_num_patterns].glob, last_slash + 1);
-
-                RMP_DEBUG("pattern[%d]: parent='%s' glob='%s'",
-                          g_num_patterns,
-                          g_patterns[g_num_patterns].parent,
-                          g_patterns[g_num_patterns].glob);
-                g_num_patterns++;
-            }
-        }
-        tok = strtok_r(NULL, ":", &saveptr);
+    load_patterns(target, pats);
+    RMP_DEBUG("target='%s'  %d pattern(s) loaded", g_target, g_num_patterns);
+    if (g_num_patterns > 0) {
+        heat_init();
+        trace_init();
     }
+}
 
-    RMP_DEBUG("target='%s'  %d pattern(s) loaded", g_target, g_num_patterns);
+/*** --heatmap counts *****************************/
+//
+// Each process of the program counts into a table of its own and folds
+// it into the report file as it exits or execs (rmp_heat_save() takes
+// the counts out, so nothing is counted twice).  Only calls on mapped
+// paths get here, by the path the program asked for: a lookup (stat,
+// access, readlink, ...) counts as a read, since the reads themselves
+// go through file descriptors the interposer never sees.
+
+#define HEAT_MAX_PATHS 16384
+
+static void heat_flush(void) {
+    if (!g_heat) return;
+    if (rmp_heat_save(g_heat, g_heat_file) < 0)
+        RMP_DEBUG("heatmap: can't write %s: %s", g_heat_file, strerror(errno));
+}
+
+// A forked child starts with its parent's counts, which are the
+// parent's to report
+static void heat_atfork_child(void) {
+    if (g_heat) rmp_heat_reset(g_heat);
+}
+
+static void heat_init(void) {
+    const char *file = getenv("RMP_HEATMAP");
+    if (!file || file[0] != '/' || strlen(file) >= sizeof(g_heat_file)) return;
+    strcpy(g_heat_file, file);
+    g_heat = rmp_heat_new(HEAT_MAX_PATHS);
+    if (!g_heat) return;
+    pthread_atfork(NULL, NULL, heat_atfork_child);
+    atexit(heat_flush);
+    RMP_DEBUG("heatmap: counting into %s", g_heat_file);
 }
 
-/*** Path rewriting *******************************/
+static int has_prefix(const char *s, const char *prefix) {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
 
-// Try to rewrite `path`. If it matches a pattern, write the rewritten
-// path into `out` and return 1. Otherwise return 0.
-int try_rewrite(const char *path, char *out, size_t outsize) {
-    if (!path || g_num_patterns == 0) return 0;
+void heat_hit(const char *func, const char *path) {
+    int kind;
+    if (has_prefix(func, "open") || has_prefix(func, "fopen") || strcmp(func, "creat") == 0)
+        return;     // heat_open(), from the hook
+    if (has_prefix(func, "mkdir") || has_prefix(func, "symlink") || has_prefix(func, "link"))
+        kind = RMP_HEAT_CREATE;
+    else if (has_prefix(func, "unlink") || has_prefix(func, "rename") ||
+             strcmp(func, "rmdir") == 0 || strcmp(func, "truncate") == 0 ||
+             strstr(func, "chmod") || strstr(func, "chown"))
+        kind = RMP_HEAT_MODIFY;
+    else
+        kind = RMP_HEAT_READ;
+    rmp_heat_add(g_heat, path, kind, 1);
+}
 
-    for (int i = 0; i < g_num_patterns; i++) {
-        if (strncmp(path, g_patterns[i].parent, g_patterns[i].parent_len) != 0)
-            continue;
+// An open that succeeded: an open, plus a create for O_CREAT (whether or
+// not the file was there) or a modify for write access
+void heat_open(const char *path, int flags) {
+    if (!g_heat) return;
+    rmp_heat_add(g_heat, path, RMP_HEAT_OPEN, 1);
+    if (flags & O_CREAT)
+        rmp_heat_add(g_heat, path, RMP_HEAT_CREATE, 1);
+    else if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC))
+        rmp_heat_add(g_heat, path, RMP_HEAT_MODIFY, 1);
+}
 
-        const char *rest = path + g_patterns[i].parent_len;
-        if (*rest == '\0') continue;  // path IS the parent dir, nothing to match
+// The open(2) flags of an fopen() mode
+int heat_fopen_flags(const char *mode) {
+    int rw = strchr(mode, '+') ? O_RDWR : O_WRONLY;
+    switch (mode[0]) {
+    case 'w': return rw | O_CREAT | O_TRUNC;
+    case 'a': return rw | O_CREAT | O_APPEND;
+    default:  return strchr(mode, '+') ? O_RDWR : O_RDONLY;
+    }
+}
 
-        // Extract next path component
-        const char *slash = strchr(rest, '/');
-        size_t clen = slash ? (size_t)(slash - rest) : strlen(rest);
-        if (clen == 0 || clen >= 256) continue;
+/*** --trace records ******************************/
+//
+// Every path the hooks hand to try_rewrite(), with the call, for
+// test/bench_rewrite to replay.  The file was started by the launcher
+// (rmp_trace_create()) with the target and mappings; each process
+// appends its own chunks.
 
-        char component[256];
-        memcpy(component, rest, clen);
-        component[clen] = '\0';
+static void trace_fork_prepare(void) { rmp_trace_lock(g_trace); }
+static void trace_fork_after(void)   { rmp_trace_unlock(g_trace); }
 
-        if (fnmatch(g_patterns[i].glob, component, 0) == 0) {
-            int n = snprintf(out, outsize, "%s%s", g_target, rest);
-            if (n < 0 || (size_t)n >= outsize) continue;
-            return 1;
-        }
+static void trace_exit(void) {
+    rmp_trace_flush(g_trace);
+}
+
+static void trace_init(void) {
+    const char *file = getenv("RMP_TRACE");
+    if (!file || !file[0]) return;
+    g_trace = rmp_trace_open(file);
+    if (!g_trace) {
+        RMP_DEBUG("trace: can't open %s: %s", file, strerror(errno));
+        return;
     }
-    return 0;
+    pthread_atfork(trace_fork_prepare, trace_fork_after, trace_fork_after);
+    atexit(trace_exit);
+    RMP_DEBUG("trace: recording into %s", file);
+}
+
+void flush_before_exec(void) {
+    heat_flush();
+    if (g_trace) rmp_trace_flush(g_trace);
 }
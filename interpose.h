@@ -25,6 +25,9 @@
 #include <errno.h>
 
 #include "rmp_shared.h"
+#include "rmp_glob.h"
+#include "rmp_heat.h"
+#include "rmp_trace.h"
 
 /*** Interpose mechanism **************************/
 
@@ -43,9 +46,12 @@
 #define MAX_PATTERNS 64
 
 typedef struct {
-    char parent[PATH_MAX];   // e.g. "/home/user/"
+    char parent[PATH_MAX];   // literal base, e.g. "/home/user/"
     size_t parent_len;
-    char glob[256];          // e.g. ".claude*"
+    char glob[256];          // the rest, e.g. ".claude*" or "src/*/.cache";
+                             // compiled into match, which owns it after
+    rmp_glob_t match;
+    char *target;            // own target with trailing '/', or NULL for g_target
 } pattern_t;
 
 extern pattern_t g_patterns[MAX_PATTERNS];
@@ -54,11 +60,71 @@ extern char      g_target[PATH_MAX];
 extern int       g_initialized;
 extern int       g_debug;
 extern FILE     *g_debug_fp;
+extern rmp_heat_t *g_heat;    // --heatmap counts, or NULL
+extern rmp_trace_t *g_trace;  // --trace file, or NULL
 
 /*** Path rewriting *******************************/
 
+// Load the target (RMP_TARGET) and the colon-separated patterns
+// (RMP_MAPPINGS) into the globals above
+void load_patterns(const char *target, const char *pats);
+
 int try_rewrite(const char *path, char *out, size_t outsize);
 
+// --heatmap: count a rewritten call to func on path (the path the
+// program asked for), by what func does; heat_open() for the open
+// family, which is counted by its flags instead
+void heat_hit(const char *func, const char *path);
+void heat_open(const char *path, int flags);
+int  heat_fopen_flags(const char *mode);
+
+// Write out this process's --heatmap counts and --trace records,
+// before an exec
+void flush_before_exec(void);
+
+/*** Fd paths *************************************/
+//
+// The absolute path (the program's, before any rewrite) each fd was
+// opened by, for the *at() calls (interpose_fdpath.c)
+
+// Record, or forget if path is NULL or relative, fd's path
+void fdpath_set(int fd, const char *path);
+void fdpath_clear(int fd);
+void fdpath_dup(int oldfd, int newfd);
+
+// fd's path into out; 1 if known
+int fdpath_get(int fd, char *out, size_t outsize);
+
+// The absolute path a relative path under dirfd names, into out; 0 if
+// path is absolute or empty, or dirfd's path isn't known
+int fdpath_join(int dirfd, const char *path, char *out, size_t outsize);
+
+/*** Union listings *******************************/
+//
+// What listing a directory a mapping's entries sit in shows: its own
+// entries less those redirected, then the target's that they are
+// redirected to (interpose_dirlist.c)
+
+typedef struct {
+    const char   *name;
+    ino_t         ino;
+    unsigned char type;     // DT_*
+} dirlist_ent_t;
+
+typedef struct {
+    int            count;
+    dirlist_ent_t *ents;
+} dirlist_t;
+
+// dir's listing (the program's path; fd open on it, or -1), cached
+// while none of the directories it read has changed.  NULL if no
+// mapping adds to or hides from it.  Hand it back to dirlist_release().
+dirlist_t *dirlist_open(const char *dir, int fd);
+
+// The same, read afresh and not cached
+dirlist_t *dirlist_merge(const char *dir);
+void dirlist_release(dirlist_t *list);
+
 /* Convenience: rewrite a single path on the stack
  * Equivilant of the function:
  *  const char *rewrite_path(const char *path) {
@@ -77,30 +143,43 @@ int try_rewrite(const char *path, char *out, size_t outsize);
 #define REWRITE_1_F(varname, path, func) \
     char varname##_buf[PATH_MAX]; \
     const char *varname; \
+    if (g_trace) \
+        rmp_trace_add(g_trace, (func), (path)); \
     if (try_rewrite((path), varname##_buf, sizeof(varname##_buf))) { \
         if ((func) && g_debug) \
             fprintf(g_debug_fp, "[remapper] %s('%s' => '%s')\n", \
                     (const char *)(func), (path), varname##_buf); \
+        if ((func) && g_heat) \
+            heat_hit((const char *)(func), (path)); \
         varname = varname##_buf; \
     } else { \
         varname = (path); \
     }
 
-// Convenience: rewrite a path only if absolute (for *at() variants)
-#define REWRITE_ABS(varname, path) \
-    REWRITE_ABS_F(varname, path, NULL)
+// Convenience: rewrite the path of an *at() call, absolute or relative
+// to a dirfd the open hooks saw.  varname##_path is the absolute path
+// the call names, or NULL if unknown; a rewritten varname is absolute,
+// so the call ignores dirfd.
+#define REWRITE_AT(varname, dirfd, path) \
+    REWRITE_AT_F(varname, dirfd, path, NULL)
 
-#define REWRITE_ABS_F(varname, path, func) \
+#define REWRITE_AT_F(varname, dirfd, path, func) \
     char varname##_buf[PATH_MAX]; \
-    const char *varname; \
-    if ((path)[0] == '/' && \
-        try_rewrite((path), varname##_buf, sizeof(varname##_buf))) { \
+    char varname##_abs[PATH_MAX]; \
+    const char *varname = (path); \
+    const char *varname##_path = (path)[0] == '/' ? (path) : \
+        fdpath_join((dirfd), (path), varname##_abs, sizeof(varname##_abs)) ? \
+        varname##_abs : NULL; \
+    if (g_trace && varname##_path) \
+        rmp_trace_add(g_trace, (func), varname##_path); \
+    if (varname##_path && \
+        try_rewrite(varname##_path, varname##_buf, sizeof(varname##_buf))) { \
         if ((func) && g_debug) \
             fprintf(g_debug_fp, "[remapper] %s('%s' => '%s')\n", \
-                    (const char *)(func), (path), varname##_buf); \
+                    (const char *)(func), varname##_path, varname##_buf); \
+        if ((func) && g_heat) \
+            heat_hit((const char *)(func), varname##_path); \
         varname = varname##_buf; \
-    } else { \
-        varname = (path); \
     }
 
 /*** Debug logging ********************************/
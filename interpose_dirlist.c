@@ -0,0 +1,316 @@
+/*
+ * interpose_dirlist.c - Merged listings of the directories mappings sit in
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * opendir() of a path inside a mapping is rewritten like any other
+ * call, but the directory a mapping's entries sit in (~ for ~/.claude*)
+ * isn't: listing it showed the real ~/.claude, whatever the target
+ * held, and none of the target's other matches.  Such a directory is
+ * listed from here instead: its own entries, less those a mapping
+ * redirects, then the entries of each target directory they redirect
+ * to that a mapping matches.  The glob states are worked out once for
+ * the directory, so each name costs one step per pattern, and what is
+ * listed is what opening each name would find.
+ *
+ * Listings are cached by path, DIRLIST_CACHE of them, each with the
+ * identity and mtime of every directory it read: a repeated listing is
+ * an fstat of the directory and a stat of each target directory, then
+ * the entries it already has.  A directory changed within the second
+ * it was read isn't cached, since a later change in that second could
+ * leave its mtime as it was.  Listings are reference counted, so one a
+ * program is reading outlives its replacement in the cache.
+ *
+ * Nothing here is macOS-only: test/bench_dirlist.c builds this file
+ * anywhere to time a listing merged, cached, and as it is.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "interpose.h"
+
+#define DIRLIST_CACHE 32    // directories whose listings are kept
+
+// A directory as it was when read; a listing is current while every
+// one it read still is
+typedef struct {
+    char *path;
+    int exists;
+    dev_t dev;
+    ino_t ino;
+    long long mtime_sec;
+    long mtime_nsec;
+} dir_stamp_t;
+
+typedef struct {
+    dirlist_t list;         // first: what callers are handed
+    _Atomic int refs;
+    char *dir;              // the program's path for it: the cache key
+    int cacheable;
+    int num_stamps;
+    dir_stamp_t *stamps;    // [0] is dir itself, then the target dirs
+    char *names;
+} listing_t;
+
+static listing_t *g_cache[DIRLIST_CACHE];
+static int g_cache_next = 0;
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*** Stamps ***************************************/
+
+static void stamp(dir_stamp_t *s, int fd, const char *path) {
+    struct stat sb;
+    s->exists = (fd >= 0 ? fstat(fd, &sb) : stat(path, &sb)) == 0;
+    if (!s->exists) return;
+    s->dev = sb.st_dev;
+    s->ino = sb.st_ino;
+    s->mtime_sec = (long long)sb.st_mtime;
+#ifdef __APPLE__
+    s->mtime_nsec = sb.st_mtimespec.tv_nsec;
+#else
+    s->mtime_nsec = sb.st_mtim.tv_nsec;
+#endif
+}
+
+static int unchanged(const dir_stamp_t *s, int fd) {
+    dir_stamp_t now;
+    stamp(&now, fd, s->path);
+    if (now.exists != s->exists) return 0;
+    return !now.exists || (now.dev == s->dev && now.ino == s->ino &&
+                           now.mtime_sec == s->mtime_sec && now.mtime_nsec == s->mtime_nsec);
+}
+
+/*** Merging **************************************/
+
+// The glob states of each pattern for an entry of dir (dirs is dir with
+// a trailing '/'), 0 for those that can't match one.  Returns how many
+// can, or 0 if none can or dir is itself inside a mapping.
+static int touching(const char *dirs, uint32_t *states) {
+    int n = 0;
+    for (int i = 0; i < g_num_patterns; i++) {
+        const pattern_t *p = &g_patterns[i];
+        states[i] = 0;
+        if (strncmp(dirs, p->parent, p->parent_len) != 0) continue;
+
+        uint32_t s = rmp_glob_start(&p->match);
+        for (const char *c = dirs + p->parent_len; *c && s; ) {
+            const char *end = strchr(c, '/');
+            char name[NAME_MAX + 1];
+            size_t len = (size_t)(end - c);
+            if (len > NAME_MAX) {
+                s = 0;
+                break;
+            }
+            memcpy(name, c, len);
+            name[len] = '\0';
+            c = end + 1;
+            if (len == 0) continue;
+            s = rmp_glob_step(&p->match, s, name);
+            if (rmp_glob_accepts(&p->match, s)) return 0;   // opendir() rewrote it
+        }
+        if (s) {
+            states[i] = s;
+            n++;
+        }
+    }
+    return n;
+}
+
+// The first pattern that redirects name, or -1
+static int redirecting(const uint32_t *states, const char *name) {
+    for (int i = 0; i < g_num_patterns; i++)
+        if (states[i] && rmp_glob_accepts(&g_patterns[i].match,
+                                          rmp_glob_step(&g_patterns[i].match, states[i], name)))
+            return i;
+    return -1;
+}
+
+typedef struct {
+    dirlist_ent_t *ents;
+    size_t count, cap;
+    char *names;
+    size_t len, ncap;
+} builder_t;
+
+// Entries keep their name's offset in b->names until it stops moving
+static int add(builder_t *b, const struct dirent *de) {
+    size_t len = strlen(de->d_name) + 1;
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 64;
+        dirlist_ent_t *ents = realloc(b->ents, cap * sizeof(*ents));
+        if (!ents) return -1;
+        b->ents = ents;
+        b->cap = cap;
+    }
+    if (b->len + len > b->ncap) {
+        size_t ncap = b->ncap ? b->ncap * 2 : 1024;
+        while (ncap < b->len + len) ncap *= 2;
+        char *names = realloc(b->names, ncap);
+        if (!names) return -1;
+        b->names = names;
+        b->ncap = ncap;
+    }
+    memcpy(b->names + b->len, de->d_name, len);
+    dirlist_ent_t *e = &b->ents[b->count++];
+    e->name = (const char *)(uintptr_t)b->len;
+    e->ino = de->d_ino;
+    e->type = de->d_type;
+    b->len += len;
+    return 0;
+}
+
+// Read one directory into b: with owner < 0 the entries no pattern
+// redirects, else those whose first redirecting pattern's target
+// directory is owner's.  Stamped before it is read, so a change while
+// reading shows as one afterwards.
+static int read_dir(builder_t *b, dir_stamp_t *s, const uint32_t *states,
+                    const int *tdir, int owner) {
+    DIR *d = opendir(s->path);
+    stamp(s, d ? dirfd(d) : -1, s->path);
+    if (!d) return owner < 0 ? -1 : 0;   // no target dir: nothing redirected exists
+    struct dirent *de;
+    int r = 0;
+    while (r == 0 && (de = readdir(d))) {
+        int i = redirecting(states, de->d_name);
+        if (owner < 0 ? i < 0 : i >= 0 && tdir[i] == owner) r = add(b, de);
+    }
+    closedir(d);
+    return r;
+}
+
+static void free_listing(listing_t *l) {
+    for (int i = 0; i < l->num_stamps; i++) free(l->stamps[i].path);
+    free(l->stamps);
+    free(l->list.ents);
+    free(l->names);
+    free(l->dir);
+    free(l);
+}
+
+// dir: the cache's key for it; dirs: the same with a trailing '/'
+static listing_t *merge(const char *dir, const char *dirs, const uint32_t *states) {
+    listing_t *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    atomic_init(&l->refs, 1);
+    l->dir = strdup(dir);
+    l->stamps = calloc(g_num_patterns + 1, sizeof(*l->stamps));
+    if (!l->dir || !l->stamps) {
+        free_listing(l);
+        return NULL;
+    }
+
+    // Each pattern's target directory for dir, the same one once
+    int tdir[MAX_PATTERNS];
+    l->stamps[l->num_stamps++].path = strdup(dir);
+    for (int i = 0; i < g_num_patterns; i++) {
+        tdir[i] = -1;
+        if (!states[i]) continue;
+        const pattern_t *p = &g_patterns[i];
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s%s", p->target ? p->target : g_target,
+                     dirs + p->parent_len);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+        for (int j = 1; j < l->num_stamps && tdir[i] < 0; j++)
+            if (strcmp(l->stamps[j].path, path) == 0) tdir[i] = j;
+        if (tdir[i] < 0) {
+            tdir[i] = l->num_stamps;
+            l->stamps[l->num_stamps++].path = strdup(path);
+        }
+    }
+
+    builder_t b = { 0 };
+    time_t start = time(NULL);
+    int r = 0;
+    for (int j = 0; r == 0 && j < l->num_stamps; j++)
+        r = l->stamps[j].path ? read_dir(&b, &l->stamps[j], states, tdir, j ? j : -1) : -1;
+    if (r < 0) {
+        l->list.ents = b.ents;
+        l->names = b.names;
+        free_listing(l);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < b.count; i++)
+        b.ents[i].name = b.names + (uintptr_t)b.ents[i].name;
+    l->list.ents = b.ents;
+    l->list.count = (int)b.count;
+    l->names = b.names;
+    l->cacheable = 1;
+    for (int j = 0; j < l->num_stamps; j++)
+        if (l->stamps[j].exists && l->stamps[j].mtime_sec >= (long long)start) l->cacheable = 0;
+    return l;
+}
+
+/*** Listings *************************************/
+
+// dir as the cache knows it, absolute and without trailing '/'s, into
+// key, with one into dirs, and the patterns' states for its entries.
+// 0 if no mapping adds to or hides from it.
+static int listed(const char *dir, char *key, char *dirs, uint32_t *states) {
+    size_t len = strlen(dir);
+    if (g_num_patterns == 0 || dir[0] != '/' || len >= PATH_MAX - 1) return 0;
+    while (len > 1 && dir[len - 1] == '/') len--;
+    memcpy(key, dir, len);
+    key[len] = '\0';
+    memcpy(dirs, dir, len);
+    if (len > 1) dirs[len++] = '/';
+    dirs[len] = '\0';
+    return touching(dirs, states);
+}
+
+dirlist_t *dirlist_merge(const char *dir) {
+    char key[PATH_MAX], dirs[PATH_MAX];
+    uint32_t states[MAX_PATTERNS];
+    if (!listed(dir, key, dirs, states)) return NULL;
+    listing_t *l = merge(key, dirs, states);
+    return l ? &l->list : NULL;
+}
+
+dirlist_t *dirlist_open(const char *dir, int fd) {
+    char key[PATH_MAX], dirs[PATH_MAX];
+    uint32_t states[MAX_PATTERNS];
+    if (!listed(dir, key, dirs, states)) return NULL;
+
+    listing_t *l = NULL;
+    pthread_mutex_lock(&g_cache_lock);
+    for (int i = 0; i < DIRLIST_CACHE && !l; i++)
+        if (g_cache[i] && strcmp(g_cache[i]->dir, key) == 0) {
+            l = g_cache[i];
+            atomic_fetch_add(&l->refs, 1);
+        }
+    pthread_mutex_unlock(&g_cache_lock);
+
+    if (l) {
+        int current = 1;
+        for (int j = 0; current && j < l->num_stamps; j++)
+            current = unchanged(&l->stamps[j], j == 0 ? fd : -1);
+        if (current) return &l->list;
+        dirlist_release(&l->list);
+    }
+
+    if (!(l = merge(key, dirs, states))) return NULL;
+    if (l->cacheable) {
+        listing_t *old = NULL;
+        pthread_mutex_lock(&g_cache_lock);
+        int slot = -1;
+        for (int i = 0; i < DIRLIST_CACHE && slot < 0; i++)
+            if (g_cache[i] && strcmp(g_cache[i]->dir, key) == 0) slot = i;
+        if (slot < 0) slot = g_cache_next++ % DIRLIST_CACHE;
+        old = g_cache[slot];
+        atomic_fetch_add(&l->refs, 1);
+        g_cache[slot] = l;
+        pthread_mutex_unlock(&g_cache_lock);
+        if (old) dirlist_release(&old->list);
+    }
+    return &l->list;
+}
+
+void dirlist_release(dirlist_t *list) {
+    listing_t *l = (listing_t *)list;
+    if (l && atomic_fetch_sub(&l->refs, 1) == 1) free_listing(l);
+}
@@ -9,7 +9,9 @@
  */
 
 #include <spawn.h>
+#include <pthread.h>
 #include "interpose.h"
+#include "rmp_presign.h"
 
 /*** Auto-resign hardened binaries ****************/
 //
@@ -20,6 +22,9 @@
 //   3. If uncached: read Mach-O header to detect hardened runtime
 //   4. If hardened: copy to cache, ad-hoc re-sign with entitlement
 //   5. Spawn the cached copy instead
+//   6. Queue the other executables in the same .app bundle for
+//      background re-signing (rmp_presign.c), so its helpers are
+//      already cached by the time the app spawns them
 
 // Shared context for cache operations
 static rmp_ctx_t g_ctx;
@@ -43,32 +48,109 @@ typedef struct {
 
 static mcache_entry_t g_mcache[MCACHE_SIZE];
 static int g_mcache_count = 0;
+// Shared with the pre-sign threads, which store their verdicts here too
+static pthread_mutex_t g_mcache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Check in-memory cache. Returns: -1=miss, 0=hardened, 1=not hardened
 static int mcache_lookup(const char *path, time_t mtime, off_t size) {
+    int ret = -1;
+    pthread_mutex_lock(&g_mcache_lock);
     for (int i = 0; i < g_mcache_count; i++) {
         if (strcmp(g_mcache[i].path, path) == 0) {
             if (g_mcache[i].mtime == mtime && g_mcache[i].size == size)
-                return g_mcache[i].hardened ? 0 : 1;
-            return -1;  // stale
+                ret = g_mcache[i].hardened ? 0 : 1;
+            break;  // else stale
         }
     }
-    return -1;
+    pthread_mutex_unlock(&g_mcache_lock);
+    return ret;
 }
 
 static void mcache_store(const char *path, time_t mtime, off_t size, int hardened) {
+    pthread_mutex_lock(&g_mcache_lock);
     int slot = -1;
     for (int i = 0; i < g_mcache_count; i++) {
         if (strcmp(g_mcache[i].path, path) == 0) { slot = i; break; }
     }
     if (slot < 0) {
-        if (g_mcache_count >= MCACHE_SIZE) return;
+        if (g_mcache_count >= MCACHE_SIZE) goto out;
         slot = g_mcache_count++;
     }
     strncpy(g_mcache[slot].path, path, PATH_MAX - 1);
     g_mcache[slot].mtime = mtime;
     g_mcache[slot].size = size;
     g_mcache[slot].hardened = hardened;
+out:
+    pthread_mutex_unlock(&g_mcache_lock);
+}
+
+static void mcache_forget(const char *path) {
+    pthread_mutex_lock(&g_mcache_lock);
+    for (int i = 0; i < g_mcache_count; i++) {
+        if (strcmp(g_mcache[i].path, path) == 0) {
+            g_mcache[i] = g_mcache[--g_mcache_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_mcache_lock);
+}
+
+/*** Background pre-signing of bundle siblings ****/
+//
+// Started lazily, the first time this process re-signs a binary.
+// RMP_PRESIGN=0 disables it; RMP_PRESIGN_JOBS bounds its threads.
+
+static rmp_presign_t  *g_presign = NULL;
+static pthread_once_t  g_presign_once = PTHREAD_ONCE_INIT;
+
+// Runs on a pre-sign thread: the same steps as resolve_spawn_path, minus
+// the spawn.  Verdicts go into the in-memory cache either way, so a
+// later spawn of a non-hardened sibling skips its codesign probe too.
+static void presign_one(void *arg, const char *path) {
+    (void)arg;
+    struct stat sb;
+    if (stat(path, &sb) != 0 || !S_ISREG(sb.st_mode)) return;
+    if (mcache_lookup(path, sb.st_mtime, sb.st_size) == 1) return;
+
+    char cached[PATH_MAX];
+    if (rmp_cache_lookup(&g_ctx, path, sb.st_mtime, sb.st_size, cached, sizeof(cached))) {
+        mcache_store(path, sb.st_mtime, sb.st_size, 1);
+        return;
+    }
+
+    int hardened = rmp_is_hardened(&g_ctx, path);
+    mcache_store(path, sb.st_mtime, sb.st_size, hardened);
+    if (hardened && rmp_cache_create(&g_ctx, path, cached,
+                                     sb.st_mtime, sb.st_size) == 0)
+        RMP_DEBUG("presigned: %s", path);
+}
+
+// fork() copies locks but not the threads holding them: quiesce the
+// in-memory cache across fork, and let the child start without a
+// scheduler (its threads did not survive).
+static void presign_atfork_prepare(void) { pthread_mutex_lock(&g_mcache_lock); }
+static void presign_atfork_parent(void)  { pthread_mutex_unlock(&g_mcache_lock); }
+static void presign_atfork_child(void) {
+    pthread_mutex_unlock(&g_mcache_lock);
+    g_presign = NULL;
+}
+
+static void presign_init(void) {
+    const char *env = getenv("RMP_PRESIGN");
+    if (env && strcmp(env, "0") == 0) return;
+
+    const char *jobs = getenv("RMP_PRESIGN_JOBS");
+    g_presign = rmp_presign_create(jobs ? atoi(jobs) : 0, presign_one, NULL);
+    if (g_presign)
+        pthread_atfork(presign_atfork_prepare, presign_atfork_parent,
+                       presign_atfork_child);
+}
+
+static void presign_siblings(const char *path) {
+    pthread_once(&g_presign_once, presign_init);
+    if (!g_presign) return;
+    int n = rmp_presign_bundle(g_presign, path);
+    if (n > 0) RMP_DEBUG("presign: queued %d sibling(s) of %s", n, path);
 }
 
 // Resolve a binary path for spawning. If it's hardened, return the
@@ -92,18 +174,24 @@ static const char *resolve_spawn_path(const char *path) {
     int mc = mcache_lookup(path, sb.st_mtime, sb.st_size);
     if (mc == 1) goto done;  // known not-hardened
 
+    // If a pre-sign thread is already working on this binary, wait for
+    // its result rather than running codesign a second time.
+    if (g_presign && rmp_presign_wait(g_presign, path)) {
+        mc = mcache_lookup(path, sb.st_mtime, sb.st_size);
+        if (mc == 1) goto done;
+    }
+
+    // Check the on-disk tiers (cached = the per-user entry on a miss)
     char cached[PATH_MAX];
-    rmp_cache_path(g_ctx.cache_dir, path, cached, sizeof(cached));
+    int valid = rmp_cache_lookup(&g_ctx, path, sb.st_mtime, sb.st_size,
+                                 cached, sizeof(cached));
 
-    if (mc == 0) {
-        if (rmp_cache_valid(cached, sb.st_mtime, sb.st_size)) {
-            result = strdup(cached);
-            goto done;
-        }
+    if (mc == 0 && valid) {
+        result = strdup(cached);
+        goto done;
     }
 
-    // Check on-disk cache
-    if (rmp_cache_valid(cached, sb.st_mtime, sb.st_size)) {
+    if (valid) {
         mcache_store(path, sb.st_mtime, sb.st_size, 1);
         RMP_DEBUG("cache hit: %s", cached);
         result = strdup(cached);
@@ -122,14 +210,36 @@ static const char *resolve_spawn_path(const char *path) {
     // Hardened — create cached copy
     RMP_DEBUG("hardened, creating cache: %s", path);
 
-    if (rmp_cache_create(&g_ctx, path, cached, sb.st_mtime, sb.st_size) == 0)
+    if (rmp_cache_create(&g_ctx, path, cached, sb.st_mtime, sb.st_size) == 0) {
         result = strdup(cached);
+        presign_siblings(path);
+    }
 
 done:
     g_resolving = 0;
     return result;
 }
 
+// The copy resolve_spawn_path() handed out was removed before the exec
+// (`remapper --cache-gc`): forget this process's verdict on path and
+// resolve it again, re-signing a fresh copy.  NULL if that fails.  The
+// original is only handed back if it is no longer hardened; run as it
+// is, a hardened one would drop DYLD_INSERT_LIBRARIES and every mapping
+// with it.
+static const char *respawn_path(const char *path) {
+    mcache_forget(path);
+    const char *actual = resolve_spawn_path(path);
+    if (actual != path) return actual;
+
+    struct stat sb;
+    if (stat(path, &sb) == 0 && mcache_lookup(path, sb.st_mtime, sb.st_size) == 1)
+        return path;
+    fprintf(stderr, "remapper: %s: cached copy gone and re-signing failed; "
+            "not running it unremapped\n", path);
+    errno = ENOENT;
+    return NULL;
+}
+
 /*** Shebang interpreter resolution ****************/
 //
 // When exec/spawn targets a script whose #! interpreter is either
@@ -216,9 +326,8 @@ static const char *resolve_shebang_interp(const char *path, char **shebang_arg)
     }
 
     char cached[PATH_MAX];
-    rmp_cache_path(g_ctx.cache_dir, interp_path, cached, sizeof(cached));
-
-    if (!rmp_cache_valid(cached, sb.st_mtime, sb.st_size)) {
+    if (!rmp_cache_lookup(&g_ctx, interp_path, sb.st_mtime, sb.st_size,
+                          cached, sizeof(cached))) {
         if (rmp_cache_create(&g_ctx, interp_path, cached,
                              sb.st_mtime, sb.st_size) != 0) {
             free(*shebang_arg);
@@ -265,6 +374,11 @@ static int my_posix_spawn(pid_t *pid, const char *path,
         RMP_DEBUG("posix_spawn: %s → %s (hardened)", path, actual);
         int ret = posix_spawn(pid, actual, fa, sa, argv, envp);
         free((void *)actual);
+        // Cached copy removed under us by `remapper --cache-gc`
+        if (ret == ENOENT && (actual = respawn_path(path))) {
+            ret = posix_spawn(pid, actual, fa, sa, argv, envp);
+            if (actual != path) free((void *)actual);
+        }
         return ret;
     }
     // Check for shebang needing re-signing (SIP or hardened interpreter)
@@ -295,6 +409,10 @@ static int my_posix_spawnp(pid_t *pid, const char *file,
             RMP_DEBUG("posix_spawnp: %s → %s (hardened)", file, actual);
             int ret = posix_spawn(pid, actual, fa, sa, argv, envp);
             free((void *)actual);
+            if (ret == ENOENT && (actual = respawn_path(resolved_path))) {
+                ret = posix_spawn(pid, actual, fa, sa, argv, envp);
+                if (actual != resolved_path) free((void *)actual);
+            }
             return ret;
         }
         // Check for shebang needing re-signing
@@ -318,10 +436,19 @@ static int my_posix_spawnp(pid_t *pid, const char *file,
 DYLD_INTERPOSE(my_posix_spawnp, posix_spawnp)
 
 static int my_execve(const char *path, char *const argv[], char *const envp[]) {
+    flush_before_exec();
     const char *actual = resolve_spawn_path(path);
     if (actual != path) {
         RMP_DEBUG("execve: %s → %s (hardened)", path, actual);
-        return execve(actual, argv, envp);
+        execve(actual, argv, envp);
+        free((void *)actual);
+        // Cached copy removed under us by `remapper --cache-gc`
+        if (errno != ENOENT || !(actual = respawn_path(path))) return -1;
+        execve(actual, argv, envp);
+        int saved = errno;
+        if (actual != path) free((void *)actual);
+        errno = saved;
+        return -1;
     }
     // Check for shebang needing re-signing
     char *shebang_arg = NULL;
@@ -338,10 +465,18 @@ static int my_execve(const char *path, char *const argv[], char *const envp[]) {
 DYLD_INTERPOSE(my_execve, execve)
 
 static int my_execv(const char *path, char *const argv[]) {
+    flush_before_exec();
     const char *actual = resolve_spawn_path(path);
     if (actual != path) {
         RMP_DEBUG("execv: %s → %s (hardened)", path, actual);
-        return execv(actual, argv);
+        execv(actual, argv);
+        free((void *)actual);
+        if (errno != ENOENT || !(actual = respawn_path(path))) return -1;
+        execv(actual, argv);
+        int saved = errno;
+        if (actual != path) free((void *)actual);
+        errno = saved;
+        return -1;
     }
     // Check for shebang needing re-signing
     char *shebang_arg = NULL;
@@ -358,12 +493,20 @@ static int my_execv(const char *path, char *const argv[]) {
 DYLD_INTERPOSE(my_execv, execv)
 
 static int my_execvp(const char *file, char *const argv[]) {
+    flush_before_exec();
     char resolved_path[PATH_MAX];
     if (resolve_in_path(file, resolved_path, sizeof(resolved_path))) {
         const char *actual = resolve_spawn_path(resolved_path);
         if (actual != resolved_path) {
             RMP_DEBUG("execvp: %s → %s (hardened)", file, actual);
-            return execv(actual, argv);
+            execv(actual, argv);
+            free((void *)actual);
+            if (errno != ENOENT || !(actual = respawn_path(resolved_path))) return -1;
+            execv(actual, argv);
+            int saved = errno;
+            if (actual != resolved_path) free((void *)actual);
+            errno = saved;
+            return -1;
         }
         // Check for shebang needing re-signing
         char *shebang_arg = NULL;
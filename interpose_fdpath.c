@@ -0,0 +1,133 @@
+/*
+ * interpose_fdpath.c - The path each open file descriptor was opened by
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The *at() calls name a file by a directory fd and a path relative to
+ * it, which the matcher can't judge on its own.  The open hooks record
+ * the absolute path (as the program named it, before any rewrite) that
+ * each fd was opened by, dup() copies it and close() drops it, so a
+ * relative *at() call is joined onto its directory's path with one
+ * table lookup instead of a fcntl(F_GETPATH) per call.
+ *
+ * Only paths a mapping could be under or above are kept: a directory
+ * whose every descendant misses every pattern never needs joining, and
+ * most opens are of those.  Fds the hooks never saw (inherited across
+ * exec, or from socket(), pipe(), ...) aren't in the table, and their
+ * relative calls pass through as before.
+ *
+ * The table is a sparse array indexed by fd: pages of FDPATH_PAGE
+ * slots, allocated on first use and never freed, each holding a
+ * malloc'd path or NULL.  Each page has a mutex that a reader holds
+ * while it copies a path out and a writer while it swaps one, so a path
+ * is never freed under a reader.  strdup() and free() stay outside it,
+ * and a page's fds rarely open and close on several threads at once.
+ *
+ * Nothing here is macOS-only: test/bench_fdpath.c builds this file
+ * anywhere to compare it with asking the kernel per call.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "interpose.h"
+
+#define FDPATH_PAGE_BITS 8
+#define FDPATH_PAGE      (1 << FDPATH_PAGE_BITS)
+#define FDPATH_PAGES     4096     // fds up to 1M are tracked
+
+typedef struct {
+    pthread_mutex_t lock;
+    char *paths[FDPATH_PAGE];
+} fdpath_page_t;
+
+static _Atomic(fdpath_page_t *) g_fd_pages[FDPATH_PAGES];
+
+static fdpath_page_t *fd_page(int fd, int create) {
+    if (fd < 0 || (fd >> FDPATH_PAGE_BITS) >= FDPATH_PAGES) return NULL;
+    _Atomic(fdpath_page_t *) *dir = &g_fd_pages[fd >> FDPATH_PAGE_BITS];
+    fdpath_page_t *page = atomic_load_explicit(dir, memory_order_acquire);
+    if (!page && create) {
+        fdpath_page_t *fresh = calloc(1, sizeof(*fresh));
+        if (!fresh) return NULL;
+        pthread_mutex_init(&fresh->lock, NULL);
+        if (atomic_compare_exchange_strong(dir, &page, fresh)) {
+            page = fresh;
+        } else {
+            pthread_mutex_destroy(&fresh->lock);
+            free(fresh);    // another thread's page won; page holds it
+        }
+    }
+    return page;
+}
+
+// Put path (or NULL) in fd's slot; the old one is freed outside the lock
+static void fd_swap(fdpath_page_t *page, int fd, char *path) {
+    pthread_mutex_lock(&page->lock);
+    char *old = page->paths[fd & (FDPATH_PAGE - 1)];
+    page->paths[fd & (FDPATH_PAGE - 1)] = path;
+    pthread_mutex_unlock(&page->lock);
+    free(old);
+}
+
+// Could a mapping match path, or something under it?  path is a prefix
+// of a pattern's parent, or the parent is a prefix of path.
+static int could_contain(const char *path) {
+    size_t len = strlen(path);
+    for (int i = 0; i < g_num_patterns; i++) {
+        size_t n = len < g_patterns[i].parent_len ? len : g_patterns[i].parent_len;
+        if (strncmp(path, g_patterns[i].parent, n) == 0) return 1;
+    }
+    return 0;
+}
+
+void fdpath_clear(int fd) {
+    fdpath_page_t *page = fd_page(fd, 0);
+    if (page) fd_swap(page, fd, NULL);
+}
+
+void fdpath_set(int fd, const char *path) {
+    if (!path || path[0] != '/' || !could_contain(path)) {
+        fdpath_clear(fd);
+        return;
+    }
+    fdpath_page_t *page = fd_page(fd, 1);
+    if (page) fd_swap(page, fd, strdup(path));
+}
+
+int fdpath_get(int fd, char *out, size_t outsize) {
+    fdpath_page_t *page = fd_page(fd, 0);
+    if (!page) return 0;
+    int found = 0;
+    pthread_mutex_lock(&page->lock);
+    const char *p = page->paths[fd & (FDPATH_PAGE - 1)];
+    size_t len = p ? strnlen(p, outsize) : outsize;
+    if (len < outsize) {
+        memcpy(out, p, len + 1);
+        found = 1;
+    }
+    pthread_mutex_unlock(&page->lock);
+    return found;
+}
+
+void fdpath_dup(int oldfd, int newfd) {
+    char path[PATH_MAX];
+    if (fdpath_get(oldfd, path, sizeof(path)))
+        fdpath_set(newfd, path);
+    else
+        fdpath_clear(newfd);
+}
+
+int fdpath_join(int dirfd, const char *path, char *out, size_t outsize) {
+    if (!path[0] || path[0] == '/' || !fdpath_get(dirfd, out, outsize)) return 0;
+    size_t len = strlen(out);
+    int sep = out[len - 1] != '/';
+    size_t plen = strlen(path);
+    if (len + sep + plen >= outsize) return 0;
+    if (sep) out[len++] = '/';
+    memcpy(out + len, path, plen + 1);
+    return 1;
+}
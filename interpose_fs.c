@@ -8,38 +8,119 @@
  * (at your option) any later version.
  */
 
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "interpose.h"
 
+/*** Union listings *******************************/
+
+// An open DIR of a directory a mapping's entries sit in, read from its
+// merged listing (interpose_dirlist.c) instead of the real one.  Few are
+// open at once, and readdir() of any other DIR checks only the count.
+typedef struct union_dir {
+    DIR *d;
+    char path[PATH_MAX];
+    dirlist_t *list;
+    long pos;
+    struct dirent ent;
+    struct union_dir *next;
+} union_dir_t;
+
+static union_dir_t *g_union_dirs = NULL;
+static _Atomic int g_num_union_dirs = 0;
+static pthread_mutex_t g_union_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void union_attach(DIR *d, const char *path) {
+    dirlist_t *list = dirlist_open(path, dirfd(d));
+    if (!list) return;
+    union_dir_t *u = calloc(1, sizeof(*u));
+    if (!u) {
+        dirlist_release(list);
+        return;
+    }
+    u->d = d;
+    snprintf(u->path, sizeof(u->path), "%s", path);
+    u->list = list;
+    RMP_DEBUG("opendir('%s'): merged listing, %d entries", path, list->count);
+    pthread_mutex_lock(&g_union_lock);
+    u->next = g_union_dirs;
+    g_union_dirs = u;
+    atomic_fetch_add(&g_num_union_dirs, 1);
+    pthread_mutex_unlock(&g_union_lock);
+}
+
+static union_dir_t *union_find(DIR *d) {
+    if (atomic_load_explicit(&g_num_union_dirs, memory_order_relaxed) == 0) return NULL;
+    pthread_mutex_lock(&g_union_lock);
+    union_dir_t *u = g_union_dirs;
+    while (u && u->d != d) u = u->next;
+    pthread_mutex_unlock(&g_union_lock);
+    return u;
+}
+
+static void union_detach(DIR *d) {
+    if (atomic_load_explicit(&g_num_union_dirs, memory_order_relaxed) == 0) return;
+    pthread_mutex_lock(&g_union_lock);
+    union_dir_t **up = &g_union_dirs, *u;
+    while ((u = *up) && u->d != d) up = &u->next;
+    if (u) {
+        *up = u->next;
+        atomic_fetch_sub(&g_num_union_dirs, 1);
+    }
+    pthread_mutex_unlock(&g_union_lock);
+    if (u) {
+        dirlist_release(u->list);
+        free(u);
+    }
+}
+
 /*** Interposed filesystem functions **************/
 
 static int my_open(const char *path, int flags, ...) {
     REWRITE_1_F(actual, path, "open");
+    mode_t mode = 0;
     if (flags & O_CREAT) {
         va_list ap; va_start(ap, flags);
-        mode_t mode = (mode_t)va_arg(ap, int);
+        mode = (mode_t)va_arg(ap, int);
         va_end(ap);
-        return open(actual, flags, mode);
     }
-    return open(actual, flags);
+    int ret = open(actual, flags, mode);
+    if (ret >= 0) {
+        fdpath_set(ret, path);
+        if (actual != path) heat_open(path, flags);
+    }
+    return ret;
 }
 DYLD_INTERPOSE(my_open, open)
 
 static int my_openat(int fd, const char *path, int flags, ...) {
-    REWRITE_ABS_F(actual, path, "openat");
+    REWRITE_AT_F(actual, fd, path, "openat");
+    mode_t mode = 0;
     if (flags & O_CREAT) {
         va_list ap; va_start(ap, flags);
-        mode_t mode = (mode_t)va_arg(ap, int);
+        mode = (mode_t)va_arg(ap, int);
         va_end(ap);
-        return openat(fd, actual, flags, mode);
     }
-    return openat(fd, actual, flags);
+    int ret = openat(fd, actual, flags, mode);
+    if (ret >= 0) {
+        fdpath_set(ret, actual_path);
+        if (actual != path) heat_open(actual_path, flags);
+    }
+    return ret;
 }
 DYLD_INTERPOSE(my_openat, openat)
 
 //creat
 static int my_creat(const char *path, mode_t mode) {
     REWRITE_1_F(actual, path, "creat");
-    return open(actual, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    int ret = open(actual, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    if (ret >= 0) {
+        fdpath_set(ret, path);
+        if (actual != path) heat_open(path, O_CREAT | O_WRONLY | O_TRUNC);
+    }
+    return ret;
 }
 DYLD_INTERPOSE(my_creat, creat)
 
@@ -57,7 +138,7 @@ static int my_lstat(const char *path, struct stat *sb) {
 DYLD_INTERPOSE(my_lstat, lstat)
 
 static int my_fstatat(int fd, const char *path, struct stat *sb, int flag) {
-    REWRITE_ABS_F(actual, path, "fstatat");
+    REWRITE_AT_F(actual, fd, path, "fstatat");
     return fstatat(fd, actual, sb, flag);
 }
 DYLD_INTERPOSE(my_fstatat, fstatat)
@@ -70,7 +151,7 @@ static int my_access(const char *path, int mode) {
 DYLD_INTERPOSE(my_access, access)
 
 static int my_faccessat(int fd, const char *path, int mode, int flag) {
-    REWRITE_ABS_F(actual, path, "faccessat");
+    REWRITE_AT_F(actual, fd, path, "faccessat");
     return faccessat(fd, actual, mode, flag);
 }
 DYLD_INTERPOSE(my_faccessat, faccessat)
@@ -83,7 +164,7 @@ static int my_mkdir(const char *path, mode_t mode) {
 DYLD_INTERPOSE(my_mkdir, mkdir)
 
 static int my_mkdirat(int fd, const char *path, mode_t mode) {
-    REWRITE_ABS_F(actual, path, "mkdirat");
+    REWRITE_AT_F(actual, fd, path, "mkdirat");
     return mkdirat(fd, actual, mode);
 }
 DYLD_INTERPOSE(my_mkdirat, mkdirat)
@@ -96,7 +177,7 @@ static int my_unlink(const char *path) {
 DYLD_INTERPOSE(my_unlink, unlink)
 
 static int my_unlinkat(int fd, const char *path, int flag) {
-    REWRITE_ABS_F(actual, path, "unlinkat");
+    REWRITE_AT_F(actual, fd, path, "unlinkat");
     return unlinkat(fd, actual, flag);
 }
 DYLD_INTERPOSE(my_unlinkat, unlinkat)
@@ -110,8 +191,8 @@ static int my_rename(const char *oldp, const char *newp) {
 DYLD_INTERPOSE(my_rename, rename)
 
 static int my_renameat(int ofd, const char *oldp, int nfd, const char *newp) {
-    REWRITE_ABS_F(aold, oldp, "renameat");
-    REWRITE_ABS_F(anew, newp, "renameat");
+    REWRITE_AT_F(aold, ofd, oldp, "renameat");
+    REWRITE_AT_F(anew, nfd, newp, "renameat");
     return renameat(ofd, aold, nfd, anew);
 }
 DYLD_INTERPOSE(my_renameat, renameat)
@@ -123,13 +204,219 @@ static int my_rmdir(const char *path) {
 }
 DYLD_INTERPOSE(my_rmdir, rmdir)
 
-//opendir
+//opendir / closedir
 static DIR *my_opendir(const char *path) {
     REWRITE_1_F(actual, path, "opendir");
-    return opendir(actual);
+    DIR *d = opendir(actual);
+    if (d) {
+        fdpath_set(dirfd(d), path);
+        if (actual == path) union_attach(d, path);
+    }
+    return d;
 }
 DYLD_INTERPOSE(my_opendir, opendir)
 
+static DIR *my_fdopendir(int fd) {
+    DIR *d = fdopendir(fd);
+    char path[PATH_MAX];
+    if (d && fdpath_get(fd, path, sizeof(path))) union_attach(d, path);
+    return d;
+}
+DYLD_INTERPOSE(my_fdopendir, fdopendir)
+
+static int my_closedir(DIR *d) {
+    if (d) {
+        union_detach(d);
+        fdpath_clear(dirfd(d));
+    }
+    return closedir(d);
+}
+DYLD_INTERPOSE(my_closedir, closedir)
+
+//readdir / rewinddir / telldir / seekdir: a merged listing's position
+//is its index
+static struct dirent *my_readdir(DIR *d) {
+    union_dir_t *u = union_find(d);
+    if (!u) return readdir(d);
+    if (u->pos < 0 || u->pos >= u->list->count) return NULL;
+    const dirlist_ent_t *e = &u->list->ents[u->pos++];
+    size_t len = strlen(e->name);
+    if (len >= sizeof(u->ent.d_name)) len = sizeof(u->ent.d_name) - 1;
+    u->ent.d_ino = e->ino;
+    u->ent.d_type = e->type;
+    u->ent.d_reclen = (unsigned short)(offsetof(struct dirent, d_name) + len + 1);
+#ifdef __APPLE__
+    u->ent.d_seekoff = (uint64_t)u->pos;
+    u->ent.d_namlen = (uint16_t)len;
+#endif
+    memcpy(u->ent.d_name, e->name, len);
+    u->ent.d_name[len] = '\0';
+    return &u->ent;
+}
+DYLD_INTERPOSE(my_readdir, readdir)
+
+// Rewinding reads the directory again: from the cache, if unchanged
+static void my_rewinddir(DIR *d) {
+    union_dir_t *u = union_find(d);
+    if (!u) {
+        rewinddir(d);
+        return;
+    }
+    dirlist_t *list = dirlist_open(u->path, dirfd(d));
+    if (list) {
+        dirlist_release(u->list);
+        u->list = list;
+    }
+    u->pos = 0;
+}
+DYLD_INTERPOSE(my_rewinddir, rewinddir)
+
+static long my_telldir(DIR *d) {
+    union_dir_t *u = union_find(d);
+    return u ? u->pos : telldir(d);
+}
+DYLD_INTERPOSE(my_telldir, telldir)
+
+static void my_seekdir(DIR *d, long loc) {
+    union_dir_t *u = union_find(d);
+    if (u)
+        u->pos = loc;
+    else
+        seekdir(d, loc);
+}
+DYLD_INTERPOSE(my_seekdir, seekdir)
+
+//close / dup / dup2 / fcntl(F_DUPFD): keep the fd paths in step.  An
+//fd's path goes before the close, since another thread may be handed
+//the same fd the moment it is closed.
+static int my_close(int fd) {
+    fdpath_clear(fd);
+    return close(fd);
+}
+DYLD_INTERPOSE(my_close, close)
+
+static int my_dup(int fd) {
+    int ret = dup(fd);
+    if (ret >= 0) fdpath_dup(fd, ret);
+    return ret;
+}
+DYLD_INTERPOSE(my_dup, dup)
+
+static int my_dup2(int fd, int fd2) {
+    int ret = dup2(fd, fd2);
+    if (ret >= 0 && fd != fd2) fdpath_dup(fd, ret);
+    return ret;
+}
+DYLD_INTERPOSE(my_dup2, dup2)
+
+// Whether cmd's third argument is a pointer, decided as libc's own
+// fcntl decides it: the lock and pointer commands; every other cmd
+// passes an int
+static int fcntl_takes_pointer(int cmd) {
+    switch (cmd) {
+    case F_GETLK: case F_SETLK: case F_SETLKW:
+#ifdef F_SETLKWTIMEOUT
+    case F_SETLKWTIMEOUT:
+#endif
+#ifdef F_OFD_GETLK
+    case F_OFD_GETLK:
+#endif
+#ifdef F_OFD_SETLK
+    case F_OFD_SETLK:
+#endif
+#ifdef F_OFD_SETLKW
+    case F_OFD_SETLKW:
+#endif
+#ifdef F_OFD_SETLKWTIMEOUT
+    case F_OFD_SETLKWTIMEOUT:
+#endif
+#ifdef F_GETLKPID
+    case F_GETLKPID:
+#endif
+#ifdef F_PREALLOCATE
+    case F_PREALLOCATE:
+#endif
+#ifdef F_PUNCHHOLE
+    case F_PUNCHHOLE:
+#endif
+#ifdef F_SETSIZE
+    case F_SETSIZE:
+#endif
+#ifdef F_RDADVISE
+    case F_RDADVISE:
+#endif
+#ifdef F_LOG2PHYS
+    case F_LOG2PHYS:
+#endif
+#ifdef F_LOG2PHYS_EXT
+    case F_LOG2PHYS_EXT:
+#endif
+#ifdef F_GETPATH
+    case F_GETPATH:
+#endif
+#ifdef F_GETPATH_MTMINFO
+    case F_GETPATH_MTMINFO:
+#endif
+#ifdef F_GETPATH_NOFIRMLINK
+    case F_GETPATH_NOFIRMLINK:
+#endif
+#ifdef F_ADDSIGS
+    case F_ADDSIGS:
+#endif
+#ifdef F_ADDFILESIGS
+    case F_ADDFILESIGS:
+#endif
+#ifdef F_ADDFILESIGS_RETURN
+    case F_ADDFILESIGS_RETURN:
+#endif
+#ifdef F_ADDFILESIGS_FOR_DYLD_SIM
+    case F_ADDFILESIGS_FOR_DYLD_SIM:
+#endif
+#ifdef F_ADDFILESIGS_INFO
+    case F_ADDFILESIGS_INFO:
+#endif
+#ifdef F_ADDFILESUPPL
+    case F_ADDFILESUPPL:
+#endif
+#ifdef F_FINDSIGS
+    case F_FINDSIGS:
+#endif
+#ifdef F_GETSIGSINFO
+    case F_GETSIGSINFO:
+#endif
+#ifdef F_CHECK_LV
+    case F_CHECK_LV:
+#endif
+#ifdef F_TRIM_ACTIVE_FILE
+    case F_TRIM_ACTIVE_FILE:
+#endif
+#ifdef F_SPECULATIVE_READ
+    case F_SPECULATIVE_READ:
+#endif
+#ifdef F_TRANSCODEKEY
+    case F_TRANSCODEKEY:
+#endif
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int my_fcntl(int fd, int cmd, ...) {
+    va_list ap; va_start(ap, cmd);
+    if (fcntl_takes_pointer(cmd)) {
+        void *arg = va_arg(ap, void *);
+        va_end(ap);
+        return fcntl(fd, cmd, arg);
+    }
+    int arg = va_arg(ap, int);
+    va_end(ap);
+    int ret = fcntl(fd, cmd, arg);
+    if (ret >= 0 && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)) fdpath_dup(fd, ret);
+    return ret;
+}
+DYLD_INTERPOSE(my_fcntl, fcntl)
+
 //chdir
 static int my_chdir(const char *path) {
     REWRITE_1_F(actual, path, "chdir");
@@ -145,7 +432,7 @@ static ssize_t my_readlink(const char *path, char *buf, size_t bufsiz) {
 DYLD_INTERPOSE(my_readlink, readlink)
 
 static ssize_t my_readlinkat(int fd, const char *path, char *buf, size_t bufsiz) {
-    REWRITE_ABS_F(actual, path, "readlinkat");
+    REWRITE_AT_F(actual, fd, path, "readlinkat");
     return readlinkat(fd, actual, buf, bufsiz);
 }
 DYLD_INTERPOSE(my_readlinkat, readlinkat)
@@ -158,7 +445,7 @@ static int my_chmod(const char *path, mode_t mode) {
 DYLD_INTERPOSE(my_chmod, chmod)
 
 static int my_fchmodat(int fd, const char *path, mode_t mode, int flag) {
-    REWRITE_ABS_F(actual, path, "fchmodat");
+    REWRITE_AT_F(actual, fd, path, "fchmodat");
     return fchmodat(fd, actual, mode, flag);
 }
 DYLD_INTERPOSE(my_fchmodat, fchmodat)
@@ -177,7 +464,7 @@ static int my_lchown(const char *path, uid_t owner, gid_t group) {
 DYLD_INTERPOSE(my_lchown, lchown)
 
 static int my_fchownat(int fd, const char *path, uid_t owner, gid_t group, int flag) {
-    REWRITE_ABS_F(actual, path, "fchownat");
+    REWRITE_AT_F(actual, fd, path, "fchownat");
     return fchownat(fd, actual, owner, group, flag);
 }
 DYLD_INTERPOSE(my_fchownat, fchownat)
@@ -192,7 +479,7 @@ DYLD_INTERPOSE(my_symlink, symlink)
 
 static int my_symlinkat(const char *target, int fd, const char *linkpath) {
     REWRITE_1_F(atarget, target, "symlinkat");
-    REWRITE_ABS_F(alink, linkpath, "symlinkat");
+    REWRITE_AT_F(alink, fd, linkpath, "symlinkat");
     return symlinkat(atarget, fd, alink);
 }
 DYLD_INTERPOSE(my_symlinkat, symlinkat)
@@ -206,8 +493,8 @@ static int my_link(const char *p1, const char *p2) {
 DYLD_INTERPOSE(my_link, link)
 
 static int my_linkat(int fd1, const char *p1, int fd2, const char *p2, int flag) {
-    REWRITE_ABS_F(a1, p1, "linkat");
-    REWRITE_ABS_F(a2, p2, "linkat");
+    REWRITE_AT_F(a1, fd1, p1, "linkat");
+    REWRITE_AT_F(a2, fd2, p2, "linkat");
     return linkat(fd1, a1, fd2, a2, flag);
 }
 DYLD_INTERPOSE(my_linkat, linkat)
@@ -238,13 +525,18 @@ extern int open$NOCANCEL(const char *, int, ...) __asm("_open$NOCANCEL");
 
 static int my_open_nocancel(const char *path, int flags, ...) {
     REWRITE_1_F(actual, path, "open$NOCANCEL");
+    mode_t mode = 0;
     if (flags & O_CREAT) {
         va_list ap; va_start(ap, flags);
-        mode_t mode = (mode_t)va_arg(ap, int);
+        mode = (mode_t)va_arg(ap, int);
         va_end(ap);
-        return open$NOCANCEL(actual, flags, mode);
     }
-    return open$NOCANCEL(actual, flags);
+    int ret = open$NOCANCEL(actual, flags, mode);
+    if (ret >= 0) {
+        fdpath_set(ret, path);
+        if (actual != path) heat_open(path, flags);
+    }
+    return ret;
 }
 DYLD_INTERPOSE(my_open_nocancel, open$NOCANCEL)
 
@@ -252,21 +544,37 @@ DYLD_INTERPOSE(my_open_nocancel, open$NOCANCEL)
 extern int openat$NOCANCEL(int, const char *, int, ...) __asm("_openat$NOCANCEL");
 
 static int my_openat_nocancel(int fd, const char *path, int flags, ...) {
-    REWRITE_ABS_F(actual, path, "openat$NOCANCEL");
+    REWRITE_AT_F(actual, fd, path, "openat$NOCANCEL");
+    mode_t mode = 0;
     if (flags & O_CREAT) {
         va_list ap; va_start(ap, flags);
-        mode_t mode = (mode_t)va_arg(ap, int);
+        mode = (mode_t)va_arg(ap, int);
         va_end(ap);
-        return openat$NOCANCEL(fd, actual, flags, mode);
     }
-    return openat$NOCANCEL(fd, actual, flags);
+    int ret = openat$NOCANCEL(fd, actual, flags, mode);
+    if (ret >= 0) {
+        fdpath_set(ret, actual_path);
+        if (actual != path) heat_open(actual_path, flags);
+    }
+    return ret;
 }
 DYLD_INTERPOSE(my_openat_nocancel, openat$NOCANCEL)
 
+// close$NOCANCEL — what libuv closes with
+extern int close$NOCANCEL(int) __asm("_close$NOCANCEL");
+
+static int my_close_nocancel(int fd) {
+    fdpath_clear(fd);
+    return close$NOCANCEL(fd);
+}
+DYLD_INTERPOSE(my_close_nocancel, close$NOCANCEL)
+
 // fopen
 static FILE *my_fopen(const char *path, const char *mode) {
     REWRITE_1_F(actual, path, "fopen");
-    return fopen(actual, mode);
+    FILE *fp = fopen(actual, mode);
+    if (fp && actual != path) heat_open(path, heat_fopen_flags(mode));
+    return fp;
 }
 DYLD_INTERPOSE(my_fopen, fopen)
 
@@ -275,7 +583,9 @@ extern FILE *fopen$DARWIN_EXTSN(const char *, const char *) __asm("_fopen$DARWIN
 
 static FILE *my_fopen_darwin(const char *path, const char *mode) {
     REWRITE_1_F(actual, path, "fopen$DARWIN_EXTSN");
-    return fopen$DARWIN_EXTSN(actual, mode);
+    FILE *fp = fopen$DARWIN_EXTSN(actual, mode);
+    if (fp && actual != path) heat_open(path, heat_fopen_flags(mode));
+    return fp;
 }
 DYLD_INTERPOSE(my_fopen_darwin, fopen$DARWIN_EXTSN)
 
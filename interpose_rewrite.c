@@ -0,0 +1,113 @@
+/*
+ * interpose_rewrite.c - The interposer's patterns and path matcher
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Each mapping is split into (parent_dir, glob) where its wildcards start, so
+ * the glob may span components, with '**' for any number of them. When any
+ * intercepted filesystem call receives a path starting with parent_dir whose
+ * next components match glob, the parent_dir prefix is replaced with the
+ * pattern's own target, if it has one, or RMP_TARGET.
+ *
+ * Nothing here is macOS-only, so test/bench_rewrite.c builds this file
+ * anywhere to replay recorded traces (RMP_TRACE) through try_rewrite().
+ */
+
+#include "interpose.h"
+
+/*** Global state *********************************/
+
+pattern_t g_patterns[MAX_PATTERNS];
+int       g_num_patterns = 0;
+char      g_target[PATH_MAX];  // includes trailing '/'
+int       g_debug = 0;
+FILE     *g_debug_fp = NULL;  // stderr or file
+
+/*** Pattern loading ******************************/
+
+void load_patterns(const char *target, const char *pats) {
+    // Copy target, ensure trailing slash
+    size_t tlen = strlen(target);
+    if (tlen == 0 || tlen >= sizeof(g_target) - 1) return;
+    memcpy(g_target, target, tlen);
+    if (g_target[tlen - 1] != '/') g_target[tlen++] = '/';
+    g_target[tlen] = '\0';
+
+    // Parse colon-separated patterns
+    char buf[PATH_MAX * 16];
+    strncpy(buf, pats, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *saveptr = NULL;
+    char *tok = strtok_r(buf, ":", &saveptr);
+    while (tok && g_num_patterns < MAX_PATTERNS) {
+        // trim spaces
+        while (*tok == ' ') tok++;
+        size_t toklen = strlen(tok);
+        while (toklen > 0 && tok[toklen - 1] == ' ') tok[--toklen] = '\0';
+        if (toklen == 0) { tok = strtok_r(NULL, ":", &saveptr); continue; }
+
+        // "<pattern>=<dir>": split off the pattern's own target
+        char *own_target = (char *)rmp_mapping_target(tok, 0);
+        if (own_target) {
+            *own_target++ = '\0';
+            toklen = strlen(tok);
+        }
+
+        // split where the wildcards start → (parent_dir, glob)
+        size_t plen = rmp_glob_split(tok, toklen);  // includes '/'
+        if (plen > 1 && plen < PATH_MAX && (toklen - plen) < 256) {
+            pattern_t *pat = &g_patterns[g_num_patterns];
+            memcpy(pat->parent, tok, plen);
+            pat->parent[plen] = '\0';
+            pat->parent_len = plen;
+            strcpy(pat->glob, tok + plen);
+
+            // Logged first: compiling splits the glob up in place
+            RMP_DEBUG("pattern[%d]: parent='%s' glob='%s' target='%s'",
+                      g_num_patterns, pat->parent, pat->glob,
+                      own_target ? own_target : g_target);
+            if (rmp_glob_compile(&pat->match, pat->glob) == 0) {
+                // Copy own target, ensure trailing slash
+                pat->target = NULL;
+                size_t olen = own_target ? strlen(own_target) : 0;
+                if (olen > 0 && own_target[0] == '/' && (pat->target = malloc(olen + 2))) {
+                    memcpy(pat->target, own_target, olen);
+                    if (pat->target[olen - 1] != '/') pat->target[olen++] = '/';
+                    pat->target[olen] = '\0';
+                }
+                g_num_patterns++;
+            }
+        }
+        tok = strtok_r(NULL, ":", &saveptr);
+    }
+}
+
+/*** Path rewriting *******************************/
+
+// Try to rewrite `path`. If it matches a pattern, write the rewritten
+// path into `out` and return 1. Otherwise return 0.
+int try_rewrite(const char *path, char *out, size_t outsize) {
+    if (!path || g_num_patterns == 0) return 0;
+
+    for (int i = 0; i < g_num_patterns; i++) {
+        if (strncmp(path, g_patterns[i].parent, g_patterns[i].parent_len) != 0)
+            continue;
+
+        const char *rest = path + g_patterns[i].parent_len;
+        if (*rest == '\0') continue;  // path IS the parent dir, nothing to match
+
+        // The next components, as many as the glob takes
+        if (rmp_glob_match(&g_patterns[i].match, rest)) {
+            const char *target = g_patterns[i].target ? g_patterns[i].target : g_target;
+            int n = snprintf(out, outsize, "%s%s", target, rest);
+            if (n < 0 || (size_t)n >= outsize) continue;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -10,7 +10,10 @@
  *
  *
  * Usage:
- *   remapper [--debug-log <file>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper [--debug-log <file>] [--heatmap=<file>] [--trace=<file>]
+ *            <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --cache-gc [--max-size <size>] [--jobs <n>]
+ *   remapper --prewarm <path>... [--jobs <n>]
  *
  * If '--' is absent, exactly one mapping is expected:
  *   remapper <target-dir> <mapping> <program> [args...]
@@ -22,12 +25,37 @@
  *
  * Mappings must be single-quoted to prevent shell glob expansion.
  *
+ * A mapping can name its own target: '<mapping>=<dir>' puts its matches
+ * in <dir> instead of <target-dir>.  ('=tmpfs:<size>' targets need the
+ * Linux mount namespace and are rejected here.)
+ *
+ * --heatmap=<file> counts, per mapped path, the calls each process of
+ * the program made on it (opens, lookups, modifies, creates) and writes
+ * the report to <file>, hottest first.  The interposer does the counting
+ * and every process folds its counts into <file> as it exits or execs.
+ *
+ * --trace=<file> records every path the interposer is asked to rewrite,
+ * with the call, in a compact binary file (rmp_trace.h), to replay
+ * through the matcher with test/bench_rewrite.
+ *
+ * Launch cache: what a launch settles on exec'ing (the interpreter a
+ * shebang names, the re-signed copy a hardened binary needs) is saved
+ * under $RMP_CONFIG/launch/, keyed by the resolved command, and reused
+ * while every file it read is unchanged (rmp_execcache.h).  A warm
+ * launch skips the codesign lookup, the shebang and the hardened check.
+ *
  * Environment variables:
  *   RMP_CONFIG     Base directory (default: ~/.remapper/)
  *   RMP_CACHE      Cache directory (default: $RMP_CONFIG/cache/)
+ *   RMP_SYSTEM_CACHE  Read-only machine-wide cache, tried first
+ *                  (default: /var/cache/remapper; "" = none)
+ *   RMP_CACHE_MAX  Size cap for --cache-gc (e.g. 10G; default: no cap)
  *   RMP_DEBUG_LOG  Log file path (enables debug logging when set)
+ *   RMP_LAUNCH_CACHE  0 = always resolve the command afresh (default: 1)
  *   RMP_TARGET     Set by CLI for the interpose library
  *   RMP_MAPPINGS   Set by CLI for the interpose library (colon-separated)
+ *   RMP_HEATMAP    Set by CLI for the interpose library (--heatmap's file)
+ *   RMP_TRACE      Set by CLI for the interpose library (--trace's file)
  *
  * The interpose library is embedded inside this binary at build time
  * via -sectcreate __DATA __interpose_lib <dylib>.
@@ -50,7 +78,12 @@
 #include <pwd.h>
 #include <errno.h>
 #include <stdint.h>
+#include <time.h>
 #include "rmp_shared.h"
+#include "rmp_gc.h"
+#include "rmp_prewarm.h"
+#include "rmp_trace.h"
+#include "rmp_execcache.h"
 
 #include <mach-o/dyld.h>
 #include <mach-o/getsect.h>
@@ -66,12 +99,14 @@ extern const struct mach_header_64 _mh_execute_header;
  *
  * If the interpreter is SIP-protected (/usr/, /bin/, /sbin/) or has
  * hardened runtime, create a cached re-signed copy and rewrite exec_argv
- * to use it.  Returns 1 if exec_argv was rewritten, 0 otherwise.
+ * to use it.  Returns 1 if exec_argv was rewritten, 0 if it needn't be,
+ * -1 if it needed to be and re-signing failed.  The interpreter and the
+ * copy go into *entry, for the launch cache.
  */
 static int resolve_sip_shebang(rmp_ctx_t *ctx, FILE *debug_fp,
                                 const char *interp, const char *cmd_resolved,
                                 char **exec_argv, int argc, char **argv,
-                                int cmd_start) {
+                                int cmd_start, rmp_exec_entry_t *entry) {
     // Parse interpreter path and optional arg
     static char shebang_interp[PATH_MAX];
     static char shebang_arg_buf[256];
@@ -93,6 +128,7 @@ static int resolve_sip_shebang(rmp_ctx_t *ctx, FILE *debug_fp,
         strncpy(shebang_interp, interp, sizeof(shebang_interp) - 1);
         shebang_interp[sizeof(shebang_interp) - 1] = '\0';
     }
+    int interp_dep = rmp_execcache_dep(entry, shebang_interp);
 
     // Check if interpreter needs re-signing
     int need_resign = (strncmp(shebang_interp, "/usr/", 5) == 0 ||
@@ -109,9 +145,8 @@ static int resolve_sip_shebang(rmp_ctx_t *ctx, FILE *debug_fp,
     int resign_ok = 0;
 
     if (stat(shebang_interp, &interp_sb) == 0) {
-        rmp_cache_path(ctx->cache_dir, shebang_interp,
-                       cached_interp, sizeof(cached_interp));
-        if (rmp_cache_valid(cached_interp, interp_sb.st_mtime, interp_sb.st_size) ||
+        if (rmp_cache_lookup(ctx, shebang_interp, interp_sb.st_mtime, interp_sb.st_size,
+                             cached_interp, sizeof(cached_interp)) ||
             rmp_cache_create(ctx, shebang_interp, cached_interp,
                              interp_sb.st_mtime, interp_sb.st_size) == 0) {
             resign_ok = 1;
@@ -119,6 +154,10 @@ static int resolve_sip_shebang(rmp_ctx_t *ctx, FILE *debug_fp,
     }
 
     if (resign_ok) {
+        if (interp_dep >= 0) {
+            strcpy(entry->cached, cached_interp);
+            entry->cached_dep = interp_dep;
+        }
         int ai = 0;
         exec_argv[ai++] = cached_interp;
         if (shebang_arg) exec_argv[ai++] = shebang_arg;
@@ -143,7 +182,7 @@ static int resolve_sip_shebang(rmp_ctx_t *ctx, FILE *debug_fp,
         "[remapper] WARNING: %s has shebang '%s' that needs re-signing\n"
         "  Failed to create cached copy. Interposition may NOT work.\n",
         cmd_resolved, interp);
-    return 0;
+    return -1;
 }
 
 /*** Helpers ***********************************/
@@ -199,18 +238,57 @@ static char *make_absolute(const char *path) {
     return out;
 }
 
+// make_absolute() for a mapping and for its "=<dir>" target, if it has
+// one, creating that dir.  Exits on a "=tmpfs:" target.  Caller must free().
+static char *absolute_mapping(const char *arg) {
+    const char *eq = rmp_mapping_target(arg, 1);
+    if (!eq) return make_absolute(arg);
+    if (strncmp(eq + 1, "tmpfs:", 6) == 0) {
+        fprintf(stderr, "remapper: %s: mapping target must be a directory"
+                        " (tmpfs: targets are Linux only)\n", arg);
+        exit(1);
+    }
+
+    char *pattern = strndup(arg, (size_t)(eq - arg));
+    if (!pattern) { perror("strndup"); exit(1); }
+    char *abs_pattern = make_absolute(pattern);
+    char *abs_target = make_absolute(eq + 1);
+    rmp_mkdirs(abs_target, 0755);
+
+    size_t len = strlen(abs_pattern) + 1 + strlen(abs_target) + 1;
+    char *out = malloc(len);
+    if (!out) { perror("malloc"); exit(1); }
+    snprintf(out, len, "%s=%s", abs_pattern, abs_target);
+    free(pattern);
+    free(abs_pattern);
+    free(abs_target);
+    return out;
+}
+
 static void usage(const char *prog) {
     fprintf(stderr,
-        "Usage: %s [--debug-log <file>] <target-dir> <mapping>... -- <program> [args...]\n"
+        "Usage: %s [--debug-log <file>] [--heatmap=<file>] [--trace=<file>]\n"
+        "          <target-dir> <mapping>... -- <program> [args...]\n"
         "\n"
         "Redirect filesystem paths matching <mapping> into <target-dir>.\n"
         "\n"
-        "Mappings are full paths with optional globs in the last component.\n"
+        "Mappings are full paths with optional globs in any component ('**' = any depth).\n"
         "Single-quote mappings to prevent shell glob expansion.\n"
         "If '--' is absent, exactly one mapping is expected.\n"
+        "'<mapping>=<dir>' gives a mapping its own target dir.\n"
         "\n"
         "Options:\n"
         "  --debug-log <file>   Log debug output to <file>\n"
+        "  --heatmap=<file>     Count the calls on each mapped path and write\n"
+        "                       them to <file>, hottest first\n"
+        "  --trace=<file>       Record every path the interposer sees to <file>,\n"
+        "                       for test/bench_rewrite to replay\n"
+        "  --cache-gc           Prune the re-signed binary cache and exit\n"
+        "    --max-size <size>  Evict least recently used entries down to <size>\n"
+        "    --jobs <n>         Scan with <n> threads (default: one per CPU)\n"
+        "  --prewarm <path>...  Re-sign the hardened executables under each\n"
+        "                       <path> into the cache now, and exit\n"
+        "    --jobs <n>         Build with <n> threads (default: one per CPU)\n"
         "\n"
         "Examples:\n"
         "  %s ~/v1 '~/.claude*' -- claude\n"
@@ -220,7 +298,10 @@ static void usage(const char *prog) {
         "Environment variables:\n"
         "  RMP_CONFIG      Base directory (default: ~/.remapper/)\n"
         "  RMP_CACHE       Cache directory (default: $RMP_CONFIG/cache/)\n"
-        "  RMP_DEBUG_LOG   Log file (enables debug when set)\n",
+        "  RMP_SYSTEM_CACHE  Read-only cache tried first (default: /var/cache/remapper)\n"
+        "  RMP_CACHE_MAX   Default --max-size for --cache-gc\n"
+        "  RMP_DEBUG_LOG   Log file (enables debug when set)\n"
+        "  RMP_LAUNCH_CACHE  0 = don't reuse earlier launches' decisions\n",
         prog, prog, prog, prog);
     exit(1);
 }
@@ -228,12 +309,15 @@ static void usage(const char *prog) {
 /*** Argument parsing ***************************/
 
 // Parse CLI arguments.  Sets *target (malloc'd, absolute path),
-// *mappings (malloc'd, colon-separated), and *debug_log.
+// *mappings (malloc'd, colon-separated), *debug_log, and *heatmap and
+// *trace (malloc'd, absolute paths, or NULL).
 // Returns the argv index where the command starts (cmd_start).
-static int parse_args(int argc, char **argv,
-                      char **target, char **mappings, const char **debug_log) {
+static int parse_args(int argc, char **argv, char **target, char **mappings,
+                      const char **debug_log, char **heatmap, char **trace) {
     int arg_idx = 1;
     *debug_log = getenv("RMP_DEBUG_LOG");
+    *heatmap = NULL;
+    *trace = NULL;
 
     while (arg_idx < argc && argv[arg_idx][0] == '-' && strcmp(argv[arg_idx], "--") != 0) {
         if (strncmp(argv[arg_idx], "--debug-log=", 12) == 0) {
@@ -242,6 +326,18 @@ static int parse_args(int argc, char **argv,
         } else if (strcmp(argv[arg_idx], "--debug-log") == 0 && arg_idx + 1 < argc) {
             *debug_log = argv[arg_idx + 1];
             arg_idx += 2;
+        } else if (strncmp(argv[arg_idx], "--heatmap=", 10) == 0 && argv[arg_idx][10]) {
+            free(*heatmap);
+            *heatmap = make_absolute(argv[arg_idx] + 10);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--heatmap") == 0) {
+            // Every process writes its own counts: they need a file to meet in
+            fprintf(stderr, "Error: --heatmap needs a file here: --heatmap=<file>\n\n");
+            usage(argv[0]);
+        } else if (strncmp(argv[arg_idx], "--trace=", 8) == 0 && argv[arg_idx][8]) {
+            free(*trace);
+            *trace = make_absolute(argv[arg_idx] + 8);
+            arg_idx++;
         } else {
             fprintf(stderr, "Unknown option: %s\n\n", argv[arg_idx]);
             usage(argv[0]);
@@ -286,7 +382,7 @@ static int parse_args(int argc, char **argv,
     size_t mlen = 0;
 
     for (int i = map_start; i < map_end; i++) {
-        char *abs = make_absolute(argv[i]);
+        char *abs = absolute_mapping(argv[i]);
 
         if (mlen > 0) {
             if (mlen + 1 >= sizeof(buf)) {
@@ -455,14 +551,226 @@ static void resolve_dirs(char *config_dir, size_t config_size,
     }
 }
 
+/*** Cache garbage collection ******************/
+
+// remapper --cache-gc [--max-size <size>] [--jobs <n>] [--debug-log <file>]
+static int cache_gc_main(int argc, char **argv) {
+    const char *max_size = getenv("RMP_CACHE_MAX");
+    const char *debug_log = getenv("RMP_DEBUG_LOG");
+    int jobs = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+            max_size = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--debug-log") == 0 && i + 1 < argc) {
+            debug_log = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n\n", argv[i]);
+            usage(argv[0]);
+        }
+    }
+
+    long long max_bytes = 0;
+    if (max_size && max_size[0]) {
+        max_bytes = rmp_parse_size(max_size);
+        if (max_bytes < 0) {
+            fprintf(stderr, "Error: invalid size '%s'\n", max_size);
+            return 1;
+        }
+    }
+
+    char config_dir[PATH_MAX];
+    char cache_dir[PATH_MAX];
+    resolve_dirs(config_dir, sizeof(config_dir), cache_dir, sizeof(cache_dir));
+
+    FILE *debug_fp = NULL;
+    if (debug_log) {
+        debug_fp = fopen(debug_log, "we");
+        if (!debug_fp) debug_fp = stderr;
+    }
+
+    rmp_gc_stats_t st;
+    if (rmp_cache_gc(cache_dir, max_bytes, jobs, debug_fp, &st) != 0) {
+        fprintf(stderr, "Error: cannot scan cache %s: %s\n",
+                cache_dir, strerror(errno));
+        return 1;
+    }
+
+    fprintf(stderr,
+        "[remapper] cache-gc: %s: %ld entries, removed %ld stale, "
+        "%ld evicted, %ld temp; %.1f MB -> %.1f MB\n",
+        cache_dir, st.scanned, st.removed_stale, st.removed_lru, st.removed_tmp,
+        st.bytes_before / 1048576.0, st.bytes_after / 1048576.0);
+    return 0;
+}
+
+/*** --prewarm ********************************/
+
+static int prewarm_main(int argc, char **argv) {
+    const char *debug_log = getenv("RMP_DEBUG_LOG");
+    int jobs = 0;
+    const char *paths[argc];
+    int npaths = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--debug-log") == 0 && i + 1 < argc) {
+            debug_log = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n\n", argv[i]);
+            usage(argv[0]);
+        } else {
+            paths[npaths++] = argv[i];
+        }
+    }
+    if (npaths == 0) usage(argv[0]);
+
+    char config_dir[PATH_MAX];
+    char cache_dir[PATH_MAX];
+    resolve_dirs(config_dir, sizeof(config_dir), cache_dir, sizeof(cache_dir));
+
+    FILE *debug_fp = NULL;
+    if (debug_log) {
+        debug_fp = fopen(debug_log, "we");
+        if (!debug_fp) debug_fp = stderr;
+    }
+
+    rmp_ctx_t ctx;
+    rmp_ctx_init(&ctx, config_dir, cache_dir, debug_fp);
+    if (!rmp_can_sign(&ctx)) {
+        fprintf(stderr, "Error: cannot find 'codesign' in PATH\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < npaths; i++) {
+        rmp_prewarm_stats_t st;
+        if (rmp_prewarm(&ctx, paths[i], jobs, &st) != 0) {
+            fprintf(stderr, "Error: cannot read %s: %s\n", paths[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        double secs = st.seconds > 0 ? st.seconds : 1e-9;
+        fprintf(stderr,
+            "[remapper] prewarm: %s: %ld files, %ld executables, %ld hardened; "
+            "built %ld, already cached %ld, failed %ld\n"
+            "[remapper] prewarm: %.1f MB in %.2fs (%.1f MB/s, %.1f binaries/s)\n",
+            paths[i], st.files, st.executables, st.hardened,
+            st.created, st.cached, st.failed,
+            st.bytes / 1048576.0, st.seconds,
+            st.bytes / 1048576.0 / secs, st.created / secs);
+        if (st.failed) status = 1;
+    }
+    return status;
+}
+
+/*** Launch cache ******************************/
+
+// Resolve the command to a full path, as execvp would find it: through
+// PATH if it is a bare name, else made absolute.  "" if not found.
+static void resolve_command(const char *cmd, char *out, size_t size) {
+    if (strchr(cmd, '/')) {
+        if (!realpath(cmd, out))
+            out[0] = '\0';
+    } else if (!resolve_in_path(cmd, out, size)) {
+        out[0] = '\0';
+    }
+}
+
+// The launch cache key: the command and what else its resolution reads
+// besides files (PATH for '#!/usr/bin/env', the caches for re-signed
+// copies).  -1 if there is no command or it can't be a key.
+static int launch_key(const char *cmd_resolved, const char *cache_dir,
+                      char *key, size_t size) {
+    const char *path = getenv("PATH");
+    const char *system_cache = getenv("RMP_SYSTEM_CACHE");
+    if (!system_cache) system_cache = RMP_SYSTEM_CACHE_DEFAULT;
+    if (!cmd_resolved[0]) return -1;
+    int n = snprintf(key, size, "%s\t%s\t%s\t%s", cmd_resolved, path ? path : "",
+                     cache_dir, system_cache);
+    if (n < 0 || (size_t)n >= size || strchr(key, '\n')) return -1;
+    return 0;
+}
+
+// Exec what entry e decided on, with the command's own arguments.
+// Returns only if the exec failed.
+static void launch_exec(const rmp_exec_entry_t *e, int argc, char **argv,
+                        int cmd_start, FILE *debug_fp) {
+    if (!e->exec_path[0]) {
+        if (debug_fp) {
+            fprintf(debug_fp, "[remapper] launch cache: hit, exec %s\n", argv[cmd_start]);
+            fflush(debug_fp);
+        }
+        execvp(argv[cmd_start], &argv[cmd_start]);
+        return;
+    }
+
+    char *exec_argv[256];
+    int ai = 0;
+    for (int i = 0; i < e->num_args; i++)
+        exec_argv[ai++] = (char *)e->args[i];
+    for (int i = cmd_start + 1; i < argc && ai < 255; i++)
+        exec_argv[ai++] = argv[i];
+    exec_argv[ai] = NULL;
+
+    if (debug_fp) {
+        fprintf(debug_fp, "[remapper] launch cache: hit, exec %s:", e->exec_path);
+        for (int i = 0; exec_argv[i]; i++)
+            fprintf(debug_fp, " %s", exec_argv[i]);
+        fprintf(debug_fp, "\n");
+        fflush(debug_fp);
+    }
+    execv(e->exec_path, exec_argv);
+}
+
+// Save the slow path's decision: exec_argv (up to the command's own
+// arguments) if it was rewritten, else the command as given.
+static void launch_store(const char *dir, const char *key, rmp_exec_entry_t *e,
+                         int use_rewritten, char **exec_argv,
+                         int argc, int cmd_start, FILE *debug_fp) {
+    if (use_rewritten) {
+        int total = 0;
+        while (exec_argv[total]) total++;
+        int nprefix = total - (argc - cmd_start - 1);
+        if (total >= 255 || nprefix < 1 || nprefix > RMP_EXEC_MAX_ARGS) return;
+        if (strlen(exec_argv[0]) >= sizeof(e->exec_path)) return;
+        strcpy(e->exec_path, exec_argv[0]);
+        for (int i = 0; i < nprefix; i++) {
+            if (strlen(exec_argv[i]) >= sizeof(e->args[0])) return;
+            strcpy(e->args[i], exec_argv[i]);
+        }
+        e->num_args = nprefix;
+    } else {
+        e->exec_path[0] = '\0';
+        e->num_args = 0;
+    }
+    e->stamp = time(NULL);
+
+    if (rmp_execcache_store(dir, key, e) == 0 && debug_fp) {
+        fprintf(debug_fp, "[remapper] launch cache: stored %s\n", e->deps[0].path);
+        fflush(debug_fp);
+    }
+}
+
 /*** Main **************************************/
 
 int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "--cache-gc") == 0)
+        return cache_gc_main(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "--prewarm") == 0)
+        return prewarm_main(argc, argv);
+
     char *target;
     char *mappings;
     const char *debug_log;
+    char *heatmap;
+    char *trace;
 
-    int cmd_start = parse_args(argc, argv, &target, &mappings, &debug_log);
+    int cmd_start = parse_args(argc, argv, &target, &mappings, &debug_log, &heatmap, &trace);
     char *cmd_to_run = argv[cmd_start];
 
     char config_dir[PATH_MAX];
@@ -479,15 +787,6 @@ int main(int argc, char **argv) {
         if (!debug_fp) debug_fp = stderr;
     }
 
-    // Initialize shared context (resolves codesign, creates dirs, writes entitlements)
-    rmp_ctx_t ctx;
-    rmp_ctx_init(&ctx, config_dir, cache_dir, debug_fp);
-
-    if (!ctx.codesign_path[0]) {
-        fprintf(stderr, "Error: cannot find 'codesign' in PATH\n");
-        exit(1);
-    }
-
     /*** Set environment variables *****************/
 
     setenv("RMP_TARGET", target, 1);
@@ -497,6 +796,63 @@ int main(int argc, char **argv) {
     setenv("RMP_CONFIG", config_dir, 1);
     if (debug_log)
         setenv("RMP_DEBUG_LOG", debug_log, 1);
+    if (heatmap) {
+        // A fresh report: the program's processes add to what's there
+        int fd = open(heatmap, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Error: cannot write %s: %s\n", heatmap, strerror(errno));
+            exit(1);
+        }
+        close(fd);
+        setenv("RMP_HEATMAP", heatmap, 1);
+    }
+    if (trace) {
+        if (rmp_trace_create(trace, target, mappings) < 0) {
+            fprintf(stderr, "Error: cannot write %s: %s\n", trace, strerror(errno));
+            exit(1);
+        }
+        setenv("RMP_TRACE", trace, 1);
+    }
+
+    /*** Launch cache ******************************/
+    //
+    // The resolved command is the key: a hit whose files are all as they
+    // were execs straight away.  An exec that fails (a re-signed copy
+    // removed since) drops the entry and takes the slow path.
+
+    char cmd_resolved[PATH_MAX] = "";
+    resolve_command(cmd_to_run, cmd_resolved, sizeof(cmd_resolved));
+
+    const char *launch_env = getenv("RMP_LAUNCH_CACHE");
+    int use_launch = !(launch_env && strcmp(launch_env, "0") == 0);
+    char launch_dir[PATH_MAX + 16];
+    char key[PATH_MAX * 4];
+    snprintf(launch_dir, sizeof(launch_dir), "%s/launch", config_dir);
+    if (use_launch)
+        use_launch = launch_key(cmd_resolved, cache_dir, key, sizeof(key)) == 0;
+
+    static rmp_exec_entry_t entry;
+    if (use_launch && rmp_execcache_lookup(launch_dir, key, &entry)) {
+        launch_exec(&entry, argc, argv, cmd_start, debug_fp);
+        if (debug_fp) {
+            fprintf(debug_fp, "[remapper] launch cache: exec failed (%s), dropped\n",
+                    strerror(errno));
+            fflush(debug_fp);
+        }
+        rmp_execcache_forget(launch_dir, key);
+    }
+    memset(&entry, 0, sizeof(entry));
+    if (use_launch && cmd_resolved[0])
+        rmp_execcache_dep(&entry, cmd_resolved);
+
+    // Initialize shared context (resolves codesign, creates dirs, writes entitlements)
+    rmp_ctx_t ctx;
+    rmp_ctx_init(&ctx, config_dir, cache_dir, debug_fp);
+
+    if (!rmp_can_sign(&ctx)) {
+        fprintf(stderr, "Error: cannot find 'codesign' in PATH\n");
+        exit(1);
+    }
 
     /*** Debug output ******************************/
 
@@ -521,18 +877,7 @@ int main(int argc, char **argv) {
     // so we exec the interpreter directly.  This is critical: SIP will
     // strip DYLD_INSERT_LIBRARIES when /usr/bin/env runs.
 
-    // Resolve the command to a full (absolute) path
-    char cmd_resolved[PATH_MAX] = "";
-    if (strchr(cmd_to_run, '/')) {
-        // Contains '/' — absolute or relative path; resolve to absolute
-        if (!realpath(cmd_to_run, cmd_resolved))
-            cmd_resolved[0] = '\0';
-    } else {
-        // Bare filename — search PATH
-        resolve_in_path(cmd_to_run, cmd_resolved, sizeof(cmd_resolved));
-    }
-
-    // Check if it's a script with a shebang
+    // Check if it's a script with a shebang (cmd_resolved: above)
     char *exec_argv[256];
     int use_rewritten = 0;
 
@@ -574,6 +919,7 @@ int main(int argc, char **argv) {
                     resolve_in_path(prog_name, interp_resolved, sizeof(interp_resolved));
 
                     if (interp_resolved[0]) {
+                        rmp_execcache_dep(&entry, interp_resolved);
                         int ai = 0;
                         exec_argv[ai++] = interp_resolved;
 
@@ -611,9 +957,11 @@ int main(int argc, char **argv) {
                 }
                 // #!/path/to/interpreter — if SIP-protected or hardened, copy+re-sign
                 else {
-                    use_rewritten = resolve_sip_shebang(
+                    int r = resolve_sip_shebang(
                         &ctx, debug_fp, interp, cmd_resolved,
-                        exec_argv, argc, argv, cmd_start);
+                        exec_argv, argc, argv, cmd_start, &entry);
+                    use_rewritten = r > 0;
+                    if (r < 0) use_launch = 0;
                 }
             }
         }
@@ -638,6 +986,12 @@ int main(int argc, char **argv) {
                 fflush(debug_fp);
             }
 
+            int dep = rmp_execcache_dep(&entry, final_binary);
+            if (dep >= 0 && strlen(resolved) < sizeof(entry.cached)) {
+                strcpy(entry.cached, resolved);
+                entry.cached_dep = dep;
+            }
+
             // Update the exec target
             if (use_rewritten) {
                 exec_argv[0] = (char *)resolved;
@@ -652,6 +1006,10 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (use_launch && entry.num_deps > 0)
+        launch_store(launch_dir, key, &entry, use_rewritten, exec_argv,
+                     argc, cmd_start, debug_fp);
+
     // Exec the command
     if (use_rewritten) {
         execv(exec_argv[0], exec_argv);
@@ -11,8 +11,22 @@
  *
  * Usage:
  *   remapper [--debug-log <file>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --profile <file> <target-dir> [<mapping>... --] <program> [args...]
+ *   remapper --stage[=<size>] [--checkpoint <secs>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --watch <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --backend=seccomp <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --shared-userns[=<file>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --stats[=<file>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --cgroup[=<limits>] <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --heatmap[=<file>] <target-dir> <mapping>... -- <program> [args...]
  *   remapper --install-apparmor
  *   remapper --install-apparmor-at <path>
+ *   remapper --serve <socket> [--zygote-ttl <secs>] [--debug-log <file>]
+ *   remapper --connect <socket> <target-dir> <mapping>... -- <program> [args...]
+ *   remapper --batch <manifest> [--jobs <n>] [--report <file>] [--shared-userns[=<file>]]
+ *            [--cgroup[=<limits>]] [--debug-log <file>]
+ *   remapper --snapshot <name> <target-dir>
+ *   remapper --reset <name> <target-dir> [<mapping>... -- <program> [args...]]
  *
  * If '--' is absent, exactly one mapping is expected:
  *   remapper <target-dir> <mapping> <program> [args...]
@@ -21,11 +35,67 @@
  *   remapper ~/v1 '~/.claude*' -- claude
  *   remapper ~/v1 '~/.codex*' codex --model X
  *   remapper --debug-log /tmp/rmp.log ~/v1 '~/.claude*' '~/.config*' -- claude
+ *   remapper --profile ~/claude.rmp ~/v1 claude
+ *   remapper --stage=1g --checkpoint 60 ~/v1 '~/.claude*' -- claude
+ *   remapper --watch ~/v1 '~/.claude*' -- claude
+ *   remapper --backend=seccomp ~/v1 '~/.claude*' -- claude
+ *   remapper --stats=run.json ~/v1 '~/.claude*' -- claude
+ *   remapper --heatmap=heat.txt ~/v1 '~/.claude*' -- claude
  *   sudo remapper --install-apparmor
  *   sudo remapper --install-apparmor-at /usr/local/bin/remapper
+ *   remapper --serve /tmp/rmp.sock &
+ *   remapper --connect /tmp/rmp.sock ~/v1 '~/.claude*' -- claude
+ *   remapper --batch agents.txt --jobs 8 --report launch.jsonl
+ *   remapper --batch agents.txt --jobs 64 --shared-userns
+ *   remapper --batch agents.txt --cgroup=cpu=100%,memory=2g,io=50
+ *   remapper --snapshot clean ~/v1
+ *   remapper --reset clean ~/v1 '~/.claude*' -- claude
  *
  * Mappings must be single-quoted to prevent shell glob expansion.
  *
+ * A mapping can name its own target: '<mapping>=<dir>' puts its matches
+ * in <dir> instead of <target-dir>, and '<mapping>=tmpfs:<size>' on a
+ * tmpfs private to the namespace, e.g. '~/.cache/app*=tmpfs:512m'.
+ *
+ * --stage runs the program against copies of its targets on a tmpfs, so
+ * small fsync'd writes (logs, SQLite, lock files) never reach the disk
+ * while it runs.  remapper stays behind as the parent and, when the
+ * program exits (and every --checkpoint seconds), writes what changed
+ * back to the targets, a file at a time by rename.
+ *
+ * --watch also catches matches the program creates while it runs: remapper
+ * stays behind in the namespace, watches each mapping's parent with
+ * inotify, and moves each new match into the target and mounts it back.
+ *
+ * --backend=seccomp mounts nothing: remapper stays behind as a seccomp
+ * supervisor and rewrites the paths of the program's file syscalls, so
+ * matches need not exist before launch (see rmp_seccomp.c).
+ *
+ * --shared-userns launches into one user namespace, created once and
+ * held by a keeper process found through <file> (default
+ * $XDG_RUNTIME_DIR/remapper-userns), instead of a new one each time:
+ * each instance only gets its own mount namespace.  The keeper exits
+ * after ten idle minutes.
+ *
+ * --stats keeps remapper behind as the program's parent and, when it
+ * exits, writes a JSON line to <file> (default stderr): wall time,
+ * rusage and I/O for the program and everything it started, and the
+ * files and bytes each mount's target gained or lost.
+ *
+ * --cgroup starts the program in a cgroup of its own, created under
+ * remapper's when that is delegated (a systemd user slice or scope, a
+ * container), with any of the limits cpu=<n>%, memory=<size>, io=<weight>
+ * and cpus=<list>, and reports the pressure stall time (PSI) it saw.
+ * Without a delegated cgroup v2 it does nothing (see rmp_cgroup.c).
+ *
+ * --heatmap counts what the program does to each file under the mounts'
+ * targets - opens, reads, writes, creations - and when it exits writes
+ * the paths hottest first to <file> (default stderr).
+ *
+ * --snapshot saves a target dir as <target-dir>/.rmp-snapshots/<name>
+ * (reflinked where the filesystem can), and --reset puts it back,
+ * rewriting only what changed since - on its own, or before a launch.
+ *
  * Environment variables:
  *   RMP_DEBUG_LOG  Log file path (enables debug logging when set)
  *
@@ -79,6 +149,23 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include "rmp_shared.h"
+#include "rmp_pool.h"
+#include "rmp_launch.h"
+#include "rmp_seccomp.h"
+#include "rmp_cgroup.h"
+#include "rmp_heat.h"
 
 /*** Debug logging ********************************/
 
@@ -93,6 +180,12 @@ static FILE *g_debug_fp = NULL;
 
 /*** Helpers **************************************/
 
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
 // Thread-safe home directory lookup: try $HOME, fall back to getpwuid_r.
 static const char *get_home_dir(char *buf, size_t bufsize) {
     const char *home = getenv("HOME");
@@ -144,6 +237,28 @@ static char *make_absolute(const char *path) {
     return out;
 }
 
+// make_absolute() for a mapping and for its "=<dir>" target, if it has
+// one; a "=tmpfs:..." target is kept as is.  Caller must free().
+static char *absolute_mapping(const char *arg) {
+    const char *eq = rmp_mapping_target(arg, 1);
+    if (!eq) return make_absolute(arg);
+
+    char *pattern = strndup(arg, (size_t)(eq - arg));
+    if (!pattern) { perror("strndup"); exit(1); }
+    char *abs_pattern = make_absolute(pattern);
+    char *abs_target = strncmp(eq + 1, "tmpfs:", 6) == 0
+                     ? strdup(eq + 1) : make_absolute(eq + 1);
+    char *out;
+    if (!abs_target || asprintf(&out, "%s=%s", abs_pattern, abs_target) < 0) {
+        perror("malloc");
+        exit(1);
+    }
+    free(pattern);
+    free(abs_pattern);
+    free(abs_target);
+    return out;
+}
+
 // Create directory path recursively (like mkdir -p).
 static void mkdirs(const char *path, mode_t mode) {
     char tmp[PATH_MAX];
@@ -165,14 +280,52 @@ static void usage(const char *prog) {
         "\n"
         "Redirect filesystem paths matching <mapping> into <target-dir>.\n"
         "\n"
-        "Mappings are full paths with optional globs in the last component.\n"
+        "Mappings are full paths with optional globs in any component ('**' = any depth).\n"
         "Single-quote mappings to prevent shell glob expansion.\n"
         "If '--' is absent, exactly one mapping is expected.\n"
+        "'<mapping>=<dir>' gives a mapping its own target dir (starting with\n"
+        "/, ~, ./ or ../; any other '=' is part of the path), and\n"
+        "'<mapping>=tmpfs:<size>' a private tmpfs (size e.g. 512m, 2g, 25%%).\n"
         "\n"
         "Options:\n"
         "  --debug-log <file>          Log debug output to <file>\n"
+        "  --profile <file>            Add the mappings listed in <file>, one per\n"
+        "                              line; then argv mappings are optional\n"
+        "  --stage[=<size>]            Run on tmpfs copies of the targets and\n"
+        "                              write changes back when the program exits\n"
+        "  --checkpoint <secs>         With --stage: also write back every <secs>\n"
+        "  --watch                     Also remap matches created while the\n"
+        "                              program runs\n"
+        "  --backend=<mount|seccomp>   How to redirect: bind mounts (default), or\n"
+        "                              by rewriting the program's file syscalls,\n"
+        "                              for paths that don't exist yet\n"
+        "  --shared-userns[=<file>]    Join one user namespace kept for all\n"
+        "                              instances (also with --batch); each gets\n"
+        "                              only a mount namespace of its own\n"
+        "  --stats[=<file>]            When the program exits, write its CPU,\n"
+        "                              memory, I/O and target growth as JSON to\n"
+        "                              <file> (default stderr)\n"
+        "  --heatmap[=<file>]          When the program exits, write how often it\n"
+        "                              opened, read, wrote and created each mapped\n"
+        "                              file to <file> (default stderr)\n"
+        "  --cgroup[=<limits>]         Run in a cgroup of its own, if ours is\n"
+        "                              delegated (also with --batch), limited by\n"
+        "                              cpu=<n>%%,memory=<size>,io=<weight>,cpus=<list>\n"
         "  --install-apparmor          Install AppArmor profile (requires sudo)\n"
         "  --install-apparmor-at <p>   Copy binary to <p> and install profile there\n"
+        "  --serve <socket>            Run a launch daemon that keeps namespaces ready\n"
+        "  --zygote-ttl <secs>         With --serve: rebuild each namespace after\n"
+        "                              <secs> to pick up new matches (default 60)\n"
+        "  --connect <socket> ...      Launch through a --serve daemon instead\n"
+        "  --batch <manifest>          Launch one instance per manifest line\n"
+        "                              (<target-dir> <mapping>... -- <program>...),\n"
+        "                              scanning shared mappings once\n"
+        "  --jobs <n>                  With --batch: instances running at once\n"
+        "                              (default: CPU count)\n"
+        "  --report <file>             With --batch: write the JSON lines to <file>\n"
+        "  --snapshot <name> <dir>     Save target dir <dir> as snapshot <name>\n"
+        "  --reset <name>              Reset the target dir to snapshot <name>,\n"
+        "                              then launch if a command follows\n"
         "\n"
         "Examples:\n"
         "  %s ~/v1 '~/.claude*' -- claude\n"
@@ -249,29 +402,17 @@ static void format_apparmor_profile(const char *binary_path, char *buf, size_t b
         binary_path);
 }
 
-// Copy a file preserving permissions.
+// Copy a file preserving permissions and metadata.
 static int copy_file(const char *src, const char *dst) {
-    struct stat sb;
-    if (stat(src, &sb) != 0) return -1;
-
-    int sfd = open(src, O_RDONLY);
-    if (sfd < 0) return -1;
-
-    int dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, sb.st_mode);
-    if (dfd < 0) { close(sfd); return -1; }
-
-    char buf[8192];
-    ssize_t n;
-    while ((n = read(sfd, buf, sizeof(buf))) > 0) {
-        if (write(dfd, buf, (size_t)n) != n) {
-            close(sfd); close(dfd); unlink(dst);
-            return -1;
-        }
+    int method = rmp_clone_file(src, dst, 0);
+    if (method < 0) {
+        int e = errno;
+        unlink(dst);
+        errno = e;
+        return -1;
     }
-
-    close(sfd);
-    close(dfd);
-    return (n < 0) ? -1 : 0;
+    DEBUG("copied %s -> %s (%s)", src, dst, rmp_clone_method_name(method));
+    return 0;
 }
 
 // Install an AppArmor profile for the remapper binary.  Must be run as root.
@@ -405,60 +546,41 @@ static void print_apparmor_help(void) {
     }
 }
 
-/*** Pattern storage ******************************/
-
-#define MAX_PATTERNS 64
-
-typedef struct {
-    char parent[PATH_MAX];   // parent directory, e.g. "/home/user/"
-    size_t parent_len;
-    char glob[256];          // glob for the last component, e.g. ".claude*"
-} pattern_t;
-
-/*** Bind mount list ******************************/
-
-// Each entry represents one bind mount to set up: mount source over original.
-#define MAX_MOUNTS 256
+/*** Argument parsing *****************************/
 
-typedef struct {
-    char original[PATH_MAX]; // the real path (mount point)
-    char target[PATH_MAX];   // path under target-dir (mount source)
-    int is_dir;              // 1 = directory, 0 = file
-} mount_entry_t;
-
-static mount_entry_t g_mounts[MAX_MOUNTS];
-static int g_num_mounts = 0;
-
-// Add a bind mount entry.  `original` is the real path (e.g. /home/user/.claude),
-// `target_dir` is the base target directory, `rest` is the path component after
-// the parent (e.g. ".claude" or ".claude/config").
-static void add_mount(const char *original, const char *target_dir, const char *rest, int is_dir) {
-    if (g_num_mounts >= MAX_MOUNTS) {
-        fprintf(stderr, "remapper: too many mount entries (max %d)\n", MAX_MOUNTS);
+static const char *g_stage;         // --stage tmpfs size ("" = default), or NULL
+static int g_checkpoint_secs;       // --checkpoint, 0 = only on exit
+static const char *g_reset;         // --reset snapshot name, or NULL
+static int g_watch;                 // --watch: hot-add new matches
+static int g_seccomp;               // --backend=seccomp
+static const char *g_shared_userns; // --shared-userns keeper file ("" = default), or NULL
+static const char *g_stats;         // --stats output file ("" = stderr), or NULL
+static const char *g_heatmap;       // --heatmap report file ("" = stderr), or NULL
+static const char *g_cgroup;        // --cgroup limits ("" = none), or NULL
+static rmp_cgroup_limits_t g_cg_limits;
+
+// Seconds a --shared-userns keeper waits for another instance to join
+#define SHARED_USERNS_IDLE  600
+
+// --cgroup[=<limits>], for both launch and --batch
+static void set_cgroup(const char *limits) {
+    g_cgroup = limits;
+    if (rmp_cgroup_parse(limits, &g_cg_limits) != 0) {
+        fprintf(stderr, "remapper: bad --cgroup limits: %s\n", limits);
         exit(1);
     }
-
-    mount_entry_t *m = &g_mounts[g_num_mounts];
-
-    snprintf(m->original, sizeof(m->original), "%s", original);
-    snprintf(m->target, sizeof(m->target), "%s/%s", target_dir, rest);
-    m->is_dir = is_dir;
-
-    DEBUG("mount entry: %s -> %s (%s)", m->target, m->original,
-          is_dir ? "dir" : "file");
-
-    g_num_mounts++;
 }
 
-/*** Argument parsing *****************************/
-
-// Parse CLI arguments.  Sets *target (malloc'd, absolute path) and
-// fills `patterns` array.  Returns the argv index where the command starts.
+// Parse CLI arguments into a plan (target dir + absolute mappings from
+// --profile files, then argv; not yet resolved).  Returns the argv index
+// where the command starts.
 static int parse_args(int argc, char **argv,
-                      char **target, const char **debug_log,
-                      pattern_t *patterns, int *num_patterns) {
+                      rmp_plan_t **plan, const char **debug_log) {
     int arg_idx = 1;
     *debug_log = getenv("RMP_DEBUG_LOG");
+    const char **profiles = calloc((size_t)argc, sizeof(char *));
+    int num_profiles = 0;
+    if (!profiles) { perror("calloc"); exit(1); }
 
     while (arg_idx < argc && argv[arg_idx][0] == '-' && strcmp(argv[arg_idx], "--") != 0) {
         if (strncmp(argv[arg_idx], "--debug-log=", 12) == 0) {
@@ -467,18 +589,73 @@ static int parse_args(int argc, char **argv,
         } else if (strcmp(argv[arg_idx], "--debug-log") == 0 && arg_idx + 1 < argc) {
             *debug_log = argv[arg_idx + 1];
             arg_idx += 2;
+        } else if (strncmp(argv[arg_idx], "--profile=", 10) == 0) {
+            profiles[num_profiles++] = argv[arg_idx] + 10;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--profile") == 0 && arg_idx + 1 < argc) {
+            profiles[num_profiles++] = argv[arg_idx + 1];
+            arg_idx += 2;
+        } else if (strcmp(argv[arg_idx], "--stage") == 0) {
+            g_stage = "";
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--stage=", 8) == 0) {
+            g_stage = argv[arg_idx] + 8;
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--checkpoint=", 13) == 0) {
+            g_checkpoint_secs = atoi(argv[arg_idx] + 13);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--checkpoint") == 0 && arg_idx + 1 < argc) {
+            g_checkpoint_secs = atoi(argv[arg_idx + 1]);
+            arg_idx += 2;
+        } else if (strncmp(argv[arg_idx], "--backend=", 10) == 0 ||
+                   (strcmp(argv[arg_idx], "--backend") == 0 && arg_idx + 1 < argc)) {
+            const char *name = argv[arg_idx][9] == '=' ? argv[arg_idx] + 10
+                                                       : argv[++arg_idx];
+            if (strcmp(name, "seccomp") == 0) {
+                g_seccomp = 1;
+            } else if (strcmp(name, "mount") != 0) {
+                fprintf(stderr, "Unknown backend: %s\n\n", name);
+                usage(argv[0]);
+            }
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--watch") == 0) {
+            g_watch = 1;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--stats") == 0) {
+            g_stats = "";
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--stats=", 8) == 0) {
+            g_stats = argv[arg_idx] + 8;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--heatmap") == 0) {
+            g_heatmap = "";
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--heatmap=", 10) == 0) {
+            g_heatmap = argv[arg_idx] + 10;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--cgroup") == 0) {
+            set_cgroup("");
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--cgroup=", 9) == 0) {
+            set_cgroup(argv[arg_idx] + 9);
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--shared-userns") == 0) {
+            g_shared_userns = "";
+            arg_idx++;
+        } else if (strncmp(argv[arg_idx], "--shared-userns=", 16) == 0) {
+            g_shared_userns = argv[arg_idx] + 16;
+            arg_idx++;
+        } else if (strcmp(argv[arg_idx], "--reset") == 0 && arg_idx + 1 < argc) {
+            g_reset = argv[arg_idx + 1];
+            arg_idx += 2;
         } else {
             fprintf(stderr, "Unknown option: %s\n\n", argv[arg_idx]);
             usage(argv[0]);
         }
     }
 
-    // Need at least: target, mapping, command
-    if (argc - arg_idx < 3) usage(argv[0]);
-
-    // argv[arg_idx] = target directory
-    *target = make_absolute(argv[arg_idx]);
-    mkdirs(*target, 0755);
+    // Need at least: target, mapping (unless a profile has them), command
+    if (argc - arg_idx < (num_profiles ? 2 : 3)) usage(argv[0]);
 
     // Find '--' separator
     int sep_idx = -1;
@@ -492,6 +669,9 @@ static int parse_args(int argc, char **argv,
     if (sep_idx >= 0) {
         map_end   = sep_idx;
         cmd_start = sep_idx + 1;
+    } else if (num_profiles) {
+        map_end   = map_start;     // mappings only from the profiles
+        cmd_start = map_start;
     } else {
         map_end   = arg_idx + 2;
         cmd_start = arg_idx + 2;
@@ -501,275 +681,2157 @@ static int parse_args(int argc, char **argv,
         fprintf(stderr, "Error: no command specified\n\n");
         usage(argv[0]);
     }
-    if (map_end <= map_start) {
+    if (map_end <= map_start && !num_profiles) {
         fprintf(stderr, "Error: no mappings specified\n\n");
         usage(argv[0]);
     }
 
-    // Parse each mapping into (parent_dir, glob_component)
-    // Same format as macOS: split at last '/' to get parent + glob
-    *num_patterns = 0;
+    // argv[arg_idx] = target directory (rmp_plan_new creates it)
+    char *target = make_absolute(argv[arg_idx]);
+    *plan = rmp_plan_new(target);
+    if (!*plan) {
+        fprintf(stderr, "remapper: %s\n", rmp_last_error());
+        exit(1);
+    }
+    free(target);
+    if (g_stage && rmp_plan_set_stage(*plan, g_stage) < 0) {
+        fprintf(stderr, "remapper: %s\n", rmp_last_error());
+        exit(1);
+    }
+    if (g_checkpoint_secs < 0 || (g_checkpoint_secs && !g_stage)) {
+        fprintf(stderr, "remapper: --checkpoint needs --stage and a positive interval\n");
+        exit(1);
+    }
+    if (g_heatmap && g_stage) {
+        // The program works on copies in its namespace, out of our sight
+        fprintf(stderr, "remapper: --heatmap can't be used with --stage\n");
+        exit(1);
+    }
+    if (g_watch && g_stage) {
+        // New matches are moved into the targets, which a tmpfs copy isn't
+        fprintf(stderr, "remapper: --watch can't be used with --stage\n");
+        exit(1);
+    }
+    if (g_seccomp && (g_stage || g_watch || g_shared_userns)) {
+        // All work on mounts; seccomp makes none
+        fprintf(stderr, "remapper: --backend=seccomp can't be used with %s\n",
+                g_stage ? "--stage" : g_watch ? "--watch" : "--shared-userns");
+        exit(1);
+    }
+
+    for (int i = 0; i < num_profiles; i++) {
+        char *path = make_absolute(profiles[i]);
+        if (rmp_plan_add_profile(*plan, path) < 0) {
+            fprintf(stderr, "remapper: %s\n", rmp_last_error());
+            exit(1);
+        }
+        free(path);
+    }
+    free(profiles);
+
+    // Each mapping is split where its wildcards start into parent dir +
+    // glob, the same format as macOS.  Mappings without a parent are ignored; a
+    // malformed "=<target>" is an error.
     for (int i = map_start; i < map_end; i++) {
-        if (*num_patterns >= MAX_PATTERNS) {
-            fprintf(stderr, "Error: too many patterns (max %d)\n", MAX_PATTERNS);
+        char *abs = absolute_mapping(argv[i]);
+        int r = rmp_plan_add_mapping(*plan, abs);
+        if (r == -RMP_ERR_NOMEM) {
+            perror("malloc");
+            exit(1);
+        }
+        if (r == -RMP_ERR_INVAL && rmp_mapping_target(abs, 0)) {
+            fprintf(stderr, "remapper: %s\n", rmp_last_error());
             exit(1);
         }
+        free(abs);
+    }
 
-        char *abs = make_absolute(argv[i]);
-        char *last_slash = strrchr(abs, '/');
+    return cmd_start;
+}
 
-        if (last_slash && last_slash != abs) {
-            size_t plen = (size_t)(last_slash - abs + 1);  // includes '/'
-            size_t glen = strlen(last_slash + 1);
+// Explain why rmp_plan_enter() failed, with a fix where we know one
+static void report_enter_error(int err) {
+    int saved_errno = errno;
+    fprintf(stderr, "remapper: %s\n", rmp_last_error());
 
-            if (plen < PATH_MAX && glen < 256) {
-                memcpy(patterns[*num_patterns].parent, abs, plen);
-                patterns[*num_patterns].parent[plen] = '\0';
-                patterns[*num_patterns].parent_len = plen;
-                strcpy(patterns[*num_patterns].glob, last_slash + 1);
-                (*num_patterns)++;
-            }
+    if (err == -RMP_ERR_USERNS && saved_errno == EPERM) {
+        if (is_apparmor_restricting()) {
+            print_apparmor_help();
+        } else if (is_userns_disabled()) {
+            fprintf(stderr,
+                "\n"
+                "Unprivileged user namespaces are disabled on this system.\n"
+                "To enable them, run:\n"
+                "\n"
+                "  sudo sysctl -w kernel.unprivileged_userns_clone=1\n"
+                "\n"
+                "To make this permanent, add to /etc/sysctl.d/99-userns.conf:\n"
+                "\n"
+                "  kernel.unprivileged_userns_clone=1\n");
+        } else {
+            fprintf(stderr,
+                "\n"
+                "Unprivileged user namespaces appear to be disabled on this system.\n"
+                "This may be a kernel configuration or security policy restriction.\n");
         }
+    } else if (err == -RMP_ERR_IDMAP && is_apparmor_restricting()) {
+        print_apparmor_help();
+    }
 
-        free(abs);
+    fprintf(stderr, "remapper: failed to set up %s\n",
+            err == -RMP_ERR_MOUNT ? "bind mounts" : "namespace");
+}
+
+/*** --snapshot / --reset: known-good targets *****/
+//
+// remapper --snapshot <name> <target-dir>
+// remapper --reset <name> <target-dir> [<mapping>... -- <program> [args...]]
+//
+// A snapshot lives inside the target dir, so it is on the same
+// filesystem and every file can be a reflink of the one it was taken
+// from; on btrfs, a target that is a subvolume gets a subvolume
+// snapshot.  A reset syncs the target back: files whose size and mtime
+// still match are not touched, so resetting a lightly-used target costs
+// about a directory walk.  Before a launch it runs ahead of the scan,
+// so targets the snapshot doesn't have are created empty as usual.
+
+static void print_sync_stats(const char *what, const rmp_sync_stats_t *st, double ms) {
+    fprintf(stderr, "remapper: %s: %ld file(s) (%ld reflinked), %lld bytes, removed %ld"
+            " in %.1f ms%s\n", what, st->files, st->reflinked, st->bytes, st->removed, ms,
+            st->failed ? ", some files failed" : "");
+}
+
+// Reset target to snapshot name.  Logged to the debug log, or to stderr
+// when it's all we're doing (verbose).  0 or -1, having said why.
+static int reset_target(const char *target, const char *name, int verbose) {
+    rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int r = rmp_snapshot_restore(target, name, 0, &st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    if (r != 0 && errno == ENOENT && st.files == 0 && st.failed == 0) {
+        fprintf(stderr, "remapper: %s: no snapshot '%s'\n", target, name);
+        return -1;
     }
 
-    return cmd_start;
+    char what[PATH_MAX + 64];
+    snprintf(what, sizeof(what), "reset %s to '%s'", target, name);
+    if (verbose || r != 0) print_sync_stats(what, &st, ms);
+    DEBUG("%s: %ld file(s), %lld bytes, removed %ld in %.1f ms",
+          what, st.files, st.bytes, st.removed, ms);
+    if (r != 0) fprintf(stderr, "remapper: reset failed: %s\n", strerror(errno));
+    return r;
 }
 
-/*** Glob resolution ******************************/
+static int snapshot_main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s %s <name> <target-dir>\n", argv[0], argv[1]);
+        return 1;
+    }
+    char *target = make_absolute(argv[3]);
+    int r;
+    if (strcmp(argv[1], "--reset") == 0) {
+        r = reset_target(target, argv[2], 1);
+    } else {
+        rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+        const char *method;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        r = rmp_snapshot_save(target, argv[2], 0, &st, &method);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        if (r == 0 && strcmp(method, "subvolume") == 0) {
+            fprintf(stderr, "remapper: snapshot '%s' of %s: subvolume snapshot in %.1f ms\n",
+                    argv[2], target, ms);
+        } else if (r == 0 || st.files || st.failed) {
+            char what[PATH_MAX + 64];
+            snprintf(what, sizeof(what), "snapshot '%s' of %s", argv[2], target);
+            print_sync_stats(what, &st, ms);
+        }
+        if (r != 0) fprintf(stderr, "remapper: snapshot failed: %s\n", strerror(errno));
+    }
+    free(target);
+    return r == 0 ? 0 : 1;
+}
+
+/*** --serve: zygote daemon ***********************/
+//
+// A cold launch pays for exec of remapper, the glob scan, unshare, the
+// uid/gid map writes and the bind mounts before the program runs.  With
+// --serve, that work is done once per profile (target dir + mappings) by
+// a "zygote": a child of the daemon that has entered its namespace, set
+// up the mounts, and then waits.  Launching is a fork of the zygote plus
+// the program's exec.
+//
+//   remapper --connect  --launch-->  daemon  --launch-->  zygote --fork--> program
+//                       <--pid/exit-         <--pid/exit-        (reaps it)
+//
+// All sockets are AF_UNIX SOCK_SEQPACKET.  A message is one packet of
+// NUL-terminated fields, the first being the verb:
+//
+//   client -> daemon   launch <target> <nmaps> <map>... <cwd> <argc> <argv>... <env>...
+//                        (+ the client's stdin/stdout/stderr via SCM_RIGHTS)
+//                      signal <signo>
+//   daemon -> client   pid <pid> | exit <wait status> | error <message>
+//   daemon -> zygote   launch <id> <cwd> <argc> <argv>... <env>... (+ fds)
+//                      kill <id> <signo> | quit
+//   zygote -> daemon   ready <mounts> | error <message>   (once, after setup)
+//                      pid <id> <pid> | exit <id> <wait status> | error <id> <message>
+//
+// Globs are resolved when a zygote starts, so each zygote is retired after
+// --zygote-ttl seconds and a fresh one built in its place; a retired
+// zygote stays up until its running programs exit.  A zygote builds its
+// namespace on its own while the daemon goes on serving: the one it
+// replaces takes launches until it reports ready, and launches for a
+// profile with none ready yet wait in the daemon.
+
+#define SERVE_MSG_MAX      (128 * 1024)
+#define SERVE_MAX_FIELDS   8192
+#define SERVE_MAX_PROFILES 32
+#define SERVE_MAX_ZYGOTES  64
+#define SERVE_MAX_CLIENTS  512
+#define SERVE_TTL_DEFAULT  60
+
+typedef struct {
+    char buf[SERVE_MSG_MAX];
+    size_t len;
+} msg_t;
 
-// Scan each pattern's parent directory and find entries matching the glob.
-// For each match, add a mount entry.
-static void resolve_globs(const pattern_t *patterns, int num_patterns,
-                          const char *target_dir) {
-    for (int i = 0; i < num_patterns; i++) {
-        const pattern_t *pat = &patterns[i];
+static void msg_init(msg_t *m) { m->len = 0; }
 
-        DEBUG("scanning '%s' for '%s'", pat->parent, pat->glob);
+static int msg_add(msg_t *m, const char *field) {
+    size_t n = strlen(field) + 1;
+    if (m->len + n > sizeof(m->buf)) return -1;
+    memcpy(m->buf + m->len, field, n);
+    m->len += n;
+    return 0;
+}
 
-        DIR *dp = opendir(pat->parent);
-        if (!dp) {
-            DEBUG("  opendir failed: %s", strerror(errno));
-            continue;
+static int msg_addl(msg_t *m, long v) {
+    char num[32];
+    snprintf(num, sizeof(num), "%ld", v);
+    return msg_add(m, num);
+}
+
+// Send one message, with up to 3 fds attached.
+static int msg_send(int sock, const msg_t *m, const int *fds, int nfds) {
+    struct iovec iov = { (void *)m->buf, m->len };
+    struct msghdr mh;
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (nfds > 0) {
+        memset(cbuf, 0, sizeof(cbuf));
+        mh.msg_control = cbuf;
+        mh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+    }
+    ssize_t n;
+    do n = sendmsg(sock, &mh, MSG_NOSIGNAL); while (n < 0 && errno == EINTR);
+    return n == (ssize_t)m->len ? 0 : -1;
+}
+
+// Send a message made of the given string fields (no fds).
+static int msg_sendv(int sock, int n, ...) {
+    msg_t *m = malloc(sizeof(*m));
+    if (!m) return -1;
+    msg_init(m);
+    va_list ap;
+    va_start(ap, n);
+    for (int i = 0; i < n; i++) msg_add(m, va_arg(ap, const char *));
+    va_end(ap);
+    int r = msg_send(sock, m, NULL, 0);
+    free(m);
+    return r;
+}
+
+// Receive one message and split it into fields.  Up to 3 attached fds are
+// returned in fds (close-on-exec); extras are closed.  Returns the number
+// of fields, 0 on EOF, -1 on error or a malformed message.
+static int msg_recv(int sock, msg_t *m, char **fields, int max_fields,
+                    int *fds, int *nfds) {
+    struct iovec iov = { m->buf, sizeof(m->buf) };
+    struct msghdr mh;
+    char cbuf[CMSG_SPACE(16 * sizeof(int))];
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+
+    ssize_t n;
+    do n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC); while (n < 0 && errno == EINTR);
+    if (nfds) *nfds = 0;
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int cnt = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *got = (int *)CMSG_DATA(c);
+        for (int i = 0; i < cnt; i++) {
+            if (fds && nfds && *nfds < 3) fds[(*nfds)++] = got[i];
+            else close(got[i]);
         }
+    }
 
-        struct dirent *ent;
-        while ((ent = readdir(dp)) != NULL) {
-            // Skip . and ..
-            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
-                continue;
+    if (n <= 0) return (int)n;
+    if ((mh.msg_flags & MSG_TRUNC) || m->buf[n - 1] != '\0') goto bad;
+    m->len = (size_t)n;
 
-            // Check if this entry matches the glob pattern
-            if (fnmatch(pat->glob, ent->d_name, 0) != 0)
-                continue;
+    int nf = 0;
+    for (size_t off = 0; off < m->len; off += strlen(m->buf + off) + 1) {
+        if (nf >= max_fields) goto bad;
+        fields[nf++] = m->buf + off;
+    }
+    return nf;
+
+bad:
+    for (int i = 0; nfds && i < *nfds; i++) close(fds[i]);
+    if (nfds) *nfds = 0;
+    errno = EPROTO;
+    return -1;
+}
 
-            // Build the full original path
-            char original[PATH_MAX];
-            snprintf(original, sizeof(original), "%s%s", pat->parent, ent->d_name);
+/*** --serve: zygote ******************************/
 
-            // stat to determine if it's a file or directory
-            struct stat sb;
-            if (stat(original, &sb) != 0) {
-                DEBUG("  stat failed for '%s': %s", original, strerror(errno));
-                continue;
+typedef struct {
+    long id;
+    pid_t pid;
+} zjob_t;
+
+// Fork and exec one program.  fields: launch <id> <cwd> <argc> <argv>... <env>...
+static pid_t zygote_launch(char **fields, int nf, const int *fds,
+                           const sigset_t *orig_mask) {
+    const char *cwd = fields[2];
+    int argc = atoi(fields[3]);
+    if (argc < 1 || 4 + argc > nf) { errno = EINVAL; return -1; }
+
+    char **args = calloc((size_t)argc + 1, sizeof(char *));
+    char **envp = calloc((size_t)(nf - 4 - argc) + 1, sizeof(char *));
+    if (!args || !envp) { free(args); free(envp); return -1; }
+    memcpy(args, &fields[4], (size_t)argc * sizeof(char *));
+    memcpy(envp, &fields[4 + argc], (size_t)(nf - 4 - argc) * sizeof(char *));
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The program gets the client's stdio and no controlling terminal
+        // of the daemon's; signals from the client arrive via "kill".
+        // Start from default dispositions, not whatever the daemon's
+        // own parent left ignored.
+        for (int sig = 1; sig < NSIG; sig++) signal(sig, SIG_DFL);
+        sigprocmask(SIG_SETMASK, orig_mask, NULL);
+        setsid();
+        for (int i = 0; i < 3; i++)
+            if (dup2(fds[i], i) < 0) _exit(127);
+        if (chdir(cwd) != 0) {
+            fprintf(stderr, "remapper: cannot chdir to %s: %s\n", cwd, strerror(errno));
+            _exit(127);
+        }
+        environ = envp;  // so execvp searches the client's PATH
+        execvp(args[0], args);
+        fprintf(stderr, "%s: %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+    int saved = errno;
+    free(args);
+    free(envp);
+    errno = saved;
+    return pid;
+}
+
+// Runs inside the namespace.  Serves launch/kill/quit from the daemon
+// until told to quit (or the daemon goes away) and no programs are left.
+static void zygote_main(int ctrl, const sigset_t *orig_mask) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    int sfd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sfd < 0) _exit(1);
+
+    static zjob_t jobs[SERVE_MAX_CLIENTS];
+    static msg_t m;
+    static char *fields[SERVE_MAX_FIELDS];
+    int njobs = 0, quitting = 0;
+    char num[2][32];
+
+    for (;;) {
+        if (quitting && njobs == 0) _exit(0);
+
+        struct pollfd pfd[2] = {
+            { sfd, POLLIN, 0 },
+            { ctrl, POLLIN, 0 },
+        };
+        if (poll(pfd, ctrl >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+
+        if (pfd[0].revents) {
+            struct signalfd_siginfo si;
+            while (read(sfd, &si, sizeof(si)) == sizeof(si)) {}
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                for (int i = 0; i < njobs; i++) {
+                    if (jobs[i].pid != pid) continue;
+                    if (ctrl >= 0) {
+                        snprintf(num[0], sizeof(num[0]), "%ld", jobs[i].id);
+                        snprintf(num[1], sizeof(num[1]), "%d", status);
+                        msg_sendv(ctrl, 3, "exit", num[0], num[1]);
+                    }
+                    jobs[i] = jobs[--njobs];
+                    break;
+                }
+            }
+        }
+
+        if (ctrl < 0 || !pfd[1].revents) continue;
+
+        int fds[3], nfds;
+        int nf = msg_recv(ctrl, &m, fields, SERVE_MAX_FIELDS, fds, &nfds);
+        if (nf <= 0) {
+            // Daemon gone: let the running programs finish, unreported
+            if (nf == 0 || errno != EPROTO) { close(ctrl); ctrl = -1; quitting = 1; }
+            continue;
+        }
+
+        if (strcmp(fields[0], "launch") == 0 && nf >= 4 && nfds == 3) {
+            pid_t pid = njobs < SERVE_MAX_CLIENTS
+                      ? zygote_launch(fields, nf, fds, orig_mask) : -1;
+            if (pid > 0) {
+                jobs[njobs].id = atol(fields[1]);
+                jobs[njobs].pid = pid;
+                njobs++;
+                snprintf(num[0], sizeof(num[0]), "%d", (int)pid);
+                msg_sendv(ctrl, 3, "pid", fields[1], num[0]);
+            } else {
+                msg_sendv(ctrl, 3, "error", fields[1],
+                          pid < 0 && njobs < SERVE_MAX_CLIENTS ? strerror(errno)
+                                                               : "too many programs");
             }
+        } else if (strcmp(fields[0], "kill") == 0 && nf == 3) {
+            long id = atol(fields[1]);
+            for (int i = 0; i < njobs; i++)
+                if (jobs[i].id == id) kill(jobs[i].pid, atoi(fields[2]));
+        } else if (strcmp(fields[0], "quit") == 0) {
+            quitting = 1;
+        }
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+    }
+}
+
+/*** --serve: daemon ******************************/
+
+typedef struct {
+    char *key;              // target "\n" mapping..., NULL = free slot
+    rmp_plan_t *plan;
+    int zygote;             // index into g_zygotes, -1 = none ready
+    int starting;           // one being built, -1 = none
+    time_t last_used;
+} profile_t;
+
+typedef struct {
+    pid_t pid;              // 0 = free slot
+    int ctrl;
+    int profile;
+    int ready;              // reported "ready"; before, still building
+    int retired;            // sent "quit"; only finishing running programs
+    time_t started;
+} zygote_t;
+
+typedef struct {
+    int fd;                 // -1 = free slot
+    long id;                // launch id, 0 = not launched yet
+    int zygote;
+    int profile;
+    msg_t *pending;         // a launch waiting for a zygote, or NULL
+    int pending_fds[3];
+} client_t;
+
+static profile_t g_profiles[SERVE_MAX_PROFILES];
+static zygote_t  g_zygotes[SERVE_MAX_ZYGOTES];
+static client_t  g_clients[SERVE_MAX_CLIENTS];
+static int  g_listen_fd = -1, g_signal_fd = -1;
+static long g_next_id = 1;
+static int  g_zygote_ttl = SERVE_TTL_DEFAULT;
+static sigset_t g_orig_mask;
+
+// Drop a launch still waiting for a zygote, with the stdio fds it holds
+static void client_unqueue(int c) {
+    client_t *cl = &g_clients[c];
+    if (!cl->pending) return;
+    for (int i = 0; i < 3; i++) close(cl->pending_fds[i]);
+    free(cl->pending);
+    cl->pending = NULL;
+}
+
+static void client_close(int c) {
+    client_unqueue(c);
+    close(g_clients[c].fd);
+    g_clients[c].fd = -1;
+}
+
+static void client_error(int c, const char *msg) {
+    DEBUG("serve: client %d: %s", c, msg);
+    msg_sendv(g_clients[c].fd, 2, "error", msg);
+    client_close(c);
+}
+
+// Close every fd above stderr except keep1 and keep2
+static void close_fds_except(int keep1, int keep2) {
+    DIR *dp = opendir("/proc/self/fd");
+    if (!dp) return;
+    int self = dirfd(dp);
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL) {
+        int fd = atoi(ent->d_name);
+        if (fd > 2 && fd != self && fd != keep1 && fd != keep2) close(fd);
+    }
+    closedir(dp);
+}
+
+// Start building a zygote for profile p: a child that resolves the
+// globs, creates the targets, enters its namespace and then reports
+// "ready".  Returns its index without waiting for that; zygote_ready()
+// hands it out.
+static int zygote_start(int p) {
+    profile_t *pr = &g_profiles[p];
+    if (pr->starting >= 0) return pr->starting;
+    int z;
+    for (z = 0; z < SERVE_MAX_ZYGOTES && g_zygotes[z].pid; z++) {}
+    if (z == SERVE_MAX_ZYGOTES) {
+        fprintf(stderr, "remapper: too many zygotes (max %d)\n", SERVE_MAX_ZYGOTES);
+        return -1;
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) return -1;
 
-            add_mount(original, target_dir, ent->d_name, S_ISDIR(sb.st_mode));
+    pid_t pid = fork();
+    if (pid < 0) { close(sv[0]); close(sv[1]); return -1; }
+    if (pid == 0) {
+        // Drop everything of the daemon's but our own control socket,
+        // including stdio fds of the client whose launch started us
+        close_fds_except(sv[1], g_debug_fp ? fileno(g_debug_fp) : -1);
+
+        int nmounts = rmp_plan_resolve(pr->plan);
+        if (nmounts < 0) {
+            msg_sendv(sv[1], 2, "error", rmp_last_error());
+            _exit(1);
+        }
+        if (nmounts == 0)
+            DEBUG("serve: no paths matched for %s — zygote runs unmapped",
+                  rmp_plan_target(pr->plan));
+        int r = rmp_plan_enter(pr->plan);
+        if (r < 0) {
+            report_enter_error(r);
+            msg_sendv(sv[1], 2, "error", rmp_last_error());
+            _exit(1);
         }
+        char num[32];
+        snprintf(num, sizeof(num), "%d", nmounts);
+        msg_sendv(sv[1], 2, "ready", num);
+        zygote_main(sv[1], &g_orig_mask);
+        _exit(0);
+    }
+    close(sv[1]);
+
+    g_zygotes[z].pid = pid;
+    g_zygotes[z].ctrl = sv[0];
+    g_zygotes[z].profile = p;
+    g_zygotes[z].ready = 0;
+    g_zygotes[z].retired = 0;
+    g_zygotes[z].started = time(NULL);
+    pr->starting = z;
+    DEBUG("serve: building zygote %d (pid %d) for %s", z, (int)pid,
+          rmp_plan_target(pr->plan));
+    return z;
+}
+
+// Stop handing out zygote z; it exits once its programs have.
+static void zygote_retire(int z) {
+    zygote_t *zg = &g_zygotes[z];
+    if (zg->retired) return;
+    zg->retired = 1;
+    if (g_profiles[zg->profile].zygote == z) g_profiles[zg->profile].zygote = -1;
+    if (g_profiles[zg->profile].starting == z) g_profiles[zg->profile].starting = -1;
+    msg_sendv(zg->ctrl, 1, "quit");
+    DEBUG("serve: retired zygote %d (pid %d)", z, (int)zg->pid);
+}
+
+// Fail the launches waiting on profile p's zygote
+static void profile_fail_pending(int p, const char *msg) {
+    for (int c = 0; c < SERVE_MAX_CLIENTS; c++)
+        if (g_clients[c].fd >= 0 && g_clients[c].pending && g_clients[c].profile == p)
+            client_error(c, msg);
+}
 
-        closedir(dp);
+// The zygote's control socket closed: it has exited (or crashed)
+static void zygote_reap(int z) {
+    zygote_t *zg = &g_zygotes[z];
+    for (int c = 0; c < SERVE_MAX_CLIENTS; c++)
+        if (g_clients[c].fd >= 0 && g_clients[c].id && g_clients[c].zygote == z)
+            client_error(c, "zygote exited");
+    profile_t *pr = &g_profiles[zg->profile];
+    if (!zg->retired && pr->zygote == z) pr->zygote = -1;
+    if (!zg->retired && pr->starting == z) {
+        // Never got ready: whoever waited on it fails, and a zygote past
+        // its TTL serves another TTL before the next try
+        pr->starting = -1;
+        if (pr->zygote >= 0) g_zygotes[pr->zygote].started = time(NULL);
+        else profile_fail_pending(zg->profile, "cannot start zygote");
     }
+    close(zg->ctrl);
+    waitpid(zg->pid, NULL, 0);
+    DEBUG("serve: zygote %d (pid %d) exited", z, (int)zg->pid);
+    zg->pid = 0;
 }
 
-/*** Target creation ******************************/
+// Find or create the profile for target + mappings
+static int profile_get(const char *target, char **maps, int nmaps) {
+    size_t klen = strlen(target) + 1;
+    for (int i = 0; i < nmaps; i++) klen += strlen(maps[i]) + 1;
+    char *key = malloc(klen);
+    if (!key) return -1;
+    char *p = stpcpy(key, target);
+    for (int i = 0; i < nmaps; i++) { *p++ = '\n'; p = stpcpy(p, maps[i]); }
+
+    int free_slot = -1;
+    for (int i = 0; i < SERVE_MAX_PROFILES; i++) {
+        if (!g_profiles[i].key) { if (free_slot < 0) free_slot = i; continue; }
+        if (strcmp(g_profiles[i].key, key) == 0) { free(key); return i; }
+    }
+    if (free_slot < 0) { free(key); return -1; }
+
+    profile_t *pr = &g_profiles[free_slot];
+    pr->plan = rmp_plan_new(target);
+    if (!pr->plan) { free(key); return -1; }
+    for (int i = 0; i < nmaps; i++)
+        rmp_plan_add_mapping(pr->plan, maps[i]);   // malformed ones are skipped
+    rmp_plan_set_debug(pr->plan, g_debug_fp);
+    pr->key = key;
+    pr->zygote = -1;
+    pr->starting = -1;
+    DEBUG("serve: new profile %d: %s (%d pattern(s))", free_slot, target,
+          rmp_plan_num_mappings(pr->plan));
+    return free_slot;
+}
+
+static void profile_free(int p) {
+    profile_t *pr = &g_profiles[p];
+    profile_fail_pending(p, "profile dropped");
+    if (pr->zygote >= 0) zygote_retire(pr->zygote);
+    if (pr->starting >= 0) zygote_retire(pr->starting);
+    DEBUG("serve: dropped idle profile %d: %s", p, rmp_plan_target(pr->plan));
+    free(pr->key);
+    rmp_plan_free(pr->plan);
+    memset(pr, 0, sizeof(*pr));
+}
 
-// For each mount entry, ensure the target path exists.
-// Directories are created with mkdir -p.  Files are created with open().
-static void create_targets(void) {
-    for (int i = 0; i < g_num_mounts; i++) {
-        mount_entry_t *m = &g_mounts[i];
+// Hand client c's waiting launch to its profile's ready zygote
+static void client_dispatch(int c) {
+    client_t *cl = &g_clients[c];
+    int z = g_profiles[cl->profile].zygote;
+    int ok = msg_send(g_zygotes[z].ctrl, cl->pending, cl->pending_fds, 3) == 0;
+    long id = atol(cl->pending->buf + strlen(cl->pending->buf) + 1);
+    client_unqueue(c);
+    if (!ok) { client_error(c, "cannot reach zygote"); return; }
+    cl->id = id;
+    cl->zygote = z;
+    DEBUG("serve: launch %ld on zygote %d", id, z);
+}
+
+// launch <target> <nmaps> <map>... <cwd> <argc> <argv>... <env>...
+static void client_launch(int c, char **fields, int nf, int *fds, int nfds) {
+    int nmaps = nf > 2 ? atoi(fields[2]) : -1;
+    int argc = nmaps >= 0 && 3 + nmaps + 1 < nf ? atoi(fields[3 + nmaps + 1]) : -1;
+    if (nfds != 3 || nmaps < 1 || argc < 1 || 3 + nmaps + 2 + argc > nf) {
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        client_error(c, "malformed launch request");
+        return;
+    }
+    const char *target = fields[1];
+    char **maps = &fields[3];
+    char **rest = &fields[3 + nmaps];   // cwd argc argv... env...
+    int nrest = nf - 3 - nmaps;
+
+    int p = profile_get(target, maps, nmaps);
+    if (p < 0) {
+        for (int i = 0; i < 3; i++) close(fds[i]);
+        client_error(c, "too many profiles");
+        return;
+    }
+    profile_t *pr = &g_profiles[p];
+    pr->last_used = time(NULL);
+
+    client_t *cl = &g_clients[c];
+    msg_t *m = malloc(sizeof(*m));
+    int ok = m != NULL;
+    if (ok) {
+        msg_init(m);
+        ok = msg_add(m, "launch") == 0 && msg_addl(m, g_next_id) == 0;
+        for (int i = 0; ok && i < nrest; i++) ok = msg_add(m, rest[i]) == 0;
+    }
+    if (!ok) {
+        free(m);
+        for (int i = 0; i < 3; i++) close(fds[i]);
+        client_error(c, "launch request too large");
+        return;
+    }
+    cl->pending = m;
+    memcpy(cl->pending_fds, fds, sizeof(cl->pending_fds));
+    cl->profile = p;
+    DEBUG("serve: launch %ld: %s", g_next_id, rest[2]);
+    g_next_id++;
+
+    // No zygote ready: wait for one, without holding up anyone else
+    if (pr->zygote >= 0)
+        client_dispatch(c);
+    else if (zygote_start(p) < 0)
+        client_error(c, "cannot start zygote");
+}
 
-        if (m->is_dir) {
-            mkdirs(m->target, 0755);
-            DEBUG("created target dir: %s", m->target);
+static void client_readable(int c) {
+    static msg_t m;
+    static char *fields[SERVE_MAX_FIELDS];
+    int fds[3], nfds;
+    int nf = msg_recv(g_clients[c].fd, &m, fields, SERVE_MAX_FIELDS, fds, &nfds);
+    client_t *cl = &g_clients[c];
+    char num[2][32];
+
+    if (nf <= 0) {
+        if (nf < 0 && errno == EPROTO) { client_error(c, "malformed request"); return; }
+        // Client hung up: the program loses its controlling client (one
+        // still waiting for a zygote is just dropped)
+        if (cl->id) {
+            snprintf(num[0], sizeof(num[0]), "%ld", cl->id);
+            snprintf(num[1], sizeof(num[1]), "%d", SIGHUP);
+            msg_sendv(g_zygotes[cl->zygote].ctrl, 3, "kill", num[0], num[1]);
+        }
+        client_close(c);
+        return;
+    }
+
+    if (strcmp(fields[0], "launch") == 0 && !cl->id && !cl->pending) {
+        client_launch(c, fields, nf, fds, nfds);
+        return;
+    }
+    for (int i = 0; i < nfds; i++) close(fds[i]);
+    if (strcmp(fields[0], "signal") == 0 && nf == 2 && cl->pending) {
+        // Nothing running to signal yet
+    } else if (strcmp(fields[0], "signal") == 0 && nf == 2 && cl->id) {
+        snprintf(num[0], sizeof(num[0]), "%ld", cl->id);
+        msg_sendv(g_zygotes[cl->zygote].ctrl, 3, "kill", num[0], fields[1]);
+    } else {
+        client_error(c, "unexpected request");
+    }
+}
+
+// Zygote z has built its namespace: it replaces the profile's current
+// one, and takes the launches that waited for it
+static void zygote_ready(int z, const char *nmounts) {
+    zygote_t *zg = &g_zygotes[z];
+    profile_t *pr = &g_profiles[zg->profile];
+    zg->ready = 1;
+    zg->started = time(NULL);
+    pr->starting = -1;
+    DEBUG("serve: zygote %d (pid %d) ready for %s, %s mount(s)",
+          z, (int)zg->pid, rmp_plan_target(pr->plan), nmounts);
+    if (pr->zygote >= 0) zygote_retire(pr->zygote);
+    pr->zygote = z;
+    for (int c = 0; c < SERVE_MAX_CLIENTS; c++)
+        if (g_clients[c].fd >= 0 && g_clients[c].pending && g_clients[c].profile == zg->profile)
+            client_dispatch(c);
+}
+
+static void zygote_readable(int z) {
+    static msg_t m;
+    char *fields[4];
+    int nf = msg_recv(g_zygotes[z].ctrl, &m, fields, 4, NULL, NULL);
+    if (nf <= 0) {
+        if (nf == 0 || errno != EPROTO) zygote_reap(z);
+        return;
+    }
+
+    // Setup's outcome: a failed one exits, and is reaped at EOF
+    if (!g_zygotes[z].ready) {
+        if (strcmp(fields[0], "ready") == 0 && nf == 2 && !g_zygotes[z].retired) {
+            zygote_ready(z, fields[1]);
+        } else if (strcmp(fields[0], "error") == 0 && nf == 2) {
+            fprintf(stderr, "remapper: %s\n", fields[1]);
+            if (g_profiles[g_zygotes[z].profile].starting == z)
+                profile_fail_pending(g_zygotes[z].profile, fields[1]);
+        }
+        return;
+    }
+    if (nf < 3) return;
+
+    long id = atol(fields[1]);
+    int c;
+    for (c = 0; c < SERVE_MAX_CLIENTS; c++)
+        if (g_clients[c].fd >= 0 && g_clients[c].id == id) break;
+    if (c == SERVE_MAX_CLIENTS) return;   // client already gone
+
+    if (strcmp(fields[0], "pid") == 0) {
+        msg_sendv(g_clients[c].fd, 2, "pid", fields[2]);
+    } else if (strcmp(fields[0], "exit") == 0) {
+        DEBUG("serve: launch %ld finished, status %s", id, fields[2]);
+        msg_sendv(g_clients[c].fd, 2, "exit", fields[2]);
+        client_close(c);
+    } else if (strcmp(fields[0], "error") == 0) {
+        client_error(c, fields[2]);
+    }
+}
+
+static void accept_client(void) {
+    int fd = accept4(g_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    // Same user only: the socket is 0600, but check anyway
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        cred.uid != getuid()) {
+        close(fd);
+        return;
+    }
+
+    for (int c = 0; c < SERVE_MAX_CLIENTS; c++) {
+        if (g_clients[c].fd >= 0) continue;
+        g_clients[c].fd = fd;
+        g_clients[c].id = 0;
+        g_clients[c].zygote = -1;
+        g_clients[c].pending = NULL;
+        return;
+    }
+    msg_sendv(fd, 2, "error", "too many clients");
+    close(fd);
+}
+
+// Rebuild zygotes past their TTL; drop profiles unused for ten TTLs.
+static void serve_housekeeping(void) {
+    time_t now = time(NULL);
+    for (int p = 0; p < SERVE_MAX_PROFILES; p++) {
+        profile_t *pr = &g_profiles[p];
+        if (!pr->key) continue;
+        if (now - pr->last_used > 10L * g_zygote_ttl) { profile_free(p); continue; }
+        // The old zygote serves until its replacement is ready
+        if (pr->zygote >= 0 && pr->starting < 0 &&
+            now - g_zygotes[pr->zygote].started >= g_zygote_ttl && zygote_start(p) < 0) {
+            fprintf(stderr, "remapper: cannot restart zygote for %s\n",
+                    rmp_plan_target(pr->plan));
+            g_zygotes[pr->zygote].started = now;
+        }
+    }
+}
+
+static int serve_main(int argc, char **argv) {
+    const char *sock_path = NULL;
+    const char *debug_log = getenv("RMP_DEBUG_LOG");
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            sock_path = argv[++i];
+        } else if (strcmp(argv[i], "--zygote-ttl") == 0 && i + 1 < argc) {
+            g_zygote_ttl = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--debug-log") == 0 && i + 1 < argc) {
+            debug_log = argv[++i];
         } else {
-            // Ensure parent directory exists
-            char parent[PATH_MAX];
-            strncpy(parent, m->target, sizeof(parent) - 1);
-            parent[sizeof(parent) - 1] = '\0';
-            char *slash = strrchr(parent, '/');
-            if (slash) {
-                *slash = '\0';
-                mkdirs(parent, 0755);
+            fprintf(stderr, "Usage: %s --serve <socket> [--zygote-ttl <secs>]"
+                            " [--debug-log <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!sock_path || g_zygote_ttl < 1) {
+        fprintf(stderr, "Usage: %s --serve <socket> [--zygote-ttl <secs>]"
+                        " [--debug-log <file>]\n", argv[0]);
+        return 1;
+    }
+    if (debug_log) {
+        g_debug_fp = fopen(debug_log, "we");
+        if (!g_debug_fp) g_debug_fp = stderr;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "remapper: socket path too long: %s\n", sock_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, sock_path);
+
+    g_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (g_listen_fd < 0) { perror("socket"); return 1; }
+
+    // Refuse to steal the socket from a live daemon; replace a stale one
+    if (connect(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "remapper: already serving on %s\n", sock_path);
+        return 1;
+    }
+    close(g_listen_fd);
+    g_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    unlink(sock_path);
+
+    mode_t old_umask = umask(077);
+    int r = bind(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+    if (r != 0 || listen(g_listen_fd, 64) != 0) {
+        fprintf(stderr, "remapper: cannot listen on %s: %s\n", sock_path, strerror(errno));
+        return 1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &g_orig_mask);
+    g_signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int c = 0; c < SERVE_MAX_CLIENTS; c++) g_clients[c].fd = -1;
+
+    DEBUG("serve: listening on %s (zygote ttl %ds)", sock_path, g_zygote_ttl);
+
+    static struct pollfd pfd[2 + SERVE_MAX_CLIENTS + SERVE_MAX_ZYGOTES];
+    static int owner[2 + SERVE_MAX_CLIENTS + SERVE_MAX_ZYGOTES];
+    for (;;) {
+        int n = 0;
+        pfd[n] = (struct pollfd){ g_signal_fd, POLLIN, 0 }; owner[n++] = 0;
+        pfd[n] = (struct pollfd){ g_listen_fd, POLLIN, 0 }; owner[n++] = 0;
+        for (int c = 0; c < SERVE_MAX_CLIENTS; c++)
+            if (g_clients[c].fd >= 0) {
+                pfd[n] = (struct pollfd){ g_clients[c].fd, POLLIN, 0 };
+                owner[n++] = 1 + c;
+            }
+        for (int z = 0; z < SERVE_MAX_ZYGOTES; z++)
+            if (g_zygotes[z].pid) {
+                pfd[n] = (struct pollfd){ g_zygotes[z].ctrl, POLLIN, 0 };
+                owner[n++] = -1 - z;
             }
 
-            // Create empty file if it doesn't exist (touch)
-            int fd = open(m->target, O_CREAT | O_WRONLY, 0644);
-            if (fd >= 0) {
-                close(fd);
-                DEBUG("created target file: %s", m->target);
+        if (poll(pfd, (nfds_t)n, 1000) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+
+        if (pfd[0].revents) {
+            struct signalfd_siginfo si;
+            int stop = 0;
+            while (read(g_signal_fd, &si, sizeof(si)) == sizeof(si))
+                if (si.ssi_signo != SIGCHLD) stop = 1;
+            if (stop) break;
+            // Zygotes are reaped when their control socket closes
+        }
+        if (pfd[1].revents) accept_client();
+
+        // Entries may have been closed by earlier handlers; skip those
+        for (int i = 2; i < n; i++) {
+            if (!pfd[i].revents) continue;
+            if (owner[i] > 0) {
+                int c = owner[i] - 1;
+                if (g_clients[c].fd == pfd[i].fd) client_readable(c);
             } else {
-                fprintf(stderr, "remapper: cannot create %s: %s\n",
-                        m->target, strerror(errno));
+                int z = -owner[i] - 1;
+                if (g_zygotes[z].pid && g_zygotes[z].ctrl == pfd[i].fd) zygote_readable(z);
             }
         }
+
+        serve_housekeeping();
     }
+
+    DEBUG("serve: shutting down");
+    unlink(sock_path);
+    for (int z = 0; z < SERVE_MAX_ZYGOTES; z++)
+        if (g_zygotes[z].pid) zygote_retire(z);
+    return 0;
 }
 
-/*** Namespace setup ******************************/
+/*** --connect: launch via a daemon ****************/
 
-// Write a single string to a file.  Used for /proc/self/uid_map etc.
-static int write_file(const char *path, const char *data) {
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) return -1;
-    ssize_t len = (ssize_t)strlen(data);
-    ssize_t written = write(fd, data, (size_t)len);
-    close(fd);
-    return (written == len) ? 0 : -1;
+static int g_sig_pipe[2] = { -1, -1 };
+
+static void forward_signal(int sig) {
+    unsigned char b = (unsigned char)sig;
+    int saved = errno;
+    if (write(g_sig_pipe[1], &b, 1) < 0) {}
+    errno = saved;
+}
+
+// remapper --connect <socket> [--debug-log <f>] <target-dir> <mapping>... -- <program> [args...]
+//
+// Arguments are parsed and made absolute here, where ~ and the cwd are
+// the caller's; the daemon only sees absolute paths.
+static int connect_main(int argc, char **argv) {
+    if (argc < 3) usage(argv[0]);
+    const char *sock_path = argv[2];
+
+    // Re-use parse_args on the arguments after the socket
+    char **args = malloc((size_t)(argc - 1) * sizeof(char *));
+    if (!args) { perror("malloc"); return 1; }
+    args[0] = argv[0];
+    for (int i = 3; i < argc; i++) args[i - 2] = argv[i];
+    int nargs = argc - 2;
+
+    rmp_plan_t *plan;
+    const char *debug_log;
+    int cmd_start = parse_args(nargs, args, &plan, &debug_log);
+    if (g_stage || g_watch || g_seccomp) {
+        // The zygote would have to stay behind to write back, watch or
+        // supervise; it doesn't
+        fprintf(stderr, "remapper: %s is not supported with --connect\n",
+                g_stage ? "--stage" : g_watch ? "--watch" : "--backend=seccomp");
+        return 1;
+    }
+    if (debug_log) {
+        g_debug_fp = fopen(debug_log, "we");
+        if (!g_debug_fp) g_debug_fp = stderr;
+    }
+    if (g_reset && reset_target(rmp_plan_target(plan), g_reset, 0) != 0) return 1;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) { perror("getcwd"); return 1; }
+
+    static msg_t m;
+    msg_init(&m);
+    int nmaps = rmp_plan_num_mappings(plan);
+    int ok = msg_add(&m, "launch") == 0 && msg_add(&m, rmp_plan_target(plan)) == 0 &&
+             msg_addl(&m, nmaps) == 0;
+    for (int i = 0; ok && i < nmaps; i++) ok = msg_add(&m, rmp_plan_mapping(plan, i)) == 0;
+    ok = ok && msg_add(&m, cwd) == 0 && msg_addl(&m, nargs - cmd_start) == 0;
+    for (int i = cmd_start; ok && i < nargs; i++) ok = msg_add(&m, args[i]) == 0;
+    for (char **e = environ; ok && *e; e++) ok = msg_add(&m, *e) == 0;
+    if (!ok) {
+        fprintf(stderr, "remapper: launch request too large (max %d bytes)\n", SERVE_MSG_MAX);
+        return 1;
+    }
+
+    // Pass our stdio; substitute /dev/null for any that are closed
+    int fds[3];
+    for (int i = 0; i < 3; i++) {
+        fds[i] = i;
+        if (fcntl(i, F_GETFD) < 0) fds[i] = open("/dev/null", O_RDWR | O_CLOEXEC);
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "remapper: cannot connect to %s: %s\n", sock_path, strerror(errno));
+        return 1;
+    }
+
+    if (pipe2(g_sig_pipe, O_CLOEXEC | O_NONBLOCK) != 0) { perror("pipe"); return 1; }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = forward_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+
+    if (msg_send(sock, &m, fds, 3) != 0) {
+        fprintf(stderr, "remapper: cannot send launch request: %s\n", strerror(errno));
+        return 1;
+    }
+
+    char *fields[4];
+    for (;;) {
+        struct pollfd pfd[2] = { { sock, POLLIN, 0 }, { g_sig_pipe[0], POLLIN, 0 } };
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+        if (pfd[1].revents) {
+            unsigned char b;
+            while (read(g_sig_pipe[0], &b, 1) == 1) {
+                char num[16];
+                snprintf(num, sizeof(num), "%d", b);
+                msg_sendv(sock, 2, "signal", num);
+            }
+        }
+        if (!pfd[0].revents) continue;
+
+        int nf = msg_recv(sock, &m, fields, 4, NULL, NULL);
+        if (nf <= 0) {
+            fprintf(stderr, "remapper: daemon closed the connection\n");
+            return 1;
+        }
+        if (strcmp(fields[0], "pid") == 0 && nf == 2) {
+            DEBUG("connect: running as pid %s", fields[1]);
+        } else if (strcmp(fields[0], "error") == 0 && nf == 2) {
+            fprintf(stderr, "remapper: %s\n", fields[1]);
+            return 1;
+        } else if (strcmp(fields[0], "exit") == 0 && nf == 2) {
+            int status = atoi(fields[1]);
+            if (WIFSIGNALED(status)) {
+                // Die the same way, so our caller sees what the program saw
+                signal(WTERMSIG(status), SIG_DFL);
+                raise(WTERMSIG(status));
+                return 128 + WTERMSIG(status);
+            }
+            return WEXITSTATUS(status);
+        }
+    }
+}
+
+/*** --cgroup: a cgroup per instance ***************/
+//
+// The cgroup remapper runs in is opened once, if it is ours to divide;
+// each instance then gets a child of it, "rmp-<our pid>-<n>", which the
+// program is started in (rmp_plan_set_cgroup) and which is removed once
+// it has exited and its pressure totals have been read.  Anything it
+// left running keeps the cgroup, and the cgroup stays.
+
+static int g_cg_base = -1;          // where instance cgroups go, or -1
+static int g_cg_controllers;        // RMP_CG_* enabled there
+static unsigned g_cg_count;
+
+static void cgroup_setup(void) {
+    double t0 = now_ms();
+    char why[PATH_MAX + 64];
+    g_cg_base = rmp_cgroup_open(&g_cg_limits, &g_cg_controllers, why, sizeof(why));
+    if (g_cg_base < 0)
+        DEBUG("cgroup: skipped: %s", why);
+    else
+        DEBUG("cgroup: instances go under %s (set up in %.3f ms)", why, now_ms() - t0);
+}
+
+// A cgroup for the next instance, its name in name; -1 if none
+static int cgroup_instance(char *name, size_t size) {
+    if (g_cg_base < 0) return -1;
+    snprintf(name, size, "rmp-%d-%u", (int)getpid(), g_cg_count++);
+    int cg = rmp_cgroup_create(g_cg_base, name, &g_cg_limits, g_cg_controllers);
+    if (cg < 0) DEBUG("cgroup: cannot create %s: %s", name, strerror(errno));
+    return cg;
+}
+
+// The instance's pressure stall totals as a JSON member,
+// "psi":{"cpu":{"some_us":..,"full_us":..},...}, or "" if it has none
+static void cgroup_psi(int cg, char *buf, size_t size) {
+    static const char *names[RMP_PSI_COUNT] = { "cpu", "memory", "io" };
+    long long psi[RMP_PSI_COUNT][2];
+    rmp_cgroup_pressure(cg, psi);
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < RMP_PSI_COUNT && len < size; i++) {
+        if (psi[i][0] < 0) continue;
+        len += (size_t)snprintf(buf + len, size - len, "%s\"%s\":{\"some_us\":%lld",
+                                len ? "," : "\"psi\":{", names[i], psi[i][0]);
+        if (len < size && psi[i][1] >= 0)
+            len += (size_t)snprintf(buf + len, size - len, ",\"full_us\":%lld", psi[i][1]);
+        if (len < size) len += (size_t)snprintf(buf + len, size - len, "}");
+    }
+    if (len && len < size) snprintf(buf + len, size - len, "}");
+    if (len >= size) buf[0] = '\0';
+}
+
+static void cgroup_remove(int cg, const char *name) {
+    close(cg);
+    if (rmp_cgroup_remove(g_cg_base, name) != 0)
+        DEBUG("cgroup: %s left behind: %s", name, strerror(errno));
 }
 
-// Enter a new user + mount namespace and set up UID/GID mappings.
+/*** --batch: many instances from one manifest ****/
 //
-// unshare(CLONE_NEWUSER) creates a new user namespace where this process
-// has full capabilities (including CAP_SYS_ADMIN for mounting).  No root
-// privileges are needed — the kernel allows any unprivileged user to create
-// a user namespace.
+// remapper --batch <manifest> [--jobs <n>] [--report <file>] [--shared-userns[=<file>]]
+//          [--cgroup[=<limits>]] [--debug-log <file>]
 //
-// unshare(CLONE_NEWNS) creates a private mount table.  Any mounts we make
-// are only visible to this process and its children.
+// One instance per manifest line, written like a command line:
 //
-// After unshare, we must write UID/GID mappings into /proc/self/uid_map and
-// /proc/self/gid_map so the kernel knows how to translate our real UID/GID
-// into the namespace.  Without this, we'd appear as "nobody" (65534).
+//   <target-dir> <mapping>... -- <program> [args...]
 //
-// We also write "deny" to /proc/self/setgroups, which is required by the
-// kernel before writing gid_map in an unprivileged user namespace (prevents
-// a process from granting itself supplementary groups it doesn't have).
-static int setup_namespace(void) {
-    uid_t uid = getuid();
-    gid_t gid = getgid();
-
-    // Create new user namespace + mount namespace in one call.
-    // CLONE_NEWUSER: new user namespace (gives us CAP_SYS_ADMIN inside it)
-    // CLONE_NEWNS:   new mount namespace (private mount table)
-    if (unshare(CLONE_NEWUSER | CLONE_NEWNS) != 0) {
-        int saved_errno = errno;
-        fprintf(stderr, "remapper: unshare(CLONE_NEWUSER | CLONE_NEWNS) failed: %s\n",
-                strerror(saved_errno));
-        if (saved_errno == EPERM) {
-            if (is_apparmor_restricting()) {
-                print_apparmor_help();
-            } else if (is_userns_disabled()) {
-                fprintf(stderr,
-                    "\n"
-                    "Unprivileged user namespaces are disabled on this system.\n"
-                    "To enable them, run:\n"
-                    "\n"
-                    "  sudo sysctl -w kernel.unprivileged_userns_clone=1\n"
-                    "\n"
-                    "To make this permanent, add to /etc/sysctl.d/99-userns.conf:\n"
-                    "\n"
-                    "  kernel.unprivileged_userns_clone=1\n");
-            } else {
-                fprintf(stderr,
-                    "\n"
-                    "Unprivileged user namespaces appear to be disabled on this system.\n"
-                    "This may be a kernel configuration or security policy restriction.\n");
+// Words split on whitespace, with '...' and "..." quoting and backslash
+// escapes; blank lines and lines starting with '#' are skipped.
+//
+// Instances with the same mappings share one scan of the parent dirs:
+// the first is resolved, the rest are rmp_plan_clone()s of it, and their
+// target trees are created in parallel.  Then every instance is spawned
+// into its own namespace, at most --jobs running at once, and a JSON
+// line is written for each as it exits.  With --shared-userns, its own
+// mount namespace only: all of them join the keeper's user namespace.
+// With --cgroup, each starts in a cgroup of its own, and its line has
+// the pressure stall time it saw there.
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+typedef struct {
+    int line;
+    char **words;           // NULL-terminated
+    int map_end;            // mappings are words[1 .. map_end)
+    int cmd;                // the program is words[cmd]
+    char *key;              // the mappings, '\n'-joined
+    rmp_plan_t *plan;
+    int cloned;             // plan copied from an earlier instance's
+    int pidfd;
+    pid_t pid;
+    int cg;                 // its cgroup (--cgroup), or -1
+    char cg_name[32];
+    double t_start, launch_ms;
+} instance_t;
+
+// Split a manifest line into a NULL-terminated array of malloc'd words.
+// Returns the count, or -1 on an unterminated quote.
+static int split_words(const char *line, char ***out) {
+    char *buf = malloc(strlen(line) + 1);
+    char **words = malloc(8 * sizeof(char *));
+    int n = 0, cap = 8;
+    const char *p = line;
+    if (!buf || !words) { perror("malloc"); exit(1); }
+
+    for (;;) {
+        while (*p && strchr(" \t\r\n", *p)) p++;
+        if (!*p) break;
+
+        size_t w = 0;
+        char quote = 0;
+        for (; *p && (quote || !strchr(" \t\r\n", *p)); p++) {
+            if (quote && *p == quote)
+                quote = 0;
+            else if (!quote && (*p == '\'' || *p == '"'))
+                quote = *p;
+            else if (*p == '\\' && quote != '\'' && p[1])
+                buf[w++] = *++p;
+            else
+                buf[w++] = *p;
+        }
+        if (quote) {
+            while (n > 0) free(words[--n]);
+            free(words);
+            free(buf);
+            return -1;
+        }
+
+        if (n + 1 == cap) {
+            cap *= 2;
+            words = realloc(words, (size_t)cap * sizeof(char *));
+            if (!words) { perror("realloc"); exit(1); }
+        }
+        words[n] = strndup(buf, w);
+        if (!words[n++]) { perror("strndup"); exit(1); }
+    }
+    words[n] = NULL;
+    free(buf);
+    *out = words;
+    return n;
+}
+
+// Read the manifest ("-" = stdin).  Exits with a line-numbered message
+// on malformed input.
+static instance_t *read_manifest(const char *path, int *count) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "re");
+    if (!fp) {
+        fprintf(stderr, "remapper: cannot open %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    instance_t *inst = NULL;
+    int n = 0, cap = 0, lineno = 0;
+    char *line = NULL;
+    size_t linecap = 0;
+    while (getline(&line, &linecap, fp) > 0) {
+        lineno++;
+        const char *s = line + strspn(line, " \t\r\n");
+        if (*s == '#' || !*s) continue;
+
+        char **words;
+        int nwords = split_words(s, &words);
+        if (nwords < 0) {
+            fprintf(stderr, "remapper: %s:%d: unterminated quote\n", path, lineno);
+            exit(1);
+        }
+
+        // Same shape as the command line: '--' may be left out with one mapping
+        int sep = -1;
+        for (int i = 1; i < nwords; i++)
+            if (strcmp(words[i], "--") == 0) { sep = i; break; }
+        int map_end = sep >= 0 ? sep : 2;
+        int cmd = sep >= 0 ? sep + 1 : 2;
+        if (map_end < 2 || cmd >= nwords) {
+            fprintf(stderr, "remapper: %s:%d: expected <target-dir> <mapping>..."
+                            " -- <program> [args...]\n", path, lineno);
+            exit(1);
+        }
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            inst = realloc(inst, (size_t)cap * sizeof(*inst));
+            if (!inst) { perror("realloc"); exit(1); }
+        }
+        instance_t *in = &inst[n++];
+        memset(in, 0, sizeof(*in));
+        in->line = lineno;
+        in->words = words;
+        in->map_end = map_end;
+        in->cmd = cmd;
+        in->pidfd = -1;
+
+        // Resolve ~ and relative paths against our cwd, as the CLI does
+        size_t klen = 1;
+        for (int i = 0; i < map_end; i++) {
+            char *abs = i ? absolute_mapping(words[i]) : make_absolute(words[i]);
+            free(words[i]);
+            words[i] = abs;
+            if (i > 0) klen += strlen(abs) + 1;
+        }
+        in->key = calloc(1, klen);
+        if (!in->key) { perror("calloc"); exit(1); }
+        for (int i = 1; i < map_end; i++) {
+            if (i > 1) strcat(in->key, "\n");
+            strcat(in->key, words[i]);
+        }
+    }
+    free(line);
+    if (fp != stdin) fclose(fp);
+    *count = n;
+    return inst;
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c == '\n')        fputs("\\n", out);
+        else if (c == '\t')        fputs("\\t", out);
+        else if (c < 0x20)         fprintf(out, "\\u%04x", c);
+        else                       fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+// One JSON line for a finished instance: a wait status, or the error
+// that kept it from starting.
+static void batch_report(FILE *out, const instance_t *in, int status, const char *error) {
+    fprintf(out, "{\"line\":%d,\"target\":", in->line);
+    json_string(out, rmp_plan_target(in->plan));
+    fputs(",\"program\":", out);
+    json_string(out, in->words[in->cmd]);
+    fprintf(out, ",\"launch_ms\":%.3f", in->launch_ms);
+    if (error) {
+        fputs(",\"error\":", out);
+        json_string(out, error);
+    } else {
+        fprintf(out, ",\"pid\":%d,\"run_ms\":%.3f", (int)in->pid,
+                now_ms() - in->t_start - in->launch_ms);
+        if (WIFSIGNALED(status))
+            fprintf(out, ",\"signal\":%d", WTERMSIG(status));
+        else
+            fprintf(out, ",\"exit\":%d", WEXITSTATUS(status));
+        char psi[512] = "";
+        if (in->cg >= 0) cgroup_psi(in->cg, psi, sizeof(psi));
+        if (*psi) fprintf(out, ",%s", psi);
+    }
+    fputs("}\n", out);
+    fflush(out);
+}
+
+static void create_targets_task(void *arg) {
+    rmp_plan_create_targets((const rmp_plan_t *)arg);
+}
+
+static void batch_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --batch <manifest> [--jobs <n>] [--report <file>]"
+                    " [--shared-userns[=<file>]] [--cgroup[=<limits>]]"
+                    " [--debug-log <file>]\n", prog);
+    exit(1);
+}
+
+static int batch_main(int argc, char **argv) {
+    const char *manifest = NULL, *report = NULL;
+    const char *debug_log = getenv("RMP_DEBUG_LOG");
+    int jobs = rmp_ncpus();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report = argv[++i];
+        } else if (strcmp(argv[i], "--debug-log") == 0 && i + 1 < argc) {
+            debug_log = argv[++i];
+        } else if (strcmp(argv[i], "--shared-userns") == 0) {
+            g_shared_userns = "";
+        } else if (strncmp(argv[i], "--shared-userns=", 16) == 0) {
+            g_shared_userns = argv[i] + 16;
+        } else if (strcmp(argv[i], "--cgroup") == 0) {
+            set_cgroup("");
+        } else if (strncmp(argv[i], "--cgroup=", 9) == 0) {
+            set_cgroup(argv[i] + 9);
+        } else {
+            batch_usage(argv[0]);
+        }
+    }
+    if (!manifest || jobs < 1) batch_usage(argv[0]);
+    if (debug_log) {
+        g_debug_fp = fopen(debug_log, "we");
+        if (!g_debug_fp) g_debug_fp = stderr;
+    }
+
+    int n;
+    instance_t *inst = read_manifest(manifest, &n);
+
+    FILE *out = stdout;
+    if (report && !(out = fopen(report, "we"))) {
+        fprintf(stderr, "remapper: cannot open %s: %s\n", report, strerror(errno));
+        return 1;
+    }
+
+    int nsfd = -1;
+    if (g_shared_userns &&
+        (nsfd = rmp_userns_open(*g_shared_userns ? g_shared_userns : NULL,
+                                SHARED_USERNS_IDLE)) < 0) {
+        report_enter_error(nsfd);
+        return 1;
+    }
+
+    // Resolve the first instance of each mapping set; clone the rest
+    double t0 = now_ms();
+    int groups = 0, clones = 0;
+    for (int i = 0; i < n; i++) {
+        instance_t *in = &inst[i];
+        const rmp_plan_t *base = NULL;
+        for (int j = 0; j < i && !base; j++)
+            if (strcmp(inst[j].key, in->key) == 0) base = inst[j].plan;
+
+        if (base) {
+            in->plan = rmp_plan_clone(base, in->words[0]);
+            in->cloned = 1;
+            clones++;
+        } else {
+            in->plan = rmp_plan_new(in->words[0]);
+            for (int m = 1; in->plan && m < in->map_end; m++) {
+                int r = rmp_plan_add_mapping(in->plan, in->words[m]);
+                if (r == -RMP_ERR_NOMEM) {
+                    perror("malloc");
+                    return 1;
+                }
+                // A malformed "=<target>" fails the batch, as on the command line
+                if (r == -RMP_ERR_INVAL && rmp_mapping_target(in->words[m], 0)) {
+                    fprintf(stderr, "remapper: %s:%d: %s\n", manifest, in->line,
+                            rmp_last_error());
+                    return 1;
+                }
             }
+            groups++;
+        }
+        if (!in->plan) {
+            fprintf(stderr, "remapper: line %d: %s\n", in->line, rmp_last_error());
+            return 1;
+        }
+        rmp_plan_set_debug(in->plan, g_debug_fp);
+        rmp_plan_set_userns(in->plan, nsfd);
+
+        if (!base && rmp_plan_resolve(in->plan) < 0) {
+            fprintf(stderr, "remapper: line %d: %s\n", in->line, rmp_last_error());
+            return 1;
         }
-        return -1;
     }
 
-    // Deny setgroups — required before writing gid_map in an unprivileged
-    // user namespace.  This prevents the process from calling setgroups()
-    // to grant itself supplementary groups it shouldn't have.
-    if (write_file("/proc/self/setgroups", "deny") != 0) {
-        // Some kernels don't have this file (pre-3.19); continue anyway
-        DEBUG("warning: could not write /proc/self/setgroups: %s", strerror(errno));
+    // Clones still need the empty files and dirs to mount over
+    if (clones > 0) {
+        rmp_pool_t *pool = rmp_pool_create(0);
+        for (int i = 0; i < n; i++) {
+            if (!inst[i].cloned) continue;
+            if (!pool || rmp_pool_submit(pool, create_targets_task, inst[i].plan) != 0)
+                rmp_plan_create_targets(inst[i].plan);
+        }
+        if (pool) rmp_pool_destroy(pool);
+    }
+    DEBUG("batch: %d instance(s), %d mapping set(s) scanned, prepared in %.1f ms",
+          n, groups, now_ms() - t0);
+    if (g_cgroup) cgroup_setup();
+
+    // Instances share our stdout and stderr, but not stdin
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+        close(devnull);
     }
 
-    // Map our real UID to UID 0 inside the namespace.
-    // Format: "<inner_uid> <outer_uid> <count>"
-    // This means: UID 0 inside the namespace corresponds to our real UID outside.
-    // We map to 0 because we need CAP_SYS_ADMIN (root) inside the namespace
-    // to perform bind mounts.
-    char uid_map[64];
-    snprintf(uid_map, sizeof(uid_map), "0 %u 1", uid);
-    if (write_file("/proc/self/uid_map", uid_map) != 0) {
-        fprintf(stderr, "remapper: failed to write uid_map: %s\n", strerror(errno));
-        if (is_apparmor_restricting()) {
-            print_apparmor_help();
+    struct pollfd *pfd = calloc((size_t)jobs, sizeof(*pfd));
+    int *running = calloc((size_t)jobs, sizeof(*running));
+    if (!pfd || !running) { perror("calloc"); return 1; }
+    int nrunning = 0, next = 0, done = 0, failed = 0, peak_userns = 0;
+
+    while (done < n) {
+        int started = 0;
+        while (nrunning < jobs && next < n) {
+            instance_t *in = &inst[next++];
+            in->t_start = now_ms();
+            in->cg = cgroup_instance(in->cg_name, sizeof(in->cg_name));
+            rmp_plan_set_cgroup(in->plan, in->cg);
+            in->pidfd = rmp_spawn(in->plan, &in->words[in->cmd], NULL, &in->pid);
+            in->launch_ms = now_ms() - in->t_start;
+            if (in->pidfd < 0) {
+                batch_report(out, in, 0, rmp_last_error());
+                if (in->cg >= 0) cgroup_remove(in->cg, in->cg_name);
+                failed++;
+                done++;
+                continue;
+            }
+            DEBUG("batch: line %d started as pid %d", in->line, (int)in->pid);
+            running[nrunning++] = (int)(in - inst);
+            started = 1;
+        }
+        if (nrunning == 0) continue;
+        if (started && g_debug_fp) {
+            int c = rmp_userns_count();
+            if (c > peak_userns) peak_userns = c;
+        }
+
+        for (int r = 0; r < nrunning; r++) {
+            pfd[r].fd = inst[running[r]].pidfd;
+            pfd[r].events = POLLIN;
+            pfd[r].revents = 0;
+        }
+        if (poll(pfd, (nfds_t)nrunning, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        for (int r = nrunning - 1; r >= 0; r--) {
+            if (!pfd[r].revents) continue;
+            instance_t *in = &inst[running[r]];
+            siginfo_t si;
+            memset(&si, 0, sizeof(si));
+            if (waitid((idtype_t)P_PIDFD, (id_t)in->pidfd, &si, WEXITED) != 0) continue;
+            close(in->pidfd);
+            int status = si.si_code == CLD_EXITED ? (si.si_status & 0xff) << 8
+                                                  : si.si_status & 0x7f;
+            batch_report(out, in, status, NULL);
+            if (in->cg >= 0) cgroup_remove(in->cg, in->cg_name);
+            if (status != 0) failed++;
+            done++;
+            running[r] = running[--nrunning];
         }
-        return -1;
     }
 
-    // Same for GID mapping.
-    char gid_map[64];
-    snprintf(gid_map, sizeof(gid_map), "0 %u 1", gid);
-    if (write_file("/proc/self/gid_map", gid_map) != 0) {
-        fprintf(stderr, "remapper: failed to write gid_map: %s\n", strerror(errno));
-        return -1;
+    DEBUG("batch: at most %d user namespace(s) in use besides ours (%s)",
+          peak_userns, nsfd >= 0 ? "shared" : "one per instance");
+    if (out != stdout) fclose(out);
+    return failed ? 1 : 0;
+}
+
+/*** --heatmap: which mapped files get used *******/
+//
+// inotify watches on each mount's target and every directory below it
+// see what the program does there, whichever path it used: IN_OPEN,
+// IN_ACCESS (reads; the kernel folds runs of them into one event),
+// IN_MODIFY, and IN_CREATE or IN_MOVED_TO for new entries.  They are
+// counted in an rmp_heat table under the path the program sees, and
+// written out hottest first when it exits.  remapper reads them as it
+// stays behind, so both backends are covered, and --watch's new mounts
+// are watched as they come; tmpfs targets are private to the namespace
+// and skipped.
+
+#define HEAT_MAX_PATHS  65536
+
+typedef struct {
+    char *path;             // the directory or file watched
+    char *shown;            // where the program sees it
+} heat_watch_t;
+
+static struct {
+    int fd;                 // inotify, or -1
+    rmp_heat_t *table;
+    heat_watch_t *watches;  // by watch descriptor
+    int num_watches;
+    int mounts;             // plan mounts watched so far
+    int full;               // out of inotify watches
+} g_heat = { -1, NULL, NULL, 0, 0, 0 };
+
+// Watch path, shown to the program as shown, and all directories below.
+// Each directory is read before it is watched, so our own reads of it
+// aren't counted as the program's.
+static void heat_watch(const char *path, const char *shown) {
+    if (g_heat.full) return;
+    char **subdirs = NULL;
+    int num_subdirs = 0;
+    DIR *d = opendir(path);
+    struct dirent *de;
+    while (d && (de = readdir(d)) != NULL) {
+        struct stat sb;
+        char sub[PATH_MAX];
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (de->d_type != DT_DIR && de->d_type != DT_UNKNOWN) continue;
+        if (de->d_type == DT_UNKNOWN &&
+            (snprintf(sub, sizeof(sub), "%s/%s", path, de->d_name) >= (int)sizeof(sub) ||
+             lstat(sub, &sb) != 0 || !S_ISDIR(sb.st_mode)))
+            continue;
+        char **grown = realloc(subdirs, (size_t)(num_subdirs + 1) * sizeof(*grown));
+        if (!grown || !(grown[num_subdirs] = strdup(de->d_name))) { perror("malloc"); exit(1); }
+        subdirs = grown;
+        num_subdirs++;
+    }
+    if (d) closedir(d);
+
+    int wd = inotify_add_watch(g_heat.fd, path, IN_OPEN | IN_ACCESS | IN_MODIFY |
+                               IN_CREATE | IN_MOVED_TO | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+    if (wd < 0 && errno == ENOSPC) {
+        g_heat.full = 1;
+        fprintf(stderr, "remapper: heatmap: out of inotify watches at %s"
+                " (see fs.inotify.max_user_watches); deeper paths go uncounted\n", shown);
+    }
+    if (wd >= g_heat.num_watches) {
+        int n = wd + 64;
+        heat_watch_t *w = realloc(g_heat.watches, (size_t)n * sizeof(*w));
+        if (!w) { perror("realloc"); exit(1); }
+        memset(w + g_heat.num_watches, 0, (size_t)(n - g_heat.num_watches) * sizeof(*w));
+        g_heat.watches = w;
+        g_heat.num_watches = n;
+    }
+    if (wd >= 0) {
+        heat_watch_t *w = &g_heat.watches[wd];
+        free(w->path);
+        free(w->shown);
+        if (!(w->path = strdup(path)) || !(w->shown = strdup(shown))) {
+            perror("strdup");
+            exit(1);
+        }
     }
 
-    DEBUG("namespace created: uid %u -> 0, gid %u -> 0", uid, gid);
-    return 0;
+    for (int i = 0; i < num_subdirs; i++) {
+        char sub[PATH_MAX], sub_shown[PATH_MAX];
+        if (wd >= 0 &&
+            snprintf(sub, sizeof(sub), "%s/%s", path, subdirs[i]) < (int)sizeof(sub) &&
+            snprintf(sub_shown, sizeof(sub_shown), "%s/%s", shown, subdirs[i]) <
+                (int)sizeof(sub_shown))
+            heat_watch(sub, sub_shown);
+        free(subdirs[i]);
+    }
+    free(subdirs);
+}
+
+// Watch the mounts the plan has gained since the last call
+static void heat_watch_mounts(const rmp_plan_t *plan) {
+    char source[PATH_MAX];
+    for (; g_heat.mounts < rmp_plan_num_mounts(plan); g_heat.mounts++) {
+        const char *original = rmp_plan_mount(plan, g_heat.mounts, source, sizeof(source));
+        if (*source) heat_watch(source, original);
+    }
+}
+
+// Read what inotify has queued; counted, or (during setup) dropped
+static void heat_drain(int count) {
+    char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(g_heat.fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                if (count) rmp_heat_lost(g_heat.table, 1);
+                continue;
+            }
+            if (ev->wd < 0 || ev->wd >= g_heat.num_watches) continue;
+            heat_watch_t *w = &g_heat.watches[ev->wd];
+            if (!w->path) continue;
+            if (ev->mask & IN_IGNORED) {
+                free(w->path);
+                free(w->shown);
+                w->path = w->shown = NULL;
+                continue;
+            }
+
+            char path[PATH_MAX], shown[PATH_MAX];
+            snprintf(path, sizeof(path), "%s%s%s", w->path, ev->len ? "/" : "",
+                     ev->len ? ev->name : "");
+            snprintf(shown, sizeof(shown), "%s%s%s", w->shown, ev->len ? "/" : "",
+                     ev->len ? ev->name : "");
+            int created = (ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0;
+            if ((ev->mask & IN_ISDIR) && created) heat_watch(path, shown);
+            // A directory's opens and reads come from its own watch too
+            if ((ev->mask & IN_ISDIR) && ev->len && !created) continue;
+            if (!count) continue;
+            int kind = created               ? RMP_HEAT_CREATE
+                     : ev->mask & IN_OPEN    ? RMP_HEAT_OPEN
+                     : ev->mask & IN_ACCESS  ? RMP_HEAT_READ
+                     : ev->mask & IN_MODIFY  ? RMP_HEAT_MODIFY : -1;
+            if (kind >= 0) rmp_heat_add(g_heat.table, shown, kind, 1);
+        }
+    }
+}
+
+// Before launching: watch every mount's target
+static void heat_begin(const rmp_plan_t *plan) {
+    double t0 = now_ms();
+    g_heat.table = rmp_heat_new(HEAT_MAX_PATHS);
+    g_heat.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (!g_heat.table || g_heat.fd < 0) {
+        fprintf(stderr, "remapper: heatmap: %s\n", strerror(errno));
+        exit(1);
+    }
+    heat_watch_mounts(plan);
+    heat_drain(0);      // our own walk
+    int watches = 0;
+    for (int i = 0; i < g_heat.num_watches; i++) watches += g_heat.watches[i].path != NULL;
+    DEBUG("heatmap: %d watch(es) on %d mount(s) in %.1f ms", watches, g_heat.mounts,
+          now_ms() - t0);
 }
 
-/*** Bind mounts **********************************/
+// After the program has exited: the last events, then the report
+static void heat_finish(void) {
+    heat_drain(1);
+    FILE *out = *g_heatmap ? fopen(g_heatmap, "we") : stderr;
+    if (!out || rmp_heat_write(g_heat.table, out) != 0)
+        fprintf(stderr, "remapper: heatmap: %s: %s\n", *g_heatmap ? g_heatmap : "stderr",
+                strerror(errno));
+    if (out && out != stderr) fclose(out);
+    close(g_heat.fd);
+    g_heat.fd = -1;
+}
 
-// Perform bind mounts: for each entry, mount the target path over the
-// original path.
+/*** --stage / --watch: stay behind as keeper ****/
 //
-// A bind mount (MS_BIND) makes a file or directory appear at a second
-// location in the filesystem tree.  Unlike symlinks, bind mounts are
-// transparent to applications — they see the mounted content as if it
-// were the original path.
+// rmp_plan_enter() has already built the namespace, ours as well as the
+// program's, so instead of exec'ing we fork it and stay behind:
+//   --stage    write back from the tmpfs copies every --checkpoint
+//              seconds while it runs, and once more after it exits
+//   --watch    mount the matches it creates, as inotify reports them
 //
-// Because we're inside a private mount namespace (from setup_namespace),
-// these mounts are completely invisible to other processes on the system.
-// When this process exits, the namespace is destroyed and the mounts
-// vanish automatically.
-static int perform_mounts(void) {
-    for (int i = 0; i < g_num_mounts; i++) {
-        mount_entry_t *m = &g_mounts[i];
-
-        // Ensure the original path exists as a mount point.
-        // Bind mounts require the target (mount point) to exist.
-        if (m->is_dir) {
-            mkdirs(m->original, 0755);
-        } else {
-            // For files, ensure parent exists and create an empty file
-            // if the original doesn't exist (so we have a mount point).
-            struct stat sb;
-            if (stat(m->original, &sb) != 0) {
-                char parent[PATH_MAX];
-                strncpy(parent, m->original, sizeof(parent) - 1);
-                parent[sizeof(parent) - 1] = '\0';
-                char *slash = strrchr(parent, '/');
-                if (slash) {
-                    *slash = '\0';
-                    mkdirs(parent, 0755);
-                }
-                int fd = open(m->original, O_CREAT | O_WRONLY, 0644);
-                if (fd >= 0) close(fd);
+// ^C and ^\ reach the program from the terminal on their own and are
+// ignored here, so the final write-back still happens; SIGTERM and
+// SIGHUP, which tend to be aimed at one pid, are passed on to it.
+
+static pid_t g_keeper_pid;
+
+static int g_cg = -1;               // the program's cgroup (--cgroup), or -1
+static char g_cg_name[32];
+
+static void run_finish(const rmp_plan_t *plan, const char *program, pid_t pid,
+                       int status);
+
+static void keeper_forward(int sig) {
+    if (g_keeper_pid > 0) kill(g_keeper_pid, sig);
+}
+
+static void keeper_signals(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+    sa.sa_handler = keeper_forward;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+}
+
+// Our exit status for the program's wait status
+static int keeper_exit(int status, int failed) {
+    if (WIFSIGNALED(status)) {
+        // Die the same way, so our caller sees what the program saw
+        signal(WTERMSIG(status), SIG_DFL);
+        raise(WTERMSIG(status));
+        return 128 + WTERMSIG(status);
+    }
+    // A clean exit whose changes were lost is not a clean exit
+    if (failed && WEXITSTATUS(status) == 0) return 1;
+    return WEXITSTATUS(status);
+}
+
+static int keeper_run(rmp_plan_t *plan, int watch_fd, char **cmd) {
+    keeper_signals();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        if (g_cg >= 0 && rmp_cgroup_enter(g_cg) != 0)
+            fprintf(stderr, "remapper: cgroup: %s\n", strerror(errno));
+        execvp(cmd[0], cmd);
+        perror(cmd[0]);
+        _exit(127);
+    }
+    g_keeper_pid = pid;
+    DEBUG("keeper: running %s as pid %d", cmd[0], (int)pid);
+
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    if (g_checkpoint_secs || watch_fd >= 0) pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+    if (g_checkpoint_secs && pidfd < 0)
+        fprintf(stderr, "remapper: stage: no pidfd_open (%s), checkpoints disabled\n",
+                strerror(errno));
+
+    rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+    int checkpoints = 0, sync_failed = 0, hot_added = 0, reaped = 0;
+    int status = 0;
+    double sync_ms = 0;
+    double next = now_ms() + g_checkpoint_secs * 1e3;
+    while (!reaped && (pidfd >= 0 || watch_fd >= 0)) {
+        // poll() skips negative fds
+        struct pollfd pfd[3] = { { pidfd, POLLIN, 0 }, { watch_fd, POLLIN, 0 },
+                                 { g_heat.fd, POLLIN, 0 } };
+        int timeout = -1;
+        if (pidfd < 0) {
+            timeout = 1000;     // no pidfd: look in on the program each second
+        } else if (g_checkpoint_secs) {
+            double wait = next - now_ms();
+            timeout = wait > 0 ? (int)wait : 0;
+        }
+        int r = poll(pfd, 3, timeout);
+        if (r < 0 && errno != EINTR) break;
+        if (r > 0 && pfd[0].revents) break;
+        if (r > 0 && pfd[2].revents) heat_drain(1);
+        if (pidfd < 0 && waitpid(pid, &status, WNOHANG) == pid) reaped = 1;
+        if (r > 0 && pfd[1].revents) {
+            int n = rmp_plan_watch_handle(plan);
+            if (n < 0) {
+                fprintf(stderr, "remapper: watch: %s\n", rmp_last_error());
+                watch_fd = -1;
+            } else {
+                hot_added += n;
+                if (n && g_heat.fd >= 0) heat_watch_mounts(plan);
             }
         }
+        if (pidfd >= 0 && g_checkpoint_secs && now_ms() >= next) {
+            double t0 = now_ms();
+            if (rmp_plan_sync(plan, &st) < 0) {
+                fprintf(stderr, "remapper: stage: checkpoint: %s\n", rmp_last_error());
+                sync_failed = 1;
+            }
+            checkpoints++;
+            sync_ms += now_ms() - t0;
+            next = now_ms() + g_checkpoint_secs * 1e3;
+        }
+    }
+    if (pidfd >= 0) close(pidfd);
 
-        // MS_BIND: create a bind mount — the target directory/file appears
-        //          at the original path location.
-        // MS_REC:  if the target is a directory, also bind-mount any
-        //          sub-mounts within it (recursive bind).
-        if (mount(m->target, m->original, NULL, MS_BIND | MS_REC, NULL) != 0) {
-            fprintf(stderr, "remapper: bind mount %s -> %s failed: %s\n",
-                    m->target, m->original, strerror(errno));
-            return -1;
+    while (!reaped && waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            status = 127 << 8;
+            break;
+        }
+    }
+    g_keeper_pid = 0;
+    if (watch_fd >= 0) DEBUG("watch: %d mount(s) hot-added", hot_added);
+
+    if (g_stage) {
+        double t0 = now_ms();
+        if (rmp_plan_sync(plan, &st) < 0) {
+            fprintf(stderr, "remapper: stage: %s\n", rmp_last_error());
+            sync_failed = 1;
         }
+        sync_ms += now_ms() - t0;
+        fprintf(stderr, "remapper: stage: wrote back %ld file(s), %lld bytes, removed %ld"
+                " in %.1f ms", st.files, st.bytes, st.removed, sync_ms);
+        if (checkpoints) fprintf(stderr, " over %d checkpoint(s) and exit", checkpoints);
+        fprintf(stderr, "%s\n", st.failed ? ", some files failed" : "");
+    }
+    run_finish(plan, cmd[0], pid, status);
+    return keeper_exit(status, sync_failed);
+}
 
-        DEBUG("mounted: %s -> %s", m->target, m->original);
+/*** --backend=seccomp: supervise, don't mount *****/
+//
+// The program's path syscalls stop in the kernel until we answer them,
+// so we stay behind until the program - and anything it left running,
+// which still has the filter - is gone: the listener reports POLLHUP.
+
+static int seccomp_run(rmp_plan_t *plan, char **cmd) {
+    int listener;
+    pid_t pid = rmp_seccomp_spawn(plan, cmd, NULL, &listener);
+    if (pid < 0) {
+        if (errno == ENOSYS)
+            fprintf(stderr, "remapper: --backend=seccomp needs seccomp user notification"
+                    " (Linux 5.14+ on x86_64 or aarch64)\n");
+        else if (errno == EINVAL)
+            fprintf(stderr, "remapper: --backend=seccomp can't do tmpfs mappings\n");
+        else
+            fprintf(stderr, "remapper: %s: %s\n", cmd[0], strerror(errno));
+        return errno == ENOENT ? 127 : 1;
     }
+    g_keeper_pid = pid;
+    keeper_signals();
+    DEBUG("seccomp: supervising %s as pid %d", cmd[0], (int)pid);
 
-    return 0;
+    int pidfd = -1;
+#ifdef SYS_pidfd_open
+    pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+    rmp_seccomp_stats_t st = {0, 0};
+    int status = 0, reaped = 0;
+    for (;;) {
+        struct pollfd pfd[3] = { { listener, POLLIN, 0 }, { pidfd, POLLIN, 0 },
+                                 { g_heat.fd, POLLIN, 0 } };
+        int r = poll(pfd, 3, pidfd < 0 && !reaped ? 1000 : -1);
+        if (r < 0 && errno != EINTR) break;
+        if (r > 0 && pfd[2].revents) heat_drain(1);
+        if (r > 0 && (pfd[0].revents & POLLIN) &&
+            rmp_seccomp_handle(plan, listener, &st) < 0) {
+            fprintf(stderr, "remapper: seccomp: %s\n", strerror(errno));
+            break;
+        }
+        if (!reaped && (pidfd < 0 || (r > 0 && pfd[1].revents)) &&
+            waitpid(pid, &status, WNOHANG) == pid) {
+            reaped = 1;
+            g_keeper_pid = 0;
+            if (pidfd >= 0) close(pidfd);
+            pidfd = -1;
+        }
+        if (r > 0 && (pfd[0].revents & (POLLHUP | POLLERR)) && !(pfd[0].revents & POLLIN))
+            break;
+    }
+    close(listener);
+    if (pidfd >= 0) close(pidfd);
+
+    while (!reaped && waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            status = 127 << 8;
+            break;
+        }
+    }
+    g_keeper_pid = 0;
+    DEBUG("seccomp: %ld call(s) trapped, %ld redirected", st.trapped, st.rewritten);
+    run_finish(plan, cmd[0], pid, status);
+    return keeper_exit(status, 0);
+}
+
+/*** --stats: account for the program's tree ******/
+//
+// Instead of exec'ing the program, remapper spawns it (clone3 with
+// CLONE_PIDFD, via rmp_spawn) and waits on the pidfd, as it does for
+// --heatmap and --cgroup; --stage, --watch and seccomp stay behind
+// anyway and report the same way.
+//
+// As a child subreaper we inherit whatever the program orphans, and
+// reap what has exited by the time the program does.  The kernel folds
+// a reaped child's rusage into RUSAGE_CHILDREN and its I/O counters into
+// our own /proc/self/io, so before/after differences of the two cover
+// the whole tree.  Descendants still running are neither waited for
+// nor counted.  Targets are measured by walking them: the mounts at
+// launch, plus any --watch added.
+
+typedef struct {
+    char *source;
+    long long files, bytes;
+} stats_target_t;
+
+static const char *g_io_keys[] = {
+    "rchar", "wchar", "syscr", "syscw", "read_bytes", "write_bytes",
+    "cancelled_write_bytes",
+};
+#define NUM_IO_KEYS (int)(sizeof(g_io_keys) / sizeof(g_io_keys[0]))
+
+static struct {
+    FILE *out;
+    double t0;
+    struct rusage ru;
+    long long io[NUM_IO_KEYS];
+    int have_io;
+    stats_target_t *targets;
+    int num_targets;
+} g_st;
+
+// Files (anything but a directory) and their bytes at name, below
+static void tree_usage(int at, const char *name, long long *files, long long *bytes) {
+    struct stat sb;
+    if (fstatat(at, name, &sb, AT_SYMLINK_NOFOLLOW) != 0) return;
+    if (!S_ISDIR(sb.st_mode)) {
+        (*files)++;
+        *bytes += sb.st_size;
+        return;
+    }
+    int fd = openat(at, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        tree_usage(dirfd(d), de->d_name, files, bytes);
+    }
+    closedir(d);
+}
+
+// /proc/self/io into io[], in g_io_keys order.  0, or -1 without
+// task I/O accounting.
+static int read_io(long long io[NUM_IO_KEYS]) {
+    FILE *fp = fopen("/proc/self/io", "re");
+    if (!fp) return -1;
+    char key[32];
+    long long v;
+    int found = 0;
+    while (fscanf(fp, "%31[^:]: %lld\n", key, &v) == 2)
+        for (int i = 0; i < NUM_IO_KEYS; i++)
+            if (strcmp(key, g_io_keys[i]) == 0) { io[i] = v; found++; }
+    fclose(fp);
+    return found == NUM_IO_KEYS ? 0 : -1;
+}
+
+static double tv_ms(const struct timeval *a, const struct timeval *b) {
+    return (a->tv_sec - b->tv_sec) * 1e3 + (a->tv_usec - b->tv_usec) / 1e3;
+}
+
+// Before launching: open the output, note the counters, measure targets
+static void stats_begin(const rmp_plan_t *plan) {
+    g_st.out = *g_stats ? fopen(g_stats, "we") : stderr;
+    if (!g_st.out) {
+        fprintf(stderr, "remapper: cannot open %s: %s\n", g_stats, strerror(errno));
+        exit(1);
+    }
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) != 0)
+        DEBUG("stats: not a subreaper (%s); orphans go uncounted", strerror(errno));
+
+    int n = rmp_plan_num_mounts(plan);
+    g_st.targets = calloc((size_t)(n ? n : 1), sizeof(*g_st.targets));
+    if (!g_st.targets) { perror("calloc"); exit(1); }
+    char source[PATH_MAX];
+    for (int i = 0; i < n; i++) {
+        rmp_plan_mount(plan, i, source, sizeof(source));
+        if (!*source) continue;     // tmpfs: gone with the namespace
+        stats_target_t *t = &g_st.targets[g_st.num_targets++];
+        if (!(t->source = strdup(source))) { perror("strdup"); exit(1); }
+        tree_usage(AT_FDCWD, source, &t->files, &t->bytes);
+    }
+    getrusage(RUSAGE_CHILDREN, &g_st.ru);
+    g_st.have_io = read_io(g_st.io) == 0;
+    g_st.t0 = now_ms();
+}
+
+// After the program has exited and been reaped: one JSON line, with
+// psi ("" or a "psi":{...} member) from its cgroup
+static void stats_finish(const rmp_plan_t *plan, const char *program, pid_t pid,
+                         int status, const char *psi) {
+    double wall = now_ms() - g_st.t0;
+    int orphans = 0;
+    while (waitpid(-1, NULL, WNOHANG) > 0) orphans++;
+
+    struct rusage ru;
+    long long io[NUM_IO_KEYS];
+    getrusage(RUSAGE_CHILDREN, &ru);
+    int have_io = g_st.have_io && read_io(io) == 0;
+
+    FILE *out = g_st.out;
+    fputs("{\"target\":", out);
+    json_string(out, rmp_plan_target(plan));
+    fputs(",\"program\":", out);
+    json_string(out, program);
+    fprintf(out, ",\"pid\":%d", (int)pid);
+    if (WIFSIGNALED(status))
+        fprintf(out, ",\"signal\":%d", WTERMSIG(status));
+    else
+        fprintf(out, ",\"exit\":%d", WEXITSTATUS(status));
+    fprintf(out, ",\"wall_ms\":%.3f,\"orphans_reaped\":%d", wall, orphans);
+    fprintf(out, ",\"rusage\":{\"user_ms\":%.3f,\"sys_ms\":%.3f,\"max_rss_kb\":%ld,"
+            "\"minor_faults\":%ld,\"major_faults\":%ld,\"voluntary_ctxsw\":%ld,"
+            "\"involuntary_ctxsw\":%ld}",
+            tv_ms(&ru.ru_utime, &g_st.ru.ru_utime), tv_ms(&ru.ru_stime, &g_st.ru.ru_stime),
+            ru.ru_maxrss, ru.ru_minflt - g_st.ru.ru_minflt, ru.ru_majflt - g_st.ru.ru_majflt,
+            ru.ru_nvcsw - g_st.ru.ru_nvcsw, ru.ru_nivcsw - g_st.ru.ru_nivcsw);
+    if (have_io) {
+        fputs(",\"io\":{", out);
+        for (int i = 0; i < NUM_IO_KEYS; i++)
+            fprintf(out, "%s\"%s\":%lld", i ? "," : "", g_io_keys[i], io[i] - g_st.io[i]);
+        fputc('}', out);
+    }
+    if (*psi) fprintf(out, ",%s", psi);
+
+    // Mounts --watch added since have no "before": all they hold is new
+    fputs(",\"targets\":[", out);
+    char source[PATH_MAX];
+    int first = 1;
+    for (int i = 0; i < rmp_plan_num_mounts(plan); i++) {
+        const char *original = rmp_plan_mount(plan, i, source, sizeof(source));
+        if (!*source) continue;
+        long long files0 = 0, bytes0 = 0, files = 0, bytes = 0;
+        for (int k = 0; k < g_st.num_targets; k++) {
+            if (strcmp(g_st.targets[k].source, source) != 0) continue;
+            files0 = g_st.targets[k].files;
+            bytes0 = g_st.targets[k].bytes;
+            break;
+        }
+        tree_usage(AT_FDCWD, source, &files, &bytes);
+        fputs(first ? "{\"path\":" : ",{\"path\":", out);
+        json_string(out, source);
+        fputs(",\"mapped\":", out);
+        json_string(out, original);
+        fprintf(out, ",\"files\":%lld,\"files_delta\":%lld,\"bytes\":%lld,"
+                "\"bytes_delta\":%lld}", files, files - files0, bytes, bytes - bytes0);
+        first = 0;
+    }
+    fputs("]}\n", out);
+    fflush(out);
+    if (out != stderr) fclose(out);
+}
+
+// After the program has exited, whoever stayed behind: the heatmap
+// (before --stats walks the targets), its pressure stall totals, the
+// --stats line, and its cgroup gone
+static void run_finish(const rmp_plan_t *plan, const char *program, pid_t pid,
+                       int status) {
+    if (g_heat.fd >= 0) heat_finish();
+    char psi[512] = "";
+    if (g_cg >= 0) {
+        cgroup_psi(g_cg, psi, sizeof(psi));
+        DEBUG("cgroup: %s: {%s}", g_cg_name, psi);
+    }
+    if (g_stats) stats_finish(plan, program, pid, status, psi);
+    if (g_cg >= 0) cgroup_remove(g_cg, g_cg_name);
+}
+
+// Spawn the program and wait for it, rather than becoming it
+static int spawn_run(rmp_plan_t *plan, char **cmd) {
+    pid_t pid;
+    int pidfd = rmp_spawn(plan, cmd, NULL, &pid);
+    if (pidfd < 0) {
+        if (pidfd == -RMP_ERR_EXEC) {
+            fprintf(stderr, "remapper: %s\n", rmp_last_error());
+            return 127;
+        }
+        report_enter_error(pidfd);
+        return 1;
+    }
+    g_keeper_pid = pid;
+    keeper_signals();
+
+    // Counting for --heatmap until the pidfd says it has exited
+    while (g_heat.fd >= 0) {
+        struct pollfd pfd[2] = { { pidfd, POLLIN, 0 }, { g_heat.fd, POLLIN, 0 } };
+        int r = poll(pfd, 2, -1);
+        if (r < 0 && errno != EINTR) break;
+        if (r > 0 && pfd[1].revents) heat_drain(1);
+        if (r > 0 && pfd[0].revents) break;
+    }
+
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    int status = 127 << 8;
+    for (;;) {
+        if (waitid((idtype_t)P_PIDFD, (id_t)pidfd, &si, WEXITED) == 0) {
+            status = si.si_code == CLD_EXITED ? (si.si_status & 0xff) << 8
+                                              : si.si_status & 0x7f;
+            break;
+        }
+        if (errno != EINTR) {
+            perror("waitid");
+            break;
+        }
+    }
+    close(pidfd);
+    g_keeper_pid = 0;
+    run_finish(plan, cmd[0], pid, status);
+    return keeper_exit(status, 0);
 }
 
 /*** Main *****************************************/
@@ -796,14 +2858,20 @@ int main(int argc, char **argv) {
         }
         return install_apparmor(self_path, argv[2]);
     }
-
-    char *target;
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0)
+        return serve_main(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "--connect") == 0)
+        return connect_main(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+        return batch_main(argc, argv);
+    if (argc >= 2 && (strcmp(argv[1], "--snapshot") == 0 ||
+                      (strcmp(argv[1], "--reset") == 0 && argc <= 4)))
+        return snapshot_main(argc, argv);
+
+    rmp_plan_t *plan;
     const char *debug_log;
-    pattern_t patterns[MAX_PATTERNS];
-    int num_patterns = 0;
 
-    int cmd_start = parse_args(argc, argv, &target, &debug_log,
-                               patterns, &num_patterns);
+    int cmd_start = parse_args(argc, argv, &plan, &debug_log);
 
     // Open debug log
     if (debug_log) {
@@ -811,54 +2879,89 @@ int main(int argc, char **argv) {
         if (!g_debug_fp) g_debug_fp = stderr;
     }
 
-    DEBUG("target: %s", target);
-    for (int i = 0; i < num_patterns; i++)
-        DEBUG("pattern[%d]: parent='%s' glob='%s'",
-              i, patterns[i].parent, patterns[i].glob);
+    rmp_plan_set_debug(plan, g_debug_fp);
+    if (g_reset && reset_target(rmp_plan_target(plan), g_reset, 0) != 0) return 1;
+
+    DEBUG("target: %s", rmp_plan_target(plan));
+    for (int i = 0; i < rmp_plan_num_mappings(plan); i++)
+        DEBUG("pattern[%d]: '%s'", i, rmp_plan_mapping(plan, i));
     DEBUG("command:");
     for (int i = cmd_start; i < argc; i++)
         DEBUG("  argv[%d] = '%s'", i - cmd_start, argv[i]);
 
-    // Step 1: Scan the filesystem to find entries matching our glob patterns.
+    // With --watch, start watching before the scan, so nothing created
+    // between the two is missed.
+    int watch_fd = -1;
+    if (g_watch && (watch_fd = rmp_plan_watch(plan)) < 0) {
+        fprintf(stderr, "remapper: %s\n", rmp_last_error());
+        return 1;
+    }
+
+    // Step 1: Scan the filesystem to find entries matching our glob patterns,
+    // and create the target files/directories so we have content to mount.
     // We enumerate matches BEFORE entering the namespace because the program
     // must have been run at least once to create its config files/dirs.
-    resolve_globs(patterns, num_patterns, target);
+    int num_mounts = rmp_plan_resolve(plan);
+    if (num_mounts < 0) {
+        fprintf(stderr, "remapper: %s\n", rmp_last_error());
+        return 1;
+    }
+    if (g_stats) stats_begin(plan);
+    if (g_heatmap) heat_begin(plan);
+    if (g_cgroup) {
+        cgroup_setup();
+        g_cg = cgroup_instance(g_cg_name, sizeof(g_cg_name));
+        rmp_plan_set_cgroup(plan, g_cg);
+    }
 
-    if (g_num_mounts == 0) {
+    if (g_seccomp) {
+        // Targets for what exists now, as for mounts; the rest on demand
+        DEBUG("%d existing match(es); redirecting by seccomp", num_mounts);
+        return seccomp_run(plan, &argv[cmd_start]);
+    }
+
+    if (num_mounts == 0 && g_watch) {
+        DEBUG("no matching paths found yet — watching for them");
+    } else if (num_mounts == 0) {
         DEBUG("no matching paths found — executing without remapping");
         fprintf(stderr,
             "remapper: warning: no paths matched the given patterns.\n"
             "  Has the program been run at least once to create its config files?\n"
             "  Executing without remapping.\n");
+        if (g_stats || g_heatmap || g_cg >= 0) return spawn_run(plan, &argv[cmd_start]);
         execvp(argv[cmd_start], &argv[cmd_start]);
         perror(argv[cmd_start]);
         return 127;
     }
 
-    DEBUG("%d mount(s) to set up", g_num_mounts);
+    DEBUG("%d mount(s) to set up", num_mounts);
 
-    // Step 2: Create target files/directories so we have content to mount.
-    // If a target file doesn't exist yet, we create an empty one.
-    // If a target directory doesn't exist, we mkdir it.
-    create_targets();
-
-    // Step 3: Enter a new user + mount namespace.
-    // This gives us a private mount table and the ability to perform
-    // bind mounts without root privileges.
-    if (setup_namespace() != 0) {
-        fprintf(stderr, "remapper: failed to set up namespace\n");
-        return 1;
+    if (g_shared_userns) {
+        int nsfd = rmp_userns_open(*g_shared_userns ? g_shared_userns : NULL,
+                                   SHARED_USERNS_IDLE);
+        if (nsfd < 0) {
+            report_enter_error(nsfd);
+            return 1;
+        }
+        rmp_plan_set_userns(plan, nsfd);
+        DEBUG("user namespaces in use besides ours: %d", rmp_userns_count());
     }
-
-    // Step 4: Bind-mount each target path over the original.
-    // After this, any access to the original path (by this process or
-    // its children) will transparently see the target content instead.
-    if (perform_mounts() != 0) {
-        fprintf(stderr, "remapper: failed to set up bind mounts\n");
+    if ((g_stats || g_heatmap || g_cg >= 0) && !g_stage && !g_watch)
+        return spawn_run(plan, &argv[cmd_start]);
+
+    // Step 2: Enter a new user + mount namespace, which gives us a private
+    // mount table and the ability to bind mount without root, and
+    // bind-mount each target path over the original.  After this, any
+    // access to the original path (by this process or its children) will
+    // transparently see the target content instead.
+    int r = rmp_plan_enter(plan);
+    if (r < 0) {
+        report_enter_error(r);
         return 1;
     }
+    if (g_stage || g_watch) return keeper_run(plan, watch_fd, &argv[cmd_start]);
 
-    // Step 5: Exec the program.  It inherits our mount namespace, so it
+    // Step 3: Exec the program.  It inherits our mount namespace, so it
     // (and all its children) will see the remapped paths.
     DEBUG("exec: %s", argv[cmd_start]);
     execvp(argv[cmd_start], &argv[cmd_start]);
@@ -0,0 +1,316 @@
+/* rmp_cgroup.c - a cgroup v2 child per instance, with limits and
+ * pressure numbers, where the caller's cgroup is delegated
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Nothing here needs privilege: a cgroup is "delegated" to us when its
+ * directory and cgroup.procs are ours to write, as systemd arranges for
+ * user@.service and for units with Delegate=yes, and container runtimes
+ * for the container's root.  Then we may create children and move our
+ * own processes between them, and nothing else.
+ *
+ * cgroup v2 has one rule that shapes this: a cgroup can hand controllers
+ * (cpu, memory, io, cpuset) to its children only while it has no
+ * processes of its own.  Run from a shell, our cgroup holds the shell
+ * too, so instances get a cgroup each - pressure numbers still work -
+ * but no limits.  Run alone in a delegated scope (systemd-run --user
+ * --scope -p Delegate=yes remapper ...), we step into a child of our
+ * own first, which frees the scope to enable them.
+*/
+#define _GNU_SOURCE
+
+#include "rmp_cgroup.h"
+#include "rmp_shared.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+static const char *g_controllers[] = { "cpu", "memory", "io", "cpuset" };
+#define NUM_CONTROLLERS (int)(sizeof(g_controllers) / sizeof(g_controllers[0]))
+
+#define CPU_PERIOD 100000   // cpu.max period, the kernel's default
+
+/*** Limits ***************************************/
+
+int rmp_cgroup_parse(const char *spec, rmp_cgroup_limits_t *lim) {
+    memset(lim, 0, sizeof(*lim));
+    char buf[256];
+    if (strlen(spec) >= sizeof(buf)) goto bad;
+    snprintf(buf, sizeof(buf), "%s", spec);
+
+    char *save = NULL;
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (!value || !value[1]) goto bad;
+        *value++ = '\0';
+        char *end;
+        if (strcmp(item, "cpu") == 0) {
+            double pct = strtod(value, &end);
+            if (end == value || strcmp(end, "%") != 0 || pct <= 0 || pct > 1e6) goto bad;
+            // The kernel's floor is 1 ms per period
+            lim->cpu_quota = (long long)(pct * CPU_PERIOD / 100);
+            if (lim->cpu_quota < 1000) lim->cpu_quota = 1000;
+        } else if (strcmp(item, "memory") == 0) {
+            if ((lim->memory_high = rmp_parse_size(value)) <= 0) goto bad;
+        } else if (strcmp(item, "io") == 0) {
+            long w = strtol(value, &end, 10);
+            if (*end || w < 1 || w > 10000) goto bad;
+            lim->io_weight = (int)w;
+        } else if (strcmp(item, "cpus") == 0) {
+            if (strspn(value, "0123456789,-") != strlen(value) ||
+                strlen(value) >= sizeof(lim->cpus))
+                goto bad;
+            snprintf(lim->cpus, sizeof(lim->cpus), "%s", value);
+        } else {
+            goto bad;
+        }
+    }
+    return 0;
+
+bad:
+    errno = EINVAL;
+    return -1;
+}
+
+// RMP_CG_* bits for the controllers lim's limits need
+static int needed(const rmp_cgroup_limits_t *lim) {
+    return (lim->cpu_quota ? RMP_CG_CPU : 0) | (lim->memory_high ? RMP_CG_MEMORY : 0) |
+           (lim->io_weight ? RMP_CG_IO : 0) | (lim->cpus[0] ? RMP_CG_CPUSET : 0);
+}
+
+/*** Files ****************************************/
+
+static int read_at(int dir, const char *name, char *buf, size_t size) {
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return 0;
+}
+
+// Written in one write(2): cgroup files take a value per write
+static int write_at(int dir, const char *name, const char *value) {
+    int fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t len = (ssize_t)strlen(value);
+    ssize_t n = write(fd, value, (size_t)len);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return n == len ? 0 : -1;
+}
+
+// RMP_CG_* bits for a space-separated controller list
+static int controller_mask(const char *list) {
+    int mask = 0;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", list);
+    char *save = NULL;
+    for (char *w = strtok_r(buf, " \n", &save); w; w = strtok_r(NULL, " \n", &save))
+        for (int i = 0; i < NUM_CONTROLLERS; i++)
+            if (strcmp(w, g_controllers[i]) == 0) mask |= 1 << i;
+    return mask;
+}
+
+static int mask_at(int dir, const char *name) {
+    char buf[256];
+    return read_at(dir, name, buf, sizeof(buf)) == 0 ? controller_mask(buf) : 0;
+}
+
+/*** The caller's cgroup **************************/
+
+// Where our cgroup is: the cgroup2 mount plus our path from
+// /proc/self/cgroup ("0::/user.slice/...").  0, or -1 with errno set.
+static int own_cgroup(char *path, size_t size) {
+    char rel[PATH_MAX] = "";
+    FILE *fp = fopen("/proc/self/cgroup", "re");
+    if (!fp) return -1;
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), fp))
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(rel, sizeof(rel), "%s", line + 3);
+        }
+    fclose(fp);
+
+    // mountinfo: id parent dev root mountpoint options... - fstype ...
+    char mnt[PATH_MAX] = "", root[PATH_MAX] = "";
+    if (rel[0] == '/' && (fp = fopen("/proc/self/mountinfo", "re"))) {
+        char r[PATH_MAX], m[PATH_MAX];
+        while (fgets(line, sizeof(line), fp)) {
+            const char *sep = strstr(line, " - ");
+            if (!sep || strncmp(sep + 3, "cgroup2 ", 8) != 0) continue;
+            if (sscanf(line, "%*s %*s %*s %4095s %4095s", r, m) != 2) continue;
+            snprintf(root, sizeof(root), "%s", r);
+            snprintf(mnt, sizeof(mnt), "%s", m);
+            break;
+        }
+        fclose(fp);
+    }
+    if (!mnt[0]) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // A mount of a subtree (a container's) shows our path below its root
+    size_t rlen = strcmp(root, "/") == 0 ? 0 : strlen(root);
+    if (rlen && (strncmp(rel, root, rlen) != 0 || (rel[rlen] && rel[rlen] != '/'))) {
+        errno = ENOENT;
+        return -1;
+    }
+    const char *below = strcmp(rel + rlen, "/") == 0 ? "" : rel + rlen;
+    if (snprintf(path, size, "%s%s", mnt, below) >= (int)size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// Whether our process is the only one in the cgroup dir
+static int alone_in(int dir) {
+    char buf[256];
+    if (read_at(dir, "cgroup.procs", buf, sizeof(buf)) != 0) return 0;
+    long self = (long)getpid();
+    char *save = NULL;
+    for (char *w = strtok_r(buf, "\n", &save); w; w = strtok_r(NULL, "\n", &save))
+        if (atol(w) != self) return 0;
+    return 1;
+}
+
+// Ask for the controllers in mask for dir's children
+static int enable(int dir, int mask) {
+    char req[128] = "";
+    for (int i = 0; i < NUM_CONTROLLERS; i++)
+        if (mask & (1 << i)) {
+            strcat(req, req[0] ? " +" : "+");
+            strcat(req, g_controllers[i]);
+        }
+    return write_at(dir, "cgroup.subtree_control", req);
+}
+
+int rmp_cgroup_open(const rmp_cgroup_limits_t *lim, int *controllers,
+                    char *why, size_t size) {
+    *controllers = 0;
+    char path[PATH_MAX];
+    if (own_cgroup(path, sizeof(path)) != 0) {
+        snprintf(why, size, "no cgroup v2 hierarchy");
+        return -1;
+    }
+    int base = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (base < 0) {
+        snprintf(why, size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (faccessat(base, ".", W_OK, AT_EACCESS) != 0 ||
+        faccessat(base, "cgroup.procs", W_OK, AT_EACCESS) != 0) {
+        snprintf(why, size, "%s is not delegated to us", path);
+        close(base);
+        errno = EACCES;
+        return -1;
+    }
+
+    int want = needed(lim), avail = mask_at(base, "cgroup.controllers");
+    int todo = want & avail & ~mask_at(base, "cgroup.subtree_control");
+    if (todo && enable(base, todo) != 0 && errno == EBUSY && alone_in(base)) {
+        // Our own process is the one in the way: step aside into a child
+        if ((mkdirat(base, "rmp-supervisor", 0755) == 0 || errno == EEXIST)) {
+            int sup = openat(base, "rmp-supervisor", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (sup >= 0 && rmp_cgroup_enter(sup) == 0) enable(base, todo);
+            if (sup >= 0) close(sup);
+        }
+    }
+    *controllers = want & mask_at(base, "cgroup.subtree_control");
+    int len = snprintf(why, size, "%s", path);
+    for (int i = 0, first = 1; i < NUM_CONTROLLERS && len > 0 && (size_t)len < size; i++) {
+        if (!(want & ~*controllers & (1 << i))) continue;
+        len += snprintf(why + len, size - (size_t)len, "%s%s", first ? ", without " : " ",
+                        g_controllers[i]);
+        first = 0;
+    }
+    if (want != *controllers && len > 0 && (size_t)len < size)
+        snprintf(why + len, size - (size_t)len, " (%s)",
+                 want & ~avail ? "not available there" : "other processes share it");
+    return base;
+}
+
+/*** Instances ************************************/
+
+// Write a limit; a file the kernel doesn't have is skipped
+static int set_limit(int cg, const char *name, const char *value) {
+    if (write_at(cg, name, value) == 0) return 0;
+    return errno == ENOENT ? 0 : -1;
+}
+
+int rmp_cgroup_create(int base, const char *name, const rmp_cgroup_limits_t *lim,
+                      int controllers) {
+    if (mkdirat(base, name, 0755) != 0 && errno != EEXIST) return -1;
+    int cg = openat(base, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cg < 0) return -1;
+
+    char v[96];
+    int r = 0;
+    if (r == 0 && (controllers & RMP_CG_CPUSET) && lim->cpus[0])
+        r = set_limit(cg, "cpuset.cpus", lim->cpus);
+    if (r == 0 && (controllers & RMP_CG_CPU) && lim->cpu_quota) {
+        snprintf(v, sizeof(v), "%lld %d", lim->cpu_quota, CPU_PERIOD);
+        r = set_limit(cg, "cpu.max", v);
+    }
+    if (r == 0 && (controllers & RMP_CG_MEMORY) && lim->memory_high) {
+        snprintf(v, sizeof(v), "%lld", lim->memory_high);
+        r = set_limit(cg, "memory.high", v);
+    }
+    if (r == 0 && (controllers & RMP_CG_IO) && lim->io_weight) {
+        snprintf(v, sizeof(v), "default %d", lim->io_weight);
+        r = set_limit(cg, "io.weight", v);
+    }
+    if (r != 0) {
+        int saved = errno;
+        close(cg);
+        unlinkat(base, name, AT_REMOVEDIR);
+        errno = saved;
+        return -1;
+    }
+    return cg;
+}
+
+int rmp_cgroup_enter(int cg) {
+    return write_at(cg, "cgroup.procs", "0");
+}
+
+void rmp_cgroup_pressure(int cg, long long psi[RMP_PSI_COUNT][2]) {
+    static const char *files[RMP_PSI_COUNT] = { "cpu.pressure", "memory.pressure",
+                                                "io.pressure" };
+    for (int i = 0; i < RMP_PSI_COUNT; i++) {
+        psi[i][0] = psi[i][1] = -1;
+        // "some avg10=0.00 avg60=0.00 avg300=0.00 total=1234\nfull ..."
+        char buf[256];
+        if (read_at(cg, files[i], buf, sizeof(buf)) != 0) continue;
+        char *save = NULL;
+        for (char *line = strtok_r(buf, "\n", &save); line;
+             line = strtok_r(NULL, "\n", &save)) {
+            const char *total = strstr(line, "total=");
+            if (!total) continue;
+            if (strncmp(line, "some ", 5) == 0) psi[i][0] = atoll(total + 6);
+            else if (strncmp(line, "full ", 5) == 0) psi[i][1] = atoll(total + 6);
+        }
+    }
+}
+
+int rmp_cgroup_remove(int base, const char *name) {
+    return unlinkat(base, name, AT_REMOVEDIR);
+}
@@ -0,0 +1,68 @@
+// rmp_cgroup.h - a cgroup v2 child per instance, with limits and
+// pressure numbers, where the caller's cgroup is delegated (Linux)
+
+#ifndef RMP_CGROUP_H
+#define RMP_CGROUP_H
+
+#include <stddef.h>
+
+// Controllers a limit needs enabled in the parent's cgroup.subtree_control
+enum {
+    RMP_CG_CPU    = 1 << 0,    // cpu.max
+    RMP_CG_MEMORY = 1 << 1,    // memory.high
+    RMP_CG_IO     = 1 << 2,    // io.weight
+    RMP_CG_CPUSET = 1 << 3,    // cpuset.cpus
+};
+
+typedef struct {
+    long long cpu_quota;    // cpu.max microseconds per 100 ms period, 0 = unlimited
+    long long memory_high;  // memory.high bytes, 0 = unlimited
+    int io_weight;          // io.weight 1..10000, 0 = the default
+    char cpus[64];          // cpuset.cpus, e.g. "0-3,6"; "" = all
+} rmp_cgroup_limits_t;
+
+// Parse a comma-separated list of limits, any of
+//   cpu=<n>%       of one CPU (250% = two and a half)
+//   memory=<size>  bytes ("512m", "2g"), throttled above it
+//   io=<weight>    1..10000, relative to siblings (default 100)
+//   cpus=<list>    CPUs it may run on, e.g. "0-3,6"
+// "" sets none.  Returns 0, or -1 with errno EINVAL.
+int rmp_cgroup_parse(const char *spec, rmp_cgroup_limits_t *lim);
+
+// The cgroup to create instance cgroups in: the caller's own (cgroup
+// v2), when delegated to it, i.e. it can make children there and move
+// processes into them.  The controllers lim needs are enabled for the
+// children where available; if the caller's own process is in the way
+// (the no-internal-process rule) and is the only one there, it first
+// moves itself into an "rmp-supervisor" child.  *controllers gets the
+// RMP_CG_* enabled: limits for the others are skipped.
+//
+// Returns a dir fd (close-on-exec), with its path in why and the
+// controllers it lacks; or -1 with errno set and the reason in why: ENOENT if there is no cgroup v2 hierarchy, EACCES if the
+// cgroup isn't ours to divide.
+int rmp_cgroup_open(const rmp_cgroup_limits_t *lim, int *controllers,
+                    char *why, size_t size);
+
+// Create child name of base (from rmp_cgroup_open()) and set those of
+// lim's limits the controllers allow; a limit whose file the kernel
+// doesn't have (io.weight without an I/O scheduler that weighs) is
+// skipped.  Returns a dir fd for rmp_plan_set_cgroup() or
+// rmp_cgroup_enter(), or -1 with errno set.
+int rmp_cgroup_create(int base, const char *name, const rmp_cgroup_limits_t *lim,
+                      int controllers);
+
+// Move the calling process into the cgroup cg.  Only syscalls: safe
+// between fork and exec.  0, or -1 with errno set.
+int rmp_cgroup_enter(int cg);
+
+// Pressure stall time in cg since it was created, in microseconds:
+// psi[resource][0] for "some" and [1] for "full", resources in the
+// order below.  -1 where the kernel doesn't report one.
+enum { RMP_PSI_CPU, RMP_PSI_MEMORY, RMP_PSI_IO, RMP_PSI_COUNT };
+void rmp_cgroup_pressure(int cg, long long psi[RMP_PSI_COUNT][2]);
+
+// Remove child name of base once nothing runs in it.  0, or -1 with
+// errno (EBUSY: something the program started is still running).
+int rmp_cgroup_remove(int base, const char *name);
+
+#endif // RMP_CGROUP_H
@@ -0,0 +1,219 @@
+/* rmp_execcache.c - the macOS launcher's fast path: exec decisions per command
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Working out what to exec costs a launch far more than the exec: a
+ * PATH walk for codesign, another for the command, its shebang, and a
+ * codesign run or two for the hardened check, every time, even when
+ * nothing changed.  An entry keeps the outcome and the identity of
+ * every file it read, so a warm launch reads one small file, stats
+ * those, and execs.
+ *
+ * One file per key, named by its hash, under the launcher's config dir:
+ *
+ *   remapper-exec 1
+ *   key <key>
+ *   exec <path>                                 ("" = through $PATH)
+ *   arg <arg>                                   (num_args of them)
+ *   dep <dev> <ino> <mtime> <nsec> <size> <path>
+ *   cached <dep> <stamp> <path>                 (if it execs a copy)
+ *
+ * The key line guards against hash collisions.  Written to a temporary
+ * and renamed into place, like the re-signed copies.
+*/
+#include "rmp_execcache.h"
+#include "rmp_shared.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define MAGIC "remapper-exec 1"
+
+static void entry_file(const char *dir, const char *key, char *out, size_t size) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    snprintf(out, size, "%s/%016llx", dir, (unsigned long long)h);
+}
+
+static void fill_dep(rmp_exec_dep_t *d, const struct stat *sb) {
+    d->dev = sb->st_dev;
+    d->ino = sb->st_ino;
+    d->mtime_sec = (long long)sb->st_mtime;
+#ifdef __APPLE__
+    d->mtime_nsec = sb->st_mtimespec.tv_nsec;
+#else
+    d->mtime_nsec = sb->st_mtim.tv_nsec;
+#endif
+    d->size = sb->st_size;
+}
+
+int rmp_execcache_dep(rmp_exec_entry_t *e, const char *path) {
+    for (int i = 0; i < e->num_deps; i++)
+        if (strcmp(e->deps[i].path, path) == 0) return i;
+    if (e->num_deps == RMP_EXEC_MAX_DEPS) {
+        errno = ENOSPC;
+        return -1;
+    }
+    struct stat sb;
+    if (strlen(path) >= sizeof(e->deps[0].path) || stat(path, &sb) != 0) return -1;
+    rmp_exec_dep_t *d = &e->deps[e->num_deps];
+    strcpy(d->path, path);
+    fill_dep(d, &sb);
+    return e->num_deps++;
+}
+
+static int unchanged(const rmp_exec_dep_t *d) {
+    struct stat sb;
+    rmp_exec_dep_t now;
+    if (stat(d->path, &sb) != 0) return 0;
+    fill_dep(&now, &sb);
+    return now.dev == d->dev && now.ino == d->ino && now.mtime_sec == d->mtime_sec &&
+           now.mtime_nsec == d->mtime_nsec && now.size == d->size;
+}
+
+// Copy the rest of a line (its '\n' gone) into a field
+static int field(char *out, size_t size, const char *s) {
+    size_t len = strlen(s);
+    if (len >= size) return -1;
+    memcpy(out, s, len + 1);
+    return 0;
+}
+
+static int parse(FILE *fp, const char *key, rmp_exec_entry_t *e) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int ok = 0, keyed = 0, have_exec = 0;
+    memset(e, 0, sizeof(*e));
+
+    while ((n = getline(&line, &cap, fp)) > 0) {
+        if (line[n - 1] != '\n') break;     // cut off: not ours
+        line[n - 1] = '\0';
+        if (!ok) {
+            if (strcmp(line, MAGIC) != 0) break;
+            ok = 1;
+        } else if (strncmp(line, "key ", 4) == 0) {
+            keyed = strcmp(line + 4, key) == 0;
+        } else if (strncmp(line, "exec ", 5) == 0) {
+            if (field(e->exec_path, sizeof(e->exec_path), line + 5) < 0) break;
+            have_exec = 1;
+        } else if (strncmp(line, "arg ", 4) == 0) {
+            if (e->num_args == RMP_EXEC_MAX_ARGS ||
+                field(e->args[e->num_args++], sizeof(e->args[0]), line + 4) < 0) break;
+        } else if (strncmp(line, "dep ", 4) == 0) {
+            if (e->num_deps == RMP_EXEC_MAX_DEPS) break;
+            rmp_exec_dep_t *d = &e->deps[e->num_deps++];
+            unsigned long long dev, ino;
+            long long size;
+            int at = 0;
+            if (sscanf(line + 4, "%llu %llu %lld %ld %lld %n", &dev, &ino, &d->mtime_sec,
+                       &d->mtime_nsec, &size, &at) != 5 || !at ||
+                field(d->path, sizeof(d->path), line + 4 + at) < 0) break;
+            d->dev = (dev_t)dev;
+            d->ino = (ino_t)ino;
+            d->size = (off_t)size;
+        } else if (strncmp(line, "cached ", 7) == 0) {
+            long long stamp;
+            int at = 0;
+            if (sscanf(line + 7, "%d %lld %n", &e->cached_dep, &stamp, &at) != 2 || !at ||
+                field(e->cached, sizeof(e->cached), line + 7 + at) < 0) break;
+            e->stamp = (time_t)stamp;
+        } else {
+            break;
+        }
+    }
+    int good = n < 0 && ok && keyed && have_exec && e->num_deps > 0 &&
+               (!e->cached[0] || (e->cached_dep >= 0 && e->cached_dep < e->num_deps));
+    free(line);
+    return good ? 0 : -1;
+}
+
+int rmp_execcache_lookup(const char *dir, const char *key, rmp_exec_entry_t *e) {
+    char path[PATH_MAX];
+    entry_file(dir, key, path, sizeof(path));
+    FILE *fp = fopen(path, "re");
+    if (!fp) return 0;
+    int r = parse(fp, key, e);
+    fclose(fp);
+    if (r < 0) return 0;
+
+    for (int i = 0; i < e->num_deps; i++)
+        if (!unchanged(&e->deps[i])) return 0;
+
+    // The copy itself: removed by --cache-gc, or re-signed for a
+    // different original since, and kept looking recently used
+    time_t now = time(NULL);
+    if (e->cached[0] && now - e->stamp >= RMP_CACHE_TOUCH_SECS) {
+        const rmp_exec_dep_t *d = &e->deps[e->cached_dep];
+        if (!rmp_cache_valid(e->cached, (time_t)d->mtime_sec, d->size)) return 0;
+        e->stamp = now;
+        rmp_execcache_store(dir, key, e);
+    }
+    return 1;
+}
+
+static int has_newline(const char *s) {
+    return strchr(s, '\n') != NULL;
+}
+
+int rmp_execcache_store(const char *dir, const char *key, const rmp_exec_entry_t *e) {
+    int bad = has_newline(key) || has_newline(e->exec_path) || has_newline(e->cached) ||
+              e->num_deps < 1 || e->num_args > RMP_EXEC_MAX_ARGS;
+    for (int i = 0; !bad && i < e->num_args; i++) bad = has_newline(e->args[i]);
+    for (int i = 0; !bad && i < e->num_deps; i++) bad = has_newline(e->deps[i].path);
+    if (bad) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char path[PATH_MAX], tmp[PATH_MAX + 32];
+    entry_file(dir, key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp, "we");
+    if (!fp && errno == ENOENT) {
+        rmp_mkdirs(dir, 0755);
+        fp = fopen(tmp, "we");
+    }
+    if (!fp) return -1;
+
+    fprintf(fp, MAGIC "\nkey %s\nexec %s\n", key, e->exec_path);
+    for (int i = 0; i < e->num_args; i++)
+        fprintf(fp, "arg %s\n", e->args[i]);
+    for (int i = 0; i < e->num_deps; i++) {
+        const rmp_exec_dep_t *d = &e->deps[i];
+        fprintf(fp, "dep %llu %llu %lld %ld %lld %s\n", (unsigned long long)d->dev,
+                (unsigned long long)d->ino, d->mtime_sec, d->mtime_nsec,
+                (long long)d->size, d->path);
+    }
+    if (e->cached[0])
+        fprintf(fp, "cached %d %lld %s\n", e->cached_dep, (long long)e->stamp, e->cached);
+
+    int r = fflush(fp) == 0 && !ferror(fp) ? 0 : -1;
+    if (fclose(fp) != 0) r = -1;
+    if (r == 0 && rename(tmp, path) != 0) r = -1;
+    if (r < 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+    }
+    return r;
+}
+
+void rmp_execcache_forget(const char *dir, const char *key) {
+    char path[PATH_MAX];
+    entry_file(dir, key, path, sizeof(path));
+    unlink(path);
+}
@@ -0,0 +1,63 @@
+// rmp_execcache.h - the macOS launcher's fast path: what it settled on
+// exec'ing for a command, reused while the files it read are unchanged
+
+#ifndef RMP_EXECCACHE_H
+#define RMP_EXECCACHE_H
+
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define RMP_EXEC_MAX_DEPS 4
+#define RMP_EXEC_MAX_ARGS 8
+
+// A file the decision depended on, as it was
+typedef struct {
+    char path[PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    long long mtime_sec;
+    long mtime_nsec;
+    off_t size;
+} rmp_exec_dep_t;
+
+typedef struct {
+    // What to exec: exec_path with args, then the command's own
+    // arguments.  "" exec_path = the command as given, through $PATH.
+    char exec_path[PATH_MAX];
+    int num_args;
+    char args[RMP_EXEC_MAX_ARGS][PATH_MAX];
+
+    int num_deps;
+    rmp_exec_dep_t deps[RMP_EXEC_MAX_DEPS];
+
+    // The re-signed copy (rmp_cache_path()) it execs, if any, of which
+    // dep; stamp = when the copy was last found valid
+    char cached[PATH_MAX];
+    int cached_dep;
+    time_t stamp;
+} rmp_exec_entry_t;
+
+// Record path as a dependency of e, as it is now.  Returns its index
+// (the existing one if path is already there), or -1 with errno set
+// (ENOSPC: RMP_EXEC_MAX_DEPS of them already).
+int rmp_execcache_dep(rmp_exec_entry_t *e, const char *path);
+
+// The entry for key (any string without newlines: the command and
+// whatever else its resolution depends on) in dir, into *e.  Returns 1
+// if there is one and every dependency is unchanged (dev, inode, mtime,
+// size), else 0.  An entry with a re-signed copy is checked against the
+// copy's .meta as rmp_cache_valid() does, at most once per
+// RMP_CACHE_TOUCH_SECS, which also keeps the copy's last use fresh for
+// --cache-gc.
+int rmp_execcache_lookup(const char *dir, const char *key, rmp_exec_entry_t *e);
+
+// Save e as the entry for key in dir (created if missing), replacing any
+// (atomically: concurrent launches read one or the other).  Returns 0,
+// or -1 with errno set (EINVAL: a newline in a string).
+int rmp_execcache_store(const char *dir, const char *key, const rmp_exec_entry_t *e);
+
+// Remove the entry for key, e.g. after its exec failed.
+void rmp_execcache_forget(const char *dir, const char *key);
+
+#endif // RMP_EXECCACHE_H
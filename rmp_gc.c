@@ -0,0 +1,313 @@
+/* rmp_gc.c - size-bounded garbage collection of the re-signed binary cache
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Cache layout (see rmp_cache_path / rmp_cache_create):
+ *
+ *   <cache_dir><original>              re-signed copy
+ *   <cache_dir><original>.meta         "<orig mtime> <orig size>"; its own
+ *                                      mtime is the entry's last use
+ *   <cache_dir><original>.tmp.<p>.<s>  in-flight (or abandoned) copy
+ *
+ * Pass 1 walks the tree in parallel, one pool task per directory, and
+ * deletes anything stale.  Pass 2 sorts the survivors by last use and
+ * evicts from the oldest end until the cache fits under the cap.
+*/
+#include "rmp_gc.h"
+#include "rmp_shared.h"
+#include "rmp_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char *path;          // cached copy
+    long long bytes;     // copy + sidecar, on disk
+    time_t last_use;     // sidecar mtime
+} gc_entry_t;
+
+typedef struct {
+    size_t cache_len;
+    time_t now;
+    FILE *debug_fp;
+    rmp_pool_t *pool;
+
+    pthread_mutex_t lock;  // guards everything below
+    gc_entry_t *entries;
+    size_t num_entries, cap_entries;
+    rmp_gc_stats_t stats;
+} gc_state_t;
+
+typedef struct {
+    gc_state_t *st;
+    char path[];
+} gc_task_t;
+
+#define GC_DEBUG(st, fmt, ...) do { \
+    if ((st)->debug_fp) { \
+        fprintf((st)->debug_fp, "[remapper] cache-gc: " fmt "\n", ##__VA_ARGS__); \
+        fflush((st)->debug_fp); \
+    } \
+} while (0)
+
+static long long disk_bytes(const struct stat *sb) {
+    return (long long)sb->st_blocks * 512;
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// Matches the "<name>.tmp.<pid>.<seq>" names used by atomic_write_file
+// and rmp_cache_create.
+static int is_temp_name(const char *name) {
+    const char *p = strstr(name, ".tmp.");
+    if (!p) return 0;
+    p += 5;
+    int dots = 0;
+    if (*p < '0' || *p > '9') return 0;
+    for (; *p; p++) {
+        if (*p == '.') dots++;
+        else if (*p < '0' || *p > '9') return 0;
+    }
+    return dots == 1;
+}
+
+// Remove an entry: sidecar first, so a concurrent rmp_cache_valid() sees
+// a miss rather than a sidecar pointing at nothing.
+static long long remove_entry(const char *cached) {
+    char meta[PATH_MAX];
+    snprintf(meta, sizeof(meta), "%s.meta", cached);
+
+    long long freed = 0;
+    struct stat sb;
+    if (lstat(meta, &sb) == 0 && unlink(meta) == 0)
+        freed += disk_bytes(&sb);
+    if (lstat(cached, &sb) == 0 && unlink(cached) == 0)
+        freed += disk_bytes(&sb);
+    return freed;
+}
+
+static void add_entry(gc_state_t *st, const char *path, long long bytes,
+                      time_t last_use) {
+    char *copy = strdup(path);
+    if (!copy) return;
+
+    pthread_mutex_lock(&st->lock);
+    if (st->num_entries == st->cap_entries) {
+        size_t cap = st->cap_entries ? st->cap_entries * 2 : 256;
+        gc_entry_t *grown = realloc(st->entries, cap * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&st->lock);
+            free(copy);
+            return;
+        }
+        st->entries = grown;
+        st->cap_entries = cap;
+    }
+    st->entries[st->num_entries++] = (gc_entry_t){ copy, bytes, last_use };
+    pthread_mutex_unlock(&st->lock);
+}
+
+// Decide the fate of one regular file found in the cache.
+static void examine_file(gc_state_t *st, const char *path, const char *name,
+                         const struct stat *sb) {
+    long long bytes = disk_bytes(sb);
+
+    if (is_temp_name(name)) {
+        int removed = 0;
+        if (st->now - sb->st_mtime >= RMP_GC_TMP_SECS && unlink(path) == 0) {
+            GC_DEBUG(st, "removed abandoned temp %s", path);
+            removed = 1;
+        }
+        pthread_mutex_lock(&st->lock);
+        st->stats.bytes_before += bytes;
+        if (removed) st->stats.removed_tmp++;
+        else         st->stats.bytes_after += bytes;
+        pthread_mutex_unlock(&st->lock);
+        return;
+    }
+
+    if (has_suffix(name, ".meta")) {
+        // Counted with its entry; only an orphan is dealt with here.
+        char cached[PATH_MAX];
+        snprintf(cached, sizeof(cached), "%.*s", (int)(strlen(path) - 5), path);
+        struct stat csb;
+        int removed = 0;
+        if (lstat(cached, &csb) != 0 && errno == ENOENT &&
+            st->now - sb->st_mtime >= RMP_GC_GRACE_SECS && unlink(path) == 0) {
+            GC_DEBUG(st, "removed orphaned sidecar %s", path);
+            removed = 1;
+        }
+        if (removed) {
+            pthread_mutex_lock(&st->lock);
+            st->stats.bytes_before += bytes;
+            st->stats.removed_tmp++;
+            pthread_mutex_unlock(&st->lock);
+        }
+        return;
+    }
+
+    // A cache entry.  Same criteria as rmp_cache_valid(), without the
+    // last-use refresh.
+    const char *original = path + st->cache_len;
+    char meta[PATH_MAX];
+    snprintf(meta, sizeof(meta), "%s.meta", path);
+
+    struct stat osb, msb;
+    time_t meta_mtime;
+    off_t meta_size;
+    int have_meta = (lstat(meta, &msb) == 0);
+    if (have_meta) bytes += disk_bytes(&msb);
+
+    const char *why = NULL;
+    if (!have_meta) {
+        // Fresh copies are renamed into place before their sidecar exists.
+        if (st->now - sb->st_ctime >= RMP_GC_GRACE_SECS) why = "no sidecar";
+    } else if (stat(original, &osb) != 0 || !S_ISREG(osb.st_mode)) {
+        why = "original gone";
+    } else if (rmp_cache_meta(path, &meta_mtime, &meta_size) != 0) {
+        why = "bad sidecar";
+    } else if (meta_mtime != osb.st_mtime || meta_size != osb.st_size) {
+        why = "original changed";
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->stats.scanned++;
+    st->stats.bytes_before += bytes;
+    pthread_mutex_unlock(&st->lock);
+
+    if (why) {
+        long long freed = remove_entry(path);
+        GC_DEBUG(st, "removed %s (%s)", path, why);
+        pthread_mutex_lock(&st->lock);
+        st->stats.removed_stale++;
+        st->stats.bytes_after += bytes - freed;
+        pthread_mutex_unlock(&st->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->stats.bytes_after += bytes;
+    pthread_mutex_unlock(&st->lock);
+
+    if (have_meta)
+        add_entry(st, path, bytes, msb.st_mtime);
+}
+
+static int submit_dir(gc_state_t *st, const char *path);
+
+static void scan_dir_task(void *arg) {
+    gc_task_t *task = arg;
+    gc_state_t *st = task->st;
+
+    DIR *dp = opendir(task->path);
+    if (!dp) {
+        GC_DEBUG(st, "opendir %s failed: %s", task->path, strerror(errno));
+        free(task);
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", task->path, ent->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+
+        if (ent->d_type == DT_DIR) {
+            submit_dir(st, path);
+            continue;
+        }
+        if (ent->d_type != DT_REG && ent->d_type != DT_UNKNOWN)
+            continue;
+
+        struct stat sb;
+        if (lstat(path, &sb) != 0) continue;
+        if (S_ISDIR(sb.st_mode))       submit_dir(st, path);
+        else if (S_ISREG(sb.st_mode))  examine_file(st, path, ent->d_name, &sb);
+    }
+
+    closedir(dp);
+    free(task);
+}
+
+static int submit_dir(gc_state_t *st, const char *path) {
+    size_t len = strlen(path);
+    gc_task_t *task = malloc(sizeof(*task) + len + 1);
+    if (!task) return -1;
+    task->st = st;
+    memcpy(task->path, path, len + 1);
+    if (rmp_pool_submit(st->pool, scan_dir_task, task) != 0) {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+static int by_last_use(const void *a, const void *b) {
+    const gc_entry_t *x = a, *y = b;
+    if (x->last_use != y->last_use) return x->last_use < y->last_use ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+int rmp_cache_gc(const char *cache_dir, long long max_bytes, int jobs,
+                 FILE *debug_fp, rmp_gc_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    struct stat sb;
+    if (stat(cache_dir, &sb) != 0 || !S_ISDIR(sb.st_mode))
+        return -1;
+
+    gc_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cache_len = strlen(cache_dir);
+    st.now = time(NULL);
+    st.debug_fp = debug_fp;
+    pthread_mutex_init(&st.lock, NULL);
+
+    st.pool = rmp_pool_create(jobs);
+    if (!st.pool) {
+        pthread_mutex_destroy(&st.lock);
+        return -1;
+    }
+
+    // Pass 1: parallel walk, dropping stale entries
+    int ret = submit_dir(&st, cache_dir);
+    rmp_pool_destroy(st.pool);
+
+    // Pass 2: LRU eviction down to the cap
+    if (ret == 0 && max_bytes > 0 && st.stats.bytes_after > max_bytes) {
+        qsort(st.entries, st.num_entries, sizeof(*st.entries), by_last_use);
+        for (size_t i = 0; i < st.num_entries &&
+                           st.stats.bytes_after > max_bytes; i++) {
+            long long freed = remove_entry(st.entries[i].path);
+            GC_DEBUG(&st, "evicted %s (last use %lds ago)", st.entries[i].path,
+                     (long)(st.now - st.entries[i].last_use));
+            st.stats.removed_lru++;
+            st.stats.bytes_after -= freed;
+        }
+    }
+
+    for (size_t i = 0; i < st.num_entries; i++)
+        free(st.entries[i].path);
+    free(st.entries);
+    pthread_mutex_destroy(&st.lock);
+
+    *stats = st.stats;
+    return ret;
+}
@@ -0,0 +1,38 @@
+// rmp_gc.h - size-bounded garbage collection of the re-signed binary cache
+
+#ifndef RMP_GC_H
+#define RMP_GC_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// Abandoned <entry>.tmp.<pid>.<seq> files older than this are removed.
+#define RMP_GC_TMP_SECS   3600
+
+// Entries younger than this are never touched: rmp_cache_create() renames
+// the binary into place before writing its .meta sidecar.
+#define RMP_GC_GRACE_SECS 60
+
+typedef struct {
+    long scanned;            // cache entries examined
+    long removed_stale;      // original gone/changed, or sidecar missing
+    long removed_lru;        // evicted to get under the size cap
+    long removed_tmp;        // abandoned temp files and orphaned sidecars
+    long long bytes_before;  // disk usage of the cache before/after
+    long long bytes_after;
+} rmp_gc_stats_t;
+
+// Walk `cache_dir` with `jobs` threads (<= 0 = one per CPU).  Drops every
+// entry that rmp_cache_valid() would reject for its original, then evicts
+// least-recently-used entries until the cache fits in `max_bytes`
+// (0 = no cap).
+//
+// Safe to run while processes are executing cached copies: entries are
+// unlinked, never truncated, so running images keep their inode, and a
+// concurrent lookup just sees a miss and rebuilds.
+//
+// Returns 0 on success, -1 if the cache could not be walked.
+int rmp_cache_gc(const char *cache_dir, long long max_bytes, int jobs,
+                 FILE *debug_fp, rmp_gc_stats_t *stats);
+
+#endif // RMP_GC_H
@@ -0,0 +1,126 @@
+/* rmp_glob.c - mapping globs with wildcards in any component, and '**'
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A glob is run as a small NFA over path components rather than over
+ * characters: state i means "component i matches next", and '**' is a
+ * state that loops on any name and can also be skipped.  With at most
+ * 31 components the live states are one word, so a step is a loop over
+ * set bits, and backtracking never happens however many '**' there are.
+ *
+ * The same step drives both users: the launcher's directory walk feeds
+ * it each entry's name and stops descending where the set goes empty,
+ * and rmp_glob_match() feeds it a path's components for the interposer
+ * and rmp_plan_rewrite().
+*/
+#include "rmp_glob.h"
+
+#include <string.h>
+#include <limits.h>
+#include <fnmatch.h>
+
+enum { SEG_LITERAL, SEG_PATTERN, SEG_ANY };
+
+size_t rmp_glob_split(const char *mapping, size_t len) {
+    size_t base = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (mapping[i] == '/') {
+            base = i + 1;
+        } else if (mapping[i] && strchr("*?[\\", mapping[i])) {
+            // The base ends before this component
+            return base;
+        }
+    }
+    return base;
+}
+
+int rmp_glob_compile(rmp_glob_t *g, char *buf) {
+    g->text = buf;
+    g->nseg = 0;
+    char *s = buf;
+    while (*s) {
+        char *end = strchr(s, '/');
+        if (end) *end = '\0';
+        if (*s) {
+            if (g->nseg == RMP_GLOB_MAX_SEGS || s - buf > UINT16_MAX) return -1;
+            g->off[g->nseg] = (uint16_t)(s - buf);
+            g->kind[g->nseg] = strcmp(s, "**") == 0 ? SEG_ANY
+                             : strpbrk(s, "*?[\\") ? SEG_PATTERN : SEG_LITERAL;
+            g->nseg++;
+        }
+        if (!end) break;
+        s = end + 1;
+    }
+    return g->nseg ? 0 : -1;
+}
+
+int rmp_glob_is_simple(const rmp_glob_t *g) {
+    return g->nseg == 1 && g->kind[0] != SEG_ANY;
+}
+
+// Add the states reachable by skipping '**' components
+static uint32_t closure(const rmp_glob_t *g, uint32_t states) {
+    for (int i = 0; i < g->nseg; i++)
+        if ((states & (1u << i)) && g->kind[i] == SEG_ANY) states |= 1u << (i + 1);
+    return states;
+}
+
+uint32_t rmp_glob_start(const rmp_glob_t *g) {
+    return closure(g, 1);
+}
+
+uint32_t rmp_glob_step(const rmp_glob_t *g, uint32_t states, const char *name) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+    uint32_t next = 0;
+    for (int i = 0; i < g->nseg; i++) {
+        if (!(states & (1u << i))) continue;
+        const char *seg = g->text + g->off[i];
+        switch (g->kind[i]) {
+        case SEG_ANY:
+            next |= 1u << i;
+            break;
+        case SEG_LITERAL:
+            if (strcmp(seg, name) == 0) next |= 1u << (i + 1);
+            break;
+        default:
+            if (fnmatch(seg, name, 0) == 0) next |= 1u << (i + 1);
+            break;
+        }
+    }
+    return closure(g, next);
+}
+
+int rmp_glob_accepts(const rmp_glob_t *g, uint32_t states) {
+    return (states >> g->nseg) & 1;
+}
+
+const char *rmp_glob_literal(const rmp_glob_t *g, uint32_t states) {
+    if (!states || (states & (states - 1))) return NULL;   // not exactly one
+    int i = __builtin_ctz(states);
+    return i < g->nseg && g->kind[i] == SEG_LITERAL ? g->text + g->off[i] : NULL;
+}
+
+size_t rmp_glob_match(const rmp_glob_t *g, const char *rest) {
+    char name[NAME_MAX + 1];
+    uint32_t states = rmp_glob_start(g);
+    const char *s = rest;
+    while (*s) {
+        size_t n = strcspn(s, "/");
+        if (n > NAME_MAX) return 0;
+        if (n > 0) {
+            memcpy(name, s, n);
+            name[n] = '\0';
+            states = rmp_glob_step(g, states, name);
+            if (!states) return 0;
+            if (rmp_glob_accepts(g, states)) return (size_t)(s + n - rest);
+        }
+        s += n;
+        if (*s) s++;
+    }
+    return 0;
+}
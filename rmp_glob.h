@@ -0,0 +1,67 @@
+// rmp_glob.h - mapping globs with wildcards in any component, and '**',
+// shared by the Linux launcher and the macOS interposer
+
+#ifndef RMP_GLOB_H
+#define RMP_GLOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Components a glob can have: its states fit one uint32_t, with a bit
+// to spare for "matched".
+#define RMP_GLOB_MAX_SEGS  31
+
+// Levels below a mapping's base that a walk for it goes down at most.
+// Only '**' can go deeper than the glob has components.
+#define RMP_GLOB_MAX_DEPTH 16
+
+// A glob split into its components, compiled in place: text holds them
+// NUL-terminated, back to back.  Each is matched as one of
+//   literal    compared with strcmp (no wildcard characters)
+//   pattern    fnmatch(3), e.g. ".claude*" or "proj-[0-9]"
+//   '**'       any number of whole components, none included
+typedef struct {
+    const char *text;
+    int nseg;
+    uint16_t off[RMP_GLOB_MAX_SEGS];
+    uint8_t kind[RMP_GLOB_MAX_SEGS];
+} rmp_glob_t;
+
+// Where a mapping splits into a literal base directory and its glob:
+// after the '/' that ends the last component before the first one with
+// a wildcard ('*', '?', '[' or '\'), or after the last '/' if none has
+// one.  "/home/u/src/*/.cache" -> "/home/u/src/" + "*/.cache".  Returns
+// the base length, including its '/'; 0 if len bytes hold no '/'.
+size_t rmp_glob_split(const char *mapping, size_t len);
+
+// Compile the glob in buf ("*/.cache", "**/node_modules"), rewriting
+// its '/'s to NULs.  g->text points at buf, which must outlive g.  Empty
+// components are dropped.  Returns 0, or -1 if nothing is left or it
+// has more than RMP_GLOB_MAX_SEGS components.
+int rmp_glob_compile(rmp_glob_t *g, char *buf);
+
+// Whether g is one component without '**': a single scan of the base,
+// as mappings always were.
+int rmp_glob_is_simple(const rmp_glob_t *g);
+
+// The glob as a matcher over one path component at a time.  A state
+// set is a bitmask of the components still to match next; start with
+// rmp_glob_start() and feed each name to rmp_glob_step().  An empty set
+// means nothing below can match (prune the walk); one that
+// rmp_glob_accepts() means the names so far match the whole glob.
+// "." and ".." never match.
+uint32_t rmp_glob_start(const rmp_glob_t *g);
+uint32_t rmp_glob_step(const rmp_glob_t *g, uint32_t states, const char *name);
+int rmp_glob_accepts(const rmp_glob_t *g, uint32_t states);
+
+// The one name that can move states on, if all that is left to match
+// next is a single literal component: a walk can look it up instead of
+// reading the whole directory.  NULL otherwise.
+const char *rmp_glob_literal(const rmp_glob_t *g, uint32_t states);
+
+// The length of the shortest run of whole components at the start of
+// rest ("proj/.cache/x" -> 11 for "*/.cache") that g matches, or 0 if
+// none does.  No allocation: safe in the interposer's hooks.
+size_t rmp_glob_match(const rmp_glob_t *g, const char *rest);
+
+#endif // RMP_GLOB_H
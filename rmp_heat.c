@@ -0,0 +1,264 @@
+/* rmp_heat.c - access counts per mapped path, for the --heatmap report
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The counting side runs inside the interposer's hooks, on whatever
+ * threads the program has, so it neither locks nor allocates: an open
+ * addressing table of twice max_paths slots, and the path strings in
+ * one arena handed out with an atomic bump.  A slot is claimed with a
+ * compare-and-swap on its hash and published with a flag once its
+ * string is in place; a thread that finds a slot claimed but not yet
+ * published just probes on, so two threads adding the same new path at
+ * once can end up with a slot each.  The report adds such twins back
+ * together, so they cost a slot and nothing else.
+ *
+ * Reports are plain text, so they read well and a later process can
+ * fold its counts into an earlier one's (rmp_heat_save, for the
+ * macOS side, where each process of the program keeps its own table).
+*/
+#include "rmp_heat.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+
+#define AVG_PATH 128    // arena bytes per path
+
+typedef struct {
+    _Atomic uint64_t hash;      // 0 = free
+    _Atomic int ready;          // str is in place
+    uint32_t off, len;          // the path, in the arena
+    _Atomic unsigned long n[RMP_HEAT_KINDS];
+} slot_t;
+
+struct rmp_heat {
+    slot_t *slots;
+    size_t mask;                // slots - 1
+    size_t max_paths;
+    _Atomic size_t used;
+    char *arena;
+    size_t arena_size;
+    _Atomic size_t arena_used;
+    _Atomic unsigned long lost;
+};
+
+// FNV-1a, never 0
+static uint64_t hash_path(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+rmp_heat_t *rmp_heat_new(size_t max_paths) {
+    if (max_paths < 1) max_paths = 1;
+    rmp_heat_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    size_t nslots = 2;
+    while (nslots < max_paths * 2) nslots <<= 1;
+    h->slots = calloc(nslots, sizeof(slot_t));
+    h->arena_size = max_paths * AVG_PATH;
+    h->arena = malloc(h->arena_size);
+    if (!h->slots || !h->arena) {
+        rmp_heat_free(h);
+        return NULL;
+    }
+    h->mask = nslots - 1;
+    h->max_paths = max_paths;
+    return h;
+}
+
+void rmp_heat_free(rmp_heat_t *h) {
+    if (!h) return;
+    free(h->slots);
+    free(h->arena);
+    free(h);
+}
+
+static int matches(const rmp_heat_t *h, slot_t *s, const char *path, size_t len) {
+    return atomic_load_explicit(&s->ready, memory_order_acquire) && s->len == len &&
+           memcmp(h->arena + s->off, path, len) == 0;
+}
+
+int rmp_heat_add(rmp_heat_t *h, const char *path, int kind, unsigned long n) {
+    if (kind < 0 || kind >= RMP_HEAT_KINDS) return 0;
+    size_t len = strlen(path);
+    uint64_t hash = hash_path(path, len);
+
+    for (size_t i = hash & h->mask, probes = 0; probes <= h->mask; probes++) {
+        slot_t *s = &h->slots[i];
+        uint64_t cur = atomic_load_explicit(&s->hash, memory_order_acquire);
+        if (cur == hash && matches(h, s, path, len)) {
+            atomic_fetch_add_explicit(&s->n[kind], n, memory_order_relaxed);
+            return 0;
+        }
+        if (cur != 0) {
+            i = (i + 1) & h->mask;
+            continue;
+        }
+
+        // A new path: room for it first, so a slot is never left unfilled
+        if (atomic_fetch_add(&h->used, 1) >= h->max_paths) break;
+        size_t off = atomic_fetch_add(&h->arena_used, len + 1);
+        if (off + len + 1 > h->arena_size) break;
+        uint64_t expected = 0;
+        while (!atomic_compare_exchange_strong(&s->hash, &expected, hash)) {
+            // Taken meanwhile: the next free slot will do
+            i = (i + 1) & h->mask;
+            s = &h->slots[i];
+            expected = 0;
+        }
+        memcpy(h->arena + off, path, len + 1);
+        s->off = (uint32_t)off;
+        s->len = (uint32_t)len;
+        atomic_store_explicit(&s->n[kind], n, memory_order_relaxed);
+        atomic_store_explicit(&s->ready, 1, memory_order_release);
+        return 0;
+    }
+    rmp_heat_lost(h, n);
+    return -1;
+}
+
+void rmp_heat_lost(rmp_heat_t *h, unsigned long n) {
+    atomic_fetch_add_explicit(&h->lost, n, memory_order_relaxed);
+}
+
+void rmp_heat_reset(rmp_heat_t *h) {
+    for (size_t i = 0; i <= h->mask; i++)
+        for (int k = 0; k < RMP_HEAT_KINDS; k++)
+            atomic_store_explicit(&h->slots[i].n[k], 0, memory_order_relaxed);
+    atomic_store_explicit(&h->lost, 0, memory_order_relaxed);
+}
+
+/*** Reports **************************************/
+
+#define HEADER "# remapper heatmap: "
+
+int rmp_heat_load(rmp_heat_t *h, FILE *fp) {
+    char line[PATH_MAX + 128];
+    int paths = 0, header = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        unsigned long lost;
+        if (strncmp(line, HEADER, strlen(HEADER)) == 0) {
+            header = 1;
+            const char *p = strstr(line, "event(s), ");
+            if (p && sscanf(p, "event(s), %lu lost", &lost) == 1) rmp_heat_lost(h, lost);
+            continue;
+        }
+        if (line[0] == '#' || !line[0]) continue;
+        unsigned long n[RMP_HEAT_KINDS];
+        int at = 0;
+        if (!header || sscanf(line, "%lu %lu %lu %lu %n", &n[0], &n[1], &n[2], &n[3], &at) != 4 ||
+            !line[at])
+            return -1;
+        for (int k = 0; k < RMP_HEAT_KINDS; k++)
+            if (n[k]) rmp_heat_add(h, line + at, k, n[k]);
+        paths++;
+    }
+    return header ? paths : -1;
+}
+
+typedef struct {
+    const char *path;
+    unsigned long n[RMP_HEAT_KINDS], total;
+} row_t;
+
+static int by_path(const void *a, const void *b) {
+    return strcmp(((const row_t *)a)->path, ((const row_t *)b)->path);
+}
+
+static int by_heat(const void *a, const void *b) {
+    const row_t *x = a, *y = b;
+    if (x->total != y->total) return x->total < y->total ? 1 : -1;
+    return strcmp(x->path, y->path);
+}
+
+int rmp_heat_write(const rmp_heat_t *h, FILE *fp) {
+    row_t *rows = malloc((h->mask + 1) * sizeof(*rows));
+    if (!rows) return -1;
+    size_t nrows = 0;
+    for (size_t i = 0; i <= h->mask; i++) {
+        slot_t *s = &h->slots[i];
+        if (!atomic_load_explicit(&s->ready, memory_order_acquire)) continue;
+        row_t *r = &rows[nrows++];
+        r->path = h->arena + s->off;
+        r->total = 0;
+        for (int k = 0; k < RMP_HEAT_KINDS; k++)
+            r->total += r->n[k] = atomic_load_explicit(&s->n[k], memory_order_relaxed);
+    }
+
+    // Twins (see above) next to each other, then added up
+    qsort(rows, nrows, sizeof(*rows), by_path);
+    size_t out = 0;
+    unsigned long events = 0;
+    for (size_t i = 0; i < nrows; i++) {
+        if (out && strcmp(rows[out - 1].path, rows[i].path) == 0) {
+            for (int k = 0; k < RMP_HEAT_KINDS; k++) rows[out - 1].n[k] += rows[i].n[k];
+            rows[out - 1].total += rows[i].total;
+        } else if (rows[i].total) {
+            rows[out++] = rows[i];
+        }
+        events += rows[i].total;
+    }
+    qsort(rows, out, sizeof(*rows), by_heat);
+
+    fprintf(fp, HEADER "%zu path(s), %lu event(s), %lu lost\n", out, events,
+            atomic_load_explicit(&h->lost, memory_order_relaxed));
+    fprintf(fp, "#%9s %10s %10s %10s  %s\n", "opens", "reads", "modifies", "creates", "path");
+    for (size_t i = 0; i < out; i++)
+        fprintf(fp, "%10lu %10lu %10lu %10lu  %s\n", rows[i].n[0], rows[i].n[1],
+                rows[i].n[2], rows[i].n[3], rows[i].path);
+    free(rows);
+    return fflush(fp) == 0 && !ferror(fp) ? 0 : -1;
+}
+
+int rmp_heat_save(rmp_heat_t *h, const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    FILE *fp = fdopen(fd, "r+");
+    if (!fp) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    flock(fd, LOCK_EX);
+
+    // Counts move into a table of their own, so that threads still
+    // counting here carry on into zeroed counters
+    rmp_heat_t *all = rmp_heat_new(h->max_paths * 2);
+    int r = -1;
+    if (all) {
+        rmp_heat_load(all, fp);
+        for (size_t i = 0; i <= h->mask; i++) {
+            slot_t *s = &h->slots[i];
+            if (!atomic_load_explicit(&s->ready, memory_order_acquire)) continue;
+            for (int k = 0; k < RMP_HEAT_KINDS; k++) {
+                unsigned long n = atomic_exchange(&s->n[k], 0);
+                if (n) rmp_heat_add(all, h->arena + s->off, k, n);
+            }
+        }
+        rmp_heat_lost(all, atomic_exchange(&h->lost, 0));
+        rewind(fp);
+        r = ftruncate(fd, 0) == 0 ? rmp_heat_write(all, fp) : -1;
+        rmp_heat_free(all);
+    }
+    int saved = errno;
+    fclose(fp);     // drops the lock
+    errno = saved;
+    return r;
+}
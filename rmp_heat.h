@@ -0,0 +1,57 @@
+// rmp_heat.h - access counts per mapped path, for the --heatmap report,
+// shared by the Linux launcher and the macOS interposer
+
+#ifndef RMP_HEAT_H
+#define RMP_HEAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// What happened to a path, one counter each
+enum {
+    RMP_HEAT_OPEN,      // opened
+    RMP_HEAT_READ,      // read (Linux) or looked up (macOS: stat, readlink, ...)
+    RMP_HEAT_MODIFY,    // written, truncated, renamed or removed
+    RMP_HEAT_CREATE,    // created, or renamed into place
+    RMP_HEAT_KINDS,
+};
+
+typedef struct rmp_heat rmp_heat_t;
+
+// A table for up to max_paths paths, all its memory allocated here:
+// nothing after this allocates, so rmp_heat_add() is safe in the
+// interposer's hooks.  NULL if out of memory.
+rmp_heat_t *rmp_heat_new(size_t max_paths);
+
+// Count n of kind for path.  Lock-free and safe from any number of
+// threads.  Returns 0, or -1 if the table is full (the counts go to
+// rmp_heat_lost()'s tally instead).
+int rmp_heat_add(rmp_heat_t *h, const char *path, int kind, unsigned long n);
+
+// Record n events that could not be attributed to a path (an inotify
+// queue overflow, a full table).
+void rmp_heat_lost(rmp_heat_t *h, unsigned long n);
+
+// Add the counts of a report written by rmp_heat_write() from fp.
+// Returns the number of paths read, or -1 if fp isn't such a report.
+int rmp_heat_load(rmp_heat_t *h, FILE *fp);
+
+// Write the report: a "#" header with the totals, then a line per path
+// with its counts, "<opens> <reads> <modifies> <creates> <path>",
+// hottest (most events) first.  Paths with no events are left out.
+// Returns 0, or -1 with errno set.
+int rmp_heat_write(const rmp_heat_t *h, FILE *fp);
+
+// Fold the counts into the report at path, under an flock(2) so that
+// processes finishing at once don't lose each other's, and zero them
+// here so that a later call doesn't count them twice.  Returns 0, or
+// -1 with errno set.
+int rmp_heat_save(rmp_heat_t *h, const char *path);
+
+// Zero every count, keeping the paths: what a forked child does, so
+// that it doesn't report its parent's counts again.
+void rmp_heat_reset(rmp_heat_t *h);
+
+void rmp_heat_free(rmp_heat_t *h);
+
+#endif // RMP_HEAT_H
@@ -0,0 +1,2138 @@
+/* rmp_launch.c - librmp: the Linux launcher as a reentrant library
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The steps remapper_linux.c used to run on process globals, now on a
+ * heap-allocated plan:
+ *
+ *   rmp_plan_resolve   scan each mapping's parent (or walk below it,
+ *                      for deeper globs), record the bind mounts,
+ *                      create the empty targets, drop the mounts
+ *                      others make unnecessary
+ *   rmp_plan_enter     unshare(CLONE_NEWUSER | CLONE_NEWNS), uid/gid
+ *                      maps, bind mounts - in the calling process (or
+ *                      setns() into a shared user namespace and
+ *                      unshare only CLONE_NEWNS)
+ *   rmp_spawn          clone3(CLONE_PIDFD), rmp_plan_enter in the
+ *                      child, exec; errors come back over a pipe
+ *   rmp_plan_sync      for a staged plan, write the tmpfs copies back
+ *   rmp_plan_watch_handle
+ *                      for a watched plan, mount matches created since
+ *
+ * The child side of rmp_spawn runs after clone in a possibly
+ * multithreaded parent, so rmp_plan_enter and the exec stick to
+ * syscalls and stack buffers: no malloc, no stdio.  The program is
+ * looked up along $PATH in the parent and the child only tries execve
+ * on the candidates.  Not strictly async-signal-safe are the error and
+ * debug messages: they are formatted with vsnprintf and strerror into
+ * a thread-local or stack buffer (debug lines then go out with write,
+ * not through the FILE), which glibc does without allocating for the
+ * plain %s/%d conversions used.  Staging is the exception - it walks
+ * and copies trees - and is why staged plans can only be entered, not
+ * spawned.  So are watched plans, whose mounts are added later from
+ * inside the namespace.
+*/
+#define _GNU_SOURCE
+
+#include "rmp_launch.h"
+#include "rmp_cgroup.h"
+#include "rmp_glob.h"
+#include "rmp_pool.h"
+#include "rmp_shared.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+extern char **environ;
+
+typedef struct {
+    const char *mapping;    // as given, e.g. "/home/u/.cache*=tmpfs:512m"
+    const char *parent;     // literal base with trailing '/', e.g. "/home/u/"
+    const char *glob;       // the rest, e.g. ".cache*" or "src/*/.cache"
+    rmp_glob_t match;       // glob, compiled (its own copy)
+    int simple;             // glob is one component, so one scan of parent
+    const char *target;     // own target dir, or NULL for the plan's
+    const char *tmpfs;      // tmpfs mount options if a tmpfs: target, else NULL
+} plan_pattern_t;
+
+// The mount source is "<target>/<name>", built when needed rather than
+// stored: name points inside original, after the pattern's parent, so
+// it is more than one component for a glob like "src/*/.cache".  It is
+// empty for a directory coalesce() merged, whose source is the target.
+typedef struct {
+    const char *original;   // the real path (mount point)
+    const char *name;
+    int pattern;            // index of the pattern that matched
+    int is_dir;
+} plan_mount_t;
+
+// Every string a plan holds lives in its arena, interned, so memory grows
+// with the distinct path bytes: a parent shared by many mappings, or a
+// path found again by a re-resolve, is stored once.
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used, size;
+    char data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *chunks;
+    const char **slots;     // open-addressed set of interned strings
+    size_t nslots, count;
+} arena_t;
+
+struct rmp_plan {
+    arena_t arena;
+    const char *target;
+    plan_pattern_t *patterns;
+    int num_patterns, cap_patterns;
+    plan_mount_t *mounts;
+    int num_mounts, cap_mounts;
+    int resolved;
+    const char *stage;      // staging tmpfs mount options, or NULL
+    int watching;
+    int watch_fd;           // inotify, if watching
+    const char **watch_parents;     // indexed by watch descriptor
+    int cap_watch;
+    int userns_fd;          // shared user namespace to join, or -1
+    int cgroup_fd;          // cgroup to start spawned children in, or -1
+    FILE *debug_fp;
+};
+
+/*** Errors ***************************************/
+
+static __thread char t_errmsg[1024];
+
+// Record the detail for rmp_last_error() and return -err, keeping errno
+static int fail(int err, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static int fail(int err, const char *fmt, ...) {
+    int saved = errno;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(t_errmsg, sizeof(t_errmsg), fmt, ap);
+    va_end(ap);
+    errno = saved;
+    return -err;
+}
+
+const char *rmp_strerror(int err) {
+    switch (err < 0 ? -err : err) {
+    case RMP_OK:         return "success";
+    case RMP_ERR_INVAL:  return "invalid argument";
+    case RMP_ERR_NOMEM:  return "out of memory";
+    case RMP_ERR_USERNS: return "cannot create user namespace";
+    case RMP_ERR_IDMAP:  return "cannot write uid/gid map";
+    case RMP_ERR_MOUNT:  return "bind mount failed";
+    case RMP_ERR_SPAWN:  return "cannot start process";
+    case RMP_ERR_EXEC:   return "cannot execute program";
+    case RMP_ERR_STAGE:  return "staging copy failed";
+    case RMP_ERR_WATCH:  return "cannot watch for new matches";
+    case RMP_ERR_CGROUP: return "cannot move into cgroup";
+    default:             return "unknown error";
+    }
+}
+
+const char *rmp_last_error(void) {
+    return t_errmsg;
+}
+
+/*** Debug logging ********************************/
+
+// One write(2) per line: safe in the spawned child, and lines from
+// concurrent spawns don't interleave.
+static void plan_debug(const rmp_plan_t *plan, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static void plan_debug(const rmp_plan_t *plan, const char *fmt, ...) {
+    if (!plan->debug_fp) return;
+    int saved = errno;
+    char buf[2 * PATH_MAX + 128];
+    int n = snprintf(buf, sizeof(buf), "[remapper] ");
+    va_list ap;
+    va_start(ap, fmt);
+    n += vsnprintf(buf + n, sizeof(buf) - (size_t)n - 1, fmt, ap);
+    va_end(ap);
+    if (n > (int)sizeof(buf) - 2) n = (int)sizeof(buf) - 2;
+    buf[n++] = '\n';
+    if (write(fileno(plan->debug_fp), buf, (size_t)n) < 0) {}
+    errno = saved;
+}
+
+/*** Arena ****************************************/
+
+#define ARENA_CHUNK (64 * 1024)
+
+static char *arena_alloc(arena_t *a, size_t len) {
+    arena_chunk_t *c = a->chunks;
+    if (!c || c->size - c->used < len) {
+        size_t size = len > ARENA_CHUNK ? len : ARENA_CHUNK;
+        c = malloc(sizeof(*c) + size);
+        if (!c) return NULL;
+        c->size = size;
+        c->used = 0;
+        c->next = a->chunks;
+        a->chunks = c;
+    }
+    char *p = c->data + c->used;
+    c->used += len;
+    return p;
+}
+
+static size_t hash_str(const char *s, size_t len) {
+    size_t h = 14695981039346656037ull;    // FNV-1a
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+    return h;
+}
+
+// The arena's copy of s[0..len), added on first use.  NULL if out of memory.
+static const char *arena_intern(arena_t *a, const char *s, size_t len) {
+    if (a->count * 2 >= a->nslots) {
+        size_t nslots = a->nslots ? a->nslots * 2 : 256;
+        const char **slots = calloc(nslots, sizeof(*slots));
+        if (!slots) return NULL;
+        for (size_t i = 0; i < a->nslots; i++) {
+            const char *old = a->slots[i];
+            if (!old) continue;
+            size_t j = hash_str(old, strlen(old)) & (nslots - 1);
+            while (slots[j]) j = (j + 1) & (nslots - 1);
+            slots[j] = old;
+        }
+        free(a->slots);
+        a->slots = slots;
+        a->nslots = nslots;
+    }
+
+    size_t j = hash_str(s, len) & (a->nslots - 1);
+    for (; a->slots[j]; j = (j + 1) & (a->nslots - 1))
+        if (strncmp(a->slots[j], s, len) == 0 && a->slots[j][len] == '\0')
+            return a->slots[j];
+
+    char *copy = arena_alloc(a, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    a->slots[j] = copy;
+    a->count++;
+    return copy;
+}
+
+static void arena_free(arena_t *a) {
+    while (a->chunks) {
+        arena_chunk_t *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    free(a->slots);
+}
+
+/*** Plan construction ****************************/
+
+rmp_plan_t *rmp_plan_new(const char *target_dir) {
+    if (!target_dir || target_dir[0] != '/') {
+        errno = EINVAL;
+        fail(RMP_ERR_INVAL, "target directory must be absolute: %s",
+             target_dir ? target_dir : "(null)");
+        return NULL;
+    }
+    // Trailing slashes would double up in "<target>/<name>"
+    size_t len = strlen(target_dir);
+    while (len > 1 && target_dir[len - 1] == '/') len--;
+
+    rmp_plan_t *plan = calloc(1, sizeof(*plan));
+    if (!plan || !(plan->target = arena_intern(&plan->arena, target_dir, len))) {
+        rmp_plan_free(plan);
+        errno = ENOMEM;
+        fail(RMP_ERR_NOMEM, "out of memory");
+        return NULL;
+    }
+    plan->userns_fd = -1;
+    plan->cgroup_fd = -1;
+    rmp_mkdirs(plan->target, 0755);
+    return plan;
+}
+
+// Check a "tmpfs:[size]" target's size ("512m", "2G", "25%", or empty)
+// and turn it into mount options.  NULL if malformed.
+static const char *tmpfs_options(arena_t *a, const char *size) {
+    char opts[64];
+    size_t digits = strspn(size, "0123456789");
+    if (!size[0]) return arena_intern(a, "mode=0700", 9);
+    if (digits == 0 || digits > 20 ||
+        (size[digits] && (size[digits + 1] || !strchr("kKmMgG%", size[digits]))))
+        return NULL;
+    int n = snprintf(opts, sizeof(opts), "mode=0700,size=%s", size);
+    return arena_intern(a, opts, (size_t)n);
+}
+
+int rmp_plan_add_mapping(rmp_plan_t *plan, const char *mapping) {
+    // "<pattern>=<target>" gives the pattern its own target
+    // Split where the wildcards start: "/home/u/src/*/.cache" has the
+    // parent "/home/u/src/"
+    const char *eq = mapping ? rmp_mapping_target(mapping, 0) : NULL;
+    size_t pat_len = mapping ? (eq ? (size_t)(eq - mapping) : strlen(mapping)) : 0;
+    size_t parent_len = mapping ? rmp_glob_split(mapping, pat_len) : 0;
+    if (!mapping || mapping[0] != '/' || parent_len <= 1 || parent_len == pat_len) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "mapping must be an absolute path with a parent: %s",
+                    mapping ? mapping : "(null)");
+    }
+    if (eq && eq[1] == '/' && !eq[2]) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "mapping target must be an absolute directory"
+                                   " or tmpfs:[size]: %s", mapping);
+    }
+
+    if (plan->num_patterns == plan->cap_patterns) {
+        int cap = plan->cap_patterns ? plan->cap_patterns * 2 : 8;
+        plan_pattern_t *p = realloc(plan->patterns, (size_t)cap * sizeof(*p));
+        if (!p) return fail(RMP_ERR_NOMEM, "out of memory");
+        plan->patterns = p;
+        plan->cap_patterns = cap;
+    }
+    plan_pattern_t *pat = &plan->patterns[plan->num_patterns];
+    pat->mapping = arena_intern(&plan->arena, mapping, strlen(mapping));
+    pat->parent = arena_intern(&plan->arena, mapping, parent_len);
+    pat->glob = arena_intern(&plan->arena, mapping + parent_len, pat_len - parent_len);
+    pat->target = pat->tmpfs = NULL;
+    char *segs = arena_alloc(&plan->arena, pat_len - parent_len + 1);
+    if (!pat->mapping || !pat->parent || !pat->glob || !segs)
+        return fail(RMP_ERR_NOMEM, "out of memory");
+    memcpy(segs, pat->glob, pat_len - parent_len + 1);
+    if (rmp_glob_compile(&pat->match, segs) != 0) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "mapping has more than %d components after its"
+                                   " first wildcard: %s", RMP_GLOB_MAX_SEGS, mapping);
+    }
+    pat->simple = rmp_glob_is_simple(&pat->match);
+    if (eq && strncmp(eq + 1, "tmpfs:", 6) == 0) {
+        if (!(pat->tmpfs = tmpfs_options(&plan->arena, eq + 7))) {
+            errno = EINVAL;
+            return fail(RMP_ERR_INVAL, "bad tmpfs size (want e.g. 512m, 2g, 25%%): %s",
+                        mapping);
+        }
+    } else if (eq) {
+        size_t len = strlen(eq + 1);
+        while (len > 1 && eq[len] == '/') len--;     // eq[len] is the last char
+        if (!(pat->target = arena_intern(&plan->arena, eq + 1, len)))
+            return fail(RMP_ERR_NOMEM, "out of memory");
+    }
+    plan->num_patterns++;
+    plan->resolved = 0;
+    return 0;
+}
+
+int rmp_plan_add_profile(rmp_plan_t *plan, const char *path) {
+    FILE *fp = fopen(path, "re");
+    if (!fp) return fail(RMP_ERR_INVAL, "cannot open profile %s: %s", path, strerror(errno));
+
+    const char *home = getenv("HOME");
+    char *line = NULL, *expanded = NULL;
+    size_t line_cap = 0, expanded_cap = 0;
+    ssize_t len;
+    int lineno = 0, added = 0, r = 0;
+
+    // One line at a time: memory is the plan's, not the file's
+    while ((len = getline(&line, &line_cap, fp)) > 0) {
+        lineno++;
+        char *s = line;
+        while (*s == ' ' || *s == '\t') s++;
+        while (len > 0 && strchr(" \t\r\n", line[len - 1])) line[--len] = '\0';
+        if (!*s || *s == '#') continue;
+
+        // "~/" at the start of the pattern and of a "=~/..." target
+        const char *mapping = s;
+        char *eq = (char *)rmp_mapping_target(s, 1);
+        if (eq && eq[1] == '.') {
+            errno = EINVAL;
+            r = fail(RMP_ERR_INVAL, "%s:%d: mapping target must be absolute or start"
+                                    " with ~/: %s", path, lineno, s);
+            break;
+        }
+        int tilde_pat = s[0] == '~' && (s[1] == '/' || s[1] == '=' || !s[1]);
+        int tilde_tgt = eq && eq[1] == '~' && (eq[2] == '/' || !eq[2]);
+        if ((tilde_pat || tilde_tgt) && home && home[0]) {
+            size_t need = 2 * strlen(home) + strlen(s) + 1;
+            if (need > expanded_cap) {
+                char *e = realloc(expanded, need);
+                if (!e) { r = fail(RMP_ERR_NOMEM, "out of memory"); break; }
+                expanded = e;
+                expanded_cap = need;
+            }
+            if (eq) *eq = '\0';
+            snprintf(expanded, expanded_cap, "%s%s%s%s%s",
+                     tilde_pat ? home : "", s + tilde_pat, eq ? "=" : "",
+                     tilde_tgt ? home : "", eq ? eq + 1 + tilde_tgt : "");
+            if (eq) *eq = '=';
+            mapping = expanded;
+        }
+
+        r = rmp_plan_add_mapping(plan, mapping);
+        if (r < 0) {
+            // Keep the reason, placed in the file
+            char reason[sizeof(t_errmsg)];
+            memcpy(reason, t_errmsg, sizeof(reason));
+            fail(-r, "%s:%d: %s", path, lineno, reason);
+            break;
+        }
+        added++;
+    }
+    if (r == 0 && ferror(fp))
+        r = fail(RMP_ERR_INVAL, "cannot read profile %s: %s", path, strerror(errno));
+
+    free(line);
+    free(expanded);
+    fclose(fp);
+    return r < 0 ? r : added;
+}
+
+int rmp_plan_set_stage(rmp_plan_t *plan, const char *size) {
+    const char *opts = tmpfs_options(&plan->arena, size ? size : "");
+    if (!opts) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "bad staging tmpfs size: %s", size);
+    }
+    plan->stage = opts;
+    return 0;
+}
+
+void rmp_plan_set_debug(rmp_plan_t *plan, FILE *fp) {
+    plan->debug_fp = fp;
+}
+
+void rmp_plan_set_userns(rmp_plan_t *plan, int nsfd) {
+    plan->userns_fd = nsfd;
+}
+
+void rmp_plan_set_cgroup(rmp_plan_t *plan, int cgfd) {
+    plan->cgroup_fd = cgfd;
+}
+
+int rmp_plan_cgroup(const rmp_plan_t *plan) {
+    return plan->cgroup_fd;
+}
+
+const char *rmp_plan_target(const rmp_plan_t *plan) {
+    return plan->target;
+}
+
+int rmp_plan_num_mappings(const rmp_plan_t *plan) {
+    return plan->num_patterns;
+}
+
+const char *rmp_plan_mapping(const rmp_plan_t *plan, int i) {
+    return i >= 0 && i < plan->num_patterns ? plan->patterns[i].mapping : NULL;
+}
+
+int rmp_plan_num_mounts(const rmp_plan_t *plan) {
+    return plan->num_mounts;
+}
+
+int rmp_plan_rewrite(const rmp_plan_t *plan, const char *path, char *out, size_t size) {
+    const plan_pattern_t *best = NULL;
+    size_t best_len = 0;
+    for (int p = 0; p < plan->num_patterns; p++) {
+        const plan_pattern_t *pat = &plan->patterns[p];
+        size_t plen = strlen(pat->parent);
+        if ((best && plen <= best_len) || strncmp(path, pat->parent, plen) != 0) continue;
+        if (rmp_glob_match(&pat->match, path + plen)) {
+            best = pat;
+            best_len = plen;
+        }
+    }
+    if (!best || best->tmpfs) return 0;
+    int n = snprintf(out, size, "%s/%s", best->target ? best->target : plan->target,
+                     path + best_len);
+    return n >= 0 && (size_t)n < size;
+}
+
+void rmp_plan_free(rmp_plan_t *plan) {
+    if (!plan) return;
+    if (plan->watching) close(plan->watch_fd);
+    free(plan->watch_parents);
+    free(plan->mounts);
+    free(plan->patterns);
+    arena_free(&plan->arena);
+    free(plan);
+}
+
+/*** Glob resolution ******************************/
+
+// Where a tmpfs: pattern's tmpfs is mounted inside the namespace: an
+// empty directory in the plan's target, so nothing outside sees it.
+static const char *tmpfs_dir(const rmp_plan_t *plan, int pattern, char *buf, size_t size) {
+    snprintf(buf, size, "%s/.rmp-tmpfs-%d", plan->target, pattern);
+    return buf;
+}
+
+// "<target>/<name>" into buf, with the pattern's own target or tmpfs if
+// it has one.  Stack only: runs in the spawned child.
+static const char *mount_source(const rmp_plan_t *plan, const plan_mount_t *m,
+                                char *buf, size_t size) {
+    const plan_pattern_t *pat = &plan->patterns[m->pattern];
+    if (pat->tmpfs) {
+        size_t n = strlen(tmpfs_dir(plan, m->pattern, buf, size));
+        snprintf(buf + n, size - n, "/%s", m->name);
+    } else if (*m->name) {
+        snprintf(buf, size, "%s/%s", pat->target ? pat->target : plan->target, m->name);
+    } else {
+        snprintf(buf, size, "%s", pat->target);    // a merged directory
+    }
+    return buf;
+}
+
+const char *rmp_plan_mount(const rmp_plan_t *plan, int i, char *source, size_t size) {
+    if (i < 0 || i >= plan->num_mounts) return NULL;
+    const plan_mount_t *m = &plan->mounts[i];
+    if (plan->patterns[m->pattern].tmpfs) {
+        if (size) source[0] = '\0';
+    } else {
+        mount_source(plan, m, source, size);
+    }
+    return m->original;
+}
+
+// A staged plan's tmpfs, in the target like the tmpfs: patterns', and
+// the copy of a mount source on it: "<stage>/<pattern>/<name>", so
+// patterns with their own target dirs can't collide.
+static const char *stage_dir(const rmp_plan_t *plan, char *buf, size_t size) {
+    snprintf(buf, size, "%s/.rmp-stage", plan->target);
+    return buf;
+}
+
+static const char *staged_source(const rmp_plan_t *plan, const plan_mount_t *m,
+                                 char *buf, size_t size) {
+    size_t n = strlen(stage_dir(plan, buf, size));
+    snprintf(buf + n, size - n, "/%d/%s", m->pattern, m->name);
+    return buf;
+}
+
+// original is "<parent><name>"; it is interned, name points inside it
+static int add_mount(rmp_plan_t *plan, const char *original, size_t parent_len,
+                     int pattern, int is_dir) {
+    if (plan->num_mounts == plan->cap_mounts) {
+        int cap = plan->cap_mounts ? plan->cap_mounts * 2 : 16;
+        plan_mount_t *m = realloc(plan->mounts, (size_t)cap * sizeof(*m));
+        if (!m) return fail(RMP_ERR_NOMEM, "out of memory");
+        plan->mounts = m;
+        plan->cap_mounts = cap;
+    }
+    plan_mount_t *m = &plan->mounts[plan->num_mounts];
+    m->original = arena_intern(&plan->arena, original, strlen(original));
+    if (!m->original) return fail(RMP_ERR_NOMEM, "out of memory");
+    m->name = m->original + parent_len;
+    m->pattern = pattern;
+    m->is_dir = is_dir;
+    plan->num_mounts++;
+
+    if (plan->debug_fp) {
+        char src[PATH_MAX];
+        plan_debug(plan, "mount entry: %s -> %s (%s)", mount_source(plan, m, src, sizeof(src)),
+                   m->original, is_dir ? "dir" : "file");
+    }
+    return 0;
+}
+
+// Ensure each mount source exists: mkdir -p for directories, touch for
+// files.  Sources on a tmpfs only exist inside the namespace, so for
+// those just the directory to mount the tmpfs on is made here.
+void rmp_plan_create_targets(const rmp_plan_t *plan) {
+    char target[PATH_MAX];
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if (plan->patterns[m->pattern].tmpfs) {
+            rmp_mkdirs(tmpfs_dir(plan, m->pattern, target, sizeof(target)), 0700);
+            continue;
+        }
+        mount_source(plan, m, target, sizeof(target));
+        if (m->is_dir) {
+            rmp_mkdirs(target, 0755);
+            plan_debug(plan, "created target dir: %s", target);
+            continue;
+        }
+
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%s", target);
+        char *slash = strrchr(parent, '/');
+        if (slash) {
+            *slash = '\0';
+            rmp_mkdirs(parent, 0755);
+        }
+        int fd = open(target, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            close(fd);
+            plan_debug(plan, "created target file: %s", target);
+        } else {
+            // Reported by perform_mounts if it matters
+            plan_debug(plan, "cannot create %s: %s", target, strerror(errno));
+        }
+    }
+}
+
+// Add a mount for parent + name if it exists
+static int match_entry(rmp_plan_t *plan, const char *parent, const char *name,
+                       int pattern) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+
+    char original[PATH_MAX];
+    snprintf(original, sizeof(original), "%s%s", parent, name);
+
+    struct stat sb;
+    if (stat(original, &sb) != 0) {
+        if (errno != ENOENT)
+            plan_debug(plan, "  stat failed for '%s': %s", original, strerror(errno));
+        return 0;
+    }
+    return add_mount(plan, original, strlen(parent), pattern, S_ISDIR(sb.st_mode));
+}
+
+typedef struct {
+    const char *parent;
+    int first;              // index of the first pattern with this parent
+    int index;
+} resolve_key_t;
+
+static int cmp_by_parent(const void *a, const void *b) {
+    const resolve_key_t *x = a, *y = b;
+    if (x->parent != y->parent) return (uintptr_t)x->parent < (uintptr_t)y->parent ? -1 : 1;
+    return x->index - y->index;
+}
+
+static int cmp_by_first(const void *a, const void *b) {
+    const resolve_key_t *x = a, *y = b;
+    if (x->first != y->first) return x->first - y->first;
+    return x->index - y->index;
+}
+
+/*** Coalescing ***********************************/
+
+// rmp_plan_resolve() records a mount per matching entry.  Some change
+// nothing another mount doesn't, so they are dropped before anything is
+// mounted - fewer mount(2) calls, and a shorter mount table for every
+// path lookup the program makes:
+//
+//   shadowed   at or under a mount made after it, which covers it
+//   redundant  under a mount made before it whose source already shows
+//              the same thing there: '~/.app*' with '~/.app/sub*=<target>/.app'
+//   merged     every entry of a directory, matched by a '*' mapping into
+//              a target dir of its own that holds nothing else: one bind
+//              of the target over the directory does for all of them.
+//              New entries then land in the target too, as '*' asks.
+//
+// Staged plans keep their per-entry mounts, since the stage copies and
+// writes back sources one mount at a time.
+
+// strcmp, but '/' sorts before every other character, so a directory's
+// subtree follows it directly: "a", "a/b", "a/c", "a.txt"
+static int path_cmp(const char *a, const char *b) {
+    for (;; a++, b++) {
+        int x = *a == '/' ? 1 : (unsigned char)*a, y = *b == '/' ? 1 : (unsigned char)*b;
+        if (x != y || !x) return x - y;
+    }
+}
+
+typedef struct {
+    const char *original;
+    int index;
+} coalesce_key_t;
+
+static int cmp_by_path(const void *a, const void *b) {
+    const coalesce_key_t *x = a, *y = b;
+    int c = path_cmp(x->original, y->original);
+    return c ? c : y->index - x->index;     // of two at one path, the later first
+}
+
+static int is_under(const char *path, const char *dir) {
+    size_t n = strlen(dir);
+    return strncmp(path, dir, n) == 0 && (path[n] == '/' || path[n] == '\0');
+}
+
+// Does mount m show what mount a, an ancestor of it, already shows there?
+static int same_view(const rmp_plan_t *plan, const plan_mount_t *a, const plan_mount_t *m) {
+    char outer[PATH_MAX], inner[PATH_MAX];
+    size_t n = strlen(mount_source(plan, a, outer, sizeof(outer)));
+    snprintf(outer + n, sizeof(outer) - n, "%s", m->original + strlen(a->original));
+    return strcmp(outer, mount_source(plan, m, inner, sizeof(inner))) == 0;
+}
+
+// Entries in dir other than "." and "..", or -1 if it can't be read
+static int count_entries(const char *dir) {
+    DIR *dp = opendir(dir);
+    if (!dp) return -1;
+    int n = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) n++;
+    closedir(dp);
+    return n;
+}
+
+enum { KEEP, SHADOWED, REDUNDANT, MERGED };
+
+// Mark the mounts of pattern p for merging into one of its parent
+// directory, if the rules above allow it.  Returns how many were marked.
+static int merge_pattern(rmp_plan_t *plan, int p, char *drop) {
+    const plan_pattern_t *pat = &plan->patterns[p];
+    if (!pat->target || strcmp(pat->glob, "*") != 0 || strcmp(pat->parent, "/") == 0)
+        return 0;
+
+    // Nothing else mounted in the parent, and no part of it left out
+    int first = -1, count = 0;
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if (m->pattern != p) {
+            if (plan->patterns[m->pattern].parent == pat->parent) return 0;
+            continue;
+        }
+        if (drop[i] != KEEP) return 0;
+        if (first < 0) first = i;
+        count++;
+    }
+    if (count < 2 || count_entries(pat->parent) != count ||
+        count_entries(pat->target) != count)
+        return 0;
+
+    size_t len = strlen(pat->parent) - 1;
+    const char *dir = arena_intern(&plan->arena, pat->parent, len);
+    if (!dir) return 0;
+    for (int i = 0; i < plan->num_mounts; i++)
+        if (plan->mounts[i].pattern == p) drop[i] = MERGED;
+    plan->mounts[first] = (plan_mount_t){ dir, dir + len, p, 1 };
+    drop[first] = KEEP;
+    plan_debug(plan, "merged %d mount(s) into %s -> %s", count, pat->target, dir);
+    return count - 1;
+}
+
+static int coalesce(rmp_plan_t *plan) {
+    int n = plan->num_mounts;
+    if (n < 2) return 0;
+    coalesce_key_t *keys = malloc((size_t)n * sizeof(*keys));
+    int *stack = malloc((size_t)n * 2 * sizeof(*stack));
+    char *drop = calloc((size_t)n, 1);
+    if (!keys || !stack || !drop) {
+        free(keys);
+        free(stack);
+        free(drop);
+        return fail(RMP_ERR_NOMEM, "out of memory");
+    }
+
+    // In path order, with the chain of mounts above the current one on a
+    // stack, each with the latest-made mount in the chain so far
+    for (int i = 0; i < n; i++) keys[i] = (coalesce_key_t){ plan->mounts[i].original, i };
+    qsort(keys, (size_t)n, sizeof(*keys), cmp_by_path);
+    int *latest = stack + n, depth = 0, shadowed = 0, redundant = 0, merged = 0;
+    for (int k = 0; k < n; k++) {
+        int i = keys[k].index;
+        const plan_mount_t *m = &plan->mounts[i];
+        while (depth && !is_under(m->original, plan->mounts[stack[depth - 1]].original))
+            depth--;
+        int above = depth ? latest[depth - 1] : -1;
+        if (above > i) {
+            drop[i] = SHADOWED;
+            shadowed++;
+        } else if (above >= 0 && same_view(plan, &plan->mounts[above], m)) {
+            drop[i] = REDUNDANT;
+            redundant++;
+        }
+        stack[depth] = i;
+        latest[depth] = above > i ? above : i;
+        depth++;
+    }
+
+    if (!plan->stage)
+        for (int p = 0; p < plan->num_patterns; p++) merged += merge_pattern(plan, p, drop);
+
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+        if (drop[i] == KEEP) plan->mounts[kept++] = plan->mounts[i];
+    plan->num_mounts = kept;
+    plan_debug(plan, "planned %d mount(s) for %d match(es): %d shadowed, %d redundant,"
+               " %d merged", kept, n, shadowed, redundant, merged);
+    free(keys);
+    free(stack);
+    free(drop);
+    return 0;
+}
+
+/*** Deep globs ***********************************/
+
+// Mappings with wildcards above their last component ('~/src/*/.cache',
+// '~/**/node_modules') are resolved by walking down from the parent,
+// one pool task per directory, every such mapping in the same walk.  A
+// task carries its glob's state set: an entry whose name empties it is
+// skipped without a stat, a match is recorded and not walked into (its
+// mount covers it), and any other directory is walked next.  Where the
+// one thing left to match is a literal name, it is looked up instead of
+// reading the directory.
+//
+// Symlinks to directories are followed, but never back into a directory
+// the walk came through, nor into the plan's targets; and no walk goes
+// more than RMP_GLOB_MAX_DEPTH levels down.
+
+typedef struct {
+    char *path;
+    int pattern;
+    int is_dir;
+} walk_match_t;
+
+typedef struct {
+    const rmp_plan_t *plan;
+    rmp_pool_t *pool;       // NULL: walk in the calling thread
+    atomic_long dirs;
+    pthread_mutex_t lock;   // guards the matches
+    walk_match_t *matches;
+    size_t num_matches, cap_matches;
+    int failed;
+} walk_t;
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} walk_dir_id_t;
+
+typedef struct {
+    walk_t *w;
+    int pattern;
+    int depth;              // levels below the parent
+    uint32_t states;
+    walk_dir_id_t up[RMP_GLOB_MAX_DEPTH + 1];   // this directory and those above
+    char path[];            // with a trailing '/'
+} walk_task_t;
+
+static void walk_dir_task(void *arg);
+
+static void walk_submit(walk_t *w, const walk_task_t *from, int pattern, uint32_t states,
+                        const char *path) {
+    size_t len = strlen(path);
+    walk_task_t *t = malloc(sizeof(*t) + len + 2);
+    if (!t) {
+        pthread_mutex_lock(&w->lock);
+        w->failed = 1;
+        pthread_mutex_unlock(&w->lock);
+        return;
+    }
+    t->w = w;
+    t->pattern = pattern;
+    t->depth = from ? from->depth + 1 : 0;
+    t->states = states;
+    if (from) memcpy(t->up, from->up, (size_t)t->depth * sizeof(t->up[0]));
+    memcpy(t->path, path, len);
+    if (len == 0 || path[len - 1] != '/') t->path[len++] = '/';
+    t->path[len] = '\0';
+    if (!w->pool || rmp_pool_submit(w->pool, walk_dir_task, t) != 0)
+        walk_dir_task(t);
+}
+
+static void walk_record(walk_t *w, const char *path, int pattern, int is_dir) {
+    char *copy = strdup(path);
+    pthread_mutex_lock(&w->lock);
+    if (copy && w->num_matches == w->cap_matches) {
+        size_t cap = w->cap_matches ? w->cap_matches * 2 : 64;
+        walk_match_t *m = realloc(w->matches, cap * sizeof(*m));
+        if (m) {
+            w->matches = m;
+            w->cap_matches = cap;
+        }
+    }
+    if (copy && w->num_matches < w->cap_matches) {
+        w->matches[w->num_matches++] = (walk_match_t){ copy, pattern, is_dir };
+    } else {
+        free(copy);
+        w->failed = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static int is_target_dir(const rmp_plan_t *plan, const char *path, size_t len) {
+    if (strncmp(path, plan->target, len) == 0 && plan->target[len] == '\0') return 1;
+    for (int p = 0; p < plan->num_patterns; p++) {
+        const char *target = plan->patterns[p].target;
+        if (target && strncmp(path, target, len) == 0 && target[len] == '\0') return 1;
+    }
+    return 0;
+}
+
+static void walk_entry(walk_task_t *t, int dirfd, const char *name, unsigned char type) {
+    walk_t *w = t->w;
+    const rmp_plan_t *plan = w->plan;
+    uint32_t next = rmp_glob_step(&plan->patterns[t->pattern].match, t->states, name);
+    if (!next) return;
+    int matched = rmp_glob_accepts(&plan->patterns[t->pattern].match, next);
+    if (!matched && (t->depth >= RMP_GLOB_MAX_DEPTH ||
+                     (type != DT_DIR && type != DT_LNK && type != DT_UNKNOWN)))
+        return;
+
+    char path[PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s%s", t->path, name);
+    if (n < 0 || (size_t)n >= sizeof(path)) return;
+
+    // Like match_entry(): stat, following symlinks, unless d_type says
+    int is_dir = type == DT_DIR;
+    struct stat sb;
+    if (type != DT_DIR && !(matched && type == DT_REG)) {
+        if (fstatat(dirfd, name, &sb, 0) != 0) {
+            if (errno != ENOENT)
+                plan_debug(plan, "  stat failed for '%s': %s", path, strerror(errno));
+            return;
+        }
+        is_dir = S_ISDIR(sb.st_mode);
+    }
+    if (matched)
+        walk_record(w, path, t->pattern, is_dir);
+    else if (is_dir && !is_target_dir(plan, path, (size_t)n))
+        walk_submit(w, t, t->pattern, next, path);
+}
+
+static void walk_dir_task(void *arg) {
+    walk_task_t *t = arg;
+    walk_t *w = t->w;
+    const rmp_plan_t *plan = w->plan;
+    atomic_fetch_add(&w->dirs, 1);
+
+    int fd = open(t->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0) {
+        if (t->depth == 0 || errno != ENOENT)
+            plan_debug(plan, "  cannot walk '%s': %s", t->path, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(t);
+        return;
+    }
+    for (int i = 0; i < t->depth; i++) {
+        if (t->up[i].dev == sb.st_dev && t->up[i].ino == sb.st_ino) {
+            plan_debug(plan, "  not walking '%s': a symlink loop", t->path);
+            close(fd);
+            free(t);
+            return;
+        }
+    }
+    t->up[t->depth] = (walk_dir_id_t){ sb.st_dev, sb.st_ino };
+
+    const char *literal = rmp_glob_literal(&plan->patterns[t->pattern].match, t->states);
+    DIR *dp = literal ? NULL : fdopendir(fd);
+    if (literal) {
+        walk_entry(t, fd, literal, DT_UNKNOWN);
+        close(fd);
+    } else if (dp) {
+        struct dirent *ent;
+        while ((ent = readdir(dp)) != NULL)
+            walk_entry(t, fd, ent->d_name, ent->d_type);
+        closedir(dp);
+    } else {
+        close(fd);
+    }
+    free(t);
+}
+
+static int cmp_walk_match(const void *a, const void *b) {
+    const walk_match_t *x = a, *y = b;
+    if (x->pattern != y->pattern) return x->pattern - y->pattern;
+    return path_cmp(x->path, y->path);
+}
+
+static double elapsed_ms(const struct timespec *t0);
+
+// Walk for every pattern that isn't simple, on a pool if there's more
+// than one CPU.  Matches come back sorted by pattern, then path, so the
+// plan doesn't depend on which thread found what.  0 or -RMP_ERR_NOMEM.
+static int walk_deep(const rmp_plan_t *plan, walk_t *w) {
+    memset(w, 0, sizeof(*w));
+    w->plan = plan;
+    atomic_init(&w->dirs, 0);
+    int deep = 0;
+    for (int p = 0; p < plan->num_patterns; p++) deep += !plan->patterns[p].simple;
+    if (!deep) return 0;
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_mutex_init(&w->lock, NULL);
+    if (rmp_ncpus() > 1) w->pool = rmp_pool_create(0);
+    for (int p = 0; p < plan->num_patterns; p++) {
+        const plan_pattern_t *pat = &plan->patterns[p];
+        if (pat->simple) continue;
+        plan_debug(plan, "walking '%s' for '%s'", pat->parent, pat->glob);
+        walk_submit(w, NULL, p, rmp_glob_start(&pat->match), pat->parent);
+    }
+    if (w->pool) rmp_pool_destroy(w->pool);
+    pthread_mutex_destroy(&w->lock);
+    qsort(w->matches, w->num_matches, sizeof(*w->matches), cmp_walk_match);
+    plan_debug(plan, "walked %ld dir(s) for %d deep mapping(s) in %.1f ms: %zu match(es)",
+               (long)atomic_load(&w->dirs), deep, elapsed_ms(&t0), w->num_matches);
+    return w->failed ? fail(RMP_ERR_NOMEM, "out of memory") : 0;
+}
+
+static void walk_free(walk_t *w) {
+    for (size_t i = 0; i < w->num_matches; i++) free(w->matches[i].path);
+    free(w->matches);
+}
+
+// Add the walk's matches for pattern as mounts, in path order
+static int add_walked(rmp_plan_t *plan, const walk_t *w, int pattern) {
+    size_t lo = 0, hi = w->num_matches;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (w->matches[mid].pattern < pattern) lo = mid + 1; else hi = mid;
+    }
+    size_t parent_len = strlen(plan->patterns[pattern].parent);
+    for (; lo < w->num_matches && w->matches[lo].pattern == pattern; lo++) {
+        int r = add_mount(plan, w->matches[lo].path, parent_len, pattern,
+                          w->matches[lo].is_dir);
+        if (r < 0) return r;
+    }
+    return 0;
+}
+
+int rmp_plan_resolve(rmp_plan_t *plan) {
+    plan->num_mounts = 0;
+    plan->resolved = 0;
+
+    // Patterns sharing a parent (the same interned pointer) are matched in
+    // one pass over it, and names without glob characters are looked up
+    // directly.  Parents are visited in the order they were first given,
+    // so a mapping listed before one nested inside it is mounted first.
+    int n = plan->num_patterns;
+    resolve_key_t *keys = malloc((size_t)(n ? n : 1) * sizeof(*keys));
+    if (!keys) return fail(RMP_ERR_NOMEM, "out of memory");
+    for (int i = 0; i < n; i++)
+        keys[i] = (resolve_key_t){ plan->patterns[i].parent, i, i };
+    qsort(keys, (size_t)n, sizeof(*keys), cmp_by_parent);
+    for (int i = 1; i < n; i++)
+        if (keys[i].parent == keys[i - 1].parent) keys[i].first = keys[i - 1].first;
+    qsort(keys, (size_t)n, sizeof(*keys), cmp_by_first);
+
+    walk_t walk;
+    int r = walk_deep(plan, &walk);
+    for (int g = 0, end; r == 0 && g < n; g = end) {
+        const char *parent = keys[g].parent;
+        int nglobs = 0;
+        for (end = g; end < n && keys[end].parent == parent; end++) {
+            const char *glob = plan->patterns[keys[end].index].glob;
+            if (!plan->patterns[keys[end].index].simple) {
+                if ((r = add_walked(plan, &walk, keys[end].index)) < 0) break;
+            } else if (strpbrk(glob, "*?[\\")) {
+                keys[g + nglobs++].index = keys[end].index;
+            } else if ((r = match_entry(plan, parent, glob, keys[end].index)) < 0) {
+                break;
+            }
+        }
+        if (r < 0 || nglobs == 0) continue;
+
+        if (nglobs == 1)
+            plan_debug(plan, "scanning '%s' for '%s'", parent,
+                       plan->patterns[keys[g].index].glob);
+        else
+            plan_debug(plan, "scanning '%s' for %d patterns", parent, nglobs);
+
+        DIR *dp = opendir(parent);
+        if (!dp) {
+            plan_debug(plan, "  opendir failed: %s", strerror(errno));
+            continue;
+        }
+        struct dirent *ent;
+        while (r == 0 && (ent = readdir(dp)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                continue;
+            for (int k = g; k < g + nglobs; k++) {
+                if (fnmatch(plan->patterns[keys[k].index].glob, ent->d_name, 0) == 0) {
+                    r = match_entry(plan, parent, ent->d_name, keys[k].index);
+                    break;
+                }
+            }
+        }
+        closedir(dp);
+    }
+    walk_free(&walk);
+    free(keys);
+    if (r < 0) return r;
+
+    rmp_plan_create_targets(plan);
+    if ((r = coalesce(plan)) < 0) return r;
+    plan->resolved = 1;
+    return plan->num_mounts;
+}
+
+rmp_plan_t *rmp_plan_clone(const rmp_plan_t *src, const char *target_dir) {
+    if (!src->resolved) {
+        errno = EINVAL;
+        fail(RMP_ERR_INVAL, "plan has not been resolved");
+        return NULL;
+    }
+    rmp_plan_t *plan = rmp_plan_new(target_dir);
+    if (!plan) return NULL;
+    plan->debug_fp = src->debug_fp;
+    plan->userns_fd = src->userns_fd;
+    plan->cgroup_fd = src->cgroup_fd;
+    if (src->stage && !(plan->stage = arena_intern(&plan->arena, src->stage,
+                                                   strlen(src->stage))))
+        goto fail;
+
+    for (int i = 0; i < src->num_patterns; i++)
+        if (rmp_plan_add_mapping(plan, src->patterns[i].mapping) < 0) goto fail;
+
+    // Only the target changes, and mount sources are built from it
+    for (int i = 0; i < src->num_mounts; i++) {
+        const plan_mount_t *m = &src->mounts[i];
+        if (add_mount(plan, m->original, (size_t)(m->name - m->original), m->pattern,
+                      m->is_dir) < 0)
+            goto fail;
+    }
+    plan->resolved = 1;
+    return plan;
+
+fail:
+    rmp_plan_free(plan);
+    errno = ENOMEM;
+    return NULL;
+}
+
+/*** Namespace setup ******************************/
+
+// Write a single string to a file.  Used for /proc/self/uid_map etc.
+static int write_proc(const char *path, const char *data) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t len = (ssize_t)strlen(data);
+    ssize_t written = write(fd, data, (size_t)len);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return (written == len) ? 0 : -1;
+}
+
+// Map our real UID/GID to 0 in the user namespace just created:
+// "<inner> <outer> <count>".  We need to be root inside (CAP_SYS_ADMIN)
+// to perform bind mounts.
+//
+// We also write "deny" to /proc/self/setgroups, which is required by the
+// kernel before writing gid_map in an unprivileged user namespace (prevents
+// a process from granting itself supplementary groups it doesn't have).
+static int write_id_maps(const rmp_plan_t *plan, uid_t uid, gid_t gid) {
+    if (write_proc("/proc/self/setgroups", "deny") != 0 && plan) {
+        // Some kernels don't have this file (pre-3.19); continue anyway
+        plan_debug(plan, "warning: could not write /proc/self/setgroups: %s",
+                   strerror(errno));
+    }
+
+    char map[64];
+    snprintf(map, sizeof(map), "0 %u 1", uid);
+    if (write_proc("/proc/self/uid_map", map) != 0)
+        return fail(RMP_ERR_IDMAP, "failed to write uid_map: %s", strerror(errno));
+    snprintf(map, sizeof(map), "0 %u 1", gid);
+    if (write_proc("/proc/self/gid_map", map) != 0)
+        return fail(RMP_ERR_IDMAP, "failed to write gid_map: %s", strerror(errno));
+    return 0;
+}
+
+// Enter a new user + mount namespace and set up UID/GID mappings.
+//
+// unshare(CLONE_NEWUSER) creates a new user namespace where this process
+// has full capabilities (including CAP_SYS_ADMIN for mounting).  No root
+// privileges are needed — the kernel allows any unprivileged user to create
+// a user namespace.
+//
+// unshare(CLONE_NEWNS) creates a private mount table.  Any mounts we make
+// are only visible to this process and its children.
+//
+// After unshare, we must write UID/GID mappings into /proc/self/uid_map and
+// /proc/self/gid_map so the kernel knows how to translate our real UID/GID
+// into the namespace.  Without this, we'd appear as "nobody" (65534).
+//
+// With a shared user namespace (rmp_plan_set_userns()) all of that was
+// done once, by its keeper: setns() gives us the same capabilities in it,
+// since our uid owns it, and only the mount table is new.
+static int setup_namespace(const rmp_plan_t *plan) {
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (plan->userns_fd >= 0) {
+        if (setns(plan->userns_fd, CLONE_NEWUSER) != 0)
+            return fail(RMP_ERR_USERNS, "setns(CLONE_NEWUSER) into the shared user "
+                        "namespace failed: %s", strerror(errno));
+        if (unshare(CLONE_NEWNS) != 0)
+            return fail(RMP_ERR_USERNS, "unshare(CLONE_NEWNS) failed: %s",
+                        strerror(errno));
+        plan_debug(plan, "joined shared user namespace, mount namespace created "
+                   "in %.3f ms", elapsed_ms(&t0));
+        return 0;
+    }
+
+    if (unshare(CLONE_NEWUSER | CLONE_NEWNS) != 0)
+        return fail(RMP_ERR_USERNS, "unshare(CLONE_NEWUSER | CLONE_NEWNS) failed: %s",
+                    strerror(errno));
+    int r = write_id_maps(plan, uid, gid);
+    if (r < 0) return r;
+
+    plan_debug(plan, "namespace created: uid %u -> 0, gid %u -> 0 in %.3f ms",
+               uid, gid, elapsed_ms(&t0));
+    return 0;
+}
+
+/*** Shared user namespace ************************/
+//
+// Every launch normally creates a user namespace of its own, just to
+// hold the capabilities to mount: hundreds of instances use up hundreds
+// of user.max_user_namespaces, and each costs kernel memory and a round
+// of id-map writes.  Instead a keeper process can create one and sit in
+// it, for launches to setns() into.
+//
+// The keeper is found through a small file, "<pid> <ns inode>\n".  The
+// pid alone could have been reused, but /proc/<pid>/ns/user with that
+// inode, owned by our uid, is the keeper's namespace whoever holds it
+// now.  Each open touches the file, and the keeper exits once it has
+// gone idle_secs untouched; instances still running keep the namespace
+// alive on their own, and the next open starts a new keeper.
+
+#ifndef NS_GET_OWNER_UID
+#define NS_GET_OWNER_UID _IO(0xb7, 0x4)
+#endif
+
+typedef struct {
+    int err, errnum;
+    pid_t pid;
+    unsigned long long ino;
+    char msg[256];
+} keeper_report_t;
+
+// An fd on the user namespace the keeper file fd names, or -1 if it
+// names none (empty, or its keeper gone)
+static int userns_from_file(int fd) {
+    char buf[64];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    long pid;
+    unsigned long long ino;
+    if (sscanf(buf, "%ld %llu", &pid, &ino) != 2 || pid <= 0) return -1;
+
+    // An exited keeper nobody has reaped yet (a container's init may
+    // never) still has its namespace, but is no longer holding it
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+    int sfd = open(path, O_RDONLY | O_CLOEXEC);
+    if (sfd < 0) return -1;
+    n = read(sfd, buf, sizeof(buf) - 1);
+    close(sfd);
+    buf[n > 0 ? n : 0] = '\0';
+    const char *state = strrchr(buf, ')');
+    if (!state || state[1] != ' ' || state[2] == 'Z' || state[2] == 'X') return -1;
+
+    snprintf(path, sizeof(path), "/proc/%ld/ns/user", pid);
+    int ns = open(path, O_RDONLY | O_CLOEXEC);
+    if (ns < 0) return -1;
+    struct stat st;
+    uid_t owner;
+    if (fstat(ns, &st) != 0 || (unsigned long long)st.st_ino != ino ||
+        (ioctl(ns, NS_GET_OWNER_UID, &owner) == 0 && owner != getuid())) {
+        close(ns);
+        return -1;
+    }
+    return ns;
+}
+
+// Lock the keeper file at path, for starting a keeper or retiring one.
+// Returns the locked fd, or -1 with errno set.
+static int lock_keeper_file(const char *path, int create) {
+    for (;;) {
+        int fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC | (create ? O_CREAT : 0),
+                      0600);
+        if (fd < 0) return -1;
+        struct stat held, now;
+        if (flock(fd, LOCK_EX) != 0 || fstat(fd, &held) != 0) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        // A keeper retiring unlinks the file under the lock: if that
+        // happened while we waited, ours is no longer the one at path
+        if (stat(path, &now) == 0 && now.st_ino == held.st_ino && now.st_dev == held.st_dev)
+            return fd;
+        close(fd);
+        if (!create) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+}
+
+// The keeper: report back over fd report, then wait out its idle time
+static void __attribute__((noreturn)) keeper_main(int report, const char *path,
+                                                  int idle_secs) {
+    keeper_report_t rep = { 0, 0, getpid(), 0, "" };
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    struct stat st;
+    if (unshare(CLONE_NEWUSER) != 0) {
+        rep.err = fail(RMP_ERR_USERNS, "unshare(CLONE_NEWUSER) failed: %s",
+                       strerror(errno));
+    } else if ((rep.err = write_id_maps(NULL, uid, gid)) == 0) {
+        if (stat("/proc/self/ns/user", &st) == 0) rep.ino = (unsigned long long)st.st_ino;
+        else rep.err = fail(RMP_ERR_USERNS, "/proc/self/ns/user: %s", strerror(errno));
+    }
+    rep.errnum = errno;
+    memcpy(rep.msg, t_errmsg, sizeof(rep.msg) - 1);
+    if (write(report, &rep, sizeof(rep)) < 0) {}
+    if (rep.err) _exit(1);
+
+    // Hold nothing of the process that started us
+    if (chdir("/") != 0) {}
+    int null = open("/dev/null", O_RDWR);
+    for (int fd = 0; fd < 3 && null >= 0; fd++) dup2(null, fd);
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) != 0)
+#endif
+        for (int fd = 3; fd < 1024; fd++) close(fd);
+
+    // Our starter holds the lock until it has recorded us
+    int fd = lock_keeper_file(path, 0);
+    if (fd < 0) _exit(0);
+    close(fd);
+
+    for (;;) {
+        fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) _exit(0);
+        char buf[64];
+        ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        buf[n > 0 ? n : 0] = '\0';
+        if (atol(buf) != (long)rep.pid || fstat(fd, &st) != 0) _exit(0);  // replaced
+        close(fd);
+        long idle = (long)(time(NULL) - st.st_mtime);
+        if (idle_secs <= 0 || idle < idle_secs) {
+            sleep(idle_secs <= 0 ? 3600 : (unsigned)(idle_secs - (idle > 0 ? idle : 0)));
+            continue;
+        }
+        // Retire, unless an open touched the file since
+        if ((fd = lock_keeper_file(path, 0)) < 0) _exit(0);
+        if (fstat(fd, &st) == 0 && time(NULL) - st.st_mtime >= idle_secs) {
+            unlink(path);
+            _exit(0);
+        }
+        close(fd);
+    }
+}
+
+// Start a keeper for the locked file fd and record it there.  Returns 0
+// or -RMP_ERR_*.
+static int start_keeper(int fd, const char *path, int idle_secs) {
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) != 0)
+        return fail(RMP_ERR_SPAWN, "pipe: %s", strerror(errno));
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Detached, in a session of its own, and not our child to reap
+        close(pfd[0]);
+        if (fork() != 0) _exit(0);
+        setsid();
+        keeper_main(pfd[1], path, idle_secs);
+    }
+    close(pfd[1]);
+    if (pid < 0) {
+        int r = fail(RMP_ERR_SPAWN, "fork: %s", strerror(errno));
+        close(pfd[0]);
+        return r;
+    }
+    waitpid(pid, NULL, 0);
+
+    keeper_report_t rep;
+    ssize_t n;
+    do n = read(pfd[0], &rep, sizeof(rep)); while (n < 0 && errno == EINTR);
+    close(pfd[0]);
+    if (n != (ssize_t)sizeof(rep)) {
+        errno = EIO;
+        return fail(RMP_ERR_SPAWN, "user namespace keeper failed without a report");
+    }
+    if (rep.err) {
+        rep.msg[sizeof(rep.msg) - 1] = '\0';
+        errno = rep.errnum;
+        return fail(-rep.err, "user namespace keeper: %s", rep.msg);
+    }
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "%ld %llu\n", (long)rep.pid, rep.ino);
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, line, (size_t)len, 0) != len) {
+        int r = fail(RMP_ERR_USERNS, "writing %s: %s", path, strerror(errno));
+        kill(rep.pid, SIGTERM);
+        return r;
+    }
+    return 0;
+}
+
+int rmp_userns_open(const char *path, int idle_secs) {
+    char def[PATH_MAX];
+    if (!path) {
+        const char *run = getenv("XDG_RUNTIME_DIR");
+        if (run && run[0] == '/')
+            snprintf(def, sizeof(def), "%s/remapper-userns", run);
+        else
+            snprintf(def, sizeof(def), "/tmp/remapper-userns-%u", getuid());
+        path = def;
+    }
+
+    // Usually the keeper is there: no lock needed to join it
+    int fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    int ns = -1;
+    if (fd >= 0) {
+        ns = userns_from_file(fd);
+        close(fd);
+    }
+    if (ns < 0) {
+        if ((fd = lock_keeper_file(path, 1)) < 0)
+            return fail(RMP_ERR_USERNS, "%s: %s", path, strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_uid != getuid()) {
+            // In /tmp anyone could have made it: don't trust theirs
+            close(fd);
+            errno = EACCES;
+            return fail(RMP_ERR_USERNS, "%s: not owned by us", path);
+        }
+        // Whoever held the lock before us may have started one
+        if ((ns = userns_from_file(fd)) < 0) {
+            int r = start_keeper(fd, path, idle_secs);
+            if (r == 0 && (ns = userns_from_file(fd)) < 0)
+                r = fail(RMP_ERR_USERNS, "user namespace keeper vanished");
+            if (r < 0) {
+                close(fd);
+                return r;
+            }
+        }
+        close(fd);
+    }
+    // Keep the keeper from going idle
+    utimensat(AT_FDCWD, path, NULL, AT_SYMLINK_NOFOLLOW);
+    return ns;
+}
+
+int rmp_userns_count(void) {
+    struct stat self, st;
+    DIR *d = opendir("/proc");
+    if (!d || stat("/proc/self/ns/user", &self) != 0) {
+        if (d) closedir(d);
+        return -1;
+    }
+    uid_t uid = getuid();
+    ino_t *seen = NULL;
+    int n = 0, cap = 0;
+    struct dirent *de;
+    char path[NAME_MAX + 16];
+    while ((de = readdir(d)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) continue;
+        if (fstatat(dirfd(d), de->d_name, &st, 0) != 0 || st.st_uid != uid) continue;
+        snprintf(path, sizeof(path), "%s/ns/user", de->d_name);
+        if (fstatat(dirfd(d), path, &st, 0) != 0 || st.st_ino == self.st_ino) continue;
+        int i = 0;
+        while (i < n && seen[i] != st.st_ino) i++;
+        if (i < n) continue;
+        if (n == cap) {
+            ino_t *grown = realloc(seen, (size_t)(cap = cap ? cap * 2 : 64) * sizeof(*seen));
+            if (!grown) break;
+            seen = grown;
+        }
+        seen[n++] = st.st_ino;
+    }
+    closedir(d);
+    free(seen);
+    return n;
+}
+
+/*** Bind mounts **********************************/
+
+// Milliseconds since t0 (CLOCK_MONOTONIC)
+static double elapsed_ms(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+// Mount the staging tmpfs and copy each mount source onto it
+static int stage_mounts(const rmp_plan_t *plan) {
+    char stage[PATH_MAX], source[PATH_MAX], copy[PATH_MAX];
+    stage_dir(plan, stage, sizeof(stage));
+    rmp_mkdirs(stage, 0700);
+    if (mount("tmpfs", stage, "tmpfs", MS_NOSUID | MS_NODEV, plan->stage) != 0)
+        return fail(RMP_ERR_MOUNT, "tmpfs mount on %s (%s) failed: %s",
+                    stage, plan->stage, strerror(errno));
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if (plan->patterns[m->pattern].tmpfs) continue;
+        staged_source(plan, m, copy, sizeof(copy));
+        *strrchr(copy, '/') = '\0';
+        rmp_mkdirs(copy, 0700);
+        staged_source(plan, m, copy, sizeof(copy));
+        if (rmp_sync_tree(mount_source(plan, m, source, sizeof(source)), copy, 0, 0,
+                          &st) != 0)
+            return fail(RMP_ERR_STAGE, "staging %s failed: %s", source, strerror(errno));
+    }
+    plan_debug(plan, "staged %ld file(s), %lld bytes on %s (%s) in %.1f ms",
+               st.files, st.bytes, stage, plan->stage, elapsed_ms(&t0));
+    return 0;
+}
+
+static int pattern_used(const rmp_plan_t *plan, int pattern) {
+    for (int i = 0; i < plan->num_mounts; i++)
+        if (plan->mounts[i].pattern == pattern) return 1;
+    return 0;
+}
+
+// A fresh tmpfs for a tmpfs: pattern, private to this namespace and gone
+// with it.  The kernel enforces the size cap.
+static int mount_tmpfs(const rmp_plan_t *plan, int pattern) {
+    char dir[PATH_MAX];
+    const char *opts = plan->patterns[pattern].tmpfs;
+    tmpfs_dir(plan, pattern, dir, sizeof(dir));
+    rmp_mkdirs(dir, 0700);
+    if (mount("tmpfs", dir, "tmpfs", MS_NOSUID | MS_NODEV, opts) != 0)
+        return fail(RMP_ERR_MOUNT, "tmpfs mount on %s (%s) failed: %s",
+                    dir, opts, strerror(errno));
+    plan_debug(plan, "mounted tmpfs: %s (%s)", dir, opts);
+    return 0;
+}
+
+// Perform bind mounts: for each entry, mount the target path over the
+// original path.
+//
+// A bind mount (MS_BIND) makes a file or directory appear at a second
+// location in the filesystem tree.  Unlike symlinks, bind mounts are
+// transparent to applications — they see the mounted content as if it
+// were the original path.  MS_REC also carries over any sub-mounts.
+//
+// Because we're inside a private mount namespace (from setup_namespace),
+// these mounts are completely invisible to other processes on the system.
+// When the last process in it exits, the namespace is destroyed and the
+// mounts vanish automatically.
+static int perform_mounts(const rmp_plan_t *plan) {
+    char source[PATH_MAX];
+
+    for (int p = 0; p < plan->num_patterns; p++) {
+        if (!plan->patterns[p].tmpfs || !pattern_used(plan, p)) continue;
+        int r = mount_tmpfs(plan, p);
+        if (r < 0) return r;
+    }
+
+    int r = plan->stage ? stage_mounts(plan) : 0;
+    if (r < 0) return r;
+
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if (plan->stage && !plan->patterns[m->pattern].tmpfs)
+            staged_source(plan, m, source, sizeof(source));
+        else
+            mount_source(plan, m, source, sizeof(source));
+
+        // Sources on a tmpfs start out missing, and under a deep glob
+        // so do the directories above them
+        if (plan->patterns[m->pattern].tmpfs) {
+            if (m->is_dir) {
+                rmp_mkdirs(source, 0755);
+            } else {
+                char *slash = strrchr(source, '/');
+                *slash = '\0';
+                rmp_mkdirs(source, 0755);
+                *slash = '/';
+                int fd = open(source, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+                if (fd >= 0) close(fd);
+            }
+        }
+
+        // Bind mounts require the mount point to exist.  For files whose
+        // original is gone, create an empty one to mount over.
+        if (m->is_dir) {
+            rmp_mkdirs(m->original, 0755);
+        } else {
+            struct stat sb;
+            if (stat(m->original, &sb) != 0) {
+                char parent[PATH_MAX];
+                snprintf(parent, sizeof(parent), "%s", m->original);
+                char *slash = strrchr(parent, '/');
+                if (slash) {
+                    *slash = '\0';
+                    rmp_mkdirs(parent, 0755);
+                }
+                int fd = open(m->original, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+                if (fd >= 0) close(fd);
+            }
+        }
+
+        if (mount(source, m->original, NULL, MS_BIND | MS_REC, NULL) != 0)
+            return fail(RMP_ERR_MOUNT, "bind mount %s -> %s failed: %s",
+                        source, m->original, strerror(errno));
+
+        plan_debug(plan, "mounted: %s -> %s", source, m->original);
+    }
+    return 0;
+}
+
+int rmp_plan_enter(const rmp_plan_t *plan) {
+    if (!plan->resolved) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "plan has not been resolved");
+    }
+    if (plan->num_mounts == 0 && !plan->watching) return 0;
+    int r = setup_namespace(plan);
+    return r < 0 ? r : perform_mounts(plan);
+}
+
+int rmp_plan_sync(const rmp_plan_t *plan, rmp_sync_stats_t *stats) {
+    if (!plan->stage) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, "plan is not staged");
+    }
+    char source[PATH_MAX], copy[PATH_MAX];
+    rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+    int r = 0;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if (plan->patterns[m->pattern].tmpfs) continue;
+        staged_source(plan, m, copy, sizeof(copy));
+        mount_source(plan, m, source, sizeof(source));
+        // Keep going: one unwritable file shouldn't cost the rest
+        if (rmp_sync_tree(copy, source, 0, 0, &st) != 0 && r == 0)
+            r = fail(RMP_ERR_STAGE, "writing back %s failed: %s", source, strerror(errno));
+    }
+    plan_debug(plan, "synced %ld file(s), %lld bytes, %ld removed in %.1f ms",
+               st.files, st.bytes, st.removed, elapsed_ms(&t0));
+    if (stats) {
+        stats->files += st.files;
+        stats->reflinked += st.reflinked;
+        stats->bytes += st.bytes;
+        stats->removed += st.removed;
+        stats->failed += st.failed;
+    }
+    return r;
+}
+
+/*** Watching for new matches ********************/
+//
+// inotify on each pattern's parent in the real filesystem (the parent
+// itself is never mounted over), so the keeper sees what the program
+// creates there.  It can't see who created it, though: with several
+// watched instances sharing a parent, a new match goes to whichever
+// keeper handles it first.  The stand-ins keepers leave behind are
+// marked with an xattr so that at least they aren't taken for new
+// entries - moving one would detach the mount on it in the other
+// namespace.
+
+#define STANDIN_XATTR "user.remapper.stand-in"
+
+int rmp_plan_watch(rmp_plan_t *plan) {
+    if (plan->watching) return plan->watch_fd;
+    // A new match is renamed into its target, never copied, so that the
+    // program doesn't lose it meanwhile; a tmpfs is another filesystem
+    if (plan->stage) {
+        errno = EINVAL;
+        return fail(RMP_ERR_WATCH, "a staged plan can't be watched");
+    }
+    for (int p = 0; p < plan->num_patterns; p++) {
+        if (plan->patterns[p].tmpfs) {
+            errno = EINVAL;
+            return fail(RMP_ERR_WATCH, "a tmpfs mapping can't be watched: %s",
+                        plan->patterns[p].mapping);
+        }
+    }
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0) return fail(RMP_ERR_WATCH, "inotify_init1: %s", strerror(errno));
+
+    for (int p = 0; p < plan->num_patterns; p++) {
+        const char *parent = plan->patterns[p].parent;
+        if (!plan->patterns[p].simple) {
+            plan_debug(plan, "not watching for '%s%s': wildcards above the last component",
+                       parent, plan->patterns[p].glob);
+            continue;
+        }
+        int wd = inotify_add_watch(fd, parent, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd < 0) {
+            // A parent that doesn't exist yet can't gain matches we'd see
+            plan_debug(plan, "cannot watch '%s': %s", parent, strerror(errno));
+            continue;
+        }
+        if (wd >= plan->cap_watch) {
+            int cap = wd * 2 + 8;
+            const char **w = realloc(plan->watch_parents, (size_t)cap * sizeof(*w));
+            if (!w) {
+                close(fd);
+                return fail(RMP_ERR_NOMEM, "out of memory");
+            }
+            memset(w + plan->cap_watch, 0, (size_t)(cap - plan->cap_watch) * sizeof(*w));
+            plan->watch_parents = w;
+            plan->cap_watch = cap;
+        }
+        if (!plan->watch_parents[wd]) plan_debug(plan, "watching '%s'", parent);
+        plan->watch_parents[wd] = parent;
+    }
+    plan->watch_fd = fd;
+    plan->watching = 1;
+    return fd;
+}
+
+// Create an empty file or directory at path (a ".rmp-" name, which
+// watchers skip), marked as a stand-in before it is swapped into place
+static int make_standin(const char *path, int is_dir) {
+    if (is_dir) {
+        if (mkdir(path, 0755) != 0) return -1;
+    } else {
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+        close(fd);
+    }
+    // Best effort: without it, only another watcher could mistake it
+    (void)lsetxattr(path, STANDIN_XATTR, "1", 1, 0);
+    return 0;
+}
+
+static void remove_standin(const char *path, int is_dir) {
+    if (is_dir) rmdir(path); else unlink(path);
+}
+
+// Exchange the entries at paths a and b.  A mount on either entry goes
+// with it, which rename(2) refuses to do for mount points in the
+// caller's namespace; so a child does it from a private copy of the
+// namespace with the copies of those mounts detached.
+static int swap_entries(const char *a, const char *b) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (unshare(CLONE_NEWNS) != 0 ||
+            mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0)
+            _exit(errno);
+        umount2(a, MNT_DETACH);
+        umount2(b, MNT_DETACH);
+        if (syscall(SYS_renameat2, AT_FDCWD, a, AT_FDCWD, b, RENAME_EXCHANGE) != 0)
+            _exit(errno);
+        _exit(0);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR) return -1;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        errno = WIFEXITED(status) ? WEXITSTATUS(status) : ECHILD;
+        return -1;
+    }
+    return 0;
+}
+
+// Move the new entry parent + name into the pattern's target and mount
+// it back.  The program's path names its entry throughout: a stand-in
+// is mounted over with the entry and swapped in for it, and only then
+// is the entry renamed from under the mount into the target.  A target
+// it can't be renamed into (another filesystem) is refused and the
+// swap undone.  Returns 1 if mounted, 0 if skipped or failed (logged).
+static int hot_add(rmp_plan_t *plan, const char *parent, const char *name, int pattern) {
+    size_t plen = strlen(parent);
+    for (int i = 0; i < plan->num_mounts; i++) {
+        const plan_mount_t *m = &plan->mounts[i];
+        if ((size_t)(m->name - m->original) == plen && strcmp(m->name, name) == 0 &&
+            strncmp(m->original, parent, plen) == 0)
+            return 0;   // ours already, or our own stand-in
+    }
+
+    char original[PATH_MAX], source[PATH_MAX], dir[PATH_MAX];
+    char standin[PATH_MAX], moved[PATH_MAX];
+    snprintf(original, sizeof(original), "%s%s", parent, name);
+    struct stat sb;
+    char mark;
+    if (lstat(original, &sb) != 0) return 0;    // gone again
+    if (!S_ISDIR(sb.st_mode) && !S_ISREG(sb.st_mode)) {
+        plan_debug(plan, "not hot-adding %s: not a file or directory", original);
+        return 0;
+    }
+    if (lgetxattr(original, STANDIN_XATTR, &mark, 1) == 1) {
+        plan_debug(plan, "not hot-adding %s: another instance's stand-in", original);
+        return 0;
+    }
+
+    int is_dir = S_ISDIR(sb.st_mode);
+    if (add_mount(plan, original, plen, pattern, is_dir) < 0) return 0;
+    const plan_mount_t *m = &plan->mounts[plan->num_mounts - 1];
+    mount_source(plan, m, source, sizeof(source));
+    snprintf(dir, sizeof(dir), "%s", source);
+    *strrchr(dir, '/') = '\0';
+    rmp_mkdirs(dir, 0755);
+    if (snprintf(standin, sizeof(standin), "%s.rmp-standin-%d-%s", parent, (int)getpid(),
+                 name) >= (int)sizeof(standin) ||
+        snprintf(moved, sizeof(moved), "%s/.rmp-moving-%d-%s", dir, (int)getpid(),
+                 name) >= (int)sizeof(moved)) {
+        errno = ENAMETOOLONG;
+        plan->num_mounts--;
+        plan_debug(plan, "hot-add of %s failed: %s", original, strerror(errno));
+        return 0;
+    }
+
+    const char *step = "stand-in";
+    if (make_standin(standin, is_dir) != 0) goto failed;
+    step = "bind mount";
+    if (mount(original, standin, NULL, MS_BIND | MS_REC, NULL) != 0) goto drop_standin;
+    step = "swap";
+    if (swap_entries(original, standin) != 0) goto unmount;
+
+    // The stand-in (and the mount) is at original, the entry at standin
+    step = "move";
+    if (rename(standin, moved) != 0) goto swap_back;
+    // The program's new entry wins over anything the target had
+    rmp_remove_tree(source);
+    if (rename(moved, source) != 0) {
+        int saved = errno;
+        if (rename(moved, standin) != 0) {
+            plan_debug(plan, "hot-add of %s stuck at %s: %s", original, moved,
+                       strerror(saved));
+            return 1;   // still mounted, just not under its name
+        }
+        errno = saved;
+        goto swap_back;
+    }
+
+    plan_debug(plan, "hot-added: %s -> %s (%s)", source, original, is_dir ? "dir" : "file");
+    return 1;
+
+swap_back: {
+    // Give the program its entry back where it left it
+    int saved = errno;
+    if (swap_entries(original, standin) != 0) {
+        plan_debug(plan, "hot-add of %s failed at %s (%s), left mounted from %s",
+                   original, step, strerror(saved), standin);
+        return 1;
+    }
+    errno = saved;
+}
+unmount: {
+    int saved = errno;
+    umount2(standin, MNT_DETACH);
+    errno = saved;
+}
+drop_standin: {
+    int saved = errno;
+    remove_standin(standin, is_dir);
+    errno = saved;
+}
+failed:
+    plan_debug(plan, "hot-add of %s failed at %s: %s", original, step, strerror(errno));
+    plan->num_mounts--;
+    return 0;
+}
+
+// Rescan every watched parent, for when inotify dropped events
+static int watch_rescan(rmp_plan_t *plan) {
+    int added = 0;
+    for (int p = 0; p < plan->num_patterns; p++) {
+        const plan_pattern_t *pat = &plan->patterns[p];
+        DIR *dp = pat->simple ? opendir(pat->parent) : NULL;
+        if (!dp) continue;
+        struct dirent *ent;
+        while ((ent = readdir(dp)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 ||
+                strncmp(ent->d_name, ".rmp-", 5) == 0)
+                continue;
+            if (fnmatch(pat->glob, ent->d_name, 0) == 0)
+                added += hot_add(plan, pat->parent, ent->d_name, p);
+        }
+        closedir(dp);
+    }
+    return added;
+}
+
+int rmp_plan_watch_handle(rmp_plan_t *plan) {
+    if (!plan->watching) {
+        errno = EINVAL;
+        return fail(RMP_ERR_WATCH, "plan is not watched");
+    }
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int added = 0;
+    for (;;) {
+        ssize_t n = read(plan->watch_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        if (n <= 0) return fail(RMP_ERR_WATCH, "reading inotify events: %s", strerror(errno));
+
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                plan_debug(plan, "inotify queue overflowed: rescanning");
+                added += watch_rescan(plan);
+                continue;
+            }
+            if (!ev->len || ev->wd < 0 || ev->wd >= plan->cap_watch ||
+                !plan->watch_parents[ev->wd] || strncmp(ev->name, ".rmp-", 5) == 0)
+                continue;
+            const char *parent = plan->watch_parents[ev->wd];
+            for (int k = 0; k < plan->num_patterns; k++) {
+                if (plan->patterns[k].parent == parent && plan->patterns[k].simple &&
+                    fnmatch(plan->patterns[k].glob, ev->name, 0) == 0) {
+                    added += hot_add(plan, parent, ev->name, k);
+                    break;
+                }
+            }
+        }
+    }
+    return added;
+}
+
+/*** Spawning *************************************/
+
+// What a child that failed before exec reports over the pipe
+typedef struct {
+    int err;
+    int errnum;
+    char msg[sizeof(t_errmsg)];
+} spawn_report_t;
+
+// struct clone_args up to version 2 (88 bytes, 5.7+: cgroup), without
+// <linux/sched.h>
+typedef struct {
+    uint64_t flags, pidfd, child_tid, parent_tid;
+    uint64_t exit_signal, stack, stack_size, tls;
+    uint64_t set_tid, set_tid_size, cgroup;
+} clone_args_t;
+
+#define CLONE_ARGS_SIZE_VER0 64
+#define CLONE_ARGS_SIZE_VER2 88
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+// fork(), handing back a pidfd for the child.  clone3 creates both at
+// once; the fork + pidfd_open fallback is race-free too, as the child
+// can't be reaped (and its pid reused) before we open it.  With cgroup
+// >= 0, clone3 starts the child there if it can; *placed says whether.
+static pid_t fork_pidfd(int *pidfd, int cgroup, int *placed) {
+    *pidfd = -1;
+    *placed = 0;
+#ifdef SYS_clone3
+    int fd = -1;
+    clone_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_PIDFD;
+    args.pidfd = (uint64_t)(uintptr_t)&fd;
+    args.exit_signal = SIGCHLD;
+    long pid = -1;
+    if (cgroup >= 0) {
+        args.flags |= CLONE_INTO_CGROUP;
+        args.cgroup = (uint64_t)cgroup;
+        pid = syscall(SYS_clone3, &args, CLONE_ARGS_SIZE_VER2);
+        // E2BIG/EINVAL: a kernel before 5.7; anything else, e.g. EBUSY
+        // for a cgroup that has taken controllers since, is the child's
+        // to find out and report
+        if (pid >= 0) *placed = 1;
+        args.flags &= ~CLONE_INTO_CGROUP;
+        args.cgroup = 0;
+    }
+    if (pid < 0) pid = syscall(SYS_clone3, &args, CLONE_ARGS_SIZE_VER0);
+    if (pid >= 0) {
+        if (pid > 0) *pidfd = fd;
+        return (pid_t)pid;
+    }
+    if (errno != ENOSYS && errno != EPERM) return -1;  // EPERM: seccomp
+#endif
+    pid_t child = fork();
+#ifdef SYS_pidfd_open
+    if (child > 0) *pidfd = (int)syscall(SYS_pidfd_open, child, 0);
+#endif
+    return child;
+}
+
+// execvp's search, split in two so the child only calls execve: the
+// candidates are laid out here, before clone, and tried in the child,
+// where the mounts they may fall under are already in place.
+typedef struct {
+    char *paths;     // NUL-terminated candidates, then an empty one
+    char **sh_argv;  // /bin/sh, the candidate, argv[1...]: for ENOEXEC
+} exec_search_t;
+
+static int exec_search_init(exec_search_t *s, char *const argv[], char *const envp[]) {
+    const char *file = argv[0];
+    const char *path = NULL;
+    if (!strchr(file, '/')) {
+        // The program's environment decides the search, not ours
+        for (char *const *e = envp; e && *e; e++)
+            if (strncmp(*e, "PATH=", 5) == 0) { path = *e + 5; break; }
+        if (!envp) path = getenv("PATH");
+        if (!path) path = "/bin:/usr/bin";
+    }
+    size_t flen = strlen(file), n = 1, argc = 0;
+    for (const char *c = path; c && *c; c++) n += *c == ':';
+    while (argv[argc]) argc++;
+
+    s->paths = malloc((path ? strlen(path) : 0) + n * (flen + 2) + 1);
+    s->sh_argv = malloc((argc + 2) * sizeof(char *));
+    if (!s->paths || !s->sh_argv) {
+        free(s->paths);
+        free(s->sh_argv);
+        return fail(RMP_ERR_NOMEM, "out of memory");
+    }
+    char *out = s->paths;
+    if (!path) {
+        memcpy(out, file, flen + 1);
+        out += flen + 1;
+    } else if (flen) {
+        // An empty element is the current directory, as for execvp
+        for (const char *dir = path;; ) {
+            const char *end = strchrnul(dir, ':');
+            if (end > dir) {
+                memcpy(out, dir, (size_t)(end - dir));
+                out += end - dir;
+                *out++ = '/';
+            }
+            memcpy(out, file, flen + 1);
+            out += flen + 1;
+            if (!*end) break;
+            dir = end + 1;
+        }
+    }
+    *out = '\0';
+    s->sh_argv[0] = (char *)"/bin/sh";
+    s->sh_argv[1] = NULL;
+    memcpy(s->sh_argv + 2, argv + 1, argc * sizeof(char *));
+    return 0;
+}
+
+// Returns only on failure, with errno as execvp would leave it
+static void exec_search_run(exec_search_t *s, char *const argv[], char *const envp[]) {
+    int denied = 0;
+    errno = ENOENT;
+    for (char *p = s->paths; *p; p += strlen(p) + 1) {
+        execve(p, argv, envp);
+        switch (errno) {
+        case ENOEXEC:
+            // No #! line: a shell script, as execvp would have it
+            s->sh_argv[1] = p;
+            execve(s->sh_argv[0], s->sh_argv, envp);
+            return;
+        case EACCES:
+            denied = 1;
+            // fall through
+        case ENOENT: case ENOTDIR: case ESTALE: case ENODEV: case ETIMEDOUT:
+            continue;
+        default:
+            return;
+        }
+    }
+    if (denied) errno = EACCES;
+}
+
+static void exec_search_free(exec_search_t *s) {
+    int saved = errno;
+    free(s->paths);
+    free(s->sh_argv);
+    errno = saved;
+}
+
+int rmp_spawn(const rmp_plan_t *plan, char *const argv[], char *const envp[],
+              pid_t *pid_out) {
+    if (!plan->resolved || plan->stage || plan->watching || !argv || !argv[0]) {
+        errno = EINVAL;
+        return fail(RMP_ERR_INVAL, !plan->resolved ? "plan has not been resolved"
+                                   : plan->stage   ? "staged plans can't be spawned"
+                                   : plan->watching ? "watched plans can't be spawned"
+                                                   : "no program given");
+    }
+
+    char *const *env = envp ? envp : environ;
+    exec_search_t search;
+    if (exec_search_init(&search, argv, envp) != 0) return -RMP_ERR_NOMEM;
+
+    int pfd[2];
+    if (pipe2(pfd, O_CLOEXEC) != 0) {
+        int r = fail(RMP_ERR_SPAWN, "pipe: %s", strerror(errno));
+        exec_search_free(&search);
+        return r;
+    }
+
+    int pidfd, placed;
+    pid_t pid = fork_pidfd(&pidfd, plan->cgroup_fd, &placed);
+    if (pid != 0) exec_search_free(&search);
+    if (pid < 0) {
+        int r = fail(RMP_ERR_SPAWN, "clone: %s", strerror(errno));
+        close(pfd[0]);
+        close(pfd[1]);
+        return r;
+    }
+
+    if (pid == 0) {
+        close(pfd[0]);
+        // Moved while still in our user namespace, where the cgroup is ours
+        int r = 0;
+        if (plan->cgroup_fd >= 0 && !placed && rmp_cgroup_enter(plan->cgroup_fd) != 0)
+            r = fail(RMP_ERR_CGROUP, "cgroup.procs: %s", strerror(errno));
+        if (r == 0) r = rmp_plan_enter(plan);
+        if (r == 0) {
+            exec_search_run(&search, argv, env);
+            r = fail(RMP_ERR_EXEC, "%s: %s", argv[0], strerror(errno));
+        }
+        spawn_report_t rep;
+        rep.err = r;
+        rep.errnum = errno;
+        memcpy(rep.msg, t_errmsg, sizeof(rep.msg));
+        if (write(pfd[1], &rep, sizeof(rep)) < 0) {}
+        _exit(127);
+    }
+
+    // The pipe's write end closes on a successful exec: EOF means running
+    close(pfd[1]);
+    spawn_report_t rep;
+    ssize_t n;
+    do n = read(pfd[0], &rep, sizeof(rep)); while (n < 0 && errno == EINTR);
+    close(pfd[0]);
+
+    if (n == 0) {
+        if (pidfd < 0) {
+            // pidfd_open unavailable (pre-5.3 kernel): can't keep the contract
+            int r = fail(RMP_ERR_SPAWN, "pidfd_open: %s", strerror(errno));
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return r;
+        }
+        plan_debug(plan, "spawned %s as pid %d", argv[0], (int)pid);
+        if (pid_out) *pid_out = pid;
+        return pidfd;
+    }
+
+    waitpid(pid, NULL, 0);
+    if (pidfd >= 0) close(pidfd);
+    if (n != (ssize_t)sizeof(rep)) {
+        errno = EIO;
+        return fail(RMP_ERR_SPAWN, "child failed without a report");
+    }
+    rep.msg[sizeof(rep.msg) - 1] = '\0';
+    memcpy(t_errmsg, rep.msg, sizeof(t_errmsg));
+    errno = rep.errnum;
+    return rep.err;
+}
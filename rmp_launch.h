@@ -0,0 +1,188 @@
+// rmp_launch.h - librmp: build a remapping plan once, launch it many times (Linux)
+
+#ifndef RMP_LAUNCH_H
+#define RMP_LAUNCH_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "rmp_sync.h"
+
+// A plan is a target directory plus mappings, resolved to the list of
+// bind mounts they need.  Nothing here exits or prints: failures return
+// one of these codes (negated), with errno set and a description in
+// rmp_last_error().
+enum {
+    RMP_OK = 0,
+    RMP_ERR_INVAL,     // relative path, malformed mapping, unresolved plan
+    RMP_ERR_NOMEM,
+    RMP_ERR_USERNS,    // unshare(CLONE_NEWUSER | CLONE_NEWNS) or setns() refused
+    RMP_ERR_IDMAP,     // writing uid_map / gid_map failed
+    RMP_ERR_MOUNT,     // a bind mount failed
+    RMP_ERR_SPAWN,     // clone/fork or pipe failed
+    RMP_ERR_EXEC,      // the program could not be executed
+    RMP_ERR_STAGE,     // copying into or back out of a staging tmpfs failed
+    RMP_ERR_WATCH,     // inotify could not be set up or read
+    RMP_ERR_CGROUP,    // the child could not be moved into its cgroup
+};
+
+typedef struct rmp_plan rmp_plan_t;
+
+// Human-readable name for an RMP_ERR_* code (either sign).
+const char *rmp_strerror(int err);
+
+// Detail for the calling thread's most recent failure, e.g.
+// "bind mount /t/.claude -> /home/u/.claude failed: Permission denied".
+const char *rmp_last_error(void);
+
+// New plan for an absolute target directory (created if missing).
+// Returns NULL with errno set on failure.
+rmp_plan_t *rmp_plan_new(const char *target_dir);
+
+// Add an absolute mapping; any component may be a glob, and "**" any
+// number of them ("/home/u/.claude*", "/home/u/src/*/.cache").  Matches
+// go to the target at their path below the last literal directory
+// before the first wildcard.  "<mapping>=<dir>" gives it its own absolute
+// target dir instead of the plan's, and "<mapping>=tmpfs:[size]" a tmpfs
+// private to each namespace, capped at size ("512m", "2g", "25%"; the
+// kernel default if empty).  Only the last '=' followed by '/' or
+// "tmpfs:" starts a target (see rmp_mapping_target()); any other is part
+// of the path, as in "/home/u/a=b/.cache*".  Returns 0 or -RMP_ERR_INVAL.
+int rmp_plan_add_mapping(rmp_plan_t *plan, const char *mapping);
+
+// Add every mapping in a profile file: one per line, absolute or
+// starting with "~/" ($HOME), as is a "=" target (split off as for
+// rmp_plan_add_mapping, "=~/..." included); blank lines and '#'
+// comments are skipped.
+// The file is streamed, so it can hold any number of mappings.  Returns
+// the number added or -RMP_ERR_*, with the file and line in
+// rmp_last_error().
+int rmp_plan_add_profile(rmp_plan_t *plan, const char *path);
+
+// Log "[remapper] ..." lines to fp (NULL = off).  Writes go straight to
+// fileno(fp), so spawned children can log without stdio locks.
+void rmp_plan_set_debug(rmp_plan_t *plan, FILE *fp);
+
+// Launch into the user namespace nsfd (from rmp_userns_open()) instead
+// of a new one each time: rmp_plan_enter() and rmp_spawn() setns() into
+// it and unshare only a mount namespace, with no id maps to write.  The
+// fd stays the caller's and must stay open while the plan is launched;
+// clones inherit it.  -1 goes back to a user namespace per launch.
+void rmp_plan_set_userns(rmp_plan_t *plan, int nsfd);
+
+// Start rmp_spawn()'s children in the cgroup cgfd (from
+// rmp_cgroup_create()): clone3(CLONE_INTO_CGROUP) where the kernel has
+// it (5.7+), else the child moves itself before entering the namespace.
+// rmp_seccomp_spawn()'s child moves itself too.  The fd stays the
+// caller's; clones inherit it.  -1 (the default) leaves them in ours.
+void rmp_plan_set_cgroup(rmp_plan_t *plan, int cgfd);
+int rmp_plan_cgroup(const rmp_plan_t *plan);
+
+// Join, or start, the keeper process holding a user namespace for any
+// number of launches to share, recorded in the file at path (NULL =
+// $XDG_RUNTIME_DIR/remapper-userns, else /tmp/remapper-userns-<uid>).
+// The keeper exits after idle_secs (0 = never) with no call here;
+// launches already in its namespace keep that alive.  Returns an fd on
+// the namespace (close-on-exec) or -RMP_ERR_*.
+int rmp_userns_open(const char *path, int idle_secs);
+
+// How many distinct user namespaces this uid's processes are in, the
+// caller's own aside: what launches are taking of
+// user.max_user_namespaces.  -1 if /proc can't be read.
+int rmp_userns_count(void);
+
+// Stage the plan's mounts through a tmpfs (size as for "tmpfs:", ""
+// for the kernel default): rmp_plan_enter() copies every mount source
+// into it and mounts the copies instead, so writes stay in memory until
+// rmp_plan_sync() writes them back.  Mappings with their own tmpfs: target
+// are left as they are.  Staging copies files, which the spawned child
+// can't do safely, so a staged plan is for rmp_plan_enter() only.
+// Returns 0 or -RMP_ERR_INVAL.
+int rmp_plan_set_stage(rmp_plan_t *plan, const char *size);
+
+// Watch each mapping's parent dir (inotify) for new matches, to be
+// mounted by rmp_plan_watch_handle() while the program runs.  Call
+// before rmp_plan_resolve(), so nothing created in between is missed.
+// A watched plan always gets a namespace, even with no mounts yet, and
+// like a staged one is for rmp_plan_enter() only.  Staged plans and tmpfs
+// mappings can't be watched.  Returns the inotify fd to poll
+// (close-on-exec, owned by the plan) or -RMP_ERR_WATCH.
+int rmp_plan_watch(rmp_plan_t *plan);
+
+// Scan each mapping's parent for matches and create the empty targets
+// to mount over.  Call again to pick up paths that appeared since.
+// Mounts hidden by a later one or adding nothing to an earlier one are
+// dropped, and a directory whose every entry a '*' mapping sends to
+// its own otherwise empty target is mounted whole (unless staged).
+// Returns the number of bind mounts (0 = nothing matched) or -RMP_ERR_*.
+int rmp_plan_resolve(rmp_plan_t *plan);
+
+// A resolved copy of plan for another target directory (created if
+// missing): same mappings and matches, without rescanning.  Call
+// rmp_plan_create_targets() on it before spawning.  NULL on failure.
+rmp_plan_t *rmp_plan_clone(const rmp_plan_t *plan, const char *target_dir);
+
+// Create the empty files and directories to mount over, as
+// rmp_plan_resolve() does.  Safe to run for different plans in parallel.
+void rmp_plan_create_targets(const rmp_plan_t *plan);
+
+const char *rmp_plan_target(const rmp_plan_t *plan);
+int rmp_plan_num_mappings(const rmp_plan_t *plan);
+const char *rmp_plan_mapping(const rmp_plan_t *plan, int i);
+int rmp_plan_num_mounts(const rmp_plan_t *plan);
+
+// Bind mount i (0 .. rmp_plan_num_mounts() - 1): returns the path it is
+// mounted over, and writes the target path mounted there into source
+// ("" for a tmpfs: mapping, which exists only inside the namespace).
+// NULL if i is out of range.
+const char *rmp_plan_mount(const rmp_plan_t *plan, int i, char *source, size_t size);
+
+// Where an absolute, normalized path lands under the plan, for backends
+// that redirect paths instead of mounting over them: if a mapping's
+// parent plus glob matches the path's leading components (as
+// rmp_plan_resolve() matches entries, whether or not they exist), write
+// the path as it would be in the target into out and return 1.  When
+// mappings nest, the deepest wins, as its mount would be on top.
+// Returns 0 if no mapping applies (tmpfs mappings never do) or the result
+// doesn't fit.
+int rmp_plan_rewrite(const rmp_plan_t *plan, const char *path, char *out, size_t size);
+
+// Move the calling process into a new user + mount namespace (or the
+// shared user namespace and a new mount namespace) with the plan's
+// mounts in place (a plan with no mounts is a no-op).  Must be
+// single-threaded, a kernel rule for CLONE_NEWUSER and setns().  Returns 0 or
+// -RMP_ERR_*.
+int rmp_plan_enter(const rmp_plan_t *plan);
+
+// From inside a watched plan's namespace, once its fd polls readable:
+// mount each new match.  A stand-in mounted over with the new entry is
+// swapped in for it, then the entry is renamed into its target, so the
+// program sees the same content at the same path throughout, now kept
+// in the target.  A match whose target is on another filesystem is left
+// alone.  Names starting ".rmp-" and other instances' stand-ins are
+// ignored.  Returns the number of mounts added, or -RMP_ERR_WATCH.
+int rmp_plan_watch_handle(rmp_plan_t *plan);
+
+// From inside a staged plan's namespace, mirror each staged copy back
+// onto its mount source: changed files are rewritten via a temporary
+// and rename(2), and deletions carried over (see rmp_sync_tree()).
+// Adds to *stats if non-NULL.  Returns 0, or -RMP_ERR_STAGE if anything
+// could not be written back.
+int rmp_plan_sync(const rmp_plan_t *plan, rmp_sync_stats_t *stats);
+
+// Start argv[0] with envp (NULL = environ; its $PATH is searched) in a
+// new namespace built from the plan.  The plan is only read, so any number
+// of threads may spawn from one plan at once.  Staged and watched plans
+// are refused.
+//
+// Returns a pidfd (close-on-exec; poll it for exit, reap it with
+// waitid(P_PIDFD, ...)) and stores the pid in *pid if non-NULL.  The
+// return is only positive once the program has been exec'd: namespace,
+// mount and exec failures come back as -RMP_ERR_* from this call, with
+// the child already reaped.
+int rmp_spawn(const rmp_plan_t *plan, char *const argv[], char *const envp[],
+              pid_t *pid);
+
+void rmp_plan_free(rmp_plan_t *plan);
+
+#endif // RMP_LAUNCH_H
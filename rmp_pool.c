@@ -0,0 +1,248 @@
+/* rmp_pool.c - fixed-size work-stealing thread pool for remapper
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Each worker owns a deque.  A task submitted from inside a worker (a
+ * directory scan fanning out into subdirectories and files) goes on the
+ * bottom of that worker's own deque, and the worker pops from the bottom
+ * too, so a walk proceeds depth-first and its working set stays local.
+ * An idle worker steals from the top of someone else's deque -- the
+ * oldest, and usually largest, piece of work.  Tasks submitted from
+ * outside the pool go on a shared injection queue, taken in FIFO order
+ * by whichever worker runs out of local work first.
+ *
+ * Deques are short mutex-guarded lists: tasks are coarse (a directory
+ * scan, a file copy, a codesign run), so per-deque locks are plenty.
+ * One pool-wide lock covers only the sleep/wake and completion counts.
+*/
+#include "rmp_pool.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct rmp_task {
+    rmp_task_fn fn;
+    void *arg;
+    struct rmp_task *prev, *next;
+} rmp_task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    rmp_task_t *top, *bottom;  // steal from top, owner works at bottom
+} rmp_deque_t;
+
+struct rmp_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;     // signalled when a task is queued or on shutdown
+    pthread_cond_t  idle;     // signalled when `pending` drops to zero
+    long queued;              // tasks sitting in some deque
+    long pending;             // queued + running
+    int shutdown;
+    int nthreads;
+    pthread_t *threads;
+    rmp_deque_t *deques;      // one per worker
+    rmp_deque_t inject;       // submits from outside the pool (FIFO)
+};
+
+typedef struct {
+    rmp_pool_t *pool;
+    int id;
+} worker_arg_t;
+
+// Which pool (if any) the current thread is a worker of, and its deque.
+static __thread rmp_pool_t *t_pool;
+static __thread int t_id;
+
+int rmp_ncpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void push_bottom(rmp_deque_t *dq, rmp_task_t *t) {
+    pthread_mutex_lock(&dq->lock);
+    t->next = NULL;
+    t->prev = dq->bottom;
+    if (dq->bottom) dq->bottom->next = t;
+    else            dq->top = t;
+    dq->bottom = t;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static rmp_task_t *pop_bottom(rmp_deque_t *dq) {
+    pthread_mutex_lock(&dq->lock);
+    rmp_task_t *t = dq->bottom;
+    if (t) {
+        dq->bottom = t->prev;
+        if (dq->bottom) dq->bottom->next = NULL;
+        else            dq->top = NULL;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return t;
+}
+
+static rmp_task_t *pop_top(rmp_deque_t *dq) {
+    pthread_mutex_lock(&dq->lock);
+    rmp_task_t *t = dq->top;
+    if (t) {
+        dq->top = t->next;
+        if (dq->top) dq->top->prev = NULL;
+        else         dq->bottom = NULL;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return t;
+}
+
+// Own deque first, then the injection queue, then steal, starting with
+// the next worker along.
+static rmp_task_t *find_task(rmp_pool_t *pool, int id) {
+    rmp_task_t *t = pop_bottom(&pool->deques[id]);
+    if (!t) t = pop_top(&pool->inject);
+    for (int i = 1; !t && i < pool->nthreads; i++)
+        t = pop_top(&pool->deques[(id + i) % pool->nthreads]);
+    return t;
+}
+
+static void *worker_main(void *p) {
+    worker_arg_t *wa = p;
+    rmp_pool_t *pool = wa->pool;
+    int id = wa->id;
+    free(wa);
+
+    t_pool = pool;
+    t_id = id;
+
+    for (;;) {
+        rmp_task_t *t = find_task(pool, id);
+        if (!t) {
+            // `queued` is raised only after the push, under the lock, so
+            // a task queued after find_task() missed it wakes us here.
+            pthread_mutex_lock(&pool->lock);
+            while (pool->queued == 0 && !pool->shutdown)
+                pthread_cond_wait(&pool->work, &pool->lock);
+            int done = (pool->queued == 0);  // shutdown with nothing left
+            pthread_mutex_unlock(&pool->lock);
+            if (done) break;
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        t->fn(t->arg);
+        free(t);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+rmp_pool_t *rmp_pool_create(int nthreads) {
+    if (nthreads <= 0) nthreads = rmp_ncpus();
+
+    rmp_pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    pool->threads = calloc((size_t)nthreads, sizeof(pthread_t));
+    pool->deques = calloc((size_t)nthreads, sizeof(rmp_deque_t));
+    if (!pool->threads || !pool->deques) {
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (int i = 0; i < nthreads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    pthread_mutex_init(&pool->inject.lock, NULL);
+
+    // Workers index deques by nthreads, so it must be final before the
+    // first one starts; trim it afterwards if a thread fails to start.
+    pool->nthreads = nthreads;
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        worker_arg_t *wa = malloc(sizeof(*wa));
+        if (!wa) break;
+        wa->pool = pool;
+        wa->id = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, wa) != 0) {
+            free(wa);
+            break;
+        }
+        started++;
+    }
+    if (started < nthreads) {
+        // Nothing has been submitted yet, so every deque is empty: stop
+        // the workers that did start and report failure.
+        pthread_mutex_lock(&pool->lock);
+        pool->shutdown = 1;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < started; i++)
+            pthread_join(pool->threads[i], NULL);
+        pool->nthreads = 0;
+        rmp_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int rmp_pool_submit(rmp_pool_t *pool, rmp_task_fn fn, void *arg) {
+    rmp_task_t *t = malloc(sizeof(*t));
+    if (!t) return -1;
+    t->fn = fn;
+    t->arg = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    push_bottom(t_pool == pool ? &pool->deques[t_id] : &pool->inject, t);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void rmp_pool_wait(rmp_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void rmp_pool_destroy(rmp_pool_t *pool) {
+    if (!pool) return;
+    rmp_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (int i = 0; i < pool->nthreads; i++)
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    pthread_mutex_destroy(&pool->inject.lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+}
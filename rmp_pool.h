@@ -0,0 +1,30 @@
+// rmp_pool.h - fixed-size work-stealing thread pool for remapper
+
+#ifndef RMP_POOL_H
+#define RMP_POOL_H
+
+typedef void (*rmp_task_fn)(void *arg);
+
+typedef struct rmp_pool rmp_pool_t;
+
+// Number of online CPUs (at least 1).
+int rmp_ncpus(void);
+
+// Start a pool with `nthreads` workers (<= 0 means rmp_ncpus()).
+// Returns NULL on failure.
+rmp_pool_t *rmp_pool_create(int nthreads);
+
+// Queue fn(arg) to run on a worker.  Safe to call from inside a task,
+// which is how recursive walks fan out: such tasks go to the submitting
+// worker's own deque and run next, unless an idle worker steals them.  Returns 0, or -1 on failure
+// (in which case the caller still owns `arg`).
+int rmp_pool_submit(rmp_pool_t *pool, rmp_task_fn fn, void *arg);
+
+// Block until every submitted task (including tasks submitted by tasks)
+// has finished.
+void rmp_pool_wait(rmp_pool_t *pool);
+
+// Wait for outstanding work, then stop and free the pool.
+void rmp_pool_destroy(rmp_pool_t *pool);
+
+#endif // RMP_POOL_H
@@ -0,0 +1,263 @@
+/* rmp_presign.c - speculative background pre-signing of bundle siblings
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * An Electron-style app launches its main binary and then, a few seconds
+ * later, helper after helper -- each of which would block its own spawn
+ * in codesign.  Once the first binary of a bundle has been re-signed we
+ * queue its siblings here and sign them on a couple of background threads
+ * while the app starts up.
+ *
+ * Every path moves through QUEUED -> RUNNING -> DONE exactly once per
+ * scheduler, so a sibling is never signed twice by this process, and a
+ * spawn that arrives while its binary is RUNNING waits for that result
+ * instead of starting a second codesign (single flight).  A spawn that
+ * arrives while the binary is merely QUEUED claims it and does the work
+ * itself -- it never waits behind unrelated queued work.
+ *
+ * The signing work itself is a callback, so this file has no macOS
+ * dependencies and is unit-tested on Linux with a stub.
+*/
+#include "rmp_presign.h"
+#include "rmp_pool.h"
+#include "rmp_shared.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+enum { PS_QUEUED, PS_RUNNING, PS_DONE, PS_CLAIMED };
+
+typedef struct ps_item {
+    struct rmp_presign *ps;
+    struct ps_item *next;
+    int state;
+    char path[];
+} ps_item_t;
+
+typedef struct ps_bundle {
+    struct ps_bundle *next;
+    char root[];
+} ps_bundle_t;
+
+struct rmp_presign {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;  // an item left PS_RUNNING
+    ps_item_t *items;         // every path ever submitted
+    ps_bundle_t *bundles;     // bundle roots already scanned
+    rmp_pool_t *pool;
+    rmp_presign_fn fn;
+    void *arg;
+};
+
+// Caller holds ps->lock.
+static ps_item_t *find_item(rmp_presign_t *ps, const char *path) {
+    for (ps_item_t *it = ps->items; it; it = it->next)
+        if (strcmp(it->path, path) == 0) return it;
+    return NULL;
+}
+
+static void run_item(void *p) {
+    ps_item_t *it = p;
+    rmp_presign_t *ps = it->ps;
+
+    pthread_mutex_lock(&ps->lock);
+    if (it->state != PS_QUEUED) {  // claimed by a foreground spawn
+        pthread_mutex_unlock(&ps->lock);
+        return;
+    }
+    it->state = PS_RUNNING;
+    pthread_mutex_unlock(&ps->lock);
+
+    ps->fn(ps->arg, it->path);
+
+    pthread_mutex_lock(&ps->lock);
+    it->state = PS_DONE;
+    pthread_cond_broadcast(&ps->changed);
+    pthread_mutex_unlock(&ps->lock);
+}
+
+rmp_presign_t *rmp_presign_create(int jobs, rmp_presign_fn fn, void *arg) {
+    rmp_presign_t *ps = calloc(1, sizeof(*ps));
+    if (!ps) return NULL;
+
+    ps->pool = rmp_pool_create(jobs > 0 ? jobs : RMP_PRESIGN_JOBS);
+    if (!ps->pool) { free(ps); return NULL; }
+
+    pthread_mutex_init(&ps->lock, NULL);
+    pthread_cond_init(&ps->changed, NULL);
+    ps->fn = fn;
+    ps->arg = arg;
+    return ps;
+}
+
+int rmp_presign_submit(rmp_presign_t *ps, const char *path) {
+    pthread_mutex_lock(&ps->lock);
+    if (find_item(ps, path)) {
+        pthread_mutex_unlock(&ps->lock);
+        return 0;
+    }
+
+    size_t len = strlen(path);
+    ps_item_t *it = malloc(sizeof(*it) + len + 1);
+    if (!it) {
+        pthread_mutex_unlock(&ps->lock);
+        return -1;
+    }
+    it->ps = ps;
+    it->state = PS_QUEUED;
+    memcpy(it->path, path, len + 1);
+    it->next = ps->items;
+    ps->items = it;
+    pthread_mutex_unlock(&ps->lock);
+
+    if (rmp_pool_submit(ps->pool, run_item, it) != 0) {
+        pthread_mutex_lock(&ps->lock);
+        it->state = PS_DONE;  // stays in the list; never retried
+        pthread_mutex_unlock(&ps->lock);
+        return -1;
+    }
+    return 1;
+}
+
+int rmp_presign_wait(rmp_presign_t *ps, const char *path) {
+    pthread_mutex_lock(&ps->lock);
+    ps_item_t *it = find_item(ps, path);
+    int waited = 0;
+    if (it && it->state == PS_QUEUED) {
+        it->state = PS_CLAIMED;
+    } else if (it) {
+        while (it->state == PS_RUNNING) {
+            pthread_cond_wait(&ps->changed, &ps->lock);
+            waited = 1;
+        }
+    }
+    pthread_mutex_unlock(&ps->lock);
+    return waited;
+}
+
+static void submit_cb(void *arg, const char *sibling) {
+    rmp_presign_t *ps = arg;
+    rmp_presign_submit(ps, sibling);
+}
+
+int rmp_presign_bundle(rmp_presign_t *ps, const char *path) {
+    char root[PATH_MAX];
+    const char *app = strstr(path, ".app/Contents/");
+    if (!app) return 0;
+    size_t rlen = (size_t)(app - path) + 4;  // through ".app"
+    if (rlen >= sizeof(root)) return 0;
+    memcpy(root, path, rlen);
+    root[rlen] = '\0';
+
+    // Scan each bundle once: it is a directory walk per call otherwise
+    pthread_mutex_lock(&ps->lock);
+    for (ps_bundle_t *b = ps->bundles; b; b = b->next) {
+        if (strcmp(b->root, root) == 0) {
+            pthread_mutex_unlock(&ps->lock);
+            return 0;
+        }
+    }
+    ps_bundle_t *b = malloc(sizeof(*b) + rlen + 1);
+    if (b) {
+        memcpy(b->root, root, rlen + 1);
+        b->next = ps->bundles;
+        ps->bundles = b;
+    }
+    pthread_mutex_unlock(&ps->lock);
+
+    return rmp_bundle_siblings(path, RMP_PRESIGN_MAX, submit_cb, ps);
+}
+
+void rmp_presign_drain(rmp_presign_t *ps) {
+    rmp_pool_wait(ps->pool);
+}
+
+void rmp_presign_destroy(rmp_presign_t *ps) {
+    if (!ps) return;
+    rmp_pool_destroy(ps->pool);
+
+    for (ps_item_t *it = ps->items, *next; it; it = next) {
+        next = it->next;
+        free(it);
+    }
+    for (ps_bundle_t *b = ps->bundles, *next; b; b = next) {
+        next = b->next;
+        free(b);
+    }
+    pthread_mutex_destroy(&ps->lock);
+    pthread_cond_destroy(&ps->changed);
+    free(ps);
+}
+
+/*** Bundle discovery *****************************/
+
+typedef struct {
+    const char *self;
+    int max, found;
+    void (*cb)(void *, const char *);
+    void *arg;
+} sib_walk_t;
+
+static void scan_dir(sib_walk_t *w, const char *dir, int depth) {
+    DIR *dp = opendir(dir);
+    if (!dp) return;
+
+    struct dirent *ent;
+    while (w->found < w->max && (ent = readdir(dp)) != NULL) {
+        if (ent->d_name[0] == '.') continue;  // ".", "..", ".DS_Store", ...
+
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+
+        // lstat: frameworks are full of Versions/Current symlinks
+        struct stat sb;
+        if (lstat(path, &sb) != 0) continue;
+
+        if (S_ISDIR(sb.st_mode)) {
+            if (depth > 0) scan_dir(w, path, depth - 1);
+        } else if (S_ISREG(sb.st_mode) && (sb.st_mode & S_IXUSR) &&
+                   strcmp(path, w->self) != 0 &&
+                   rmp_macho_kind(path) == RMP_MACHO_EXECUTE) {
+            w->cb(w->arg, path);
+            w->found++;
+        }
+    }
+    closedir(dp);
+}
+
+int rmp_bundle_siblings(const char *path, int max,
+                        void (*cb)(void *arg, const char *sibling), void *arg) {
+    // The outermost bundle: a helper inside Contents/Frameworks/X.app
+    // belongs to the app that ships it.
+    const char *app = strstr(path, ".app/Contents/");
+    if (!app) return 0;
+
+    char contents[PATH_MAX];
+    int clen = snprintf(contents, sizeof(contents), "%.*s/Contents",
+                        (int)(app - path) + 4, path);
+    if (clen < 0 || (size_t)clen >= sizeof(contents)) return 0;
+
+    sib_walk_t w = { path, max, 0, cb, arg };
+    static const struct { const char *sub; int depth; } dirs[] = {
+        { "MacOS",      0 },
+        { "Helpers",    2 },
+        { "Frameworks", RMP_PRESIGN_DEPTH },
+    };
+
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        char dir[PATH_MAX + 16];
+        snprintf(dir, sizeof(dir), "%s/%s", contents, dirs[i].sub);
+        scan_dir(&w, dir, dirs[i].depth);
+    }
+    return w.found;
+}
@@ -0,0 +1,54 @@
+// rmp_presign.h - speculative background pre-signing of bundle siblings
+
+#ifndef RMP_PRESIGN_H
+#define RMP_PRESIGN_H
+
+// Default number of background signing threads per process.
+#define RMP_PRESIGN_JOBS   2
+
+// Upper bound on siblings queued from one bundle scan, and how deep the
+// scan descends into Contents/Frameworks.
+#define RMP_PRESIGN_MAX    64
+#define RMP_PRESIGN_DEPTH  6
+
+// Does the (possibly slow) work for one binary: check hardened state and
+// build its cache entry.  Runs on a background thread.
+typedef void (*rmp_presign_fn)(void *arg, const char *path);
+
+typedef struct rmp_presign rmp_presign_t;
+
+// Create a scheduler running `fn` on at most `jobs` threads (<= 0 means
+// RMP_PRESIGN_JOBS).  Returns NULL on failure.
+rmp_presign_t *rmp_presign_create(int jobs, rmp_presign_fn fn, void *arg);
+
+// Queue `path` unless it is already queued, running or done.
+// Returns 1 if queued, 0 if already known, -1 on error.
+int rmp_presign_submit(rmp_presign_t *ps, const char *path);
+
+// Single-flight hand-off for a spawn that needs `path` right now:
+//   - running in the background: block until it finishes, return 1
+//     (the caller should re-check the cache rather than redo the work)
+//   - queued but not started: take it off the queue, return 0 (the
+//     caller does the work itself; the background never will)
+//   - finished, or never seen: return 0 immediately
+int rmp_presign_wait(rmp_presign_t *ps, const char *path);
+
+// Find the other spawnable executables in the app bundle containing
+// `path` (Contents/MacOS, Contents/Helpers, Contents/Frameworks/...) and
+// queue them.  Each bundle is scanned once per scheduler.
+// Returns the number of binaries queued.
+int rmp_presign_bundle(rmp_presign_t *ps, const char *path);
+
+// Block until the queue is empty and nothing is running.
+void rmp_presign_drain(rmp_presign_t *ps);
+
+// Drain, then free.
+void rmp_presign_destroy(rmp_presign_t *ps);
+
+// Enumerate MH_EXECUTE binaries in the bundle containing `path`, other
+// than `path` itself, calling cb(arg, sibling) for each (at most `max`).
+// Returns the number found, or 0 if `path` is not inside a .app bundle.
+int rmp_bundle_siblings(const char *path, int max,
+                        void (*cb)(void *arg, const char *sibling), void *arg);
+
+#endif // RMP_PRESIGN_H
@@ -0,0 +1,188 @@
+/* rmp_prewarm.c - build hardened-binary cache entries ahead of first launch
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * After an app update, the first launch otherwise copies and re-signs
+ * every hardened binary it spawns, one at a time, on the critical path.
+ * `remapper --prewarm` does the same work up front and in parallel.
+ *
+ * Two kinds of pool task: a directory scan, which classifies each file
+ * by its Mach-O header (cheap, no subprocess) and queues a build task
+ * for every executable; and a build, which runs the hardened check and
+ * rmp_cache_create().  Build tasks land on the scanning worker's own
+ * deque, and idle workers steal the rest.
+*/
+#include "rmp_prewarm.h"
+#include "rmp_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    rmp_ctx_t *ctx;
+    rmp_pool_t *pool;
+    pthread_mutex_t lock;  // guards stats
+    rmp_prewarm_stats_t stats;
+} pw_state_t;
+
+typedef struct {
+    pw_state_t *st;
+    char path[];
+} pw_task_t;
+
+#define PW_DEBUG(st, fmt, ...) do { \
+    if ((st)->ctx->debug_fp) { \
+        fprintf((st)->ctx->debug_fp, "[remapper] prewarm: " fmt "\n", ##__VA_ARGS__); \
+        fflush((st)->ctx->debug_fp); \
+    } \
+} while (0)
+
+static int submit(pw_state_t *st, rmp_task_fn fn, const char *path) {
+    size_t len = strlen(path);
+    pw_task_t *task = malloc(sizeof(*task) + len + 1);
+    if (!task) return -1;
+    task->st = st;
+    memcpy(task->path, path, len + 1);
+    if (rmp_pool_submit(st->pool, fn, task) != 0) {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+static void build_task(void *arg) {
+    pw_task_t *task = arg;
+    pw_state_t *st = task->st;
+    const char *path = task->path;
+
+    struct stat sb;
+    char cached[PATH_MAX];
+    long *counter = NULL;
+    long long bytes = 0;
+
+    if (stat(path, &sb) != 0) goto out;  // vanished mid-walk
+    if (rmp_cache_lookup(st->ctx, path, sb.st_mtime, sb.st_size, cached, sizeof(cached))) {
+        counter = &st->stats.cached;
+    } else if (!rmp_is_hardened(st->ctx, path)) {
+        goto out;
+    } else if (rmp_cache_create(st->ctx, path, cached,
+                                sb.st_mtime, sb.st_size) == 0) {
+        PW_DEBUG(st, "built %s", cached);
+        counter = &st->stats.created;
+        bytes = sb.st_size;
+    } else {
+        PW_DEBUG(st, "failed %s", path);
+        counter = &st->stats.failed;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->stats.hardened++;
+    (*counter)++;
+    st->stats.bytes += bytes;
+    pthread_mutex_unlock(&st->lock);
+out:
+    free(task);
+}
+
+// Classify one regular file and queue a build if it is spawnable.
+static void examine_file(pw_state_t *st, const char *path) {
+    int kind = rmp_macho_kind(path);
+
+    pthread_mutex_lock(&st->lock);
+    st->stats.files++;
+    if (kind != RMP_MACHO_NONE)    st->stats.macho++;
+    if (kind == RMP_MACHO_EXECUTE) st->stats.executables++;
+    pthread_mutex_unlock(&st->lock);
+
+    if (kind == RMP_MACHO_EXECUTE)
+        submit(st, build_task, path);
+}
+
+static void scan_task(void *arg) {
+    pw_task_t *task = arg;
+    pw_state_t *st = task->st;
+
+    DIR *dp = opendir(task->path);
+    if (!dp) {
+        PW_DEBUG(st, "opendir %s failed: %s", task->path, strerror(errno));
+        free(task);
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", task->path, ent->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+
+        if (ent->d_type != DT_DIR && ent->d_type != DT_REG &&
+            ent->d_type != DT_UNKNOWN)
+            continue;
+
+        struct stat sb;
+        if (lstat(path, &sb) != 0) continue;
+        if (S_ISDIR(sb.st_mode)) {
+            if (strcmp(path, st->ctx->cache_dir) != 0)
+                submit(st, scan_task, path);
+        } else if (S_ISREG(sb.st_mode) && (sb.st_mode & 0111)) {
+            examine_file(st, path);
+        }
+    }
+
+    closedir(dp);
+    free(task);
+}
+
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int rmp_prewarm(rmp_ctx_t *ctx, const char *root, int jobs,
+                rmp_prewarm_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    // Cache entries are keyed by the path a spawn would use
+    char real[PATH_MAX];
+    struct stat sb;
+    if (!realpath(root, real) || stat(real, &sb) != 0)
+        return -1;
+
+    pw_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    pthread_mutex_init(&st.lock, NULL);
+
+    double t0 = now_secs();
+    st.pool = rmp_pool_create(jobs);
+    if (!st.pool) {
+        pthread_mutex_destroy(&st.lock);
+        return -1;
+    }
+
+    if (S_ISDIR(sb.st_mode))
+        submit(&st, scan_task, real);
+    else if (S_ISREG(sb.st_mode))
+        examine_file(&st, real);
+    rmp_pool_destroy(st.pool);
+
+    st.stats.seconds = now_secs() - t0;
+    pthread_mutex_destroy(&st.lock);
+    *stats = st.stats;
+    return 0;
+}
@@ -0,0 +1,30 @@
+// rmp_prewarm.h - build hardened-binary cache entries ahead of first launch
+
+#ifndef RMP_PREWARM_H
+#define RMP_PREWARM_H
+
+#include "rmp_shared.h"
+
+typedef struct {
+    long files;          // regular files examined
+    long macho;          // ... of which Mach-O
+    long executables;    // ... of which MH_EXECUTE (spawnable)
+    long hardened;       // ... of which need a re-signed copy
+    long created;        // cache entries built by this run
+    long cached;         // already had a valid entry
+    long failed;         // copy or signing failed
+    long long bytes;     // size of the binaries copied and signed
+    double seconds;      // wall time of the whole run
+} rmp_prewarm_stats_t;
+
+// Walk `root` (a directory, .app bundle or single file) with `jobs`
+// threads (<= 0 = one per CPU), and build a cache entry in ctx->cache_dir
+// for every executable rmp_is_hardened() flags, exactly as a first spawn
+// would.  Symlinks are not followed, and the cache directory itself is
+// skipped.  Per-file progress goes to ctx->debug_fp.
+//
+// Returns 0 on success, -1 if `root` cannot be resolved.
+int rmp_prewarm(rmp_ctx_t *ctx, const char *root, int jobs,
+                rmp_prewarm_stats_t *stats);
+
+#endif // RMP_PREWARM_H
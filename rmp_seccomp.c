@@ -0,0 +1,588 @@
+/* rmp_seccomp.c - redirect path syscalls from a seccomp supervisor
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The bind-mount backend can only mount over what exists at launch.
+ * Here nothing is mounted: the program runs under a seccomp filter with
+ * SECCOMP_RET_USER_NOTIF for the syscalls that take a path, and each one
+ * it makes waits for us.  We read the path out of its memory, resolve
+ * it against its cwd or dirfd (lexically, through /proc/<tid>), and ask
+ * rmp_plan_rewrite() whether a mapping covers it:
+ *
+ *   no     SECCOMP_USER_NOTIF_FLAG_CONTINUE: the kernel runs the call as
+ *          if we'd never seen it
+ *   yes    make the call ourselves on the rewritten path and answer
+ *          with its result; opens hand the fd over with
+ *          SECCOMP_IOCTL_NOTIF_ADDFD, which also answers the call
+ *
+ * The filter compares only the syscall number, so calls that take no
+ * path cost a handful of BPF instructions and never leave the kernel.
+ * Calls that do all round-trip through us, matched or not - that is the
+ * price of this backend (see test/bench_seccomp.c); glibc's fstat(),
+ * newfstatat(fd, "", AT_EMPTY_PATH), is sent straight back.
+ *
+ * This redirects, it doesn't confine: CONTINUE re-reads the path after
+ * we looked at it, and calls this table doesn't list (chdir, execve,
+ * openat2, xattr writes, ...) or 32-bit ABI calls see the real paths.
+ * chdir() into a mapped dir fails outright: we can't move another
+ * process's cwd.  The program already runs as us, so nothing is gained
+ * by fooling it.
+ *
+ * Calls that create files run under the caller's umask, read from
+ * /proc/<tid>/status and swapped in for the call: the supervisor's own
+ * would leave a program's 0700 dirs 0755.  umask is per process, so
+ * the supervisor shouldn't create files on other threads meanwhile.
+*/
+#define _GNU_SOURCE
+
+#include "rmp_seccomp.h"
+#include "rmp_cgroup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+extern char **environ;
+
+#if defined(__x86_64__)
+#define AUDIT_ARCH_NATIVE AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define AUDIT_ARCH_NATIVE AUDIT_ARCH_AARCH64
+#endif
+
+#if defined(AUDIT_ARCH_NATIVE) && defined(SECCOMP_ADDFD_FLAG_SEND) && \
+    defined(SYS_seccomp)
+#define HAVE_USER_NOTIF 1
+#endif
+
+#ifdef HAVE_USER_NOTIF
+
+/*** Trapped syscalls *****************************/
+
+enum {
+    OP_OPEN,        // a = flags, b = mode
+    OP_CREAT,       // a = mode
+    OP_MKDIR,       // a = mode
+    OP_STAT,        // a = struct stat *, b = flags
+    OP_LSTAT,       // a = struct stat *
+    OP_STATX,       // a = flags, b = mask, c = struct statx *
+    OP_ACCESS,      // a = mode, b = flags
+    OP_READLINK,    // a = buffer, b = size
+    OP_UNLINK,      // a = flags
+    OP_RMDIR,
+    OP_RENAME,      // a = new dirfd, b = new path, c = flags
+    OP_CHMOD,       // a = mode
+    OP_TRUNCATE,    // a = length
+    OP_GETXATTR,    // a = name, b = value, c = size
+    OP_LISTXATTR,   // a = list, b = size
+};
+
+// Where each syscall keeps its arguments: indexes into seccomp_data.args,
+// -1 for none (a dirfd of AT_FDCWD, flags of 0)
+typedef struct {
+    int nr;
+    int op;
+    signed char dirfd, path, a, b, c;
+} trap_t;
+
+static const trap_t g_traps[] = {
+#ifdef SYS_open
+    { SYS_open,       OP_OPEN,     -1, 0, 1, 2, -1 },
+#endif
+#ifdef SYS_creat
+    { SYS_creat,      OP_CREAT,    -1, 0, 1, -1, -1 },
+#endif
+    { SYS_openat,     OP_OPEN,      0, 1, 2, 3, -1 },
+#ifdef SYS_stat
+    { SYS_stat,       OP_STAT,     -1, 0, 1, -1, -1 },
+#endif
+#ifdef SYS_lstat
+    { SYS_lstat,      OP_LSTAT,    -1, 0, 1, -1, -1 },
+#endif
+    { SYS_newfstatat, OP_STAT,      0, 1, 2, 3, -1 },
+#ifdef SYS_statx
+    { SYS_statx,      OP_STATX,     0, 1, 2, 3, 4 },
+#endif
+#ifdef SYS_access
+    { SYS_access,     OP_ACCESS,   -1, 0, 1, -1, -1 },
+#endif
+    { SYS_faccessat,  OP_ACCESS,    0, 1, 2, -1, -1 },
+#ifdef SYS_faccessat2
+    { SYS_faccessat2, OP_ACCESS,    0, 1, 2, 3, -1 },
+#endif
+#ifdef SYS_mkdir
+    { SYS_mkdir,      OP_MKDIR,    -1, 0, 1, -1, -1 },
+#endif
+    { SYS_mkdirat,    OP_MKDIR,     0, 1, 2, -1, -1 },
+#ifdef SYS_readlink
+    { SYS_readlink,   OP_READLINK, -1, 0, 1, 2, -1 },
+#endif
+    { SYS_readlinkat, OP_READLINK,  0, 1, 2, 3, -1 },
+#ifdef SYS_unlink
+    { SYS_unlink,     OP_UNLINK,   -1, 0, -1, -1, -1 },
+#endif
+#ifdef SYS_rmdir
+    { SYS_rmdir,      OP_RMDIR,    -1, 0, -1, -1, -1 },
+#endif
+    { SYS_unlinkat,   OP_UNLINK,    0, 1, 2, -1, -1 },
+#ifdef SYS_rename
+    // rename(old, new): new has no dirfd of its own
+    { SYS_rename,     OP_RENAME,   -1, 0, -1, 1, -1 },
+#endif
+#ifdef SYS_renameat
+    { SYS_renameat,   OP_RENAME,    0, 1, 2, 3, -1 },
+#endif
+    { SYS_renameat2,  OP_RENAME,    0, 1, 2, 3, 4 },
+#ifdef SYS_chmod
+    { SYS_chmod,      OP_CHMOD,    -1, 0, 1, -1, -1 },
+#endif
+    { SYS_fchmodat,   OP_CHMOD,     0, 1, 2, -1, -1 },
+    { SYS_truncate,   OP_TRUNCATE, -1, 0, 1, -1, -1 },
+    // ls -l asks for ACLs; the l* forms are made as the same syscall
+    { SYS_getxattr,   OP_GETXATTR,  -1, 0, 1, 2, 3 },
+    { SYS_lgetxattr,  OP_GETXATTR,  -1, 0, 1, 2, 3 },
+    { SYS_listxattr,  OP_LISTXATTR, -1, 0, 1, 2, -1 },
+    { SYS_llistxattr, OP_LISTXATTR, -1, 0, 1, 2, -1 },
+};
+
+#define NUM_TRAPS ((int)(sizeof(g_traps) / sizeof(g_traps[0])))
+
+static const trap_t *find_trap(int nr) {
+    for (int i = 0; i < NUM_TRAPS; i++)
+        if (g_traps[i].nr == nr) return &g_traps[i];
+    return NULL;
+}
+
+/*** Reading the caller's paths *******************/
+
+// NUL-terminated string at addr in pid's memory.  Read a page-aligned
+// chunk at a time, so the string ending just before an unmapped page
+// doesn't fail the read.
+static int read_string(pid_t pid, uint64_t addr, char *buf, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        size_t chunk = 4096 - ((addr + got) & 4095);
+        if (chunk > size - got) chunk = size - got;
+        struct iovec local = { buf + got, chunk };
+        struct iovec remote = { (void *)(uintptr_t)(addr + got), chunk };
+        ssize_t n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (n <= 0) return -1;
+        if (memchr(buf + got, '\0', (size_t)n)) return 0;
+        got += (size_t)n;
+    }
+    errno = ENAMETOOLONG;
+    return -1;
+}
+
+static int write_mem(pid_t pid, uint64_t addr, const void *data, size_t len) {
+    struct iovec local = { (void *)data, len };
+    struct iovec remote = { (void *)(uintptr_t)addr, len };
+    return process_vm_writev(pid, &local, 1, &remote, 1, 0) == (ssize_t)len ? 0 : -1;
+}
+
+// Collapse "//", "." and ".." in an absolute path, in place.  Returns 1
+// if a ".." steps back out of a mapped entry ("<mapped>/.."): the
+// kernel would look for that entry where it isn't, so such a call has to
+// be made here even when the result maps to nothing.
+static int normalize(const rmp_plan_t *plan, char *path) {
+    char *out = path, tmp[PATH_MAX];
+    const char *in = path;
+    int crossed = 0;
+    while (*in) {
+        while (*in == '/') in++;
+        const char *end = in + strcspn(in, "/");
+        size_t n = (size_t)(end - in);
+        if (n == 0 || (n == 1 && in[0] == '.')) {
+            // nothing
+        } else if (n == 2 && in[0] == '.' && in[1] == '.') {
+            char saved = *out;
+            *out = '\0';
+            if (!crossed && out > path && rmp_plan_rewrite(plan, path, tmp, sizeof(tmp)))
+                crossed = 1;
+            *out = saved;
+            while (out > path && *--out != '/') {}
+        } else {
+            *out++ = '/';
+            memmove(out, in, n);
+            out += n;
+        }
+        in = end;
+    }
+    if (out == path) *out++ = '/';
+    *out = '\0';
+    return crossed;
+}
+
+// The caller's path argument as an absolute, normalized path.  Returns
+// normalize()'s result, or -1 if it can't be read or resolved (the call
+// then goes ahead untouched).
+static int caller_path(const rmp_plan_t *plan, const struct seccomp_notif *req,
+                       int dirfd_arg, int path_arg, char *buf, size_t size) {
+    char path[PATH_MAX];
+    if (read_string((pid_t)req->pid, req->data.args[path_arg], path, sizeof(path)) != 0 ||
+        !path[0])
+        return -1;
+
+    if (path[0] == '/') {
+        snprintf(buf, size, "%s", path);
+    } else {
+        char link[64], dir[PATH_MAX];
+        int dirfd = dirfd_arg < 0 ? AT_FDCWD : (int)req->data.args[dirfd_arg];
+        if (dirfd == AT_FDCWD)
+            snprintf(link, sizeof(link), "/proc/%u/cwd", req->pid);
+        else
+            snprintf(link, sizeof(link), "/proc/%u/fd/%d", req->pid, dirfd);
+        ssize_t n = readlink(link, dir, sizeof(dir) - 1);
+        if (n <= 0) return -1;
+        dir[n] = '\0';
+        if (dir[0] != '/') return -1;   // not a directory we could name
+        if (snprintf(buf, size, "%s/%s", dir, path) >= (int)size) return -1;
+    }
+    return normalize(plan, buf);
+}
+
+/*** Spawning *************************************/
+
+// Load the syscall number; notify on every trapped one, allow the rest
+static int install_filter(void) {
+    struct sock_filter prog[NUM_TRAPS + 5];
+    int n = 0;
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                             offsetof(struct seccomp_data, arch));
+    prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_NATIVE,
+                                             0, NUM_TRAPS + 1);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                             offsetof(struct seccomp_data, nr));
+    for (int i = 0; i < NUM_TRAPS; i++)
+        prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                 (unsigned)g_traps[i].nr,
+                                                 (unsigned char)(NUM_TRAPS - i), 0);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF);
+
+    struct sock_fprog fprog = { (unsigned short)n, prog };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) return -1;
+    return (int)syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+                        SECCOMP_FILTER_FLAG_NEW_LISTENER, &fprog);
+}
+
+// One int (0 or an errno) over the socket, with fd attached if >= 0
+static void send_status(int sock, int err, int fd) {
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &err, sizeof(err) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(cbuf, 0, sizeof(cbuf));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    }
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+static int recv_status(int sock, int *fd) {
+    int err = EIO;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &err, sizeof(err) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    ssize_t n;
+    do n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); while (n < 0 && errno == EINTR);
+    *fd = -1;
+    struct cmsghdr *c = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+        memcpy(fd, CMSG_DATA(c), sizeof(int));
+    return n == (ssize_t)sizeof(err) ? err : -1;    // -1: EOF
+}
+
+pid_t rmp_seccomp_spawn(const rmp_plan_t *plan, char *const argv[], char *const envp[],
+                        int *listener) {
+    for (int i = 0; i < rmp_plan_num_mappings(plan); i++) {
+        if (strstr(rmp_plan_mapping(plan, i), "=tmpfs:")) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (!argv || !argv[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The child sends the listener (or why it has none), then exec's;
+    // the socket closes on exec, so EOF next means the program is running
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        int saved = errno;
+        close(sv[0]);
+        close(sv[1]);
+        errno = saved;
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        int cg = rmp_plan_cgroup(plan);
+        int fd = cg >= 0 && rmp_cgroup_enter(cg) != 0 ? -1 : install_filter();
+        send_status(sv[1], fd < 0 ? errno : 0, fd);
+        if (fd < 0) _exit(127);
+        close(fd);
+        if (envp) environ = (char **)envp;
+        execvp(argv[0], argv);
+        send_status(sv[1], errno, -1);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    int fd;
+    int err = recv_status(sv[0], &fd);
+    if (err == 0 && fd >= 0) {
+        int fd2;
+        err = recv_status(sv[0], &fd2);     // -1 = EOF = exec'd
+        if (err < 0) {
+            close(sv[0]);
+            *listener = fd;
+            return pid;
+        }
+        close(fd);
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    close(sv[0]);
+    waitpid(pid, NULL, 0);
+    // No status at all: the kernel refused the filter flag before we could say
+    errno = err > 0 ? err : ENOSYS;
+    return -1;
+}
+
+/*** Answering calls ******************************/
+
+// Swap in the caller's umask for a call that creates a file; returns
+// ours for umask_restore(), or -1 if the caller's can't be read and
+// ours stays
+static int umask_borrow(pid_t pid) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+    long mask = -1;
+    while (mask < 0 && fgets(line, sizeof(line), f))
+        if (strncmp(line, "Umask:", 6) == 0) mask = strtol(line + 6, NULL, 8);
+    fclose(f);
+    return mask < 0 ? -1 : (int)umask((mode_t)mask & 0777);
+}
+
+static void umask_restore(int old) {
+    if (old >= 0) umask((mode_t)old);
+}
+
+// Make the call on the rewritten path(s); returns the result or -errno
+static long emulate(const struct seccomp_notif *req, const trap_t *t,
+                    const char *path, const char *path2) {
+    const __u64 *args = req->data.args;
+    uint64_t a = t->a >= 0 ? args[t->a] : 0;
+    uint64_t b = t->b >= 0 ? args[t->b] : 0;
+    uint64_t c = t->c >= 0 ? args[t->c] : 0;
+    pid_t pid = (pid_t)req->pid;
+    long r;
+
+    switch (t->op) {
+    case OP_MKDIR: {
+        int old = umask_borrow(pid);
+        r = mkdir(path, (mode_t)a);
+        int saved = errno;
+        umask_restore(old);
+        errno = saved;
+        break;
+    }
+    case OP_UNLINK:   r = unlinkat(AT_FDCWD, path, (int)a); break;
+    case OP_RMDIR:    r = rmdir(path); break;
+    case OP_CHMOD:    r = chmod(path, (mode_t)a); break;
+    case OP_TRUNCATE: r = truncate(path, (off_t)a); break;
+    case OP_ACCESS:   r = faccessat(AT_FDCWD, path, (int)a, (int)b); break;
+    case OP_RENAME:
+        r = syscall(SYS_renameat2, AT_FDCWD, path, AT_FDCWD, path2, (unsigned)c);
+        break;
+    case OP_STAT:
+    case OP_LSTAT: {
+        struct stat sb;
+        int flags = t->op == OP_LSTAT ? AT_SYMLINK_NOFOLLOW
+                  : (int)b & (AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT);
+        r = fstatat(AT_FDCWD, path, &sb, flags);
+        if (r == 0 && write_mem(pid, a, &sb, sizeof(sb)) != 0) return -EFAULT;
+        break;
+    }
+    case OP_STATX: {
+#ifdef SYS_statx
+        struct statx sx;
+        r = syscall(SYS_statx, AT_FDCWD, path, (int)a & ~AT_EMPTY_PATH, (unsigned)b, &sx);
+        if (r == 0 && write_mem(pid, c, &sx, sizeof(sx)) != 0) return -EFAULT;
+#else
+        r = -1;
+        errno = ENOSYS;
+#endif
+        break;
+    }
+    case OP_GETXATTR:
+    case OP_LISTXATTR: {
+        // xattr values top out at 64k
+        char name[256], *buf = NULL;
+        size_t size = t->op == OP_GETXATTR ? c : b;
+        if (size > 65536) size = 65536;
+        if (size && !(buf = malloc(size))) return -ENOMEM;
+        if (t->op == OP_GETXATTR) {
+            r = read_string(pid, a, name, sizeof(name)) != 0 ? -1
+              : syscall(t->nr, path, name, buf, size);
+            if (r > 0 && write_mem(pid, b, buf, (size_t)r) != 0) r = -1, errno = EFAULT;
+        } else {
+            r = syscall(t->nr, path, buf, size);
+            if (r > 0 && write_mem(pid, a, buf, (size_t)r) != 0) r = -1, errno = EFAULT;
+        }
+        int saved = errno;
+        free(buf);
+        errno = saved;
+        break;
+    }
+    case OP_READLINK: {
+        char buf[PATH_MAX];
+        size_t size = b < sizeof(buf) ? (size_t)b : sizeof(buf);
+        r = readlink(path, buf, size);
+        if (r > 0 && write_mem(pid, a, buf, (size_t)r) != 0) return -EFAULT;
+        break;
+    }
+    default:
+        return -ENOSYS;
+    }
+    return r < 0 ? -errno : r;
+}
+
+// Open the rewritten path and install the fd in the caller, which
+// answers the call.  Returns 0 if answered, else -errno for the caller.
+static long emulate_open(int listener, const struct seccomp_notif *req, const trap_t *t,
+                         const char *path) {
+    const __u64 *args = req->data.args;
+    int flags = t->op == OP_CREAT ? O_CREAT | O_WRONLY | O_TRUNC : (int)args[t->a];
+    mode_t mode = (mode_t)(t->op == OP_CREAT ? args[t->a] : args[t->b]);
+    int creates = (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE;
+    int old = creates ? umask_borrow((pid_t)req->pid) : -1;
+    int fd = open(path, flags | O_CLOEXEC, mode);
+    int saved = errno;
+    umask_restore(old);
+    if (fd < 0) return -saved;
+
+    struct seccomp_notif_addfd add;
+    memset(&add, 0, sizeof(add));
+    add.id = req->id;
+    add.flags = SECCOMP_ADDFD_FLAG_SEND;
+    add.srcfd = (unsigned)fd;
+    add.newfd_flags = (unsigned)(flags & O_CLOEXEC);
+    int r = ioctl(listener, SECCOMP_IOCTL_NOTIF_ADDFD, &add);
+    saved = errno;
+    close(fd);
+    if (r >= 0 || saved == ENOENT) return 0;    // ENOENT: the caller is gone
+    return -saved;
+}
+
+int rmp_seccomp_handle(const rmp_plan_t *plan, int listener, rmp_seccomp_stats_t *stats) {
+    struct seccomp_notif req;
+    struct seccomp_notif_resp resp;
+    memset(&req, 0, sizeof(req));
+    if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, &req) != 0)
+        return errno == ENOENT || errno == EINTR ? 0 : -1;
+    if (stats) stats->trapped++;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.id = req.id;
+    resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+
+    char path[PATH_MAX], path2[PATH_MAX], to[PATH_MAX], to2[PATH_MAX];
+    const trap_t *t = find_trap(req.data.nr);
+    int hit = 0, crossed;
+    if (t && (crossed = caller_path(plan, &req, t->dirfd, t->path, path, sizeof(path))) >= 0) {
+        hit = rmp_plan_rewrite(plan, path, to, sizeof(to));
+        if (!hit) snprintf(to, sizeof(to), "%s", path);
+        hit |= crossed;
+        if (t->op == OP_RENAME) {
+            crossed = caller_path(plan, &req, t->a, t->b, path2, sizeof(path2));
+            if (crossed < 0) {
+                hit = 0;
+            } else if (rmp_plan_rewrite(plan, path2, to2, sizeof(to2))) {
+                hit = 1;
+            } else {
+                snprintf(to2, sizeof(to2), "%s", path2);
+                hit |= crossed;
+            }
+        }
+    }
+
+    // The caller may have died and its tid been reused while we read
+    if (hit && ioctl(listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &req.id) != 0) return 0;
+    if (hit) {
+        long r;
+        if (t->op == OP_OPEN || t->op == OP_CREAT) {
+            r = emulate_open(listener, &req, t, to);
+            if (r == 0) {
+                if (stats) stats->rewritten++;
+                return 1;
+            }
+        } else {
+            r = emulate(&req, t, to, to2);
+        }
+        resp.flags = 0;
+        if (r < 0) resp.error = (int)r;
+        else resp.val = r;
+        if (stats) stats->rewritten++;
+    }
+    if (ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, &resp) != 0 && errno != ENOENT)
+        return -1;
+    return hit;
+}
+
+#else   // !HAVE_USER_NOTIF
+
+pid_t rmp_seccomp_spawn(const rmp_plan_t *plan, char *const argv[], char *const envp[],
+                        int *listener) {
+    (void)plan; (void)argv; (void)envp; (void)listener;
+    errno = ENOSYS;
+    return -1;
+}
+
+int rmp_seccomp_handle(const rmp_plan_t *plan, int listener, rmp_seccomp_stats_t *stats) {
+    (void)plan; (void)listener; (void)stats;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
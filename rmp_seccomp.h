@@ -0,0 +1,43 @@
+// rmp_seccomp.h - redirect a program's path syscalls from a seccomp
+// user-notification supervisor, instead of bind mounts (Linux)
+
+#ifndef RMP_SECCOMP_H
+#define RMP_SECCOMP_H
+
+#include <sys/types.h>
+
+#include "rmp_launch.h"
+
+typedef struct {
+    long trapped;       // notifications handled
+    long rewritten;     // ... whose path was redirected and the call emulated
+} rmp_seccomp_stats_t;
+
+// Start argv[0] with envp (NULL = environ; $PATH is searched) under a
+// seccomp filter that traps the path-taking syscalls (open, stat,
+// mkdir, rename, unlink, ... and their *at forms) to a listener fd
+// handed back in *listener (close-on-exec).  Nothing is mounted, so
+// paths that only come into being after launch are redirected too.
+// The plan is only read, via rmp_plan_rewrite().  tmpfs mappings need
+// a namespace and are refused.
+//
+// Until its calls are answered the program blocks: poll *listener and
+// call rmp_seccomp_handle() whenever it's readable.  It reports POLLHUP
+// once the program and every process it started have exited.
+//
+// Returns the pid, or -1 with errno set (EINVAL: a tmpfs mapping or no
+// program; ENOSYS: no seccomp user notification on this kernel
+// or architecture; a plan's cgroup it can't enter as from writing
+// cgroup.procs; exec failures as from execvp).
+pid_t rmp_seccomp_spawn(const rmp_plan_t *plan, char *const argv[], char *const envp[],
+                        int *listener);
+
+// Answer one trapped call.  A path that no mapping matches goes on to
+// the kernel untouched; a matching one is rewritten into the target and
+// the call made here on the program's behalf: results are copied into
+// its memory, and opened files are installed in its fd table.  Adds to
+// *stats if non-NULL.  Returns 1 if rewritten, 0 if passed through (or
+// the caller died meanwhile), -1 with errno if the listener failed.
+int rmp_seccomp_handle(const rmp_plan_t *plan, int listener, rmp_seccomp_stats_t *stats);
+
+#endif // RMP_SECCOMP_H
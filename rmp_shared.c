@@ -7,6 +7,10 @@
  * the Free Software Foundation, either version 3 of the License, or
  * (at your option) any later version.
 */
+#ifndef __APPLE__
+#define _GNU_SOURCE  // copy_file_range
+#endif
+
 #include "rmp_shared.h"
 
 #include <stdlib.h>
@@ -17,11 +21,34 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <spawn.h>
 #include <pwd.h>
 #include <stdatomic.h>
+#include <time.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#ifdef __APPLE__
 #include <mach-o/loader.h>
 #include <mach-o/fat.h>
 #include <copyfile.h>
+#include <sys/clonefile.h>
+#else
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/xattr.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)  // <linux/fs.h>, not always installed
+#endif
+
+// Mach-O magic numbers, so the cache logic builds (and can be unit-tested
+// with a stub signer) on Linux.
+#define MH_MAGIC_64 0xfeedfacfu
+#define MH_CIGAM_64 0xcffaedfeu
+#define FAT_MAGIC   0xcafebabeu
+#define FAT_CIGAM   0xbebafecau
+#endif
 
 // Thread-safe home directory lookup: try $HOME, fall back to getpwuid_r.
 static const char *get_home_dir(char *buf, size_t bufsize) {
@@ -75,40 +102,54 @@ int resolve_in_path(const char *file, char *out, size_t outsize) {
 
 
 /*** Safe pipe-based process spawning ************/
+//
+// posix_spawn, not fork: inside the interposer we run in the host's
+// address space -- often a multi-GB Electron or JVM process -- and fork()
+// would copy its whole page table for every codesign probe, then run
+// code in a child that inherited locks held by the host's other threads.
+// posix_spawn uses vfork semantics (CLONE_VM|CLONE_VFORK on glibc), so
+// the cost no longer scales with the parent's size.
+
+extern char **environ;
 
 rmp_pipe_t rmp_pipe_open(const char *path, const char *const argv[]) {
     rmp_pipe_t proc = { NULL, -1 };
 
     int pipefd[2];
+#ifdef __APPLE__
     if (pipe(pipefd) != 0) return proc;
-
-    pid_t pid = fork();
-    if (pid < 0) {
+    fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+#else
+    if (pipe2(pipefd, O_CLOEXEC) != 0) return proc;
+#endif
+
+    // Child: stdout+stderr to the pipe.  dup2 clears close-on-exec on
+    // the copies; the originals close at exec.
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDERR_FILENO);
+    posix_spawnattr_init(&attr);
+#ifdef __APPLE__
+    // Don't leak the host application's descriptors into codesign
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_CLOEXEC_DEFAULT);
+    posix_spawn_file_actions_addinherit_np(&fa, STDIN_FILENO);
+#endif
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &fa, &attr, (char *const *)argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    close(pipefd[1]);
+    if (err != 0) {
         close(pipefd[0]);
-        close(pipefd[1]);
+        errno = err;
         return proc;
     }
 
-    if (pid == 0) {
-        // Child: redirect stdout+stderr to pipe
-        close(pipefd[0]);
-        dup2(pipefd[1], STDOUT_FILENO);
-        dup2(pipefd[1], STDERR_FILENO);
-        close(pipefd[1]);
-        execv(path, (char *const *)argv);
-        // exec failed — write error to stderr (which is the pipe)
-        // Assign to suppress GCC's warn_unused_result after fork
-        int e = errno;
-        const char *msg = "execv failed: ";
-        __attribute__((unused)) ssize_t r1 = write(STDERR_FILENO, msg, strlen(msg));
-        const char *err = strerror(e);
-        __attribute__((unused)) ssize_t r2 = write(STDERR_FILENO, err, strlen(err));
-        __attribute__((unused)) ssize_t r3 = write(STDERR_FILENO, "\n", 1);
-        _exit(127);
-    }
-
     // Parent: read end
-    close(pipefd[1]);
     proc.fp = fdopen(pipefd[0], "r");
     if (!proc.fp) {
         close(pipefd[0]);
@@ -151,6 +192,191 @@ void rmp_mkdirs(const char *path, mode_t mode) {
     mkdir(tmp, mode);
 }
 
+/*** rmp_parse_size ******************************/
+
+long long rmp_parse_size(const char *s) {
+    if (!s || !isdigit((unsigned char)s[0])) return -1;
+
+    char *end = NULL;
+    long long n = strtoll(s, &end, 10);
+    if (n < 0) return -1;
+
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+    case '\0': break;
+    case 'K': shift = 10; end++; break;
+    case 'M': shift = 20; end++; break;
+    case 'G': shift = 30; end++; break;
+    case 'T': shift = 40; end++; break;
+    default: return -1;
+    }
+    if (*end == 'B' || *end == 'b') end++;  // accept "10GB" as well as "10G"
+    if (*end != '\0') return -1;
+    if (shift && n > (LLONG_MAX >> shift)) return -1;
+    return n << shift;
+}
+
+const char *rmp_mapping_target(const char *mapping, int relative) {
+    const char *eq = NULL;
+    for (const char *p = mapping; (p = strchr(p, '=')); p++) {
+        const char *t = p + 1;
+        if (t[0] == '/' || strncmp(t, "tmpfs:", 6) == 0 ||
+            (relative && ((t[0] == '~' && (t[1] == '/' || !t[1])) ||
+                          strncmp(t, "./", 2) == 0 || strncmp(t, "../", 3) == 0)))
+            eq = p;
+    }
+    return eq;
+}
+
+/*** rmp_clone_file ******************************/
+
+#define CLONE_BUF_SIZE (1 << 20)
+
+const char *rmp_clone_method_name(int method) {
+    switch (method) {
+    case RMP_CLONE_REFLINK:  return "reflink";
+    case RMP_CLONE_KERNEL:   return "kernel";
+    case RMP_CLONE_BUFFERED: return "buffered";
+    default:                 return "failed";
+    }
+}
+
+static int copy_buffered(int sfd, int dfd) {
+    char *buf = malloc(CLONE_BUF_SIZE);
+    if (!buf) return -1;
+
+    ssize_t n;
+    while ((n = read(sfd, buf, CLONE_BUF_SIZE)) > 0) {
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(dfd, buf + done, (size_t)(n - done));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                free(buf);
+                return -1;
+            }
+            done += w;
+        }
+    }
+    free(buf);
+    return (n < 0) ? -1 : 0;
+}
+
+#ifndef __APPLE__
+// Errors meaning "this filesystem pair can't do that", as opposed to a
+// real I/O failure.
+static int unsupported(int e) {
+    return e == ENOSYS || e == EXDEV || e == EINVAL || e == EOPNOTSUPP ||
+           e == ENOTTY || e == EPERM;
+}
+
+// copy_file_range(), or sendfile() on kernels/filesystems without it.
+// Returns 0 on success, 1 if neither is usable (nothing copied yet),
+// -1 on failure part-way through.
+static int copy_kernel(int sfd, int dfd, off_t size) {
+    off_t total = 0;
+    int use_sendfile = 0;
+    for (;;) {
+        size_t chunk = 1 << 30;
+        ssize_t n = use_sendfile ? sendfile(dfd, sfd, NULL, chunk)
+                                 : copy_file_range(sfd, NULL, dfd, NULL, chunk, 0);
+        if (n > 0) { total += n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+
+        if (total == 0 && (n < 0 ? unsupported(errno) : size > 0)) {
+            // Nothing copied: procfs-style files read as empty here, and
+            // some filesystems refuse copy_file_range outright
+            if (use_sendfile) return 1;
+            use_sendfile = 1;
+            continue;
+        }
+        return n < 0 ? -1 : 0;
+    }
+}
+
+static void copy_xattrs(int sfd, int dfd) {
+    char names[4096];
+    ssize_t len = flistxattr(sfd, names, sizeof(names));
+    if (len <= 0) return;
+
+    char *val = malloc(65536);
+    if (!val) return;
+    for (ssize_t off = 0; off < len; off += (ssize_t)strlen(names + off) + 1) {
+        ssize_t vlen = fgetxattr(sfd, names + off, val, 65536);
+        if (vlen >= 0) fsetxattr(dfd, names + off, val, (size_t)vlen, 0);
+    }
+    free(val);
+}
+#endif
+
+int rmp_clone_file(const char *src, const char *dst, int flags) {
+    int sfd = open(src, O_RDONLY | O_CLOEXEC);
+    if (sfd < 0) return -1;
+    struct stat sb;
+    if (fstat(sfd, &sb) != 0) { close(sfd); return -1; }
+    if (!S_ISREG(sb.st_mode)) {
+        close(sfd);
+        errno = S_ISDIR(sb.st_mode) ? EISDIR : EINVAL;
+        return -1;
+    }
+
+#ifdef __APPLE__
+    // Refuses an existing dst; on success every attribute comes along
+    if (!(flags & RMP_CLONE_NO_REFLINK) &&
+        fclonefileat(sfd, AT_FDCWD, dst, 0) == 0) {
+        close(sfd);
+        return RMP_CLONE_REFLINK;
+    }
+#endif
+
+    // Owner-only until the data and final mode are in place
+    int dfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (dfd < 0) { close(sfd); return -1; }
+
+    int method = -1;
+#ifdef __APPLE__
+    if (!(flags & RMP_CLONE_NO_KERNEL) &&
+        fcopyfile(sfd, dfd, NULL, COPYFILE_DATA) == 0)
+        method = RMP_CLONE_KERNEL;
+#else
+    if (!(flags & RMP_CLONE_NO_REFLINK) && ioctl(dfd, FICLONE, sfd) == 0) {
+        method = RMP_CLONE_REFLINK;
+    } else if (!(flags & RMP_CLONE_NO_KERNEL)) {
+        int r = copy_kernel(sfd, dfd, sb.st_size);
+        if (r == 0) method = RMP_CLONE_KERNEL;
+        else if (r < 0) goto out;
+    }
+#endif
+    if (method < 0) {
+        if (lseek(dfd, 0, SEEK_SET) != 0 || ftruncate(dfd, 0) != 0 ||
+            lseek(sfd, 0, SEEK_SET) != 0 || copy_buffered(sfd, dfd) != 0)
+            goto out;
+        method = RMP_CLONE_BUFFERED;
+    }
+
+    // Metadata.  Ownership is best effort (root only, in general) and
+    // must precede chmod, which it would otherwise strip setuid from.
+#ifdef __APPLE__
+    fcopyfile(sfd, dfd, NULL, COPYFILE_METADATA);
+#else
+    copy_xattrs(sfd, dfd);
+#endif
+    if (fchown(dfd, sb.st_uid, sb.st_gid) != 0) { /* not ours to give */ }
+#ifdef __APPLE__
+    struct timespec times[2] = { sb.st_atimespec, sb.st_mtimespec };
+#else
+    struct timespec times[2] = { sb.st_atim, sb.st_mtim };
+#endif
+    if (fchmod(dfd, sb.st_mode & 07777) != 0 || futimens(dfd, times) != 0)
+        method = -1;
+
+out:;
+    int e = errno;
+    close(sfd);
+    if (close(dfd) != 0 && method >= 0) { method = -1; e = errno; }
+    errno = e;
+    return method;
+}
+
 /*** Hardened binary cache *************************/
 
 // Atomic counter for unique temp file names (thread-safe)
@@ -197,6 +423,20 @@ static const char *ENTITLEMENTS_PLIST =
 
 /*** rmp_ctx_init ********************************/
 
+// name under ctx's config dir, into out; 0 if it doesn't fit
+static int config_path(const rmp_ctx_t *ctx, const char *name, char *out, size_t size) {
+    int n = snprintf(out, size, "%s/%s", ctx->config_dir, name);
+    return n >= 0 && (size_t)n < size;
+}
+
+// A tier others could plant copies in would run their code as whoever
+// launches through it: only trust one that root or we alone can write.
+static int trusted_tier(const char *dir) {
+    struct stat sb;
+    return stat(dir, &sb) == 0 && S_ISDIR(sb.st_mode) &&
+           (sb.st_uid == 0 || sb.st_uid == geteuid()) && !(sb.st_mode & 022);
+}
+
 void rmp_ctx_init(rmp_ctx_t *ctx, const char *config_dir,
                   const char *cache_dir, FILE *debug_fp) {
     char pwbuf[1024];
@@ -214,17 +454,30 @@ void rmp_ctx_init(rmp_ctx_t *ctx, const char *config_dir,
     }
     ctx->config_dir[sizeof(ctx->config_dir) - 1] = '\0';
 
-    // Cache dir
+    // Entitlements path; a config dir too long to hold it is no better
+    // than none
+    if (!config_path(ctx, "entitlements.plist", ctx->entitlements_path,
+                     sizeof(ctx->entitlements_path))) {
+        strcpy(ctx->config_dir, "/tmp/.remapper");
+        config_path(ctx, "entitlements.plist", ctx->entitlements_path,
+                    sizeof(ctx->entitlements_path));
+    }
+
+    // Cache dir (fits wherever entitlements.plist does)
     if (cache_dir && cache_dir[0]) {
         strncpy(ctx->cache_dir, cache_dir, sizeof(ctx->cache_dir) - 1);
     } else {
-        snprintf(ctx->cache_dir, sizeof(ctx->cache_dir), "%s/cache", ctx->config_dir);
+        config_path(ctx, "cache", ctx->cache_dir, sizeof(ctx->cache_dir));
     }
     ctx->cache_dir[sizeof(ctx->cache_dir) - 1] = '\0';
 
-    // Entitlements path
-    snprintf(ctx->entitlements_path, sizeof(ctx->entitlements_path),
-             "%s/entitlements.plist", ctx->config_dir);
+    // Machine-wide read-only tier, unless it is the cache we write to
+    const char *system_cache = getenv("RMP_SYSTEM_CACHE");
+    if (!system_cache) system_cache = RMP_SYSTEM_CACHE_DEFAULT;
+    ctx->system_cache_dir[0] = '\0';
+    if (system_cache[0] && strlen(system_cache) < sizeof(ctx->system_cache_dir) &&
+        strcmp(system_cache, ctx->cache_dir) != 0 && trusted_tier(system_cache))
+        strcpy(ctx->system_cache_dir, system_cache);
 
     // Create directories
     rmp_mkdirs(ctx->config_dir, 0755);
@@ -241,6 +494,36 @@ void rmp_ctx_init(rmp_ctx_t *ctx, const char *config_dir,
                          sizeof(ctx->codesign_path))) {
         ctx->codesign_path[0] = '\0';
     }
+    ctx->signer_path[0] = '\0';
+}
+
+int rmp_ctx_set_signer(rmp_ctx_t *ctx, const char *signer) {
+    if (!signer || !signer[0] ||
+        !resolve_in_path(signer, ctx->signer_path, sizeof(ctx->signer_path))) {
+        ctx->signer_path[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+int rmp_can_sign(const rmp_ctx_t *ctx) {
+    return ctx->signer_path[0] || ctx->codesign_path[0];
+}
+
+// Run `argv` and forward its output to the debug log, prefixed by `tag`.
+// Returns the exit status, or -1 if it could not be run.
+static int run_logged(const rmp_ctx_t *ctx, const char *path,
+                      const char *const argv[], const char *tag) {
+    rmp_pipe_t proc = rmp_pipe_open(path, argv);
+    if (!proc.fp) return -1;
+    char line[256];
+    while (fgets(line, sizeof(line), proc.fp)) {
+        if (ctx->debug_fp) {
+            fprintf(ctx->debug_fp, "[remapper] %s: %s", tag, line);
+            fflush(ctx->debug_fp);
+        }
+    }
+    return rmp_pipe_close(&proc);
 }
 
 /*** rmp_is_hardened *****************************/
@@ -263,6 +546,11 @@ int rmp_is_hardened(const rmp_ctx_t *ctx, const char *path) {
         return 0;
     }
 
+    if (ctx->signer_path[0]) {
+        const char *argv[] = {ctx->signer_path, "check", path, NULL};
+        return run_logged(ctx, ctx->signer_path, argv, "signer") == 0;
+    }
+
     if (codesign == NULL || codesign[0] == '\0') {
         // If we don't have codesign then we can't resign the binary, so
         // fallback to treating it as hardened to avoid silently failing to insert the dylib.
@@ -297,6 +585,56 @@ int rmp_is_hardened(const rmp_ctx_t *ctx, const char *path) {
     return has_dyld_ent ? 0 : 1;
 }
 
+/*** rmp_macho_kind *****************************/
+
+#define RMP_MH_MAGIC     0xfeedfaceu  // 32-bit thin
+#define RMP_MH_CIGAM     0xcefaedfeu
+#define RMP_MH_EXECUTE   0x2
+#define RMP_MH_DYLIB     0x6
+#define RMP_MH_BUNDLE    0x8
+
+int rmp_macho_kind(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return RMP_MACHO_NONE;
+
+    // mach_header: magic, cputype, cpusubtype, filetype, ...
+    // fat_header:  magic, nfat_arch, then fat_arch { cputype, cpusubtype,
+    //              offset, size, align } -- always big-endian
+    uint32_t hdr[5];
+    if (pread(fd, hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        close(fd);
+        return RMP_MACHO_NONE;
+    }
+
+    if (hdr[0] == FAT_MAGIC || hdr[0] == FAT_CIGAM) {
+        int swap = (hdr[0] == FAT_CIGAM);
+        uint32_t nfat = swap ? __builtin_bswap32(hdr[1]) : hdr[1];
+        uint32_t off  = swap ? __builtin_bswap32(hdr[4]) : hdr[4];
+        // Java class files share the magic; their "nfat" is a version
+        if (nfat == 0 || nfat > 32 ||
+            pread(fd, hdr, 4 * sizeof(uint32_t), (off_t)off) != 4 * sizeof(uint32_t)) {
+            close(fd);
+            return RMP_MACHO_NONE;
+        }
+    }
+    close(fd);
+
+    uint32_t filetype;
+    if (hdr[0] == MH_MAGIC_64 || hdr[0] == RMP_MH_MAGIC)
+        filetype = hdr[3];
+    else if (hdr[0] == MH_CIGAM_64 || hdr[0] == RMP_MH_CIGAM)
+        filetype = __builtin_bswap32(hdr[3]);
+    else
+        return RMP_MACHO_NONE;
+
+    switch (filetype) {
+    case RMP_MH_EXECUTE: return RMP_MACHO_EXECUTE;
+    case RMP_MH_DYLIB:
+    case RMP_MH_BUNDLE:  return RMP_MACHO_DYLIB;
+    default:             return RMP_MACHO_OTHER;
+    }
+}
+
 /*** rmp_cache_path ******************************/
 
 void rmp_cache_path(const char *cache_dir, const char *original,
@@ -306,6 +644,33 @@ void rmp_cache_path(const char *cache_dir, const char *original,
 
 /*** rmp_cache_valid *****************************/
 
+// Parse "<mtime> <size>" from an open .meta sidecar.
+static int parse_meta(int fd, time_t *mtime, off_t *size) {
+    char buf[128];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+
+    long cached_mtime;
+    long long cached_size;
+    if (sscanf(buf, "%ld %lld", &cached_mtime, &cached_size) != 2)
+        return -1;
+
+    *mtime = (time_t)cached_mtime;
+    *size = (off_t)cached_size;
+    return 0;
+}
+
+int rmp_cache_meta(const char *cached, time_t *mtime, off_t *size) {
+    char meta[PATH_MAX];
+    snprintf(meta, sizeof(meta), "%s.meta", cached);
+    int fd = open(meta, O_RDONLY);
+    if (fd < 0) return -1;
+    int ret = parse_meta(fd, mtime, size);
+    close(fd);
+    return ret;
+}
+
 int rmp_cache_valid(const char *cached, time_t orig_mtime, off_t orig_size) {
     struct stat sb;
     if (stat(cached, &sb) != 0) return 0;
@@ -315,18 +680,67 @@ int rmp_cache_valid(const char *cached, time_t orig_mtime, off_t orig_size) {
     int fd = open(meta, O_RDONLY);
     if (fd < 0) return 0;
 
-    char buf[128];
-    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    time_t cached_mtime;
+    off_t cached_size;
+    int valid = (parse_meta(fd, &cached_mtime, &cached_size) == 0 &&
+                 cached_mtime == orig_mtime && cached_size == orig_size);
+
+    // The sidecar's mtime doubles as the entry's last-use time for
+    // rmp_cache_gc().  Refresh it at most once per RMP_CACHE_TOUCH_SECS
+    // so that warm hits don't write on every spawn.  Failure (e.g. a
+    // read-only cache) is harmless.
+    if (valid && fstat(fd, &sb) == 0 &&
+        time(NULL) - sb.st_mtime >= RMP_CACHE_TOUCH_SECS)
+        futimens(fd, NULL);
+
     close(fd);
-    if (n <= 0) return 0;
-    buf[n] = '\0';
+    return valid;
+}
 
-    time_t cached_mtime;
-    long long cached_size;
-    if (sscanf(buf, "%ld %lld", &cached_mtime, &cached_size) != 2)
+static int tier_owned(const struct stat *sb, uid_t owner) {
+    return (sb->st_uid == 0 || sb->st_uid == owner) && !(sb->st_mode & 022);
+}
+
+// trusted_tier() for one entry: the copy about to be exec'd and every
+// directory between it and the tier must be root's or the tier owner's
+// and writable by no one else, or others could have swapped it in.
+static int trusted_entry(const char *tier, const char *cached) {
+    struct stat sb;
+    char dir[PATH_MAX];
+    size_t top = strlen(tier);
+    if (stat(tier, &sb) != 0 || !tier_owned(&sb, sb.st_uid) ||
+        strlen(cached) >= sizeof(dir))
         return 0;
+    uid_t owner = sb.st_uid;
 
-    return (cached_mtime == orig_mtime && (off_t)cached_size == orig_size);
+    strcpy(dir, cached);
+    for (char *slash; (slash = strrchr(dir, '/')) && (size_t)(slash - dir) > top; ) {
+        *slash = '\0';
+        if (stat(dir, &sb) != 0 || !S_ISDIR(sb.st_mode) || !tier_owned(&sb, owner))
+            return 0;
+    }
+    int fd = open(cached, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    int ok = fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && tier_owned(&sb, owner);
+    close(fd);
+    return ok;
+}
+
+int rmp_cache_lookup(const rmp_ctx_t *ctx, const char *original,
+                     time_t orig_mtime, off_t orig_size, char *out, size_t outsize) {
+    if (ctx->system_cache_dir[0]) {
+        rmp_cache_path(ctx->system_cache_dir, original, out, outsize);
+        if (rmp_cache_valid(out, orig_mtime, orig_size)) {
+            if (trusted_entry(ctx->system_cache_dir, out)) return 1;
+            if (ctx->debug_fp) {
+                fprintf(ctx->debug_fp, "[remapper] cache: %s is writable by others,"
+                                       " not used\n", out);
+                fflush(ctx->debug_fp);
+            }
+        }
+    }
+    rmp_cache_path(ctx->cache_dir, original, out, outsize);
+    return rmp_cache_valid(out, orig_mtime, orig_size);
 }
 
 /*** rmp_cache_create ****************************/
@@ -348,20 +762,36 @@ int rmp_cache_create(rmp_ctx_t *ctx, const char *original,
     int seq = atomic_fetch_add(&g_tmp_seq, 1);
     snprintf(tmp, sizeof(tmp), "%s.tmp.%d.%d", cached, getpid(), seq);
 
-    if (copyfile(original, tmp, NULL, COPYFILE_ALL) != 0) {
+    int method = rmp_clone_file(original, tmp, 0);
+    if (method < 0) {
         if (ctx->debug_fp) {
-            fprintf(ctx->debug_fp, "[remapper] cache: copyfile failed for %s: %s\n",
+            fprintf(ctx->debug_fp, "[remapper] cache: copy failed for %s: %s\n",
                     original, strerror(errno));
             fflush(ctx->debug_fp);
         }
         unlink(tmp);
         return -1;
     }
+    if (ctx->debug_fp) {
+        fprintf(ctx->debug_fp, "[remapper] cache: copied %s (%s)\n",
+                original, rmp_clone_method_name(method));
+        fflush(ctx->debug_fp);
+    }
 
     chmod(tmp, 0755);
 
     // Re-sign with entitlements
-    if (ctx->codesign_path[0] == '\0') {
+    int ret;
+    if (ctx->signer_path[0]) {
+        const char *sign_argv[] = {ctx->signer_path, "sign",
+                                   ctx->entitlements_path, tmp, NULL};
+        ret = run_logged(ctx, ctx->signer_path, sign_argv, "signer");
+    } else if (ctx->codesign_path[0]) {
+        const char *sign_argv[] = {"codesign", "--force", "-s", "-",
+                                   "--entitlements", ctx->entitlements_path,
+                                   tmp, NULL};
+        ret = run_logged(ctx, ctx->codesign_path, sign_argv, "codesign");
+    } else {
         if (ctx->debug_fp) {
             fprintf(ctx->debug_fp, "[remapper] cache: codesign not available\n");
             fflush(ctx->debug_fp);
@@ -369,19 +799,6 @@ int rmp_cache_create(rmp_ctx_t *ctx, const char *original,
         unlink(tmp);
         return -1;
     }
-    const char *sign_argv[] = {"codesign", "--force", "-s", "-",
-                               "--entitlements", ctx->entitlements_path,
-                               tmp, NULL};
-    rmp_pipe_t sign_proc = rmp_pipe_open(ctx->codesign_path, sign_argv);
-    if (!sign_proc.fp) { unlink(tmp); return -1; }
-    char line[256];
-    while (fgets(line, sizeof(line), sign_proc.fp)) {
-        if (ctx->debug_fp) {
-            fprintf(ctx->debug_fp, "[remapper] codesign: %s", line);
-            fflush(ctx->debug_fp);
-        }
-    }
-    int ret = rmp_pipe_close(&sign_proc);
     if (ret != 0) {
         if (ctx->debug_fp) {
             fprintf(ctx->debug_fp, "[remapper] cache: codesign failed (exit %d)\n", ret);
@@ -419,11 +836,9 @@ const char *rmp_resolve_hardened(rmp_ctx_t *ctx, const char *path, int *was_cach
     if (stat(path, &sb) != 0) return path;
     if (!S_ISREG(sb.st_mode)) return path;
 
-    // Check on-disk cache first
+    // Check the on-disk tiers first
     char cached[PATH_MAX];
-    rmp_cache_path(ctx->cache_dir, path, cached, sizeof(cached));
-
-    if (rmp_cache_valid(cached, sb.st_mtime, sb.st_size)) {
+    if (rmp_cache_lookup(ctx, path, sb.st_mtime, sb.st_size, cached, sizeof(cached))) {
         if (ctx->debug_fp) {
             fprintf(ctx->debug_fp, "[remapper] cache hit: %s\n", cached);
             fflush(ctx->debug_fp);
@@ -12,18 +12,53 @@
 // Create directory path recursively
 void rmp_mkdirs(const char *path, mode_t mode);
 
+// Parse a byte count with an optional K/M/G/T suffix (powers of 1024),
+// e.g. "512M" or "10G".  Returns -1 if malformed.
+long long rmp_parse_size(const char *s);
+
+// The '=' that gives "<mapping>=<target>" its own target: the last one
+// followed by "tmpfs:" or an absolute path - with `relative`, also one
+// starting "~", "./" or "../", for the caller to expand - so a '=' in
+// the mapping's own path ("/home/u/a=b/.cache*") stays part of it.
+// NULL if there is none.
+const char *rmp_mapping_target(const char *mapping, int relative);
+
+// Copy src to dst (created, or truncated if it exists), taking the
+// cheapest route the filesystem allows:
+//   1. copy-on-write clone    clonefile(2) on macOS, FICLONE on Linux
+//   2. in-kernel copy         fcopyfile(3) on macOS, copy_file_range(2)
+//                             then sendfile(2) on Linux
+//   3. userspace copy         read/write with a 1 MB buffer
+// Mode, timestamps, extended attributes and (where permitted) ownership
+// are preserved.  `flags` can rule out steps, for tests and benchmarks.
+// Returns the step that succeeded, or -1 with errno set; dst is left
+// behind on failure, for the caller to unlink.
+enum {
+    RMP_CLONE_REFLINK = 0,
+    RMP_CLONE_KERNEL,
+    RMP_CLONE_BUFFERED,
+};
+#define RMP_CLONE_NO_REFLINK  0x1
+#define RMP_CLONE_NO_KERNEL   0x2
+int rmp_clone_file(const char *src, const char *dst, int flags);
+
+// "reflink", "kernel" or "buffered"
+const char *rmp_clone_method_name(int method);
+
 // Resolve a bare filename via $PATH.
 // Returns 1 on success (result in `out`), 0 on failure.
 int resolve_in_path(const char *file, char *out, size_t outsize);
 
-// Safe popen replacement: fork+execv with stdout+stderr piped back.
-// No shell involved — immune to injection via filenames.
+// Safe popen replacement: posix_spawn with stdout+stderr piped back.
+// No shell involved — immune to injection via filenames — and no fork,
+// so it is cheap and safe from large, multithreaded host processes.
 typedef struct {
     FILE *fp;    // read end of pipe (caller reads from this)
     pid_t pid;   // child pid
 } rmp_pipe_t;
 
-// Spawn a child process. Returns .fp=NULL on failure.
+// Spawn a child process. Returns .fp=NULL (errno set) on failure,
+// including when `path` cannot be executed.
 rmp_pipe_t rmp_pipe_open(const char *path, const char *const argv[]);
 
 // Close pipe and wait for child. Returns exit status, or -1 on error.
@@ -34,30 +69,77 @@ int rmp_pipe_close(rmp_pipe_t *proc);
 // Context for cache operations (codesign + entitlements)
 typedef struct {
     char cache_dir[PATH_MAX];
+    char system_cache_dir[PATH_MAX]; // read-only tier checked first, "" = none
     char config_dir[PATH_MAX];
     char entitlements_path[PATH_MAX];
     char codesign_path[PATH_MAX];  // resolved once at init
+    char signer_path[PATH_MAX];    // rmp_ctx_set_signer()'s, replaces codesign if set
     FILE *debug_fp; // NULL = no debug logging
 } rmp_ctx_t;
 
 // Initialize context: populate paths, create dirs, write entitlements plist.
 // config_dir / cache_dir: if NULL, defaults to ~/.remapper / ~/.remapper/cache.
 // debug_fp: if NULL, no debug logging.
+//
+// $RMP_SYSTEM_CACHE (default RMP_SYSTEM_CACHE_DEFAULT, "" = none) names a
+// machine-wide tier, filled by an admin's `RMP_CACHE=<it> remapper
+// --prewarm`, that lookups try before cache_dir and never write to.  It
+// is only used if it is a directory owned by root or the caller and
+// writable by no one else, and an entry in it only if it and the
+// directories up to the tier are, too (owned by root or the tier's owner).
+#define RMP_SYSTEM_CACHE_DEFAULT "/var/cache/remapper"
 void rmp_ctx_init(rmp_ctx_t *ctx, const char *config_dir,
                   const char *cache_dir, FILE *debug_fp);
 
+// Tests and benchmarks only: use signer instead of codesign,
+//   <signer> check <binary>               exit 0 = needs re-signing
+//   <signer> sign <entitlements> <binary> re-sign in place, exit 0 = ok
+// which is what lets the cache pipeline run (and be benchmarked) off
+// macOS.  Nothing takes it from the environment, so no stray variable
+// can swap out codesign for a program or its interposer.  Returns 0,
+// or -1 if signer isn't found (codesign stays).
+int rmp_ctx_set_signer(rmp_ctx_t *ctx, const char *signer);
+
 // Check if a Mach-O binary has hardened runtime without the
 // allow-dyld-environment-variables entitlement.
 // Returns 1 if it needs re-signing, 0 otherwise.
 int rmp_is_hardened(const rmp_ctx_t *ctx, const char *path);
 
+// Classify a file by its Mach-O header (following the first slice of a
+// universal binary).  Reads at most two small chunks; never runs codesign.
+enum {
+    RMP_MACHO_NONE = 0,   // not Mach-O (scripts, data, Java class files, ...)
+    RMP_MACHO_EXECUTE,    // MH_EXECUTE: something posix_spawn can launch
+    RMP_MACHO_DYLIB,      // MH_DYLIB / MH_BUNDLE: loaded, never spawned
+    RMP_MACHO_OTHER,
+};
+int rmp_macho_kind(const char *path);
+
 // Build the cached path for a binary: <cache_dir><original_path>
 void rmp_cache_path(const char *cache_dir, const char *original,
                     char *out, size_t outsize);
 
-// Check if on-disk cache is valid (exists and matches original mtime/size)
+// Minimum interval between last-use updates of a cache entry.
+#define RMP_CACHE_TOUCH_SECS 3600
+
+// Check if on-disk cache is valid (exists and matches original mtime/size).
+// A valid hit also refreshes the entry's last-use time (the mtime of its
+// .meta sidecar), at most once per RMP_CACHE_TOUCH_SECS.
 int rmp_cache_valid(const char *cached, time_t orig_mtime, off_t orig_size);
 
+// Find a valid entry for original (its mtime and size as given) in ctx's
+// tiers: the system tier, then cache_dir.  Returns 1 with the entry's
+// path in out, else 0 with out = where to create one (in cache_dir).
+int rmp_cache_lookup(const rmp_ctx_t *ctx, const char *original,
+                     time_t orig_mtime, off_t orig_size, char *out, size_t outsize);
+
+// Read the original's (mtime, size) recorded in a cache entry's .meta
+// sidecar.  Returns 0 on success, -1 if missing or malformed.
+int rmp_cache_meta(const char *cached, time_t *mtime, off_t *size);
+
+// True if ctx can re-sign binaries (codesign found, or a signer set).
+int rmp_can_sign(const rmp_ctx_t *ctx);
+
 // Copy binary to cache and re-sign with entitlements.
 // Thread-safe: uses atomic counter for unique temp file names.
 // Returns 0 on success, -1 on failure.
@@ -65,7 +147,8 @@ int rmp_cache_create(rmp_ctx_t *ctx, const char *original,
                      const char *cached, time_t mtime, off_t size);
 
 // High-level: check if binary is hardened, and if so return a cached
-// re-signed copy. Returns the path to use (original or cached).
+// re-signed copy (from either tier, see rmp_cache_lookup). Returns the
+// path to use (original or cached).
 // If a new string is returned, caller must free() it.
 // Sets *was_cached = 1 if the returned path is a cached copy.
 const char *rmp_resolve_hardened(rmp_ctx_t *ctx, const char *path, int *was_cached);
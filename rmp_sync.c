@@ -0,0 +1,456 @@
+/* rmp_sync.c - mirror one file or directory tree onto another
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Two passes per directory: bring each entry of src over (recursing into
+ * subdirectories), then delete whatever dst has that src doesn't.  A
+ * stale temporary from an interrupted sync is just such an entry.
+ *
+ * "Differs" is size or mtime for files.  rmp_clone_file() carries the
+ * mtime across, so a tree synced one way and back compares equal
+ * without reading any data.
+ *
+ * The walk only touches metadata - directories, symlinks, removals, the
+ * comparisons - and stays on the calling thread.  File copies are the
+ * part worth spreading out, so with a pool they become tasks, and
+ * directory modes wait until they are all done: a read-only directory
+ * can't be filled.
+*/
+#include "rmp_sync.h"
+#include "rmp_shared.h"
+#include "rmp_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <linux/btrfs.h>
+#include <linux/magic.h>
+#endif
+
+#ifdef __APPLE__
+#define MTIME(sb) ((sb)->st_mtimespec)
+#else
+#define MTIME(sb) ((sb)->st_mtim)
+#endif
+
+typedef struct {
+    char *path;
+    mode_t mode;
+} dir_mode_t;
+
+typedef struct {
+    rmp_sync_stats_t *stats;
+    int flags;
+    int err;                // errno of the first failure
+    rmp_pool_t *pool;       // NULL: copy inline
+    pthread_mutex_t lock;   // guards stats and err while tasks run
+    dir_mode_t *modes;      // deferred chmods, with a pool
+    int num_modes, cap_modes;
+} sync_ctx_t;
+
+typedef struct {
+    sync_ctx_t *c;
+    long long size;
+    char *dst;              // points into src's allocation
+    char src[];
+} copy_task_t;
+
+static void sync_failed(sync_ctx_t *c) {
+    int saved = errno;
+    pthread_mutex_lock(&c->lock);
+    if (!c->err) c->err = saved ? saved : EIO;
+    c->stats->failed++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+// Walk-side counts can race with copy tasks' too
+static void count(sync_ctx_t *c, long *field) {
+    pthread_mutex_lock(&c->lock);
+    (*field)++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static int join(char *buf, size_t size, const char *dir, const char *name) {
+    int n = snprintf(buf, size, "%s/%s", dir, name);
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static int is_dot(const char *name) {
+    return name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]));
+}
+
+static int skipped(const sync_ctx_t *c, int depth, const char *name) {
+    return depth == 0 && (c->flags & RMP_SYNC_SKIP_RMP) && strncmp(name, ".rmp-", 5) == 0;
+}
+
+int rmp_remove_tree(const char *path) {
+    struct stat sb;
+    if (lstat(path, &sb) != 0) return errno == ENOENT ? 0 : -1;
+    if (!S_ISDIR(sb.st_mode)) return unlink(path);
+
+    DIR *d = opendir(path);
+    if (!d) return -1;
+    int r = 0;
+    struct dirent *e;
+    char child[PATH_MAX];
+    while ((e = readdir(d))) {
+        if (is_dot(e->d_name)) continue;
+        if (join(child, sizeof(child), path, e->d_name) != 0 || rmp_remove_tree(child) != 0)
+            r = -1;
+    }
+    closedir(d);
+    return r == 0 ? rmdir(path) : -1;
+}
+
+// "<dir>/.<name>.rmp-sync-<pid>" beside dst, for the write-then-rename
+static int temp_name(const char *dst, char *buf, size_t size) {
+    const char *slash = strrchr(dst, '/');
+    int dir_len = slash ? (int)(slash - dst) + 1 : 0;
+    int n = snprintf(buf, size, "%.*s.%s.rmp-sync-%d", dir_len, dst, dst + dir_len,
+                     (int)getpid());
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static void copy_file(sync_ctx_t *c, const char *src, const char *dst, long long size) {
+    char tmp[PATH_MAX];
+    if (temp_name(dst, tmp, sizeof(tmp)) != 0) {
+        sync_failed(c);
+        return;
+    }
+    unlink(tmp);
+    int method = rmp_clone_file(src, tmp, 0);
+    if (method < 0 || rename(tmp, dst) != 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        sync_failed(c);
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    c->stats->files++;
+    if (method == RMP_CLONE_REFLINK) c->stats->reflinked++;
+    c->stats->bytes += size;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void copy_task(void *arg) {
+    copy_task_t *t = arg;
+    copy_file(t->c, t->src, t->dst, t->size);
+    free(t);
+}
+
+// Copy now, or queue the copy if there is a pool
+static void queue_copy(sync_ctx_t *c, const char *src, const char *dst, long long size) {
+    if (!c->pool) {
+        copy_file(c, src, dst, size);
+        return;
+    }
+    size_t slen = strlen(src) + 1, dlen = strlen(dst) + 1;
+    copy_task_t *t = malloc(sizeof(*t) + slen + dlen);
+    if (!t) {
+        sync_failed(c);
+        return;
+    }
+    t->c = c;
+    t->size = size;
+    t->dst = t->src + slen;
+    memcpy(t->src, src, slen);
+    memcpy(t->dst, dst, dlen);
+    if (rmp_pool_submit(c->pool, copy_task, t) != 0) {
+        free(t);
+        copy_file(c, src, dst, size);
+    }
+}
+
+static void sync_file(const char *src, const struct stat *ssb, const char *dst,
+                      sync_ctx_t *c) {
+    struct stat dsb;
+    int have = lstat(dst, &dsb) == 0;
+    if (have && S_ISREG(dsb.st_mode) && dsb.st_size == ssb->st_size &&
+        MTIME(&dsb).tv_sec == MTIME(ssb).tv_sec &&
+        MTIME(&dsb).tv_nsec == MTIME(ssb).tv_nsec) {
+        if ((dsb.st_mode & 07777) != (ssb->st_mode & 07777) &&
+            chmod(dst, ssb->st_mode & 07777) != 0)
+            sync_failed(c);
+        return;
+    }
+    // rename() can't replace a directory
+    if (have && S_ISDIR(dsb.st_mode) && rmp_remove_tree(dst) != 0) {
+        sync_failed(c);
+        return;
+    }
+    queue_copy(c, src, dst, ssb->st_size);
+}
+
+static void sync_link(const char *src, const char *dst, sync_ctx_t *c) {
+    char want[PATH_MAX], have_target[PATH_MAX];
+    ssize_t n = readlink(src, want, sizeof(want) - 1);
+    if (n < 0) {
+        sync_failed(c);
+        return;
+    }
+    want[n] = '\0';
+
+    struct stat dsb;
+    int have = lstat(dst, &dsb) == 0;
+    if (have && S_ISLNK(dsb.st_mode)) {
+        ssize_t m = readlink(dst, have_target, sizeof(have_target) - 1);
+        if (m == n && memcmp(want, have_target, (size_t)n) == 0) return;
+    }
+
+    char tmp[PATH_MAX];
+    if (temp_name(dst, tmp, sizeof(tmp)) != 0 ||
+        (have && S_ISDIR(dsb.st_mode) && rmp_remove_tree(dst) != 0)) {
+        sync_failed(c);
+        return;
+    }
+    unlink(tmp);
+    if (symlink(want, tmp) != 0 || rename(tmp, dst) != 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        sync_failed(c);
+        return;
+    }
+    count(c, &c->stats->files);
+}
+
+static void set_mode(sync_ctx_t *c, const char *dst, mode_t mode) {
+    if (!c->pool) {
+        if (chmod(dst, mode) != 0) sync_failed(c);
+        return;
+    }
+    if (c->num_modes == c->cap_modes) {
+        int cap = c->cap_modes ? c->cap_modes * 2 : 64;
+        dir_mode_t *m = realloc(c->modes, (size_t)cap * sizeof(*m));
+        if (!m) {
+            sync_failed(c);
+            return;
+        }
+        c->modes = m;
+        c->cap_modes = cap;
+    }
+    char *path = strdup(dst);
+    if (!path) {
+        sync_failed(c);
+        return;
+    }
+    c->modes[c->num_modes].path = path;
+    c->modes[c->num_modes].mode = mode;
+    c->num_modes++;
+}
+
+static void sync_entry(const char *src, const char *dst, int depth, sync_ctx_t *c);
+
+static void sync_dir(const char *src, const struct stat *ssb, const char *dst,
+                     int depth, sync_ctx_t *c) {
+    struct stat dsb;
+    int have = lstat(dst, &dsb) == 0;
+    if (have && !S_ISDIR(dsb.st_mode)) {
+        if (unlink(dst) != 0) {
+            sync_failed(c);
+            return;
+        }
+        count(c, &c->stats->removed);
+        have = 0;
+    }
+    // Owner-writable while it is filled; the real mode goes on last
+    if (!have && mkdir(dst, 0700) != 0) {
+        sync_failed(c);
+        return;
+    }
+
+    // First drop what src no longer has: once copies are queued, their
+    // temporaries beside dst would look like such entries
+    char s[PATH_MAX], d[PATH_MAX];
+    struct dirent *e;
+    DIR *dir;
+    if (have && (dir = opendir(dst))) {
+        struct stat sb;
+        while ((e = readdir(dir))) {
+            if (is_dot(e->d_name) || skipped(c, depth, e->d_name)) continue;
+            if (join(s, sizeof(s), src, e->d_name) != 0 ||
+                join(d, sizeof(d), dst, e->d_name) != 0)
+                continue;
+            if (lstat(s, &sb) == 0 || errno != ENOENT) continue;
+            if (rmp_remove_tree(d) == 0) count(c, &c->stats->removed);
+            else sync_failed(c);
+        }
+        closedir(dir);
+    }
+
+    if (!(dir = opendir(src))) {
+        sync_failed(c);
+        return;
+    }
+    while ((e = readdir(dir))) {
+        if (is_dot(e->d_name) || skipped(c, depth, e->d_name)) continue;
+        if (join(s, sizeof(s), src, e->d_name) != 0 ||
+            join(d, sizeof(d), dst, e->d_name) != 0) {
+            sync_failed(c);
+            continue;
+        }
+        sync_entry(s, d, depth + 1, c);
+    }
+    closedir(dir);
+
+    if (!have || (dsb.st_mode & 07777) != (ssb->st_mode & 07777))
+        set_mode(c, dst, ssb->st_mode & 07777);
+}
+
+// Sockets, fifos and devices are left alone
+static void sync_entry(const char *src, const char *dst, int depth, sync_ctx_t *c) {
+    struct stat sb;
+    if (lstat(src, &sb) != 0) {
+        sync_failed(c);
+        return;
+    }
+    if (S_ISDIR(sb.st_mode))      sync_dir(src, &sb, dst, depth, c);
+    else if (S_ISREG(sb.st_mode)) sync_file(src, &sb, dst, c);
+    else if (S_ISLNK(sb.st_mode)) sync_link(src, dst, c);
+}
+
+int rmp_sync_tree(const char *src, const char *dst, int flags, int jobs,
+                  rmp_sync_stats_t *stats) {
+    rmp_sync_stats_t local;
+    memset(&local, 0, sizeof(local));
+    sync_ctx_t c;
+    memset(&c, 0, sizeof(c));
+    c.stats = stats ? stats : &local;
+    c.flags = flags;
+
+    struct stat sb;
+    if (lstat(src, &sb) != 0) return -1;
+    if (!S_ISDIR(sb.st_mode) && !S_ISREG(sb.st_mode) && !S_ISLNK(sb.st_mode)) {
+        errno = EINVAL;
+        return -1;
+    }
+    // A single file has nothing to spread out
+    if (jobs != 1 && S_ISDIR(sb.st_mode)) c.pool = rmp_pool_create(jobs);
+    pthread_mutex_init(&c.lock, NULL);
+
+    sync_entry(src, dst, 0, &c);
+
+    if (c.pool) {
+        rmp_pool_destroy(c.pool);
+        c.pool = NULL;
+        for (int i = c.num_modes - 1; i >= 0; i--) {
+            if (chmod(c.modes[i].path, c.modes[i].mode) != 0) sync_failed(&c);
+            free(c.modes[i].path);
+        }
+        free(c.modes);
+    }
+    pthread_mutex_destroy(&c.lock);
+
+    if (c.err) {
+        errno = c.err;
+        return -1;
+    }
+    return 0;
+}
+
+/*** Snapshots ************************************/
+
+// "<dir>/.rmp-snapshots[/<name>]" into buf; -1 with EINVAL for a name
+// that isn't a single path component
+static int snapshot_path(const char *dir, const char *name, char *buf, size_t size) {
+    if (name && (!name[0] || strchr(name, '/') || is_dot(name))) {
+        errno = EINVAL;
+        return -1;
+    }
+    int n = name ? snprintf(buf, size, "%s/.rmp-snapshots/%s", dir, name)
+                 : snprintf(buf, size, "%s/.rmp-snapshots", dir);
+    if (n < 0 || (size_t)n >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// Snapshot a btrfs subvolume at dir into parent/name, which must not
+// exist.  Unprivileged callers may, if they own dir.  0 or -1.
+static int subvolume_snapshot(const char *dir, const char *parent, const char *name) {
+#if defined(__linux__) && defined(BTRFS_IOC_SNAP_CREATE_V2)
+    struct statfs fs;
+    struct stat sb;
+    // A subvolume's root is always inode 256 (BTRFS_FIRST_FREE_OBJECTID)
+    if (statfs(dir, &fs) != 0 || fs.f_type != BTRFS_SUPER_MAGIC ||
+        stat(dir, &sb) != 0 || sb.st_ino != 256) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    int src = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int dst = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int r = -1;
+    if (src >= 0 && dst >= 0) {
+        struct btrfs_ioctl_vol_args_v2 args;
+        memset(&args, 0, sizeof(args));
+        args.fd = src;
+        snprintf(args.name, sizeof(args.name), "%s", name);
+        r = ioctl(dst, BTRFS_IOC_SNAP_CREATE_V2, &args);
+    }
+    int saved = errno;
+    if (src >= 0) close(src);
+    if (dst >= 0) close(dst);
+    errno = saved;
+    return r;
+#else
+    (void)dir; (void)parent; (void)name;
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+int rmp_snapshot_save(const char *dir, const char *name, int jobs,
+                      rmp_sync_stats_t *stats, const char **method) {
+    char parent[PATH_MAX], snap[PATH_MAX];
+    if (snapshot_path(dir, NULL, parent, sizeof(parent)) != 0 ||
+        snapshot_path(dir, name, snap, sizeof(snap)) != 0)
+        return -1;
+    if (mkdir(parent, 0700) != 0 && errno != EEXIST) return -1;
+
+    struct stat sb;
+    if (method) *method = "tree";
+    if (lstat(snap, &sb) != 0 && subvolume_snapshot(dir, parent, name) == 0) {
+        if (method) *method = "subvolume";
+        return 0;
+    }
+    return rmp_sync_tree(dir, snap, RMP_SYNC_SKIP_RMP, jobs, stats);
+}
+
+int rmp_snapshot_restore(const char *dir, const char *name, int jobs,
+                         rmp_sync_stats_t *stats) {
+    char snap[PATH_MAX];
+    struct stat sb;
+    if (snapshot_path(dir, name, snap, sizeof(snap)) != 0) return -1;
+    if (stat(snap, &sb) != 0) return -1;
+    if (!S_ISDIR(sb.st_mode)) {
+        errno = ENOTDIR;
+        return -1;
+    }
+    return rmp_sync_tree(snap, dir, RMP_SYNC_SKIP_RMP, jobs, stats);
+}
@@ -0,0 +1,55 @@
+// rmp_sync.h - mirror one file or directory tree onto another, and
+// named snapshots of a target dir built on it
+
+#ifndef RMP_SYNC_H
+#define RMP_SYNC_H
+
+typedef struct {
+    long files;         // regular files and symlinks written
+    long reflinked;     // ... of which copy-on-write clones
+    long long bytes;    // bytes in the files written
+    long removed;       // entries deleted from dst (a directory counts once)
+    long failed;        // entries that could not be brought up to date
+} rmp_sync_stats_t;
+
+// At the top of the tree only, leave remapper's own ".rmp-*" entries
+// (staging tmpfs, snapshots) alone, in src and in dst.
+#define RMP_SYNC_SKIP_RMP  0x1
+
+// Make dst a copy of src, writing only what differs: a regular file is
+// rewritten when its size or mtime differs, a symlink when its target
+// does, and anything in dst that src lacks is removed.  Each file is
+// written to a temporary name beside it with rmp_clone_file() and
+// renamed into place, so readers of dst never see a partial file.
+// src may be a regular file or a directory.  Directory modes follow
+// src; owners and directory times are left alone.
+//
+// The walk itself is serial; the file copies run on `jobs` threads
+// (<= 0 = one per CPU, 1 = in the calling thread).
+//
+// Keeps going past entries it can't sync.  Adds to *stats (if non-NULL)
+// and returns 0, or -1 if anything failed, with errno from the first
+// failure.
+int rmp_sync_tree(const char *src, const char *dst, int flags, int jobs,
+                  rmp_sync_stats_t *stats);
+
+// Remove path and, for a directory, everything below it.  0 or -1.
+int rmp_remove_tree(const char *path);
+
+// Named snapshots of a target dir, kept in <dir>/.rmp-snapshots/<name>
+// on the same filesystem, so files are shared copy-on-write wherever
+// the filesystem can reflink.
+//
+// rmp_snapshot_save() makes or updates the snapshot: a btrfs subvolume
+// snapshot when dir is a subvolume and the snapshot is new, otherwise a
+// synced tree.  rmp_snapshot_restore() syncs dir back to the snapshot,
+// so only what changed since is rewritten or removed.  Both skip the
+// ".rmp-*" entries in dir.  `method` (if non-NULL) gets "subvolume" or
+// "tree".  Return 0, or -1 with errno set (ENOENT: no such snapshot,
+// EINVAL: bad name).
+int rmp_snapshot_save(const char *dir, const char *name, int jobs,
+                      rmp_sync_stats_t *stats, const char **method);
+int rmp_snapshot_restore(const char *dir, const char *name, int jobs,
+                         rmp_sync_stats_t *stats);
+
+#endif // RMP_SYNC_H
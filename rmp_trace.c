@@ -0,0 +1,348 @@
+/* rmp_trace.c - path traces of the interposer's calls, for replay
+ *
+ * Copyright (c) 2026 Nick Clifford <nick@nickclifford.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A trace is a header, then chunks, all integers little-endian:
+ *
+ *   "RMPTRACE" u32 version, u32 target length, u32 mappings length,
+ *              the target, the mappings
+ *   chunk:     u32 length, then that many bytes of records
+ *   record:    0, u8 length, a call name: the chunk's next call id
+ *              (from 1), or
+ *              id, u16 kept, u16 length, bytes: a path to that call,
+ *              the first `kept` bytes of it those of the previous path
+ *
+ * Paths in a session mostly share long prefixes ("/Users/me/.claude/"),
+ * so a record is a handful of bytes.  Every chunk starts afresh, with
+ * no call names and no previous path, so chunks from processes
+ * appending to one file (O_APPEND, a write(2) each) can interleave in
+ * any order.
+*/
+#include "rmp_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define MAGIC       "RMPTRACE"
+#define VERSION     1
+#define CHUNK_SIZE  65536
+#define MAX_CALLS   255         // call ids per chunk
+#define MAX_NAME    63
+
+struct rmp_trace {
+    int fd;
+    pthread_mutex_t lock;
+    unsigned char buf[CHUNK_SIZE];  // the chunk: length, then records
+    size_t used;
+    char call_name[MAX_CALLS][MAX_NAME + 1];
+    int num_calls;
+    char prev[PATH_MAX];
+    size_t prev_len;
+};
+
+static __thread int t_adding = 0;
+
+static void put16(unsigned char *p, uint32_t v) { p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; }
+static void put32(unsigned char *p, uint32_t v) { put16(p, v & 0xffff); put16(p + 2, v >> 16); }
+static uint32_t get16(const unsigned char *p) { return p[0] | (uint32_t)p[1] << 8; }
+static uint32_t get32(const unsigned char *p) { return get16(p) | get16(p + 2) << 16; }
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int rmp_trace_create(const char *path, const char *target, const char *mappings) {
+    size_t tlen = strlen(target), mlen = strlen(mappings);
+    unsigned char head[20];
+    memcpy(head, MAGIC, 8);
+    put32(head + 8, VERSION);
+    put32(head + 12, (uint32_t)tlen);
+    put32(head + 16, (uint32_t)mlen);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    int r = write_all(fd, head, sizeof(head)) == 0 && write_all(fd, target, tlen) == 0 &&
+            write_all(fd, mappings, mlen) == 0 ? 0 : -1;
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return r;
+}
+
+rmp_trace_t *rmp_trace_open(const char *path) {
+    int fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    char magic[8];
+    if (pread(fd, magic, 8, 0) != 8 || memcmp(magic, MAGIC, 8) != 0) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    rmp_trace_t *t = calloc(1, sizeof(*t));
+    if (!t) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    t->fd = fd;
+    t->used = 4;
+    pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+static int flush_locked(rmp_trace_t *t) {
+    int r = 0;
+    if (t->used > 4) {
+        put32(t->buf, (uint32_t)(t->used - 4));
+        r = write_all(t->fd, t->buf, t->used);
+    }
+    t->used = 4;
+    t->num_calls = 0;
+    t->prev_len = 0;
+    return r;
+}
+
+// The chunk's id for call, or 0 if it needs defining
+static int call_id(rmp_trace_t *t, const char *call) {
+    for (int i = 0; i < t->num_calls; i++)
+        if (strcmp(t->call_name[i], call) == 0) return i + 1;
+    return 0;
+}
+
+void rmp_trace_add(rmp_trace_t *t, const char *call, const char *path) {
+    if (!path || t_adding) return;
+    size_t len = strlen(path);
+    if (len >= sizeof(t->prev)) return;
+    if (!call) call = "?";
+    t_adding = 1;
+    pthread_mutex_lock(&t->lock);
+
+    size_t name_len = strnlen(call, MAX_NAME);
+    if (t->used + 2 + name_len + 5 + len > sizeof(t->buf) ||
+        (!call_id(t, call) && t->num_calls == MAX_CALLS))
+        flush_locked(t);
+
+    int id = call_id(t, call);
+    if (!id) {
+        t->buf[t->used++] = 0;
+        t->buf[t->used++] = (unsigned char)name_len;
+        memcpy(t->buf + t->used, call, name_len);
+        t->used += name_len;
+        memcpy(t->call_name[t->num_calls], call, name_len);
+        t->call_name[t->num_calls][name_len] = '\0';
+        id = ++t->num_calls;
+    }
+
+    size_t kept = 0;
+    while (kept < t->prev_len && kept < len && t->prev[kept] == path[kept]) kept++;
+    t->buf[t->used++] = (unsigned char)id;
+    put16(t->buf + t->used, (uint32_t)kept);
+    put16(t->buf + t->used + 2, (uint32_t)(len - kept));
+    memcpy(t->buf + t->used + 4, path + kept, len - kept);
+    t->used += 4 + len - kept;
+    memcpy(t->prev + kept, path + kept, len - kept);
+    t->prev_len = len;
+
+    pthread_mutex_unlock(&t->lock);
+    t_adding = 0;
+}
+
+int rmp_trace_flush(rmp_trace_t *t) {
+    pthread_mutex_lock(&t->lock);
+    int r = flush_locked(t);
+    pthread_mutex_unlock(&t->lock);
+    return r;
+}
+
+void rmp_trace_lock(rmp_trace_t *t) {
+    pthread_mutex_lock(&t->lock);
+    flush_locked(t);
+}
+
+void rmp_trace_unlock(rmp_trace_t *t) {
+    pthread_mutex_unlock(&t->lock);
+}
+
+void rmp_trace_close(rmp_trace_t *t) {
+    if (!t) return;
+    rmp_trace_flush(t);
+    close(t->fd);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+/*** Reading **************************************/
+
+// Strings go into one growing buffer, so records hold offsets into it
+// until the end, when they become pointers
+typedef struct {
+    char *buf;
+    size_t used, size;
+} strings_t;
+
+static size_t strings_add(strings_t *s, const void *str, size_t len) {
+    if (s->used + len + 1 > s->size) {
+        size_t size = s->size ? s->size : 4096;
+        while (s->used + len + 1 > size) size *= 2;
+        char *buf = realloc(s->buf, size);
+        if (!buf) return (size_t)-1;
+        s->buf = buf;
+        s->size = size;
+    }
+    size_t off = s->used;
+    memcpy(s->buf + off, str, len);
+    s->buf[off + len] = '\0';
+    s->used += len + 1;
+    return off;
+}
+
+typedef struct { size_t call, path; } rec_off_t;
+
+// The chunk records in body, onto recs; the call names interned in
+// names (offsets, num_names of them).  0, or -1 with errno set.
+static int load_chunk(const unsigned char *body, size_t len, strings_t *s,
+                      rec_off_t **recs, size_t *count, size_t *cap,
+                      size_t **names, size_t *num_names) {
+    size_t calls[MAX_CALLS];
+    int num_calls = 0;
+    char prev[PATH_MAX];
+    size_t prev_len = 0;
+
+    for (size_t pos = 0; pos < len; ) {
+        unsigned id = body[pos++];
+        if (id == 0) {
+            if (pos >= len || pos + 1 + body[pos] > len || num_calls == MAX_CALLS) goto bad;
+            size_t nlen = body[pos++];
+            const char *name = (const char *)body + pos;
+            pos += nlen;
+            size_t n;
+            for (n = 0; n < *num_names; n++)
+                if (strlen(s->buf + (*names)[n]) == nlen &&
+                    memcmp(s->buf + (*names)[n], name, nlen) == 0) break;
+            if (n == *num_names) {
+                size_t *grown = realloc(*names, (n + 1) * sizeof(**names));
+                if (!grown) return -1;
+                *names = grown;
+                if (((*names)[n] = strings_add(s, name, nlen)) == (size_t)-1) return -1;
+                (*num_names)++;
+            }
+            calls[num_calls++] = (*names)[n];
+            continue;
+        }
+        if ((int)id > num_calls || pos + 4 > len) goto bad;
+        size_t kept = get16(body + pos), rest = get16(body + pos + 2);
+        pos += 4;
+        if (kept > prev_len || kept + rest >= sizeof(prev) || pos + rest > len) goto bad;
+        memcpy(prev + kept, body + pos, rest);
+        prev_len = kept + rest;
+        pos += rest;
+
+        if (*count == *cap) {
+            size_t ncap = *cap ? *cap * 2 : 4096;
+            rec_off_t *grown = realloc(*recs, ncap * sizeof(**recs));
+            if (!grown) return -1;
+            *recs = grown;
+            *cap = ncap;
+        }
+        rec_off_t *r = &(*recs)[(*count)++];
+        r->call = calls[id - 1];
+        if ((r->path = strings_add(s, prev, prev_len)) == (size_t)-1) return -1;
+    }
+    return 0;
+bad:
+    errno = EINVAL;
+    return -1;
+}
+
+int rmp_trace_load(const char *path, rmp_trace_data_t *data) {
+    memset(data, 0, sizeof(*data));
+    FILE *fp = fopen(path, "rbe");
+    if (!fp) return -1;
+    unsigned char *file = NULL;
+    size_t size = 0, cap = 0;
+    for (;;) {
+        if (size == cap) {
+            cap = cap ? cap * 2 : 1 << 20;
+            unsigned char *grown = realloc(file, cap);
+            if (!grown) { free(file); fclose(fp); errno = ENOMEM; return -1; }
+            file = grown;
+        }
+        size_t n = fread(file + size, 1, cap - size, fp);
+        if (n == 0) break;
+        size += n;
+    }
+    fclose(fp);
+
+    strings_t s = { NULL, 0, 0 };
+    rec_off_t *recs = NULL;
+    size_t count = 0, rcap = 0, *names = NULL, num_names = 0;
+    size_t tlen = 0, mlen = 0, toff = 0, moff = 0;
+    int r = -1;
+
+    errno = EINVAL;
+    if (size < 20 || memcmp(file, MAGIC, 8) != 0 || get32(file + 8) != VERSION) goto out;
+    tlen = get32(file + 12);
+    mlen = get32(file + 16);
+    if (tlen > size - 20 || mlen > size - 20 - tlen) goto out;
+    if ((toff = strings_add(&s, file + 20, tlen)) == (size_t)-1 ||
+        (moff = strings_add(&s, file + 20 + tlen, mlen)) == (size_t)-1) goto out;
+
+    size_t pos = 20 + tlen + mlen;
+    while (pos < size) {
+        if (size - pos < 4 || get32(file + pos) > size - pos - 4) {
+            data->truncated = size - pos;   // a copy taken mid-write
+            break;
+        }
+        size_t len = get32(file + pos);
+        if (load_chunk(file + pos + 4, len, &s, &recs, &count, &rcap, &names, &num_names) < 0)
+            goto out;
+        pos += 4 + len;
+    }
+
+    data->recs = malloc((count ? count : 1) * sizeof(*data->recs));
+    if (!data->recs) goto out;
+    for (size_t i = 0; i < count; i++) {
+        data->recs[i].call = s.buf + recs[i].call;
+        data->recs[i].path = s.buf + recs[i].path;
+    }
+    data->count = count;
+    data->target = s.buf + toff;
+    data->mappings = s.buf + moff;
+    data->strings = s.buf;
+    s.buf = NULL;
+    r = 0;
+out:;
+    int saved = errno;
+    free(file);
+    free(recs);
+    free(names);
+    free(s.buf);
+    errno = saved;
+    return r;
+}
+
+void rmp_trace_data_free(rmp_trace_data_t *data) {
+    free(data->recs);
+    free(data->strings);
+    memset(data, 0, sizeof(*data));
+}
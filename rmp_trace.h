@@ -0,0 +1,63 @@
+// rmp_trace.h - path traces: every path the interposer is asked to
+// rewrite, with the call it came from, for replaying through the
+// matcher (test/bench_rewrite.c)
+
+#ifndef RMP_TRACE_H
+#define RMP_TRACE_H
+
+#include <stddef.h>
+
+typedef struct rmp_trace rmp_trace_t;
+
+// Start a trace file at path, replacing any there.  Its header keeps
+// target and mappings (as in RMP_TARGET and RMP_MAPPINGS), so that a
+// replay loads the same patterns.  Returns 0, or -1 with errno set.
+int rmp_trace_create(const char *path, const char *target, const char *mappings);
+
+// Open a file from rmp_trace_create() to add records to.  Any number
+// of processes may add to one file.  NULL with errno set (EINVAL: not
+// a trace).
+rmp_trace_t *rmp_trace_open(const char *path);
+
+// Record that call ("open", "stat", ...) was given path.  Thread-safe.
+// Records are buffered and go out in chunks, each one write(2) of whole
+// records, so processes sharing the file never split each other's.  A
+// call made while this thread is already adding one (a signal handler)
+// isn't recorded.
+void rmp_trace_add(rmp_trace_t *t, const char *call, const char *path);
+
+// Write out the buffered records.  0, or -1 with errno set.
+int rmp_trace_flush(rmp_trace_t *t);
+
+// Flush and hold the trace across fork(), so that the child neither
+// inherits a held lock nor writes its parent's records again; unlock in
+// both parent and child after.
+void rmp_trace_lock(rmp_trace_t *t);
+void rmp_trace_unlock(rmp_trace_t *t);
+
+// Flush and close.
+void rmp_trace_close(rmp_trace_t *t);
+
+/*** Reading **************************************/
+
+typedef struct {
+    const char *call;           // interned: equal calls, one pointer
+    const char *path;
+} rmp_trace_rec_t;
+
+typedef struct {
+    char *target;
+    char *mappings;
+    rmp_trace_rec_t *recs;      // in the order they were written
+    size_t count;
+    size_t truncated;           // bytes of an incomplete last chunk, skipped
+    char *strings;              // owns the paths and call names
+} rmp_trace_data_t;
+
+// Read a whole trace into memory.  Returns 0, or -1 with errno set
+// (EINVAL: not a trace, or a malformed chunk).
+int rmp_trace_load(const char *path, rmp_trace_data_t *data);
+
+void rmp_trace_data_free(rmp_trace_data_t *data);
+
+#endif // RMP_TRACE_H
@@ -0,0 +1,121 @@
+/*
+ * bench_batch.c - bring up a fleet: separate remapper launches vs. --batch
+ *
+ * Starts N instances of a trivial program, each with its own fresh
+ * target dir and the same mapping, and times the whole fleet from the
+ * first launch to the last exit:
+ *   separate   N remapper processes started at once, each scanning the
+ *              mapped parent and creating its own targets
+ *   --batch    one remapper --batch: one scan, targets created by the
+ *              pool, N spawns at most --jobs at a time
+ *
+ * Usage:
+ *   ./bench_batch [instances] [mappings] [runs]
+ *     defaults: 50 instances, 32 mapped directories, 5 runs
+ *
+ * Expects build/remapper next to this binary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) {
+    int n     = argc > 1 ? atoi(argv[1]) : 50;
+    int nmaps = argc > 2 ? atoi(argv[2]) : 32;
+    int runs  = argc > 3 ? atoi(argv[3]) : 5;
+
+    char remapper[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", remapper, sizeof(remapper) - 16);
+    if (len < 0) { perror("readlink"); return 2; }
+    remapper[len] = '\0';
+    strcpy(strrchr(remapper, '/') + 1, "remapper");
+
+    char root[256];
+    snprintf(root, sizeof(root), "%s/rmp-bench-batch-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 2; }
+
+    char home[PATH_MAX], map[PATH_MAX + 16], manifest[PATH_MAX], target[PATH_MAX];
+    snprintf(home, sizeof(home), "%s/home", root);
+    snprintf(map, sizeof(map), "%s/.bench*", home);
+    snprintf(manifest, sizeof(manifest), "%s/manifest", root);
+    mkdir(home, 0755);
+    for (int i = 0; i < nmaps; i++) {
+        char dir[PATH_MAX + 32];
+        snprintf(dir, sizeof(dir), "%s/.bench-%d", home, i);
+        mkdir(dir, 0755);
+    }
+
+    pid_t *pids = malloc((size_t)n * sizeof(pid_t));
+    char jobs[16];
+    snprintf(jobs, sizeof(jobs), "%d", n);
+
+    printf("%d instances of /bin/true, %d mapped dirs, %d runs\n\n", n, nmaps, runs);
+    printf("%-10s %10s %10s %12s\n", "mode", "best ms", "mean ms", "ms/instance");
+
+    for (int mode = 0; mode < 2; mode++) {
+        double best = 1e9, sum = 0;
+        for (int r = 0; r < runs; r++) {
+            // Fresh targets every run, so target creation is always timed
+            char cmd[PATH_MAX + 16];
+            snprintf(cmd, sizeof(cmd), "rm -rf '%s/t'", root);
+            if (system(cmd) != 0) return 2;
+
+            FILE *fp = fopen(manifest, "w");
+            for (int i = 0; i < n; i++)
+                fprintf(fp, "%s/t/%d '%s' -- /bin/true\n", root, i, map);
+            fclose(fp);
+
+            double t0 = now_ms();
+            int ok = 1;
+            if (mode == 0) {
+                for (int i = 0; i < n; i++) {
+                    snprintf(target, sizeof(target), "%s/t/%d", root, i);
+                    char *args[] = { remapper, target, map, "--", "/bin/true", NULL };
+                    if (posix_spawn(&pids[i], remapper, NULL, NULL, args, environ) != 0)
+                        return 2;
+                }
+                for (int i = 0; i < n; i++) {
+                    int status;
+                    waitpid(pids[i], &status, 0);
+                    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                }
+            } else {
+                char *args[] = { remapper, "--batch", manifest, "--jobs", jobs,
+                                 "--report", "/dev/null", NULL };
+                pid_t pid;
+                int status;
+                if (posix_spawn(&pid, remapper, NULL, NULL, args, environ) != 0) return 2;
+                waitpid(pid, &status, 0);
+                ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            }
+            double t = now_ms() - t0;
+            if (!ok) { fprintf(stderr, "launch failed\n"); return 1; }
+            if (t < best) best = t;
+            sum += t;
+        }
+        printf("%-10s %10.1f %10.1f %12.3f\n", mode ? "--batch" : "separate",
+               best, sum / runs, best / n);
+    }
+
+    free(pids);
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * bench_dirlist.c - listing a directory a mapping sits in: merged, cached
+ *
+ * The interposer lists such a directory (~ for ~/.claude*) from its
+ * merged listing: the real entries less those the mapping redirects,
+ * then the target's that it redirects to.  This builds the listings
+ * (interpose_dirlist.c) and the matcher (interpose_rewrite.c) in, makes
+ * a scratch "home" of [files] files and a few names the mapping covers,
+ * and times a listing, opendir() to closedir(), each way:
+ *   as it is   readdir() of the real directory, what programs saw before
+ *   afresh     dirlist_merge(), reading both directories every time
+ *   cached     dirlist_open(), as the opendir() hook does
+ * for us/listing (the best of [rounds] passes), the entries listed, and
+ * a checksum of their names; afresh and cached must agree.  Then it
+ * adds a name to the target and checks the cached listing shows it,
+ * and lists home again under a mapping whose glob also matches home's
+ * own name, so it is stepped through a component below the parent.
+ *
+ * Usage:
+ *   ./bench_dirlist [rounds] [listings] [files]
+ *     default: 10 rounds of 2000 listings of 200 files
+ *   Exits 1 if the cached listing differs from the merged one, or
+ *   misses the change.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "interpose.h"
+
+typedef enum { AS_IS, AFRESH, CACHED } way_t;
+static const char *g_way_names[] = { "as it is", "afresh", "cached" };
+#define NUM_WAYS 3
+
+static char g_home[PATH_MAX];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t fnv(uint64_t h, const char *s) {
+    for (const unsigned char *p = (const unsigned char *)s; ; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+        if (!*p) return h;
+    }
+}
+
+static void touch(const char *dir, const char *name) {
+    char path[PATH_MAX + 256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    if (fd >= 0) close(fd);
+}
+
+// A minute ago: the cache doesn't keep a directory changed this second
+static void backdate(const char *dir) {
+    struct timespec times[2] = { { time(NULL) - 60, 0 }, { time(NULL) - 60, 0 } };
+    utimensat(AT_FDCWD, dir, times, 0);
+}
+
+// One listing, opendir() to closedir(); the entries, and their checksum
+static int list(way_t way, uint64_t *sum, const char *want) {
+    uint64_t h = 1469598103934665603ULL;
+    int n = 0, found = 0;
+    DIR *d = opendir(g_home);
+    if (!d) return -1;
+    if (way == AS_IS) {
+        struct dirent *de;
+        while ((de = readdir(d))) {
+            h = fnv(h, de->d_name);
+            found |= want && strcmp(de->d_name, want) == 0;
+            n++;
+        }
+    } else {
+        dirlist_t *l = way == AFRESH ? dirlist_merge(g_home) : dirlist_open(g_home, dirfd(d));
+        for (int i = 0; l && i < l->count; i++) {
+            h = fnv(h, l->ents[i].name);
+            found |= want && strcmp(l->ents[i].name, want) == 0;
+        }
+        n = l ? l->count : -1;
+        dirlist_release(l);
+    }
+    closedir(d);
+    if (sum) *sum = h;
+    return want && !found ? -1 : n;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    long listings = argc > 2 ? atol(argv[2]) : 2000;
+    int files = argc > 3 ? atoi(argv[3]) : 200;
+    if (rounds < 1) rounds = 1;
+    if (listings < 1) listings = 1;
+    if (files < 0) files = 0;
+
+    char tmpl[] = "/tmp/rmp-bench-dirlist-XXXXXX", target[PATH_MAX + 16];
+    char mapping[PATH_MAX + 16], name[32];
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    snprintf(g_home, sizeof(g_home), "%s/home/u", tmpl);
+    snprintf(target, sizeof(target), "%s/t", tmpl);
+    snprintf(mapping, sizeof(mapping), "%s/.app*", g_home);
+    rmp_mkdirs(g_home, 0755);
+    rmp_mkdirs(target, 0755);
+
+    // Home: the files, and three names the mapping hides.  The target:
+    // two it shows, and one it doesn't cover
+    for (int i = 0; i < files; i++) {
+        snprintf(name, sizeof(name), "f%04d", i);
+        touch(g_home, name);
+    }
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/.app", g_home);
+    mkdir(path, 0755);
+    touch(g_home, ".apple");
+    touch(g_home, ".app.json");
+    snprintf(path, sizeof(path), "%s/.app", target);
+    mkdir(path, 0755);
+    touch(target, ".app-state");
+    touch(target, "notes");
+    backdate(g_home);
+    backdate(target);
+    load_patterns(target, mapping);
+
+    int want = files + 2 + 2;   // ".", "..", and the target's two
+    printf("%d files, %d pattern(s), %ld listings\n", files, g_num_patterns, listings);
+    printf("\n%-10s %12s %8s  %-16s\n", "listing", "us/listing", "entries", "checksum");
+    uint64_t sums[NUM_WAYS];
+    int differ = 0;
+    for (int w = 0; w < NUM_WAYS; w++) {
+        int n = list(w, &sums[w], NULL);
+        double best = 0;
+        for (int r = 0; r < rounds; r++) {
+            double t0 = now_ns();
+            for (long i = 0; i < listings; i++) list(w, NULL, NULL);
+            double t = now_ns() - t0;
+            if (r == 0 || t < best) best = t;
+        }
+        int bad = w != AS_IS && (n != want || sums[w] != sums[AFRESH]);
+        printf("%-10s %12.2f %8d  %016llx%s\n", g_way_names[w], best / listings / 1000, n,
+               (unsigned long long)sums[w], bad ? "  WRONG" : "");
+        differ |= bad;
+    }
+
+    // A name added to the target: its mtime moves, so the cached
+    // listing is read again
+    touch(target, ".app-new");
+    int n = list(CACHED, NULL, ".app-new");
+    printf("\nafter a change: %d entries%s\n", n, n == want + 1 ? "" : "  WRONG");
+    differ |= n != want + 1;
+
+    // The same names under <tmp>/home/u*/.app*: home's "u" is matched by
+    // the glob's first component, and the target's entries are under u/
+    char deep[PATH_MAX + 16];
+    snprintf(deep, sizeof(deep), "%s/t2", tmpl);
+    snprintf(path, sizeof(path), "%s/t2/u", tmpl);
+    rmp_mkdirs(path, 0755);
+    touch(path, ".app-deep");
+    touch(path, "other");
+    snprintf(mapping, sizeof(mapping), "%s/home/u*/.app*", tmpl);
+    g_num_patterns = 0;
+    load_patterns(deep, mapping);
+    n = list(AFRESH, NULL, ".app-deep");
+    printf("below the parent: %d entries%s\n", n, n == files + 3 ? "" : "  WRONG");
+    differ |= n != files + 3;
+
+    snprintf(path, sizeof(path), "rm -rf '%s'", tmpl);
+    if (system(path) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return differ ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * bench_fdpath.c - dirfd-relative rewrites: the fd table vs asking the kernel
+ *
+ * The interposer rewrites an *at() call relative to a dirfd by joining
+ * the path onto the dirfd's, then matching the result.  This builds the
+ * fd table (interpose_fdpath.c) and the matcher (interpose_rewrite.c)
+ * in, opens a few directories under a scratch "home" with one mapping,
+ * and runs the same relative paths through each way of finding the
+ * dirfd's path:
+ *   fd table   fdpath_join(), one array lookup
+ *   kernel     fcntl(F_GETPATH) on macOS, readlink(/proc/self/fd/N) on
+ *              Linux, per call
+ * for ns/call (the best of [rounds] passes, join and match together),
+ * how many were rewritten, and a checksum of the results; the two must
+ * agree.  Then what the table costs the open hooks: a set and a clear
+ * per open and close.
+ *
+ * Usage:
+ *   ./bench_fdpath [rounds] [calls]
+ *     default: 10 rounds of 100000 calls
+ *   Exits 1 if the two ways' results differ.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "interpose.h"
+
+typedef int (*join_fn)(int dirfd, const char *path, char *out, size_t outsize);
+
+// The directories opened, under the scratch root, and the relative
+// paths tried against each: some under the mapping, some beside it
+static const char *g_dirs[] = { "home/u", "home/u/.app", "home/u/src", "home" };
+#define NUM_DIRS (int)(sizeof(g_dirs) / sizeof(g_dirs[0]))
+static const char *g_rels[] = {
+    ".app/config.json", ".app/cache/a", "config.json", "x/.cache/b",
+    ".apple", "other", "u/.app/state", "node_modules/pkg/index.js",
+};
+#define NUM_RELS (int)(sizeof(g_rels) / sizeof(g_rels[0]))
+
+static int g_fds[NUM_DIRS];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t fnv(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// The dirfd's path from the kernel, joined as fdpath_join() does
+static int kernel_join(int dirfd, const char *path, char *out, size_t outsize) {
+#ifdef F_GETPATH
+    char dir[PATH_MAX];
+    if (fcntl(dirfd, F_GETPATH, dir) < 0) return 0;
+    size_t len = strlen(dir);
+#else
+    char link[64], dir[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dirfd);
+    ssize_t n = readlink(link, dir, sizeof(dir) - 1);
+    if (n <= 0) return 0;
+    size_t len = (size_t)n;
+    dir[len] = '\0';
+#endif
+    int sep = dir[len - 1] != '/';
+    if (len + sep + strlen(path) >= outsize) return 0;
+    snprintf(out, outsize, "%s%s%s", dir, sep ? "/" : "", path);
+    return 1;
+}
+
+static const struct {
+    const char *name;
+    join_fn fn;
+} g_ways[] = {
+    { "fd table", fdpath_join },
+#ifdef F_GETPATH
+    { "F_GETPATH", kernel_join },
+#else
+    { "/proc/self/fd", kernel_join },
+#endif
+};
+#define NUM_WAYS (int)(sizeof(g_ways) / sizeof(g_ways[0]))
+
+// What an *at() hook does with (dirfd, path): 1 if it rewrote it
+static int rewrite_at(join_fn join, int dirfd, const char *path, char *out) {
+    char abs[PATH_MAX];
+    return join(dirfd, path, abs, sizeof(abs)) && try_rewrite(abs, out, PATH_MAX);
+}
+
+static size_t check(join_fn join, long calls, uint64_t *sum) {
+    char out[PATH_MAX];
+    size_t hits = 0;
+    uint64_t h = 1469598103934665603ULL;
+    for (long i = 0; i < calls; i++) {
+        if (rewrite_at(join, g_fds[i % NUM_DIRS], g_rels[(i / NUM_DIRS) % NUM_RELS], out)) {
+            hits++;
+            h = fnv(h, out, strlen(out) + 1);
+        } else {
+            h = fnv(h, "", 1);
+        }
+    }
+    *sum = h;
+    return hits;
+}
+
+static double best_ns(join_fn join, long calls, int rounds) {
+    char out[PATH_MAX];
+    volatile size_t sink = 0;
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        double t0 = now_ns();
+        for (long i = 0; i < calls; i++)
+            sink += rewrite_at(join, g_fds[i % NUM_DIRS], g_rels[(i / NUM_DIRS) % NUM_RELS], out);
+        double t = now_ns() - t0;
+        if (r == 0 || t < best) best = t;
+    }
+    (void)sink;
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    long calls = argc > 2 ? atol(argv[2]) : 100000;
+    if (rounds < 1) rounds = 1;
+    if (calls < 1) calls = 1;
+
+    // The kernel reports real paths: work under one
+    char tmpl[] = "/tmp/rmp-bench-fdpath-XXXXXX", root[PATH_MAX];
+    if (!mkdtemp(tmpl) || !realpath(tmpl, root)) {
+        perror("mkdtemp");
+        return 2;
+    }
+    char path[PATH_MAX + 64], target[PATH_MAX + 16], mapping[PATH_MAX + 16];
+    snprintf(target, sizeof(target), "%s/t", root);
+    snprintf(mapping, sizeof(mapping), "%s/home/u/.app*", root);
+    load_patterns(target, mapping);
+
+    for (int i = 0; i < NUM_DIRS; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, g_dirs[i]);
+        rmp_mkdirs(path, 0755);
+        g_fds[i] = open(path, O_RDONLY | O_DIRECTORY);
+        if (g_fds[i] < 0) {
+            perror(path);
+            return 2;
+        }
+        fdpath_set(g_fds[i], path);
+    }
+    printf("%d dirfds, %d relative paths, %ld calls, %d pattern(s)\n",
+           NUM_DIRS, NUM_RELS, calls, g_num_patterns);
+
+    printf("\n%-16s %10s %10s %8s  %-16s\n", "dirfd path", "ns/call", "rewritten", "%", "checksum");
+    uint64_t first = 0;
+    int differ = 0;
+    for (int w = 0; w < NUM_WAYS; w++) {
+        uint64_t sum;
+        size_t hits = check(g_ways[w].fn, calls, &sum);
+        double ns = best_ns(g_ways[w].fn, calls, rounds) / calls;
+        if (w == 0) first = sum;
+        printf("%-16s %10.1f %10zu %7.1f%%  %016llx%s\n", g_ways[w].name, ns, hits,
+               100.0 * hits / calls, (unsigned long long)sum,
+               w > 0 && sum != first ? "  DIFFERS" : "");
+        differ |= sum != first;
+    }
+
+    // The open hooks' share: a set on open, a clear on close
+    snprintf(path, sizeof(path), "%s/home/u/.app/config.json", root);
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        double t0 = now_ns();
+        for (long i = 0; i < calls; i++) {
+            fdpath_set(g_fds[0] + NUM_DIRS + (int)(i & 63), path);
+            fdpath_clear(g_fds[0] + NUM_DIRS + (int)(i & 63));
+        }
+        double t = now_ns() - t0;
+        if (r == 0 || t < best) best = t;
+    }
+    printf("\ntable upkeep: %.1f ns per open+close\n", best / calls);
+
+    for (int i = 0; i < NUM_DIRS; i++) close(g_fds[i]);
+    snprintf(path, sizeof(path), "rm -rf '%s'", root);
+    if (system(path) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return differ ? 1 : 0;
+}
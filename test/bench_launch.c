@@ -0,0 +1,127 @@
+/*
+ * bench_launch.c - supervisor launch cost: exec the CLI vs. rmp_spawn()
+ *
+ * A supervisor that shells out pays for the remapper exec and a fresh
+ * glob scan per instance; with librmp it resolves the plan once and
+ * each rmp_spawn() is a clone, the namespace setup and the exec.
+ * Latency is measured to the program's exit.
+ *
+ * Usage:
+ *   ./bench_launch [launches] [mappings] [program]
+ *     defaults: 200 launches, 8 mapped directories, /bin/true
+ *
+ * Expects build/remapper next to this binary.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "rmp_launch.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+extern char **environ;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, double *t, int n) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += t[i];
+    qsort(t, (size_t)n, sizeof(double), cmp_double);
+    printf("%-12s %10.3f %10.3f %10.3f %10.3f\n", label, sum / n,
+           t[n / 2], t[(int)(n * 0.99)], t[0]);
+}
+
+int main(int argc, char **argv) {
+    int n     = argc > 1 ? atoi(argv[1]) : 200;
+    int nmaps = argc > 2 ? atoi(argv[2]) : 8;
+    char *prog = argc > 3 ? argv[3] : "/bin/true";
+
+    char remapper[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", remapper, sizeof(remapper) - 16);
+    if (len < 0) { perror("readlink"); return 2; }
+    remapper[len] = '\0';
+    strcpy(strrchr(remapper, '/') + 1, "remapper");
+
+    char root[256];
+    snprintf(root, sizeof(root), "%s/rmp-bench-launch-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 2; }
+
+    char home[PATH_MAX], target[PATH_MAX], map[PATH_MAX + 16];
+    snprintf(home, sizeof(home), "%s/home", root);
+    snprintf(target, sizeof(target), "%s/target", root);
+    snprintf(map, sizeof(map), "%s/.bench*", home);
+    mkdir(home, 0755);
+    for (int i = 0; i < nmaps; i++) {
+        char dir[PATH_MAX + 32];
+        snprintf(dir, sizeof(dir), "%s/.bench-%d", home, i);
+        mkdir(dir, 0755);
+    }
+
+    double *t = malloc((size_t)n * sizeof(double));
+    printf("%d launches of %s, %d mapped dirs\n\n", n, prog, nmaps);
+    printf("%-12s %10s %10s %10s %10s\n", "mode", "mean ms", "p50 ms", "p99 ms", "min ms");
+
+    char *cli[] = { remapper, target, map, "--", prog, NULL };
+    for (int i = 0; i < n; i++) {
+        double t0 = now_ms();
+        pid_t pid;
+        int status;
+        if (posix_spawn(&pid, remapper, NULL, NULL, cli, environ) != 0 ||
+            waitpid(pid, &status, 0) != pid || status != 0) {
+            fprintf(stderr, "CLI launch failed\n");
+            return 1;
+        }
+        t[i] = now_ms() - t0;
+    }
+    report("exec CLI", t, n);
+
+    rmp_plan_t *plan = rmp_plan_new(target);
+    rmp_plan_add_mapping(plan, map);
+    if (rmp_plan_resolve(plan) != nmaps) {
+        fprintf(stderr, "resolve: %s\n", rmp_last_error());
+        return 1;
+    }
+    char *args[] = { prog, NULL };
+    for (int i = 0; i < n; i++) {
+        double t0 = now_ms();
+        int pidfd = rmp_spawn(plan, args, NULL, NULL);
+        siginfo_t si;
+        if (pidfd < 0 || waitid((idtype_t)P_PIDFD, (id_t)pidfd, &si, WEXITED) != 0 ||
+            si.si_status != 0) {
+            fprintf(stderr, "rmp_spawn: %s\n", rmp_last_error());
+            return 1;
+        }
+        close(pidfd);
+        t[i] = now_ms() - t0;
+    }
+    report("rmp_spawn", t, n);
+    rmp_plan_free(plan);
+    free(t);
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
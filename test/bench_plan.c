@@ -0,0 +1,124 @@
+/*
+ * bench_plan.c - plan memory and time at large mapping and mount counts
+ *
+ * Builds a home with <dirs> directories of <per-dir> entries each, then
+ * times profiles that all resolve to every entry:
+ *   literal   one mapping per entry (dirs * per-dir lines), looked up
+ *             directly
+ *   glob      one "<dir>/.e*" mapping per directory, scanned
+ *   mid       the single mapping "home/<star>/.e*", walked in parallel
+ *   **        the single mapping "home/<star><star>/.e*", likewise
+ * For each: profile parse time, resolve time (the scan plus creating the
+ * empty targets), and heap in use by the plan after each step.  The last
+ * column is what the old fixed arrays - a PATH_MAX pair per mount - would
+ * have needed for the same mounts.
+ *
+ * Usage:
+ *   ./bench_plan [dirs] [per-dir]
+ *     defaults: 1000 directories x 100 entries = 100k
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rmp_shared.h"
+#include "rmp_launch.h"
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static size_t heap_used(void) {
+    return mallinfo2().uordblks;
+}
+
+static void run(const char *label, const char *profile, const char *target) {
+    size_t heap0 = heap_used();
+    double t0 = now_ms();
+    rmp_plan_t *plan = rmp_plan_new(target);
+    int nmaps = plan ? rmp_plan_add_profile(plan, profile) : -1;
+    double t_parse = now_ms() - t0;
+    size_t heap_parse = heap_used() - heap0;
+    if (nmaps < 0) { fprintf(stderr, "%s: %s\n", label, rmp_last_error()); exit(1); }
+
+    t0 = now_ms();
+    int nmounts = rmp_plan_resolve(plan);
+    double t_resolve = now_ms() - t0;
+    size_t heap_resolve = heap_used() - heap0;
+    if (nmounts < 0) { fprintf(stderr, "%s: %s\n", label, rmp_last_error()); exit(1); }
+
+    printf("%-8s %8d %8d %10.1f %10.1f %10.2f %10.2f %10.1f\n", label, nmaps, nmounts,
+           t_parse, t_resolve, heap_parse / 1048576.0, heap_resolve / 1048576.0,
+           nmounts * 2.0 * PATH_MAX / 1048576.0);
+    rmp_plan_free(plan);
+}
+
+int main(int argc, char **argv) {
+    int dirs    = argc > 1 ? atoi(argv[1]) : 1000;
+    int per_dir = argc > 2 ? atoi(argv[2]) : 100;
+
+    char root[256];
+    snprintf(root, sizeof(root), "%s/rmp-bench-plan-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 2; }
+
+    char path[PATH_MAX], literal[PATH_MAX], glob[PATH_MAX], mid[PATH_MAX], any[PATH_MAX];
+    snprintf(literal, sizeof(literal), "%s/literal.rmp", root);
+    snprintf(glob, sizeof(glob), "%s/glob.rmp", root);
+    snprintf(mid, sizeof(mid), "%s/mid.rmp", root);
+    snprintf(any, sizeof(any), "%s/any.rmp", root);
+    FILE *lit = fopen(literal, "w"), *glb = fopen(glob, "w");
+    FILE *md = fopen(mid, "w"), *an = fopen(any, "w");
+    if (!lit || !glb || !md || !an) { perror("fopen"); return 2; }
+    fprintf(md, "%s/home/*/.e*\n", root);
+    fprintf(an, "%s/home/**/.e*\n", root);
+    fclose(md);
+    fclose(an);
+
+    fprintf(lit, "# %d literal mappings\n", dirs * per_dir);
+    fprintf(glb, "# %d glob mappings\n", dirs);
+    for (int d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "%s/home/project-%04d", root, d);
+        rmp_mkdirs(path, 0755);
+        fprintf(glb, "%s/.e*\n", path);
+        for (int e = 0; e < per_dir; e++) {
+            char entry[PATH_MAX + 32];
+            snprintf(entry, sizeof(entry), "%s/.entry-%03d", path, e);
+            int fd = open(entry, O_CREAT | O_WRONLY, 0644);
+            if (fd < 0) { perror(entry); return 2; }
+            close(fd);
+            fprintf(lit, "%s\n", entry);
+        }
+    }
+    fclose(lit);
+    fclose(glb);
+
+    printf("%d directories x %d entries\n\n", dirs, per_dir);
+    printf("%-8s %8s %8s %10s %10s %10s %10s %10s\n", "profile", "maps", "mounts",
+           "parse ms", "resolve ms", "parse MB", "plan MB", "fixed MB");
+
+    snprintf(path, sizeof(path), "%s/t-literal", root);
+    run("literal", literal, path);
+    snprintf(path, sizeof(path), "%s/t-glob", root);
+    run("glob", glob, path);
+    snprintf(path, sizeof(path), "%s/t-mid", root);
+    run("mid", mid, path);
+    snprintf(path, sizeof(path), "%s/t-any", root);
+    run("**", any, path);
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
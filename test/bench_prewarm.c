@@ -0,0 +1,109 @@
+/*
+ * bench_prewarm.c - throughput of rmp_prewarm() at increasing job counts
+ *
+ * Generates a tree of fake hardened executables and a stub signer that
+ * stands in for codesign (a fixed delay per call, like codesign's own
+ * process start and hashing), then builds the cache from cold at each
+ * job count and reports binaries/s and MB/s.
+ *
+ * Usage:
+ *   ./bench_prewarm [binaries] [size-KB] [sign-delay-ms]
+ *     defaults: 200 binaries, 1024 KB each, 20 ms per signer call
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+#include "rmp_pool.h"
+#include "rmp_prewarm.h"
+
+static char g_root[512];
+
+static void write_file(const char *path, const void *data, size_t len, mode_t mode) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    if (fd < 0 || write(fd, data, len) != (ssize_t)len) { perror(path); exit(2); }
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    int nbins  = argc > 1 ? atoi(argv[1]) : 200;
+    int kb     = argc > 2 ? atoi(argv[2]) : 1024;
+    int delay  = argc > 3 ? atoi(argv[3]) : 20;
+
+    snprintf(g_root, sizeof(g_root), "%s/rmp-bench-prewarm-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+
+    // Stub signer: every check says "hardened", every sign sleeps
+    char signer[PATH_MAX], script[256];
+    snprintf(signer, sizeof(signer), "%s/signer", g_root);
+    snprintf(script, sizeof(script),
+             "#!/bin/sh\n"
+             "[ \"$1\" = check ] && exit 0\n"
+             "sleep %d.%03d\n", delay / 1000, delay % 1000);
+    write_file(signer, script, strlen(script), 0755);
+
+    // App-like layout: ten binaries per directory
+    size_t len = (size_t)kb * 1024;
+    char *buf = calloc(1, len < 32 ? 32 : len);
+    uint32_t hdr[8] = { 0xfeedfacfu, 0x0100000cu, 0, 2, 0, 0, 0, 0 };
+    memcpy(buf, hdr, sizeof(hdr));
+
+    char tree[PATH_MAX];
+    snprintf(tree, sizeof(tree), "%s/Bench.app", g_root);
+    for (int i = 0; i < nbins; i++) {
+        char dir[PATH_MAX + 64], path[PATH_MAX + 96];
+        snprintf(dir, sizeof(dir), "%s/Contents/Frameworks/F%03d.framework/Helpers",
+                 tree, i / 10);
+        rmp_mkdirs(dir, 0755);
+        snprintf(path, sizeof(path), "%s/helper-%d", dir, i);
+        write_file(path, buf, len < 32 ? 32 : len, 0755);
+    }
+    free(buf);
+
+    printf("%d binaries x %d KB, signer delay %d ms, %d CPUs\n\n",
+           nbins, kb, delay, rmp_ncpus());
+    printf("%6s %10s %12s %10s %8s\n", "jobs", "seconds", "binaries/s", "MB/s", "speedup");
+
+    int ncpu = rmp_ncpus();
+    int jobs_list[] = { 1, 2, 4, 8, ncpu, 2 * ncpu };
+    double base = 0;
+    int last = 0;
+    for (size_t j = 0; j < sizeof(jobs_list) / sizeof(jobs_list[0]); j++) {
+        int jobs = jobs_list[j];
+        if (jobs <= last) continue;  // list is ascending; skip repeats
+        last = jobs;
+
+        char config[PATH_MAX + 16], cache[PATH_MAX + 16], cmd[PATH_MAX + 64];
+        snprintf(config, sizeof(config), "%s/config", g_root);
+        snprintf(cache, sizeof(cache), "%s/cache", g_root);
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", cache);
+        if (system(cmd) != 0) return 2;
+
+        rmp_ctx_t ctx;
+        rmp_ctx_init(&ctx, config, cache, NULL);
+        rmp_ctx_set_signer(&ctx, signer);
+
+        rmp_prewarm_stats_t st;
+        if (rmp_prewarm(&ctx, tree, jobs, &st) != 0 || st.created != nbins) {
+            fprintf(stderr, "prewarm failed at %d jobs (%ld built)\n", jobs, st.created);
+            return 1;
+        }
+        if (!base) base = st.seconds;
+        printf("%6d %10.3f %12.1f %10.1f %7.2fx\n", jobs, st.seconds,
+               st.created / st.seconds, st.bytes / 1048576.0 / st.seconds,
+               base / st.seconds);
+    }
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * bench_rewrite.c - replay a --trace through the interposer's matcher
+ *
+ * Loads a trace recorded with `remapper --trace=<file>` (macOS), loads
+ * its target and mappings into the interposer's patterns as the dylib
+ * would (interpose_rewrite.c, built in here), and feeds every recorded
+ * path through each matcher in g_matchers:
+ *   ns/call    the best of [rounds] passes over the whole trace
+ *   rewritten  how many of the paths a mapping covered
+ *   checksum   of every result in order: the rewritten path, or a
+ *              pass-through; a candidate whose checksum differs from
+ *              try_rewrite()'s gives a different answer somewhere
+ * then how the paths split by call, for try_rewrite().
+ *
+ * To try a change to the matcher, add the candidate to g_matchers next
+ * to try_rewrite() and run both over traces of real sessions.
+ *
+ * Usage:
+ *   ./bench_rewrite <trace> [rounds]
+ *     default: 10 rounds
+ *   Exits 1 if a candidate's results differ from try_rewrite()'s.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "interpose.h"
+#include "rmp_trace.h"
+
+typedef int (*matcher_fn)(const char *path, char *out, size_t outsize);
+
+static const struct {
+    const char *name;
+    matcher_fn fn;
+} g_matchers[] = {
+    { "try_rewrite", try_rewrite },
+};
+#define NUM_MATCHERS (int)(sizeof(g_matchers) / sizeof(g_matchers[0]))
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// FNV-1a over len bytes, continuing from h
+static uint64_t fnv(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// One untimed pass: how many paths fn rewrote, and the checksum
+static size_t check(matcher_fn fn, const rmp_trace_data_t *d, uint64_t *sum) {
+    char out[PATH_MAX];
+    size_t hits = 0;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < d->count; i++) {
+        if (fn(d->recs[i].path, out, sizeof(out))) {
+            hits++;
+            h = fnv(h, out, strlen(out) + 1);
+        } else {
+            h = fnv(h, "", 1);
+        }
+    }
+    *sum = h;
+    return hits;
+}
+
+static double best_ns(matcher_fn fn, const rmp_trace_data_t *d, int rounds) {
+    char out[PATH_MAX];
+    volatile size_t sink = 0;
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        double t0 = now_ns();
+        for (size_t i = 0; i < d->count; i++)
+            sink += fn(d->recs[i].path, out, sizeof(out));
+        double t = now_ns() - t0;
+        if (r == 0 || t < best) best = t;
+    }
+    (void)sink;
+    return best;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [rounds]\n", argv[0]);
+        return 2;
+    }
+    int rounds = argc > 2 ? atoi(argv[2]) : 10;
+    if (rounds < 1) rounds = 1;
+
+    rmp_trace_data_t d;
+    if (rmp_trace_load(argv[1], &d) < 0) {
+        perror(argv[1]);
+        return 2;
+    }
+    load_patterns(d.target, d.mappings);
+    printf("%zu paths, %d pattern(s), target %s\n", d.count, g_num_patterns, d.target);
+    if (d.truncated)
+        printf("(last %zu bytes skipped: an incomplete chunk)\n", d.truncated);
+    if (d.count == 0) return 0;
+
+    printf("\n%-16s %10s %10s %8s  %-16s\n", "matcher", "ns/call", "rewritten", "%", "checksum");
+    uint64_t first = 0;
+    int differ = 0;
+    for (int m = 0; m < NUM_MATCHERS; m++) {
+        uint64_t sum;
+        size_t hits = check(g_matchers[m].fn, &d, &sum);
+        double ns = best_ns(g_matchers[m].fn, &d, rounds) / d.count;
+        if (m == 0) first = sum;
+        printf("%-16s %10.1f %10zu %7.1f%%  %016llx%s\n", g_matchers[m].name, ns, hits,
+               100.0 * hits / d.count, (unsigned long long)sum,
+               m > 0 && sum != first ? "  DIFFERS" : "");
+        differ |= sum != first;
+    }
+
+    // By call: names are interned, so equal calls share a pointer
+    const char *calls[256];
+    size_t num = 0, count[256] = { 0 }, hits[256] = { 0 };
+    char out[PATH_MAX];
+    for (size_t i = 0; i < d.count; i++) {
+        size_t c;
+        for (c = 0; c < num && calls[c] != d.recs[i].call; c++) {}
+        if (c == num) {
+            if (num == 256) continue;
+            calls[num++] = d.recs[i].call;
+        }
+        count[c]++;
+        hits[c] += try_rewrite(d.recs[i].path, out, sizeof(out));
+    }
+    printf("\n%-20s %10s %10s %8s\n", "call", "paths", "rewritten", "%");
+    for (size_t c = 0; c < num; c++)
+        printf("%-20s %10zu %10zu %7.1f%%\n", calls[c], count[c], hits[c],
+               100.0 * hits[c] / count[c]);
+
+    rmp_trace_data_free(&d);
+    return differ ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * bench_serve.c - launch latency: cold remapper vs. --connect to --serve
+ *
+ * Runs a trivial program under remapper repeatedly and reports per-launch
+ * latency, measured to the program's exit:
+ *   cold       a full remapper exec each time: globs, unshare, uid/gid
+ *              maps, mounts, exec
+ *   --connect  remapper --connect: one remapper exec for the client, then
+ *              a fork of the zygote plus exec
+ *   socket     what an orchestrator talking to the socket itself pays:
+ *              the fork plus exec alone
+ *
+ * Usage:
+ *   ./bench_serve [launches] [mappings] [program]
+ *     defaults: 200 launches, 8 mapped directories, /bin/true
+ *
+ * Expects build/remapper next to this binary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int run(char **argv) {
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) != 0) return -1;
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// One launch over the --serve protocol (see remapper_linux.c), passing
+// our own stdio.  Returns the program's exit code.
+static int launch_direct(const char *sock_path, const char *target,
+                         const char *map, char *prog) {
+    static char buf[128 * 1024];
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+    const char *head[] = { "launch", target, "1", map, cwd, "1", prog };
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(head) / sizeof(head[0]); i++)
+        len += (size_t)sprintf(buf + len, "%s", head[i]) + 1;
+    for (char **e = environ; *e; e++) {
+        size_t n = strlen(*e) + 1;
+        if (len + n > sizeof(buf)) break;
+        memcpy(buf + len, *e, n);
+        len += n;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if ((size_t)snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path) >=
+        sizeof(addr.sun_path))
+        return -1;
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) return -1;
+
+    int fds[3] = { 0, 1, 2 };
+    char cbuf[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { buf, len };
+    struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1,
+                         .msg_control = cbuf, .msg_controllen = sizeof(cbuf) };
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    if (sendmsg(sock, &mh, 0) != (ssize_t)len) { close(sock); return -1; }
+
+    int ret = -1;
+    ssize_t n;
+    while ((n = recv(sock, buf, sizeof(buf), 0)) > 0) {
+        if (strcmp(buf, "exit") == 0) {
+            int status = atoi(buf + 5);
+            ret = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            break;
+        }
+        if (strcmp(buf, "error") == 0) break;
+    }
+    close(sock);
+    return ret;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, double *t, int n) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += t[i];
+    qsort(t, (size_t)n, sizeof(double), cmp_double);
+    printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", label, sum / n,
+           t[n / 2], t[(int)(n * 0.99)], t[0]);
+}
+
+int main(int argc, char **argv) {
+    int n     = argc > 1 ? atoi(argv[1]) : 200;
+    int nmaps = argc > 2 ? atoi(argv[2]) : 8;
+    char *prog = argc > 3 ? argv[3] : "/bin/true";
+
+    char remapper[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", remapper, sizeof(remapper) - 16);
+    if (len < 0) { perror("readlink"); return 2; }
+    remapper[len] = '\0';
+    strcpy(strrchr(remapper, '/') + 1, "remapper");
+
+    char root[256];
+    snprintf(root, sizeof(root), "%s/rmp-bench-serve-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 2; }
+
+    // A fake home with nmaps matching config dirs, like a real profile
+    char home[PATH_MAX], target[PATH_MAX], sock[PATH_MAX], map[PATH_MAX + 16];
+    snprintf(home, sizeof(home), "%s/home", root);
+    snprintf(target, sizeof(target), "%s/target", root);
+    snprintf(sock, sizeof(sock), "%s/serve.sock", root);
+    snprintf(map, sizeof(map), "%s/.bench*", home);
+    mkdir(home, 0755);
+    mkdir(target, 0755);
+    for (int i = 0; i < nmaps; i++) {
+        char dir[PATH_MAX + 32];
+        snprintf(dir, sizeof(dir), "%s/.bench-%d", home, i);
+        mkdir(dir, 0755);
+    }
+
+    double *t = malloc((size_t)n * sizeof(double));
+    printf("%d launches of %s, %d mapped dirs\n\n", n, prog, nmaps);
+    printf("%-10s %10s %10s %10s %10s\n", "mode", "mean ms", "p50 ms", "p99 ms", "min ms");
+
+    char *cold[] = { remapper, target, map, "--", prog, NULL };
+    for (int i = 0; i < n; i++) {
+        double t0 = now_ms();
+        if (run(cold) != 0) { fprintf(stderr, "cold launch failed\n"); return 1; }
+        t[i] = now_ms() - t0;
+    }
+    report("cold", t, n);
+
+    char *serve[] = { remapper, "--serve", sock, NULL };
+    pid_t daemon;
+    if (posix_spawn(&daemon, remapper, NULL, NULL, serve, environ) != 0) {
+        perror("posix_spawn");
+        return 2;
+    }
+    for (int i = 0; i < 50 && access(sock, F_OK) != 0; i++) usleep(100 * 1000);
+
+    char *warm[] = { remapper, "--connect", sock, target, map, "--", prog, NULL };
+    if (run(warm) != 0) { fprintf(stderr, "daemon launch failed\n"); return 1; }  // builds the zygote
+    for (int i = 0; i < n; i++) {
+        double t0 = now_ms();
+        if (run(warm) != 0) { fprintf(stderr, "daemon launch failed\n"); return 1; }
+        t[i] = now_ms() - t0;
+    }
+    report("--connect", t, n);
+
+    for (int i = 0; i < n; i++) {
+        double t0 = now_ms();
+        if (launch_direct(sock, target, map, prog) != 0) {
+            fprintf(stderr, "direct launch failed\n");
+            return 1;
+        }
+        t[i] = now_ms() - t0;
+    }
+    report("socket", t, n);
+
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    free(t);
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
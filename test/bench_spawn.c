@@ -0,0 +1,114 @@
+/*
+ * bench_spawn.c - rmp_pipe_open() latency as the parent's footprint grows
+ *
+ * The interposer spawns codesign from inside the host application.  This
+ * makes the benchmark process resident at each size, then times spawning
+ * /bin/true through rmp_pipe_open() (posix_spawn) against the fork+execv
+ * implementation it replaced.
+ *
+ * Usage:
+ *   ./bench_spawn [spawns] [resident-MB]...
+ *     defaults: 200 spawns at 0, 1024 and 8192 MB
+ *
+ * Sizes that don't fit in MemAvailable are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "rmp_shared.h"
+
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// rmp_pipe_open() as it was: fork, redirect, execv
+static rmp_pipe_t fork_pipe_open(const char *path, const char *const argv[]) {
+    rmp_pipe_t proc = { NULL, -1 };
+    int pipefd[2];
+    if (pipe(pipefd) != 0) return proc;
+    pid_t pid = fork();
+    if (pid < 0) { close(pipefd[0]); close(pipefd[1]); return proc; }
+    if (pid == 0) {
+        close(pipefd[0]);
+        dup2(pipefd[1], STDOUT_FILENO);
+        dup2(pipefd[1], STDERR_FILENO);
+        close(pipefd[1]);
+        execv(path, (char *const *)argv);
+        _exit(127);
+    }
+    close(pipefd[1]);
+    proc.fp = fdopen(pipefd[0], "r");
+    proc.pid = pid;
+    return proc;
+}
+
+static double time_spawns(int n, rmp_pipe_t (*open_fn)(const char *, const char *const[])) {
+    const char *argv[] = {"true", NULL};
+    char line[64];
+    double t0 = now_secs();
+    for (int i = 0; i < n; i++) {
+        rmp_pipe_t p = open_fn("/bin/true", argv);
+        if (!p.fp) { perror("spawn"); exit(1); }
+        while (fgets(line, sizeof(line), p.fp)) {}
+        rmp_pipe_close(&p);
+    }
+    return (now_secs() - t0) / n;
+}
+
+static long mem_available_mb(void) {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) return -1;  // not Linux: don't guess
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1) break;
+    fclose(fp);
+    return kb < 0 ? -1 : kb / 1024;
+}
+
+int main(int argc, char **argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 200;
+    long default_sizes[] = { 0, 1024, 8192 };
+    int nsizes = argc > 2 ? argc - 2 : 3;
+
+    printf("%d spawns of /bin/true per measurement\n\n", n);
+    printf("%12s %14s %14s %9s\n", "resident MB", "fork+exec us", "posix_spawn us", "speedup");
+
+    for (int i = 0; i < nsizes; i++) {
+        long mb = argc > 2 ? atol(argv[i + 2]) : default_sizes[i];
+        long avail = mem_available_mb();
+        if (avail >= 0 && mb > avail * 8 / 10) {
+            printf("%12ld   skipped: only %ld MB available\n", mb, avail);
+            continue;
+        }
+
+        // Touch every page so it is resident, and mapped in the page table
+        size_t len = (size_t)mb << 20;
+        char *mem = NULL;
+        if (len) {
+            mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) {
+                printf("%12ld   skipped: mmap: %s\n", mb, strerror(errno));
+                continue;
+            }
+            memset(mem, 1, len);
+        }
+
+        double f = time_spawns(n, fork_pipe_open);
+        double s = time_spawns(n, rmp_pipe_open);
+        printf("%12ld %14.1f %14.1f %8.1fx\n", mb, f * 1e6, s * 1e6, f / s);
+
+        if (mem) munmap(mem, len);
+    }
+    return 0;
+}
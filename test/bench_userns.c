@@ -0,0 +1,138 @@
+/*
+ * bench_userns.c - a user namespace per launch vs. one shared
+ *
+ * Launches /bin/true from one plan, first with a new user namespace
+ * each time (unshare, setgroups, uid_map, gid_map), then joining one
+ * held by a keeper (setns, unshare(CLONE_NEWNS) only), and times each
+ * launch to exit.  Then holds a number of instances running at once
+ * both ways and counts the user namespaces they take.
+ *
+ * Needs unprivileged user namespaces.
+ *
+ * Usage:
+ *   ./bench_userns [launches] [concurrent]
+ *     defaults: 200 launches, 100 running at once
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "rmp_launch.h"
+#include "rmp_shared.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+static const char *g_names[] = { "per-launch", "shared" };
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int reap(int pidfd) {
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    int r = waitid((idtype_t)P_PIDFD, (id_t)pidfd, &si, WEXITED);
+    close(pidfd);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    int launches   = argc > 1 ? atoi(argv[1]) : 200;
+    int concurrent = argc > 2 ? atoi(argv[2]) : 100;
+    if (launches < 1 || concurrent < 1) {
+        fprintf(stderr, "usage: %s [launches] [concurrent]\n", argv[0]);
+        return 2;
+    }
+
+    char root[256], path[PATH_MAX + 32];
+    snprintf(root, sizeof(root), "%s/rmp-bench-userns-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) { perror("mkdtemp"); return 2; }
+
+    snprintf(path, sizeof(path), "%s/home/.app", root);
+    rmp_mkdirs(path, 0755);
+    snprintf(path, sizeof(path), "%s/target", root);
+    rmp_plan_t *plan = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app*", root);
+    if (!plan || rmp_plan_add_mapping(plan, path) < 0 || rmp_plan_resolve(plan) != 1) {
+        fprintf(stderr, "plan: %s\n", rmp_last_error());
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/keeper", root);
+    int nsfd = rmp_userns_open(path, 0);
+    if (nsfd < 0) {
+        fprintf(stderr, "keeper: %s\n", rmp_last_error());
+        return 1;
+    }
+
+    char *true_argv[] = { "/bin/true", NULL };
+    char *sleep_argv[] = { "/bin/sleep", "60", NULL };
+    int *pidfds = calloc((size_t)concurrent, sizeof(int));
+    pid_t *pids = calloc((size_t)concurrent, sizeof(pid_t));
+    if (!pidfds || !pids) { perror("calloc"); return 2; }
+
+    printf("%d launches of /bin/true, %d running at once\n\n", launches, concurrent);
+    printf("%-12s %12s %12s %12s\n", "user ns", "launch us", "hold us", "namespaces");
+    for (int mode = 0; mode < 2; mode++) {
+        rmp_plan_set_userns(plan, mode ? nsfd : -1);
+
+        double t0 = now_us();
+        int i;
+        for (i = 0; i < launches; i++) {
+            int pidfd = rmp_spawn(plan, true_argv, NULL, NULL);
+            if (pidfd < 0 || reap(pidfd) != 0) break;
+        }
+        if (i < launches) {
+            printf("%-12s %s\n", g_names[mode], rmp_last_error());
+            continue;
+        }
+        double launch = (now_us() - t0) / launches;
+
+        // Counted while all of them are up, the keeper's one for shared
+        int before = rmp_userns_count(), held = 0;
+        t0 = now_us();
+        for (; held < concurrent; held++)
+            if ((pidfds[held] = rmp_spawn(plan, sleep_argv, NULL, &pids[held])) < 0) break;
+        double hold = held ? (now_us() - t0) / held : 0;
+        int during = rmp_userns_count();
+        for (int k = 0; k < held; k++) {
+            kill(pids[k], SIGKILL);
+            reap(pidfds[k]);
+        }
+        printf("%-12s %12.1f %12.1f %12d", g_names[mode], launch, hold,
+               during - before + mode);
+        if (held < concurrent) printf("  (only %d started: %s)", held, rmp_last_error());
+        printf("\n");
+    }
+
+    // The keeper goes with its file's pid
+    char line[64] = "";
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0 && read(fd, line, sizeof(line) - 1) < 0) line[0] = '\0';
+    if (fd >= 0) close(fd);
+    if (atol(line) > 0) kill((pid_t)atol(line), SIGTERM);
+    close(nsfd);
+    free(pidfds);
+    free(pids);
+    rmp_plan_free(plan);
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+    return 0;
+}
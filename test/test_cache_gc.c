@@ -0,0 +1,188 @@
+/*
+ * test_cache_gc.c - exercise rmp_cache_gc() against a fixture cache tree
+ *
+ * Builds, under a scratch directory:
+ *   orig/        originals (keep-{1,2,3}, changed, gone)
+ *   cache/       <cache>/<abs original> + .meta sidecars, as written by
+ *                rmp_cache_create(), plus a temp file and an orphan sidecar
+ *
+ * Usage:
+ *   ./test_cache_gc
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+#include "rmp_gc.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[512];
+static char g_cache[PATH_MAX];
+
+static void write_bytes(const char *path, size_t len, char fill) {
+    char *buf = malloc(len);
+    memset(buf, fill, len);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0755);
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+        perror(path);
+        exit(2);
+    }
+    close(fd);
+    free(buf);
+}
+
+static void set_mtime(const char *path, time_t when) {
+    struct timeval tv[2] = { { when, 0 }, { when, 0 } };
+    utimes(path, tv);
+}
+
+static int exists(const char *path) {
+    struct stat sb;
+    return lstat(path, &sb) == 0;
+}
+
+// Create orig/<name> and a matching cache entry whose last use is `age`
+// seconds ago.  Fills `cached` with the entry path.
+static void make_entry(const char *name, size_t len, time_t age,
+                       char *orig, char *cached) {
+    snprintf(orig, PATH_MAX, "%s/orig/%s", g_root, name);
+    write_bytes(orig, len, 'o');
+
+    struct stat sb;
+    stat(orig, &sb);
+
+    rmp_cache_path(g_cache, orig, cached, PATH_MAX);
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", cached);
+    *strrchr(parent, '/') = '\0';
+    rmp_mkdirs(parent, 0755);
+    write_bytes(cached, len, 'c');
+
+    char meta[PATH_MAX + 8], mbuf[64];
+    snprintf(meta, sizeof(meta), "%s.meta", cached);
+    int mlen = snprintf(mbuf, sizeof(mbuf), "%ld %lld",
+                        (long)sb.st_mtime, (long long)sb.st_size);
+    int fd = open(meta, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, mbuf, (size_t)mlen) != mlen) { perror(meta); exit(2); }
+    close(fd);
+
+    time_t old = time(NULL) - age;
+    set_mtime(cached, old);
+    set_mtime(meta, old);
+}
+
+int main(void) {
+    snprintf(g_root, sizeof(g_root), "%s/rmp-gc-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+    snprintf(g_cache, sizeof(g_cache), "%s/cache", g_root);
+
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/orig", g_root);
+    rmp_mkdirs(path, 0755);
+    rmp_mkdirs(g_cache, 0755);
+
+    char orig[5][PATH_MAX], cached[5][PATH_MAX];
+    make_entry("keep-1",  64 * 1024, 9000, orig[0], cached[0]);  // oldest
+    make_entry("keep-2",  64 * 1024, 8000, orig[1], cached[1]);
+    make_entry("keep-3",  64 * 1024, 7000, orig[2], cached[2]);  // newest
+    make_entry("changed", 16 * 1024, 500,  orig[3], cached[3]);
+    make_entry("gone",    16 * 1024, 500,  orig[4], cached[4]);
+
+    // Original updated since caching; original deleted
+    write_bytes(orig[3], 20 * 1024, 'n');
+    unlink(orig[4]);
+
+    // Abandoned temp copy, and a sidecar with no copy beside it
+    char tmp[PATH_MAX + 32], orphan[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.4242.7", cached[0]);
+    write_bytes(tmp, 4096, 't');
+    set_mtime(tmp, time(NULL) - 2 * RMP_GC_TMP_SECS);
+    snprintf(orphan, sizeof(orphan), "%s/orphan.meta", g_cache);
+    write_bytes(orphan, 10, 'm');
+    set_mtime(orphan, time(NULL) - 2 * RMP_GC_GRACE_SECS);
+
+    // A process still "executing" a copy that is about to be evicted
+    int busy_fd = open(cached[0], O_RDONLY);
+
+    printf("--- pass 1: stale entries, no cap ---\n");
+    rmp_gc_stats_t st;
+    int ret = rmp_cache_gc(g_cache, 0, 4, NULL, &st);
+    CHECK("gc returns 0", ret == 0);
+    CHECK("5 entries scanned", st.scanned == 5);
+    CHECK("2 stale entries removed", st.removed_stale == 2);
+    CHECK("temp + orphan sidecar removed", st.removed_tmp == 2);
+    CHECK("nothing evicted without a cap", st.removed_lru == 0);
+    CHECK("changed original: copy removed", !exists(cached[3]));
+    snprintf(path, sizeof(path), "%s.meta", cached[3]);
+    CHECK("changed original: sidecar removed", !exists(path));
+    CHECK("deleted original: copy removed", !exists(cached[4]));
+    CHECK("abandoned temp removed", !exists(tmp));
+    CHECK("orphan sidecar removed", !exists(orphan));
+    CHECK("valid entries kept",
+          exists(cached[0]) && exists(cached[1]) && exists(cached[2]));
+    CHECK("bytes_after < bytes_before", st.bytes_after < st.bytes_before);
+
+    printf("--- pass 2: LRU eviction to a cap ---\n");
+    // Room for two of the three remaining 64K entries (plus sidecars)
+    long long cap = st.bytes_after - 32 * 1024;
+    ret = rmp_cache_gc(g_cache, cap, 2, NULL, &st);
+    CHECK("gc returns 0", ret == 0);
+    CHECK("one entry evicted", st.removed_lru == 1);
+    CHECK("cache fits under cap", st.bytes_after <= cap);
+    CHECK("least recently used entry evicted", !exists(cached[0]));
+    CHECK("recent entries kept", exists(cached[1]) && exists(cached[2]));
+
+    printf("--- rmp_cache_valid refreshes last use ---\n");
+    struct stat osb, msb;
+    stat(orig[1], &osb);
+    CHECK("entry still valid", rmp_cache_valid(cached[1], osb.st_mtime, osb.st_size));
+    snprintf(path, sizeof(path), "%s.meta", cached[1]);
+    stat(path, &msb);
+    CHECK("sidecar mtime bumped to now", time(NULL) - msb.st_mtime < 60);
+
+    // keep-2 is now the most recent; evicting one more must take keep-3
+    ret = rmp_cache_gc(g_cache, 96 * 1024, 0, NULL, &st);
+    CHECK("gc returns 0", ret == 0);
+    CHECK("refreshed entry survives", exists(cached[1]));
+    CHECK("older entry evicted", !exists(cached[2]));
+
+    printf("--- running copies are unaffected ---\n");
+    char buf[16];
+    CHECK("evicted copy still readable through open fd",
+          busy_fd >= 0 && pread(busy_fd, buf, sizeof(buf), 0) == sizeof(buf) &&
+          buf[0] == 'c');
+    if (busy_fd >= 0) close(busy_fd);
+
+    printf("--- rmp_parse_size ---\n");
+    CHECK("plain bytes", rmp_parse_size("1234") == 1234);
+    CHECK("K suffix", rmp_parse_size("4K") == 4096);
+    CHECK("G suffix", rmp_parse_size("10G") == 10LL << 30);
+    CHECK("GB suffix", rmp_parse_size("2GB") == 2LL << 30);
+    CHECK("garbage rejected", rmp_parse_size("10X") == -1);
+    CHECK("empty rejected", rmp_parse_size("") == -1);
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
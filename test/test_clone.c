@@ -0,0 +1,177 @@
+/*
+ * test_clone.c - exercise rmp_clone_file() down each step of its fallback
+ *
+ * Copies a file with odd-sized, non-repeating content through every
+ * combination of RMP_CLONE_NO_* flags and checks data, mode, timestamps
+ * and extended attributes on the result, plus the error paths.
+ *
+ * Usage:
+ *   ./test_clone
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[512];
+
+// macOS adds position/options arguments to the xattr calls
+#ifdef __APPLE__
+#define set_xattr(p, n, v, l) setxattr(p, n, v, l, 0, 0)
+#define get_xattr(p, n, v, l) getxattr(p, n, v, l, 0, 0)
+#else
+#define set_xattr(p, n, v, l) setxattr(p, n, v, l, 0)
+#define get_xattr(p, n, v, l) getxattr(p, n, v, l)
+#endif
+
+// 3 MB + change: spans several buffered-copy chunks, not a multiple of any
+#define SRC_SIZE (3 * 1024 * 1024 + 12345)
+
+static unsigned char *fill_pattern(size_t len) {
+    unsigned char *buf = malloc(len);
+    unsigned int x = 2463534242u;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        buf[i] = (unsigned char)x;
+    }
+    return buf;
+}
+
+static int same_content(const char *path, const unsigned char *want, size_t len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    unsigned char *got = malloc(len + 1);
+    ssize_t n = 0, r;
+    while ((size_t)n < len + 1 && (r = read(fd, got + n, len + 1 - (size_t)n)) > 0)
+        n += r;
+    close(fd);
+    int ok = (n == (ssize_t)len && memcmp(got, want, len) == 0);
+    free(got);
+    return ok;
+}
+
+int main(void) {
+    snprintf(g_root, sizeof(g_root), "%s/rmp-clone-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+
+    char src[PATH_MAX], dst[PATH_MAX];
+    snprintf(src, sizeof(src), "%s/src", g_root);
+    unsigned char *data = fill_pattern(SRC_SIZE);
+    int fd = open(src, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    if (fd < 0 || write(fd, data, SRC_SIZE) != SRC_SIZE) { perror(src); return 2; }
+    close(fd);
+    chmod(src, 0751);
+    struct timeval tv[2] = { { 1000000000, 0 }, { 1234567890, 0 } };
+    utimes(src, tv);
+    int have_xattr = (set_xattr(src, "user.rmp-test", "hello", 5) == 0);
+
+    static const struct { int flags; const char *name; } cases[] = {
+        { 0,                                         "default" },
+        { RMP_CLONE_NO_REFLINK,                      "no reflink" },
+        { RMP_CLONE_NO_REFLINK | RMP_CLONE_NO_KERNEL, "buffered only" },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        printf("--- %s ---\n", cases[i].name);
+        snprintf(dst, sizeof(dst), "%s/dst-%zu", g_root, i);
+        int m = rmp_clone_file(src, dst, cases[i].flags);
+        printf("  (method: %s)\n", rmp_clone_method_name(m));
+
+        char label[128];
+        snprintf(label, sizeof(label), "%s: copy succeeds", cases[i].name);
+        CHECK(label, m >= 0);
+        snprintf(label, sizeof(label), "%s: method honours flags", cases[i].name);
+        CHECK(label, (!(cases[i].flags & RMP_CLONE_NO_REFLINK) || m != RMP_CLONE_REFLINK) &&
+                     (!(cases[i].flags & RMP_CLONE_NO_KERNEL) || m != RMP_CLONE_KERNEL));
+        if (cases[i].flags == (RMP_CLONE_NO_REFLINK | RMP_CLONE_NO_KERNEL)) {
+            snprintf(label, sizeof(label), "%s: buffered copy used", cases[i].name);
+            CHECK(label, m == RMP_CLONE_BUFFERED);
+        }
+#ifdef __linux__
+        // copy_file_range/sendfile work on every local Linux filesystem
+        if (cases[i].flags == RMP_CLONE_NO_REFLINK) {
+            snprintf(label, sizeof(label), "%s: in-kernel copy used", cases[i].name);
+            CHECK(label, m == RMP_CLONE_KERNEL);
+        }
+#endif
+        snprintf(label, sizeof(label), "%s: content identical", cases[i].name);
+        CHECK(label, same_content(dst, data, SRC_SIZE));
+
+        struct stat sb;
+        stat(dst, &sb);
+        snprintf(label, sizeof(label), "%s: mode preserved", cases[i].name);
+        CHECK(label, (sb.st_mode & 07777) == 0751);
+        snprintf(label, sizeof(label), "%s: mtime preserved", cases[i].name);
+        CHECK(label, sb.st_mtime == 1234567890);
+
+        if (have_xattr) {
+            char val[16] = "";
+            ssize_t n = get_xattr(dst, "user.rmp-test", val, sizeof(val) - 1);
+            snprintf(label, sizeof(label), "%s: xattr preserved", cases[i].name);
+            CHECK(label, n == 5 && memcmp(val, "hello", 5) == 0);
+        }
+    }
+
+    printf("--- overwrite ---\n");
+    // An existing, larger destination is truncated, and gets src's mode
+    snprintf(dst, sizeof(dst), "%s/existing", g_root);
+    unsigned char *big = fill_pattern(SRC_SIZE + 4096);
+    fd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, big, SRC_SIZE + 4096) != SRC_SIZE + 4096) { perror(dst); return 2; }
+    close(fd);
+    free(big);
+    CHECK("overwrite succeeds", rmp_clone_file(src, dst, RMP_CLONE_NO_REFLINK) >= 0);
+    CHECK("old tail truncated", same_content(dst, data, SRC_SIZE));
+    struct stat sb;
+    stat(dst, &sb);
+    CHECK("mode replaced", (sb.st_mode & 07777) == 0751);
+
+    printf("--- empty file ---\n");
+    char empty[PATH_MAX + 8];
+    snprintf(empty, sizeof(empty), "%s/empty", g_root);
+    fd = open(empty, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    close(fd);
+    snprintf(dst, sizeof(dst), "%s/empty-copy", g_root);
+    CHECK("empty file copies", rmp_clone_file(empty, dst, 0) >= 0);
+    stat(dst, &sb);
+    CHECK("copy is empty", sb.st_size == 0);
+
+    printf("--- errors ---\n");
+    snprintf(dst, sizeof(dst), "%s/never", g_root);
+    CHECK("missing source fails", rmp_clone_file("/nonexistent/src", dst, 0) == -1 &&
+                                  errno == ENOENT);
+    CHECK("directory source fails", rmp_clone_file(g_root, dst, 0) == -1 &&
+                                    errno == EISDIR);
+    CHECK("unwritable destination fails",
+          rmp_clone_file(src, "/nonexistent/dir/dst", 0) == -1);
+    CHECK("method names", strcmp(rmp_clone_method_name(RMP_CLONE_KERNEL), "kernel") == 0 &&
+                          strcmp(rmp_clone_method_name(-1), "failed") == 0);
+
+    free(data);
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -209,6 +209,196 @@ else
     rm -rf "$HOME/.dummy-hardened-interp"
 fi
 
+###############################################################################
+# Group 7: Cache garbage collection (unit)
+###############################################################################
+echo "=== Group 7: Cache garbage collection ==="
+if "$BUILD/test_cache_gc" > "$RMP_TMPDIR/cache_gc.out" 2>&1; then
+    pass "rmp_cache_gc fixture tests"
+else
+    cat "$RMP_TMPDIR/cache_gc.out"
+    fail "rmp_cache_gc fixture tests"
+fi
+
+###############################################################################
+# Group 8: Background pre-signing scheduler (unit)
+###############################################################################
+echo "=== Group 8: Background pre-signing ==="
+if "$BUILD/test_presign" > "$RMP_TMPDIR/presign.out" 2>&1; then
+    pass "rmp_presign scheduler tests"
+else
+    cat "$RMP_TMPDIR/presign.out"
+    fail "rmp_presign scheduler tests"
+fi
+
+###############################################################################
+# Group 9: Cache prewarm (unit)
+###############################################################################
+echo "=== Group 9: Cache prewarm ==="
+if "$BUILD/test_prewarm" > "$RMP_TMPDIR/prewarm.out" 2>&1; then
+    pass "rmp_prewarm fixture tests"
+else
+    cat "$RMP_TMPDIR/prewarm.out"
+    fail "rmp_prewarm fixture tests"
+fi
+
+###############################################################################
+# Group 10: File clone primitive (unit)
+###############################################################################
+echo "=== Group 10: File clone primitive ==="
+if "$BUILD/test_clone" > "$RMP_TMPDIR/clone.out" 2>&1; then
+    pass "rmp_clone_file tests"
+else
+    cat "$RMP_TMPDIR/clone.out"
+    fail "rmp_clone_file tests"
+fi
+
+###############################################################################
+# Group 11: Subprocess pipes (unit)
+###############################################################################
+echo "=== Group 11: Subprocess pipes ==="
+if "$BUILD/test_pipe" > "$RMP_TMPDIR/pipe.out" 2>&1; then
+    pass "rmp_pipe_open tests"
+else
+    cat "$RMP_TMPDIR/pipe.out"
+    fail "rmp_pipe_open tests"
+fi
+
+###############################################################################
+# Group 12: Per-mapping target
+#   '<mapping>=<dir>' sends that mapping's paths to <dir>, not <target-dir>
+###############################################################################
+echo "=== Group 12: Per-mapping target ==="
+TMPDIR12=$(mktemp -d)
+CLEANUP_DIRS+=("$TMPDIR12")
+
+"$BUILD/remapper" "$TMPDIR12/shared" "$HOME/.dummy*=$TMPDIR12/own" -- "$BUILD/test_interpose"
+if "$BUILD/verify_test_interpose" "$TMPDIR12/own" "$HOME"; then
+    pass "per-mapping target receives the mapping's paths"
+else
+    fail "per-mapping target receives the mapping's paths"
+fi
+if [ ! -e "$TMPDIR12/shared/.dummy-test" ]; then
+    pass "shared target untouched"
+else
+    fail "shared target untouched"
+fi
+
+###############################################################################
+# Group 13: Tree sync (unit)
+###############################################################################
+echo "=== Group 13: Tree sync ==="
+if "$BUILD/test_sync" > "$RMP_TMPDIR/sync.out" 2>&1; then
+    pass "rmp_sync_tree tests"
+else
+    cat "$RMP_TMPDIR/sync.out"
+    fail "rmp_sync_tree tests"
+fi
+
+###############################################################################
+# Group 14: Globs across components (unit)
+###############################################################################
+echo "=== Group 14: Globs across components ==="
+if "$BUILD/test_glob" > "$RMP_TMPDIR/glob.out" 2>&1; then
+    pass "rmp_glob tests"
+else
+    cat "$RMP_TMPDIR/glob.out"
+    fail "rmp_glob tests"
+fi
+
+###############################################################################
+# Group 15: Access heatmap
+#   rmp_heat unit tests, then the interposer's counts for a mapped run
+###############################################################################
+echo "=== Group 15: Access heatmap ==="
+if "$BUILD/test_heat" > "$RMP_TMPDIR/heat.out" 2>&1; then
+    pass "rmp_heat tests"
+else
+    cat "$RMP_TMPDIR/heat.out"
+    fail "rmp_heat tests"
+fi
+
+TMPDIR15=$(mktemp -d)
+CLEANUP_DIRS+=("$TMPDIR15")
+
+"$BUILD/remapper" --heatmap="$TMPDIR15/heat.txt" "$TMPDIR15/t" "$HOME/.dummy*" -- \
+    "$BUILD/test_interpose" > /dev/null
+if head -1 "$TMPDIR15/heat.txt" 2>/dev/null | grep -q '^# remapper heatmap: [1-9][0-9]* path(s), ' &&
+   grep -q "  $HOME/.dummy" "$TMPDIR15/heat.txt"; then
+    pass "mapped paths counted into the report"
+else
+    fail "mapped paths counted into the report"
+fi
+
+###############################################################################
+# Group 16: Path traces
+#   rmp_trace unit tests, then a mapped run recorded with --trace and
+#   replayed through the matcher
+###############################################################################
+echo "=== Group 16: Path traces ==="
+if "$BUILD/test_trace" > "$RMP_TMPDIR/trace.out" 2>&1; then
+    pass "rmp_trace tests"
+else
+    cat "$RMP_TMPDIR/trace.out"
+    fail "rmp_trace tests"
+fi
+
+TMPDIR16=$(mktemp -d)
+CLEANUP_DIRS+=("$TMPDIR16")
+
+"$BUILD/remapper" --trace="$TMPDIR16/run.trace" "$TMPDIR16/t" "$HOME/.dummy*" -- \
+    "$BUILD/test_interpose" > /dev/null
+OUT16=$("$BUILD/bench_rewrite" "$TMPDIR16/run.trace" 1 2>&1)
+if echo "$OUT16" | grep -q '^[1-9][0-9]* paths, 1 pattern(s)' &&
+   echo "$OUT16" | grep -q '^try_rewrite .* [1-9][0-9]* '; then
+    pass "run recorded and replayed"
+else
+    fail "run recorded and replayed (got '$OUT16')"
+fi
+
+###############################################################################
+# Group 17: Launch cache
+#   rmp_execcache unit tests, then a script with a hardened shebang run
+#   again: the second launch execs the re-signed interpreter straight
+#   from the cache, a changed script takes the slow path again
+###############################################################################
+echo "=== Group 17: Launch cache ==="
+if "$BUILD/test_execcache" > "$RMP_TMPDIR/execcache.out" 2>&1; then
+    pass "rmp_execcache tests"
+else
+    cat "$RMP_TMPDIR/execcache.out"
+    fail "rmp_execcache tests"
+fi
+
+TMPDIR17=$(mktemp -d)
+CLEANUP_DIRS+=("$TMPDIR17")
+SCRIPT17="$TMPDIR17/test_script"
+printf '#!%s\n' "$INTERP_ABS" > "$SCRIPT17"
+chmod +x "$SCRIPT17"
+
+"$BUILD/remapper" --debug-log "$TMPDIR17/a.log" "$TMPDIR17/a" "$HOME/.dummy*" -- "$SCRIPT17"
+"$BUILD/remapper" --debug-log "$TMPDIR17/b.log" "$TMPDIR17/b" "$HOME/.dummy*" -- "$SCRIPT17"
+if grep -q 'launch cache: stored' "$TMPDIR17/a.log" &&
+   grep -q 'launch cache: hit' "$TMPDIR17/b.log" &&
+   [ -f "$TMPDIR17/b/.dummy-hardened-interp/proof.txt" ]; then
+    pass "second launch from the cache, still interposed"
+else
+    fail "second launch from the cache, still interposed"
+fi
+
+echo '# changed' >> "$SCRIPT17"
+"$BUILD/remapper" --debug-log "$TMPDIR17/c.log" "$TMPDIR17/c" "$HOME/.dummy*" -- "$SCRIPT17"
+RMP_LAUNCH_CACHE=0 "$BUILD/remapper" --debug-log "$TMPDIR17/d.log" "$TMPDIR17/d" \
+    "$HOME/.dummy*" -- "$SCRIPT17"
+if ! grep -q 'launch cache: hit' "$TMPDIR17/c.log" &&
+   grep -q 'launch cache: stored' "$TMPDIR17/c.log" &&
+   ! grep -q 'launch cache' "$TMPDIR17/d.log" &&
+   [ -f "$TMPDIR17/d/.dummy-hardened-interp/proof.txt" ]; then
+    pass "changed script and RMP_LAUNCH_CACHE=0 take the slow path"
+else
+    fail "changed script and RMP_LAUNCH_CACHE=0 take the slow path"
+fi
+
 ###############################################################################
 # Summary
 ###############################################################################
@@ -0,0 +1,182 @@
+/*
+ * test_execcache.c - exercise rmp_execcache (the macOS launcher's fast path)
+ *
+ * Stores exec decisions and looks them up again: hits while the files
+ * they depend on are unchanged, misses once one is rewritten, replaced
+ * or removed, or the re-signed copy they exec stops being valid, and
+ * refusals of what the file format can't hold.
+ *
+ * Usage:
+ *   ./test_execcache
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rmp_execcache.h"
+#include "rmp_shared.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[] = "/tmp/rmp-test-execcache-XXXXXX";
+static char g_dir[PATH_MAX], g_cmd[PATH_MAX], g_interp[PATH_MAX], g_copy[PATH_MAX + 64];
+
+static void write_file(const char *path, const char *data) {
+    FILE *fp = fopen(path, "w");
+    if (fp) {
+        fputs(data, fp);
+        fclose(fp);
+    }
+}
+
+// Set a file's mtime to t seconds ago
+static void age(const char *path, time_t t) {
+    struct timespec times[2] = { { time(NULL) - t, 0 }, { time(NULL) - t, 0 } };
+    utimensat(AT_FDCWD, path, times, 0);
+}
+
+// An entry as the launcher makes one for a script run by an interpreter
+static void script_entry(rmp_exec_entry_t *e) {
+    memset(e, 0, sizeof(*e));
+    rmp_execcache_dep(e, g_cmd);
+    int interp = rmp_execcache_dep(e, g_interp);
+    strcpy(e->exec_path, g_interp);
+    strcpy(e->args[e->num_args++], g_interp);
+    strcpy(e->args[e->num_args++], "-S");
+    strcpy(e->args[e->num_args++], g_cmd);
+    (void)interp;
+}
+
+int main(void) {
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+    snprintf(g_dir, sizeof(g_dir), "%s/launch", g_root);
+    snprintf(g_cmd, sizeof(g_cmd), "%s/tool", g_root);
+    snprintf(g_interp, sizeof(g_interp), "%s/node", g_root);
+    snprintf(g_copy, sizeof(g_copy), "%s/cache%s", g_root, g_interp);
+    write_file(g_cmd, "#!/usr/bin/env -S node\n");
+    write_file(g_interp, "interpreter v1");
+    const char *key = "tool\t/usr/bin:/bin\t/cache";
+    static rmp_exec_entry_t e, got;
+
+    printf("=== Entries ===\n");
+    CHECK("miss before any store", rmp_execcache_lookup(g_dir, key, &got) == 0);
+    script_entry(&e);
+    CHECK("deps recorded once each", e.num_deps == 2 && rmp_execcache_dep(&e, g_cmd) == 0 &&
+                                     e.num_deps == 2);
+    CHECK("a missing dep refused", rmp_execcache_dep(&e, "/nonexistent/x") < 0 && e.num_deps == 2);
+    CHECK("stored, dir created", rmp_execcache_store(g_dir, key, &e) == 0);
+    CHECK("hit", rmp_execcache_lookup(g_dir, key, &got) == 1);
+    CHECK("the decision back", strcmp(got.exec_path, g_interp) == 0 && got.num_args == 3 &&
+                               strcmp(got.args[1], "-S") == 0 && strcmp(got.args[2], g_cmd) == 0);
+    CHECK("another key misses", rmp_execcache_lookup(g_dir, "tool\t/opt/bin\t/cache", &got) == 0);
+
+    rmp_exec_entry_t plain;
+    memset(&plain, 0, sizeof(plain));
+    rmp_execcache_dep(&plain, g_cmd);
+    strcpy(plain.args[plain.num_args++], "tool");
+    CHECK("'through $PATH' kept", rmp_execcache_store(g_dir, "plain", &plain) == 0 &&
+                                  rmp_execcache_lookup(g_dir, "plain", &got) == 1 &&
+                                  got.exec_path[0] == '\0' && got.num_args == 1);
+
+    printf("\n=== Changes ===\n");
+    write_file(g_interp, "interpreter v2");
+    CHECK("interpreter rewritten: miss", rmp_execcache_lookup(g_dir, key, &got) == 0);
+    script_entry(&e);
+    rmp_execcache_store(g_dir, key, &e);
+    CHECK("stored again: hit", rmp_execcache_lookup(g_dir, key, &got) == 1);
+
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.new", g_interp);
+    write_file(tmp, "interpreter v2");
+    struct stat sb;
+    stat(g_interp, &sb);
+#ifdef __APPLE__
+    struct timespec times[2] = { sb.st_mtimespec, sb.st_mtimespec };
+#else
+    struct timespec times[2] = { sb.st_mtim, sb.st_mtim };
+#endif
+    utimensat(AT_FDCWD, tmp, times, 0);
+    rename(tmp, g_interp);
+    CHECK("replaced, same size and mtime: miss", rmp_execcache_lookup(g_dir, key, &got) == 0);
+
+    script_entry(&e);
+    rmp_execcache_store(g_dir, key, &e);
+    unlink(g_cmd);
+    CHECK("command removed: miss", rmp_execcache_lookup(g_dir, key, &got) == 0);
+    write_file(g_cmd, "#!/usr/bin/env -S node\n");
+    script_entry(&e);
+    rmp_execcache_store(g_dir, key, &e);
+    rmp_execcache_forget(g_dir, key);
+    CHECK("forgotten: miss", rmp_execcache_lookup(g_dir, key, &got) == 0);
+
+    printf("\n=== Re-signed copies ===\n");
+    char meta[PATH_MAX + 128];
+    snprintf(meta, sizeof(meta), "%s.meta", g_copy);
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s/cache%s", g_root, g_root);
+    rmp_mkdirs(parent, 0755);
+    write_file(g_copy, "re-signed interpreter");
+    stat(g_interp, &sb);
+    char line[64];
+    snprintf(line, sizeof(line), "%ld %lld", (long)sb.st_mtime, (long long)sb.st_size);
+    write_file(meta, line);
+    age(meta, 2 * RMP_CACHE_TOUCH_SECS);
+
+    script_entry(&e);
+    strcpy(e.exec_path, g_copy);
+    strcpy(e.args[0], g_copy);
+    strcpy(e.cached, g_copy);
+    e.cached_dep = 1;
+    e.stamp = time(NULL);
+    rmp_execcache_store(g_dir, key, &e);
+    unlink(g_copy);
+    CHECK("fresh stamp: the copy not looked at", rmp_execcache_lookup(g_dir, key, &got) == 1);
+
+    write_file(g_copy, "re-signed interpreter");
+    e.stamp = time(NULL) - 2 * RMP_CACHE_TOUCH_SECS;
+    rmp_execcache_store(g_dir, key, &e);
+    CHECK("old stamp, valid copy: hit", rmp_execcache_lookup(g_dir, key, &got) == 1 &&
+                                        strcmp(got.cached, g_copy) == 0);
+    CHECK("copy's last use refreshed", stat(meta, &sb) == 0 && time(NULL) - sb.st_mtime < 60);
+    CHECK("and the stamp", rmp_execcache_lookup(g_dir, key, &got) == 1 &&
+                           time(NULL) - got.stamp < 60);
+
+    e.stamp = time(NULL) - 2 * RMP_CACHE_TOUCH_SECS;
+    rmp_execcache_store(g_dir, key, &e);
+    unlink(meta);
+    CHECK("old stamp, copy gone: miss", rmp_execcache_lookup(g_dir, key, &got) == 0);
+
+    printf("\n=== Format ===\n");
+    script_entry(&e);
+    CHECK("newline in the key refused", rmp_execcache_store(g_dir, "a\nb", &e) < 0 && errno == EINVAL);
+    strcpy(e.args[1], "-S\nx");
+    CHECK("newline in an arg refused", rmp_execcache_store(g_dir, key, &e) < 0 && errno == EINVAL);
+    memset(&e, 0, sizeof(e));
+    CHECK("no deps refused", rmp_execcache_store(g_dir, key, &e) < 0);
+
+    script_entry(&e);
+    rmp_execcache_store(g_dir, key, &e);
+    char cmd[PATH_MAX * 2];
+    snprintf(cmd, sizeof(cmd), "for f in '%s'/*; do head -c 40 \"$f\" > \"$f.x\" && mv \"$f.x\" \"$f\"; done",
+             g_dir);
+    CHECK("a cut off entry misses", system(cmd) == 0 && rmp_execcache_lookup(g_dir, key, &got) == 0);
+
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
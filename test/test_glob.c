@@ -0,0 +1,109 @@
+/*
+ * test_glob.c - exercise rmp_glob (mapping globs across components)
+ *
+ * Splits mappings into base and glob, compiles globs, and matches
+ * paths against them: single components as mappings always had,
+ * wildcards further up, '**' at either end and in the middle, and the
+ * state-set stepping the launcher's walk uses to prune.
+ *
+ * Usage:
+ *   ./test_glob
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "rmp_glob.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_buf[512];
+static rmp_glob_t g_glob;
+
+static const rmp_glob_t *compile(const char *glob) {
+    snprintf(g_buf, sizeof(g_buf), "%s", glob);
+    if (rmp_glob_compile(&g_glob, g_buf) != 0) return NULL;
+    return &g_glob;
+}
+
+// Length matched at the start of rest, or 0
+static size_t match(const char *glob, const char *rest) {
+    const rmp_glob_t *g = compile(glob);
+    return g ? rmp_glob_match(g, rest) : 0;
+}
+
+static size_t split(const char *mapping) {
+    return rmp_glob_split(mapping, strlen(mapping));
+}
+
+int main(void) {
+    printf("=== Split ===\n");
+    CHECK("last component glob", split("/home/u/.claude*") == 8);
+    CHECK("no wildcards: at the last '/'", split("/home/u/.claude") == 8);
+    CHECK("mid-path glob: before its component", split("/home/u/src/*/.cache") == 12);
+    CHECK("'**' splits the same way", split("/home/u/**/node_modules") == 8);
+    CHECK("wildcard mid-component", split("/home/u/pro?/x") == 8);
+    CHECK("only a given length is looked at", rmp_glob_split("/a/b=/t/*", 4) == 3);
+    CHECK("no '/' at all", split("abc") == 0);
+
+    printf("\n=== Compile ===\n");
+    const rmp_glob_t *g = compile(".claude*");
+    CHECK("single component is simple", g && g->nseg == 1 && rmp_glob_is_simple(g));
+    g = compile("src/*/.cache");
+    CHECK("three components", g && g->nseg == 3 && !rmp_glob_is_simple(g));
+    g = compile("**");
+    CHECK("'**' alone is not simple", g && g->nseg == 1 && !rmp_glob_is_simple(g));
+    g = compile("a//b/");
+    CHECK("empty components dropped", g && g->nseg == 2);
+    CHECK("nothing left is an error", compile("/") == NULL);
+    char many[128] = "";
+    for (int i = 0; i < RMP_GLOB_MAX_SEGS + 1; i++) strcat(many, "a/");
+    CHECK("too many components is an error", compile(many) == NULL);
+
+    printf("\n=== Match ===\n");
+    CHECK("one component", match(".claude*", ".claude.json") == 12);
+    CHECK("only the matched component counts", match(".claude*", ".claude/x/y") == 7);
+    CHECK("no match", match(".claude*", ".config/x") == 0);
+    CHECK("mid-path wildcard", match("src/*/.cache", "src/proj/.cache/x") == 15);
+    CHECK("literal after it must match", match("src/*/.cache", "src/proj/.config") == 0);
+    CHECK("too short a path", match("src/*/.cache", "src/proj") == 0);
+    CHECK("'**' matches none", match("**/.cache", ".cache/x") == 6);
+    CHECK("'**' matches several", match("**/.cache", "a/b/c/.cache") == 12);
+    CHECK("shortest match wins", match("**/.cache", "a/.cache/b/.cache") == 8);
+    CHECK("trailing '**' matches the directory itself", match("cfg/**", "cfg/a/b") == 3);
+    CHECK("'**' in the middle", match("a/**/b/*.json", "a/x/y/b/c.json") == 14);
+    CHECK("'..' never matches", match("*/.cache", "../.cache") == 0);
+    CHECK("'**' doesn't cross '..'", match("**/.cache", "a/../.cache") == 0);
+    CHECK("doubled slashes skipped", match("src/*/.cache", "src//p/.cache") == 13);
+    CHECK("dotfiles match '*'", match("*", ".hidden") == 7);
+
+    printf("\n=== Stepping ===\n");
+    g = compile("src/*/.cache");
+    uint32_t s = rmp_glob_start(g);
+    CHECK("first a literal: looked up", rmp_glob_literal(g, s) &&
+                                       strcmp(rmp_glob_literal(g, s), "src") == 0);
+    CHECK("wrong name prunes", rmp_glob_step(g, s, "lib") == 0);
+    s = rmp_glob_step(g, s, "src");
+    CHECK("then a pattern: read the directory", s && !rmp_glob_literal(g, s));
+    s = rmp_glob_step(g, s, "proj");
+    CHECK("then a literal again", rmp_glob_literal(g, s) &&
+                                  strcmp(rmp_glob_literal(g, s), ".cache") == 0);
+    CHECK("not matched yet", !rmp_glob_accepts(g, s));
+    s = rmp_glob_step(g, s, ".cache");
+    CHECK("matched", rmp_glob_accepts(g, s));
+    g = compile("**/x");
+    s = rmp_glob_step(g, rmp_glob_start(g), "a");
+    CHECK("'**' keeps the walk going", s && !rmp_glob_accepts(g, s) &&
+                                       !rmp_glob_literal(g, s));
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
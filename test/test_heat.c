@@ -0,0 +1,166 @@
+/*
+ * test_heat.c - exercise rmp_heat (the --heatmap counts and report)
+ *
+ * Counts events per path, from one thread and from several at once,
+ * fills a table to see the overflow land in "lost", and writes reports:
+ * sorted hottest first, read back, reset, and folded into a file by
+ * one process after another as the macOS interposer does.
+ *
+ * Usage:
+ *   ./test_heat
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "rmp_heat.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_report[8192];
+
+// The report h writes, in g_report
+static const char *report(const rmp_heat_t *h) {
+    FILE *fp = tmpfile();
+    g_report[0] = '\0';
+    if (!fp) return g_report;
+    if (rmp_heat_write(h, fp) == 0) {
+        rewind(fp);
+        size_t n = fread(g_report, 1, sizeof(g_report) - 1, fp);
+        g_report[n] = '\0';
+    }
+    fclose(fp);
+    return g_report;
+}
+
+// The path on report line i (0 = first after the header)
+static const char *row(int i, char *buf, size_t size) {
+    const char *p = g_report;
+    buf[0] = '\0';
+    for (; *p; p = strchr(p, '\n') + 1) {
+        if (*p != '#' && i-- == 0) {
+            unsigned long n[4];
+            int at = 0;
+            if (sscanf(p, "%lu %lu %lu %lu %n", &n[0], &n[1], &n[2], &n[3], &at) == 4)
+                snprintf(buf, size, "%.*s", (int)strcspn(p + at, "\n"), p + at);
+            break;
+        }
+        if (!strchr(p, '\n')) break;
+    }
+    return buf;
+}
+
+static rmp_heat_t *g_shared;
+
+static void *hammer(void *arg) {
+    (void)arg;
+    char path[64];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(path, sizeof(path), "/home/u/.app/f%d", i % 50);
+        rmp_heat_add(g_shared, path, i % RMP_HEAT_KINDS, 1);
+    }
+    return NULL;
+}
+
+int main(void) {
+    char buf[256];
+
+    printf("=== Counting ===\n");
+    rmp_heat_t *h = rmp_heat_new(16);
+    CHECK("table created", h != NULL);
+    rmp_heat_add(h, "/home/u/.app/cold", RMP_HEAT_OPEN, 1);
+    for (int i = 0; i < 5; i++) rmp_heat_add(h, "/home/u/.app/hot", RMP_HEAT_READ, 2);
+    rmp_heat_add(h, "/home/u/.app/hot", RMP_HEAT_OPEN, 1);
+    rmp_heat_add(h, "/home/u/.app/warm", RMP_HEAT_MODIFY, 3);
+    rmp_heat_add(h, "/home/u/.app/warm", RMP_HEAT_CREATE, 1);
+    rmp_heat_add(h, "/home/u/.app/idle", RMP_HEAT_OPEN, 0);
+    report(h);
+    CHECK("header totals", strstr(g_report, "3 path(s), 16 event(s), 0 lost") != NULL);
+    CHECK("hottest first", strcmp(row(0, buf, sizeof(buf)), "/home/u/.app/hot") == 0);
+    CHECK("then by count", strcmp(row(1, buf, sizeof(buf)), "/home/u/.app/warm") == 0 &&
+                           strcmp(row(2, buf, sizeof(buf)), "/home/u/.app/cold") == 0);
+    CHECK("paths without events left out", !strstr(g_report, "idle"));
+    CHECK("counts per kind", strstr(g_report, "1         10          0          0  "
+                                              "/home/u/.app/hot") != NULL);
+
+    printf("\n=== Full table ===\n");
+    int full = 0;
+    for (int i = 0; i < 40; i++) {
+        snprintf(buf, sizeof(buf), "/home/u/.app/many/%d", i);
+        if (rmp_heat_add(h, buf, RMP_HEAT_OPEN, 1) < 0) full++;
+    }
+    CHECK("adds past max_paths refused", full == 40 - 12);
+    CHECK("known paths still counted", rmp_heat_add(h, "/home/u/.app/hot", RMP_HEAT_READ, 1) == 0);
+    rmp_heat_lost(h, 2);
+    report(h);
+    CHECK("refused and lost events tallied", strstr(g_report, "30 lost") != NULL);
+    rmp_heat_free(h);
+
+    printf("\n=== Threads ===\n");
+    g_shared = rmp_heat_new(64);
+    pthread_t t[4];
+    for (int i = 0; i < 4; i++) pthread_create(&t[i], NULL, hammer, NULL);
+    for (int i = 0; i < 4; i++) pthread_join(t[i], NULL);
+    report(g_shared);
+    CHECK("every event counted once", strstr(g_report, "50 path(s), 80000 event(s), 0 lost") != NULL);
+    CHECK("each path on one line", strcmp(row(49, buf, sizeof(buf)), "") != 0 &&
+                                   strcmp(row(50, buf, sizeof(buf)), "") == 0);
+    rmp_heat_free(g_shared);
+
+    printf("\n=== Reports ===\n");
+    char path[] = "/tmp/rmp-test-heat-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    unlink(path);
+    h = rmp_heat_new(16);
+    rmp_heat_add(h, "/a/with space", RMP_HEAT_OPEN, 2);
+    rmp_heat_add(h, "/a/b", RMP_HEAT_MODIFY, 1);
+    CHECK("saved to a new file", rmp_heat_save(h, path) == 0);
+    report(h);
+    CHECK("counts moved out, not kept", strstr(g_report, "0 path(s), 0 event(s)") != NULL);
+    rmp_heat_add(h, "/a/b", RMP_HEAT_MODIFY, 4);
+    rmp_heat_t *other = rmp_heat_new(16);
+    rmp_heat_add(other, "/a/c", RMP_HEAT_CREATE, 1);
+    rmp_heat_lost(other, 1);
+    CHECK("folded in by a second", rmp_heat_save(h, path) == 0 && rmp_heat_save(other, path) == 0);
+    rmp_heat_free(other);
+    rmp_heat_free(h);
+
+    h = rmp_heat_new(16);
+    FILE *fp = fopen(path, "r");
+    CHECK("report read back", fp && rmp_heat_load(h, fp) == 3);
+    if (fp) fclose(fp);
+    report(h);
+    CHECK("all three processes' counts", strstr(g_report, "3 path(s), 8 event(s), 1 lost") != NULL);
+    CHECK("merged counts", strcmp(row(0, buf, sizeof(buf)), "/a/b") == 0 &&
+                           strstr(g_report, "0          0          5          0  /a/b"));
+    CHECK("spaces in paths kept", strstr(g_report, "  /a/with space\n") != NULL);
+    rmp_heat_reset(h);
+    report(h);
+    CHECK("reset zeroes the counts", strstr(g_report, "0 path(s), 0 event(s), 0 lost") != NULL);
+    CHECK("and keeps the paths", rmp_heat_add(h, "/a/b", RMP_HEAT_OPEN, 1) == 0 &&
+                                 strstr(report(h), "1 path(s), 1 event(s)") != NULL);
+    rmp_heat_free(h);
+
+    h = rmp_heat_new(4);
+    fp = fopen("/etc/hostname", "r");
+    if (!fp) fp = tmpfile();
+    CHECK("anything else refused", fp && rmp_heat_load(h, fp) < 0);
+    if (fp) fclose(fp);
+    rmp_heat_free(h);
+    unlink(path);
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -24,6 +24,8 @@
  *     subdir/
  *       mkdirat.txt     "mkdirat-content\n"
  *     chdir-proof.txt   "chdir-ok\n"              (created after chdir)
+ *     dirfd.txt         "dirfd-content\n"         (openat relative to $HOME's fd)
+ *     dirfd-dir/        (mkdirat relative to a dup of it)
  *   .dummy.txt          "toplevel\n"              (tests glob: .dummy* ≠ .dummy-test*)
  *
  * Should NOT exist:
@@ -311,6 +313,22 @@ int main(void) {
         closedir(d);
     }
 
+    /* $HOME itself isn't redirected: its listing is merged with the target's */
+    d = opendir(home);
+    CHECK("opendir $HOME", d != NULL);
+    if (d) {
+        int seen = 0, again = 0;
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL)
+            if (strcmp(de->d_name, ".dummy-test") == 0) seen++;
+        rewinddir(d);
+        while ((de = readdir(d)) != NULL)
+            if (strcmp(de->d_name, ".dummy-test") == 0) again++;
+        CHECK("$HOME lists .dummy-test once", seen == 1);
+        CHECK("and again after rewinddir", again == 1);
+        closedir(d);
+    }
+
     /* ================================================================ */
     /*  mkdirat                                                         */
     /* ================================================================ */
@@ -355,6 +373,23 @@ int main(void) {
     CHECK("unlinkat", unlinkat(AT_FDCWD, path, 0) == 0);
     CHECK("unlinkat verified gone", access(path, F_OK) != 0);
 
+    /* ================================================================ */
+    /*  *at() relative to a dirfd above the mapping                     */
+    /* ================================================================ */
+    printf("\n[dirfd-relative]\n");
+    int hfd = open(home, O_RDONLY | O_DIRECTORY);
+    CHECK("open $HOME", hfd >= 0);
+    fd = openat(hfd, ".dummy-test/dirfd.txt", O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    CHECK("openat relative", fd >= 0);
+    if (fd >= 0) { write_to_fd(fd, "dirfd-content\n"); close(fd); }
+    CHECK("fstatat relative", fstatat(hfd, ".dummy-test/dirfd.txt", &sb, 0) == 0);
+    int hfd2 = dup(hfd);
+    close(hfd);
+    CHECK("mkdirat relative to a dup", mkdirat(hfd2, ".dummy-test/dirfd-dir", 0755) == 0);
+    snprintf(path, sizeof(path), "%s/dirfd-dir", base);
+    CHECK("dirfd-dir seen by path", access(path, F_OK) == 0);
+    close(hfd2);
+
     /* ================================================================ */
     /*  rmdir                                                           */
     /* ================================================================ */
@@ -0,0 +1,647 @@
+/*
+ * test_launch.c - exercise librmp (rmp_launch.h) without the CLI
+ *
+ * Builds a plan against a scratch "home" with one mapped directory and
+ * one mapped file, then spawns programs from it: remapped reads, exit
+ * status via the pidfd, envp/PATH handling, error reporting for bad
+ * plans and missing programs, concurrent spawns from one plan, clones
+ * of a plan for another target, mappings read from profile files,
+ * per-mapping directory and tmpfs targets, staged plans written back
+ * with rmp_plan_sync(), watched plans picking up new matches, and
+ * rmp_plan_rewrite() with the seccomp backend built on it, the mounts
+ * coalesced away when others make them unnecessary, globs with
+ * wildcards above the last component, launches sharing one user
+ * namespace held by a keeper, and launches into a cgroup of their own
+ * where ours is delegated.
+ *
+ * Needs unprivileged user namespaces, like test_linux.sh.
+ *
+ * Usage:
+ *   ./test_launch
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+#include "rmp_launch.h"
+#include "rmp_seccomp.h"
+#include "rmp_cgroup.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[512];
+
+static void write_file(const char *rel, const char *data) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, data, strlen(data)) != (ssize_t)strlen(data)) {
+        perror(path);
+        exit(2);
+    }
+    close(fd);
+}
+
+static int file_is(const char *rel, const char *want) {
+    char path[PATH_MAX], buf[256];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n < 0) return 0;
+    buf[n] = '\0';
+    return strcmp(buf, want) == 0;
+}
+
+// Exit status of the process behind pidfd (reaps it), or -1
+static int wait_pidfd(int pidfd) {
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    if (waitid((idtype_t)P_PIDFD, (id_t)pidfd, &si, WEXITED) != 0) return -1;
+    close(pidfd);
+    return si.si_code == CLD_EXITED ? si.si_status : -1;
+}
+
+/*** Concurrent spawns ****/
+
+#define SPAWN_THREADS 4
+#define SPAWNS_EACH   8
+
+static rmp_plan_t *g_plan;
+static char g_check_cmd[PATH_MAX * 2];
+
+static void *spawn_thread(void *arg) {
+    (void)arg;
+    intptr_t ok = 0;
+    for (int i = 0; i < SPAWNS_EACH; i++) {
+        char *argv[] = { "sh", "-c", g_check_cmd, NULL };
+        int pidfd = rmp_spawn(g_plan, argv, NULL, NULL);
+        if (pidfd >= 0 && wait_pidfd(pidfd) == 0) ok++;
+    }
+    return (void *)ok;
+}
+
+int main(void) {
+    snprintf(g_root, sizeof(g_root), "%s/rmp-launch-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+
+    char path[PATH_MAX], target[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/home/.app/sub", g_root);
+    rmp_mkdirs(path, 0755);
+    write_file("home/.app/f", "original");
+    write_file("home/.app.json", "original-json");
+    write_file("home/.other", "untouched");
+    snprintf(target, sizeof(target), "%s/target/", g_root);  // trailing '/'
+
+    printf("--- plan construction ---\n");
+    CHECK("relative target rejected", rmp_plan_new("target") == NULL && errno == EINVAL);
+    CHECK("error detail recorded", strstr(rmp_last_error(), "absolute") != NULL);
+
+    rmp_plan_t *plan = rmp_plan_new(target);
+    CHECK("plan created", plan != NULL);
+    CHECK("target dir created", access(target, F_OK) == 0);
+    CHECK("trailing slash dropped",
+          rmp_plan_target(plan)[strlen(rmp_plan_target(plan)) - 1] != '/');
+    CHECK("relative mapping rejected",
+          rmp_plan_add_mapping(plan, "home/.app*") == -RMP_ERR_INVAL);
+    CHECK("mapping without parent rejected",
+          rmp_plan_add_mapping(plan, "/.app*") == -RMP_ERR_INVAL);
+
+    char *true_argv[] = { "true", NULL };
+    CHECK("spawn before resolve rejected",
+          rmp_spawn(plan, true_argv, NULL, NULL) == -RMP_ERR_INVAL);
+
+    snprintf(path, sizeof(path), "%s/home/.app*", g_root);
+    CHECK("mapping added", rmp_plan_add_mapping(plan, path) == 0);
+    CHECK("mapping kept as given", rmp_plan_num_mappings(plan) == 1 &&
+                                   strcmp(rmp_plan_mapping(plan, 0), path) == 0);
+
+    printf("--- resolve ---\n");
+    CHECK("two matches", rmp_plan_resolve(plan) == 2 && rmp_plan_num_mounts(plan) == 2);
+    snprintf(path, sizeof(path), "%s/target/.app", g_root);
+    struct stat sb;
+    CHECK("target dir created for dir match", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+    snprintf(path, sizeof(path), "%s/target/.app.json", g_root);
+    CHECK("target file created for file match", stat(path, &sb) == 0 && S_ISREG(sb.st_mode));
+
+    char source[PATH_MAX];
+    const char *over = rmp_plan_mount(plan, 0, source, sizeof(source));
+    snprintf(path, sizeof(path), "%s/target/.app", g_root);
+    CHECK("mount listed with its target", over && strstr(over, "/home/.app") &&
+          (strcmp(source, path) == 0 || strstr(source, "/target/.app.json")));
+    CHECK("no mount past the end", rmp_plan_mount(plan, 2, source, sizeof(source)) == NULL);
+
+    printf("--- spawn ---\n");
+    write_file("target/.app/f", "remapped");
+    char cmd[PATH_MAX * 2];
+    snprintf(cmd, sizeof(cmd),
+             "cat '%s/home/.app/f' > '%s/out'; echo x > '%s/home/.app/new'; exit 3",
+             g_root, g_root, g_root);
+    char *sh_argv[] = { "sh", "-c", cmd, NULL };
+    pid_t pid = 0;
+    int pidfd = rmp_spawn(plan, sh_argv, NULL, &pid);
+    CHECK("spawn returns a pidfd", pidfd >= 0 && pid > 0);
+    struct pollfd pfd = { pidfd, POLLIN, 0 };
+    CHECK("pidfd becomes readable on exit", poll(&pfd, 1, 5000) == 1);
+    CHECK("exit status through the pidfd", wait_pidfd(pidfd) == 3);
+    CHECK("child saw the remapped content", file_is("out", "remapped"));
+    CHECK("writes land in the target", file_is("target/.app/new", "x\n"));
+    snprintf(path, sizeof(path), "%s/home/.app/new", g_root);
+    CHECK("original untouched", access(path, F_OK) != 0 && file_is("home/.app/f", "original"));
+
+    printf("--- envp ---\n");
+    snprintf(cmd, sizeof(cmd), "echo \"$RMP_TEST_VAR\" > '%s/env-out'", g_root);
+    char *env[] = { "RMP_TEST_VAR=from-envp", "PATH=/usr/bin:/bin", NULL };
+    pidfd = rmp_spawn(plan, sh_argv, env, NULL);
+    CHECK("spawn with envp", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    CHECK("program got envp", file_is("env-out", "from-envp\n"));
+
+    char *empty_path[] = { "PATH=/nonexistent", NULL };
+    CHECK("PATH searched from envp",
+          rmp_spawn(plan, true_argv, empty_path, NULL) == -RMP_ERR_EXEC && errno == ENOENT);
+
+    // Only the mapping has bin/, and the script has no #! line
+    snprintf(path, sizeof(path), "%s/target/.app/bin", g_root);
+    mkdir(path, 0755);
+    snprintf(cmd, sizeof(cmd), "echo ran > '%s/script-out'\n", g_root);
+    write_file("target/.app/bin/tool", cmd);
+    snprintf(path, sizeof(path), "%s/target/.app/bin/tool", g_root);
+    chmod(path, 0755);
+    char path_var[PATH_MAX + 16];
+    snprintf(path_var, sizeof(path_var), "PATH=/nonexistent::%s/home/.app/bin", g_root);
+    char *tool_env[] = { path_var, NULL };
+    char *tool_argv[] = { "tool", NULL };
+    pidfd = rmp_spawn(plan, tool_argv, tool_env, NULL);
+    CHECK("PATH searched inside the namespace, script run by sh",
+          pidfd >= 0 && wait_pidfd(pidfd) == 0 && file_is("script-out", "ran\n"));
+
+    printf("--- errors ---\n");
+    char *missing[] = { "/nonexistent/prog", NULL };
+    int r = rmp_spawn(plan, missing, NULL, NULL);
+    CHECK("exec failure reported by rmp_spawn", r == -RMP_ERR_EXEC && errno == ENOENT);
+    CHECK("exec failure detail", strstr(rmp_last_error(), "/nonexistent/prog") != NULL);
+    CHECK("failed child already reaped", waitpid(-1, NULL, WNOHANG) == -1 && errno == ECHILD);
+    CHECK("error names", strcmp(rmp_strerror(-RMP_ERR_MOUNT), "bind mount failed") == 0 &&
+                         strcmp(rmp_strerror(99), "unknown error") == 0);
+
+    printf("--- concurrent spawns ---\n");
+    g_plan = plan;
+    snprintf(g_check_cmd, sizeof(g_check_cmd), "[ \"$(cat '%s/home/.app/f')\" = remapped ]",
+             g_root);
+    pthread_t threads[SPAWN_THREADS];
+    for (int i = 0; i < SPAWN_THREADS; i++)
+        pthread_create(&threads[i], NULL, spawn_thread, NULL);
+    intptr_t total = 0;
+    for (int i = 0; i < SPAWN_THREADS; i++) {
+        void *ok;
+        pthread_join(threads[i], &ok);
+        total += (intptr_t)ok;
+    }
+    CHECK("every concurrent spawn remapped", total == SPAWN_THREADS * SPAWNS_EACH);
+
+    printf("--- clone ---\n");
+    snprintf(path, sizeof(path), "%s/clone-target", g_root);
+    rmp_plan_t *copy = rmp_plan_clone(plan, path);
+    CHECK("clone created", copy != NULL);
+    CHECK("clone keeps mappings and mounts",
+          rmp_plan_num_mappings(copy) == 1 && rmp_plan_num_mounts(copy) == 2 &&
+          strcmp(rmp_plan_target(copy), path) == 0);
+    rmp_plan_create_targets(copy);
+    snprintf(path, sizeof(path), "%s/clone-target/.app", g_root);
+    CHECK("clone targets created", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+    write_file("clone-target/.app/f", "cloned");
+    snprintf(cmd, sizeof(cmd), "[ \"$(cat '%s/home/.app/f')\" = cloned ]", g_root);
+    pidfd = rmp_spawn(copy, sh_argv, NULL, NULL);
+    CHECK("clone spawns into its own target", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    rmp_plan_free(copy);
+
+    rmp_plan_t *unresolved = rmp_plan_new(target);
+    CHECK("unresolved plan not cloned",
+          rmp_plan_clone(unresolved, path) == NULL && errno == EINVAL);
+    rmp_plan_free(unresolved);
+
+    printf("--- profile ---\n");
+    write_file("home/.lit", "literal");
+    snprintf(path, sizeof(path),
+             "# mappings for the test\n"
+             "\n"
+             "  %s/home/.app*  \n"
+             "%s/home/.lit\n"
+             "~/.missing-literal\n"
+             "%s/home/.oth?r\n", g_root, g_root, g_root);
+    write_file("profile", path);
+    snprintf(path, sizeof(path), "%s/profile-target", g_root);
+    rmp_plan_t *prof = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/profile", g_root);
+    CHECK("profile mappings added", rmp_plan_add_profile(prof, path) == 4 &&
+                                    rmp_plan_num_mappings(prof) == 4);
+    CHECK("mapping trimmed", strcmp(rmp_plan_mapping(prof, 0) + strlen(g_root),
+                                    "/home/.app*") == 0);
+    CHECK("~ expanded from $HOME", rmp_plan_mapping(prof, 2)[0] == '/' &&
+                                   strstr(rmp_plan_mapping(prof, 2), "/.missing-literal"));
+    CHECK("shared parent, literal and missing names resolve",
+          rmp_plan_resolve(prof) == 4);
+    snprintf(path, sizeof(path), "%s/profile-target/.lit", g_root);
+    CHECK("literal mapping target created", stat(path, &sb) == 0 && S_ISREG(sb.st_mode));
+
+    write_file("bad-profile", "/ok/.x*\n\nrelative/.y*\n");
+    snprintf(path, sizeof(path), "%s/bad-profile", g_root);
+    CHECK("relative mapping in profile rejected",
+          rmp_plan_add_profile(prof, path) == -RMP_ERR_INVAL);
+    CHECK("error names the line", strstr(rmp_last_error(), "bad-profile:3:") != NULL);
+    write_file("bad-profile", "/ok/.x*=tmpfs:12q\n");
+    CHECK("bad line's own reason kept",
+          rmp_plan_add_profile(prof, path) == -RMP_ERR_INVAL &&
+          strstr(rmp_last_error(), "bad-profile:1: bad tmpfs size") != NULL);
+    CHECK("missing profile rejected",
+          rmp_plan_add_profile(prof, "/nonexistent/profile") == -RMP_ERR_INVAL &&
+          errno == ENOENT);
+    rmp_plan_free(prof);
+
+    printf("--- per-mapping targets ---\n");
+    snprintf(path, sizeof(path), "%s/own-target", g_root);
+    rmp_plan_t *own = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app=%s/own-dir/", g_root, g_root);
+    CHECK("own target accepted", rmp_plan_add_mapping(own, path) == 0);
+    snprintf(path, sizeof(path), "%s/home/.app.json=tmpfs:64k", g_root);
+    CHECK("tmpfs target accepted", rmp_plan_add_mapping(own, path) == 0);
+    snprintf(path, sizeof(path), "%s/home/.other=/", g_root);
+    CHECK("root as own target rejected", rmp_plan_add_mapping(own, path) == -RMP_ERR_INVAL);
+    snprintf(path, sizeof(path), "%s/home/.other=tmpfs:12q", g_root);
+    CHECK("bad tmpfs size rejected", rmp_plan_add_mapping(own, path) == -RMP_ERR_INVAL &&
+                                     strstr(rmp_last_error(), "tmpfs size"));
+    CHECK("both resolve", rmp_plan_resolve(own) == 2);
+    snprintf(path, sizeof(path), "%s/own-dir/.app", g_root);
+    CHECK("own target created", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+    snprintf(path, sizeof(path), "%s/own-target/.app.json", g_root);
+    CHECK("nothing on disk for the tmpfs match", stat(path, &sb) != 0);
+
+    write_file("own-dir/.app/f", "own");
+    snprintf(cmd, sizeof(cmd), "[ \"$(cat '%s/home/.app/f')\" = own ] && "
+             "[ ! -s '%s/home/.app.json' ] && echo ram > '%s/home/.app.json' && "
+             "! dd if=/dev/zero of='%s/home/.app.json' bs=1k count=128 2>/dev/null",
+             g_root, g_root, g_root, g_root);
+    pidfd = rmp_spawn(own, sh_argv, NULL, NULL);
+    CHECK("own target and capped tmpfs seen", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    CHECK("tmpfs writes not kept", file_is("home/.app.json", "original-json"));
+    rmp_plan_free(own);
+
+    // Only the last '=' before '/' or "tmpfs:" starts a target
+    snprintf(path, sizeof(path), "%s/home/a=b", g_root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/home/a=b/.eq", g_root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/eq-target", g_root);
+    rmp_plan_t *eqp = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/a=b/.eq*", g_root);
+    CHECK("'=' in the path kept", rmp_plan_add_mapping(eqp, path) == 0 &&
+                                  rmp_plan_resolve(eqp) == 1);
+    snprintf(path, sizeof(path), "%s/eq-target/.eq", g_root);
+    CHECK("its match under the plan's target", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+    rmp_plan_free(eqp);
+    snprintf(path, sizeof(path), "%s/eq-target", g_root);
+    eqp = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/a=b/.eq*=rel=%s/eq-own", g_root, g_root);
+    CHECK("split at the last '=' before a target", rmp_plan_add_mapping(eqp, path) == 0 &&
+                                                 rmp_plan_resolve(eqp) == 0);
+    rmp_plan_free(eqp);
+    snprintf(path, sizeof(path), "%s/eq-target", g_root);
+    eqp = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/a=b/.eq*=%s/eq-own", g_root, g_root);
+    CHECK("'=' in the path with its own target",
+          rmp_plan_add_mapping(eqp, path) == 0 && rmp_plan_resolve(eqp) == 1);
+    snprintf(path, sizeof(path), "%s/eq-own/.eq", g_root);
+    CHECK("its match under its own target", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode));
+    rmp_plan_free(eqp);
+
+    printf("--- staged ---\n");
+    snprintf(path, sizeof(path), "%s/stage-target", g_root);
+    rmp_plan_t *staged = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app*", g_root);
+    rmp_plan_add_mapping(staged, path);
+    CHECK("bad staging size rejected", rmp_plan_set_stage(staged, "lots") == -RMP_ERR_INVAL);
+    CHECK("staging size accepted", rmp_plan_set_stage(staged, "4m") == 0);
+    CHECK("staged plan resolves", rmp_plan_resolve(staged) == 2);
+    write_file("stage-target/.app/f", "before");
+    CHECK("staged plan can't be spawned",
+          rmp_spawn(staged, true_argv, NULL, NULL) == -RMP_ERR_INVAL);
+    CHECK("unstaged plan can't be synced", rmp_plan_sync(plan, NULL) == -RMP_ERR_INVAL);
+
+    // Enter in a child, which stays in the namespace to write back
+    pid = fork();
+    if (pid == 0) {
+        if (rmp_plan_enter(staged) != 0) _exit(1);
+        write_file("home/.app/f", "after");
+        if (!file_is("home/.app/f", "after")) _exit(2);
+        if (!file_is("stage-target/.app/f", "before")) _exit(3);
+        rmp_sync_stats_t st = {0, 0, 0, 0, 0};
+        if (rmp_plan_sync(staged, &st) != 0 || st.files != 1 || st.bytes != 5) _exit(4);
+        _exit(file_is("stage-target/.app/f", "after") ? 0 : 5);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    CHECK("writes stay on the tmpfs until synced, then land",
+          WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK("written back to the target", file_is("stage-target/.app/f", "after"));
+    CHECK("original untouched", file_is("home/.app/f", "original"));
+    rmp_plan_free(staged);
+
+    printf("--- watched ---\n");
+    snprintf(path, sizeof(path), "%s/watch-target", g_root);
+    rmp_plan_t *watched = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.new*", g_root);
+    rmp_plan_add_mapping(watched, path);
+    int wfd = rmp_plan_watch(watched);
+    CHECK("watch gives an fd", wfd >= 0);
+    CHECK("nothing to mount yet", rmp_plan_resolve(watched) == 0);
+    CHECK("watched plan can't be spawned",
+          rmp_spawn(watched, true_argv, NULL, NULL) == -RMP_ERR_INVAL);
+
+    pid = fork();
+    if (pid == 0) {
+        if (rmp_plan_enter(watched) != 0) _exit(1);
+        snprintf(path, sizeof(path), "%s/home/.newdir", g_root);
+        mkdir(path, 0755);
+        write_file("home/.newdir/f", "made");
+        write_file("home/.other", "not a match");
+        struct pollfd pfd = { wfd, POLLIN, 0 };
+        if (poll(&pfd, 1, 5000) != 1) _exit(2);
+        if (rmp_plan_watch_handle(watched) != 1) _exit(3);
+        if (rmp_plan_watch_handle(watched) != 0) _exit(4);
+        // The program still sees its dir, now kept in the target
+        write_file("home/.newdir/g", "later");
+        if (!file_is("home/.newdir/f", "made")) _exit(5);
+        _exit(file_is("watch-target/.newdir/g", "later") ? 0 : 6);
+    }
+    status = -1;
+    waitpid(pid, &status, 0);
+    CHECK("new match moved into the target and mounted back",
+          WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK("kept in the target", file_is("watch-target/.newdir/f", "made") &&
+          file_is("watch-target/.newdir/g", "later"));
+    snprintf(path, sizeof(path), "%s/home/.newdir", g_root);
+    CHECK("empty stand-in left behind", stat(path, &sb) == 0 && S_ISDIR(sb.st_mode) &&
+          !file_is("home/.newdir/f", "made"));
+    CHECK("non-matching names left alone", file_is("home/.other", "not a match"));
+    rmp_plan_free(watched);
+
+    printf("--- rewrite ---\n");
+    char out[PATH_MAX], want[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/home/.app/sub/x", g_root);
+    snprintf(want, sizeof(want), "%s/target/.app/sub/x", g_root);
+    CHECK("path below a match rewritten",
+          rmp_plan_rewrite(plan, path, out, sizeof(out)) == 1 && strcmp(out, want) == 0);
+    snprintf(path, sizeof(path), "%s/home/.apple", g_root);
+    snprintf(want, sizeof(want), "%s/target/.apple", g_root);
+    CHECK("names that don't exist yet rewritten too",
+          rmp_plan_rewrite(plan, path, out, sizeof(out)) == 1 && strcmp(out, want) == 0);
+    snprintf(path, sizeof(path), "%s/home/.other", g_root);
+    CHECK("non-matching name left alone", rmp_plan_rewrite(plan, path, out, sizeof(out)) == 0);
+    snprintf(path, sizeof(path), "%s/home", g_root);
+    CHECK("parent itself left alone", rmp_plan_rewrite(plan, path, out, sizeof(out)) == 0);
+
+    snprintf(path, sizeof(path), "%s/target", g_root);
+    rmp_plan_t *nested = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app*", g_root);
+    rmp_plan_add_mapping(nested, path);
+    snprintf(path, sizeof(path), "%s/home/.app/sub*=%s/inner", g_root, g_root);
+    rmp_plan_add_mapping(nested, path);
+    snprintf(path, sizeof(path), "%s/home/.app/sub/x", g_root);
+    snprintf(want, sizeof(want), "%s/inner/sub/x", g_root);
+    CHECK("deepest mapping wins",
+          rmp_plan_rewrite(nested, path, out, sizeof(out)) == 1 && strcmp(out, want) == 0);
+    rmp_plan_free(nested);
+
+    printf("--- seccomp ---\n");
+    snprintf(path, sizeof(path), "%s/sc-target", g_root);
+    rmp_plan_t *sc = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.sc*", g_root);
+    rmp_plan_add_mapping(sc, path);
+    CHECK("nothing exists to mount", rmp_plan_resolve(sc) == 0);
+    snprintf(g_check_cmd, sizeof(g_check_cmd),
+             "cd '%s/home' && mkdir .scdir && echo made > .scdir/f && "
+             "mv .scdir/f .scdir/g && test \"$(cat .scdir/../.scdir/g)\" = made", g_root);
+    char *sc_argv[] = { "sh", "-c", g_check_cmd, NULL };
+    int listener = -1;
+    pid = rmp_seccomp_spawn(sc, sc_argv, NULL, &listener);
+    CHECK("seccomp spawn", pid > 0 && listener >= 0);
+    rmp_seccomp_stats_t sst = {0, 0};
+    while (pid > 0) {
+        struct pollfd pfd = { listener, POLLIN, 0 };
+        if (poll(&pfd, 1, 10000) <= 0 || !(pfd.revents & POLLIN)) break;
+        rmp_seccomp_handle(sc, listener, &sst);
+    }
+    if (listener >= 0) close(listener);
+    status = -1;
+    if (pid > 0) waitpid(pid, &status, 0);
+    CHECK("program saw its new dir", WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CHECK("calls trapped and some redirected", sst.trapped > sst.rewritten && sst.rewritten > 0);
+    CHECK("created in the target", file_is("sc-target/.scdir/g", "made\n"));
+    snprintf(path, sizeof(path), "%s/home/.scdir", g_root);
+    CHECK("nothing created in place", access(path, F_OK) != 0);
+    rmp_plan_free(sc);
+
+    snprintf(path, sizeof(path), "%s/sc-target", g_root);
+    sc = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.sc*=tmpfs:1m", g_root);
+    rmp_plan_add_mapping(sc, path);
+    errno = 0;
+    CHECK("tmpfs mappings refused",
+          rmp_seccomp_spawn(sc, true_argv, NULL, &listener) == -1 && errno == EINVAL);
+    rmp_plan_free(sc);
+
+    printf("--- coalescing ---\n");
+    snprintf(path, sizeof(path), "%s/co-target", g_root);
+    rmp_plan_t *co = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app*", g_root);
+    rmp_plan_add_mapping(co, path);
+    snprintf(path, sizeof(path), "%s/home/.app/sub*=%s/co-target/.app", g_root, g_root);
+    rmp_plan_add_mapping(co, path);
+    CHECK("nested mapping into the same place dropped", rmp_plan_resolve(co) == 2);
+    rmp_plan_free(co);
+
+    snprintf(path, sizeof(path), "%s/co-target", g_root);
+    co = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/.app/sub*=%s/co-elsewhere", g_root, g_root);
+    rmp_plan_add_mapping(co, path);
+    snprintf(path, sizeof(path), "%s/home/.app*", g_root);
+    rmp_plan_add_mapping(co, path);
+    CHECK("nested mapping mounted over dropped", rmp_plan_resolve(co) == 2);
+    rmp_plan_free(co);
+
+    snprintf(path, sizeof(path), "%s/home/cfg/c", g_root);
+    rmp_mkdirs(path, 0755);
+    write_file("home/cfg/a", "original");
+    write_file("home/cfg/b", "original");
+    snprintf(path, sizeof(path), "%s/co-target", g_root);
+    co = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/cfg/*=%s/cfgt", g_root, g_root);
+    rmp_plan_add_mapping(co, path);
+    CHECK("whole directory merged into one mount", rmp_plan_resolve(co) == 1);
+    write_file("cfgt/a", "merged");
+    snprintf(cmd, sizeof(cmd), "[ \"$(cat '%s/home/cfg/a')\" = merged ] && "
+             "[ -d '%s/home/cfg/c' ] && echo x > '%s/home/cfg/new'", g_root, g_root, g_root);
+    pidfd = rmp_spawn(co, sh_argv, NULL, NULL);
+    CHECK("merged directory seen", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    CHECK("new entries land in the target", file_is("cfgt/new", "x\n"));
+    CHECK("original untouched", file_is("home/cfg/a", "original"));
+    CHECK("not merged once the target holds more", rmp_plan_resolve(co) == 3);
+    rmp_plan_free(co);
+
+    printf("--- deep globs ---\n");
+    snprintf(path, sizeof(path), "%s/home/src/p1/.tc", g_root);
+    rmp_mkdirs(path, 0755);
+    snprintf(path, sizeof(path), "%s/home/src/p2/.tc", g_root);
+    rmp_mkdirs(path, 0755);
+    snprintf(path, sizeof(path), "%s/home/src/p3", g_root);
+    rmp_mkdirs(path, 0755);
+    snprintf(path, sizeof(path), "%s/deep-target", g_root);
+    rmp_plan_t *deep = rmp_plan_new(path);
+    snprintf(path, sizeof(path), "%s/home/src/*/.tc", g_root);
+    CHECK("mid-path glob accepted", rmp_plan_add_mapping(deep, path) == 0);
+    CHECK("a match per project", rmp_plan_resolve(deep) == 2);
+    snprintf(cmd, sizeof(cmd), "echo x > '%s/home/src/p2/.tc/f'", g_root);
+    pidfd = rmp_spawn(deep, sh_argv, NULL, NULL);
+    CHECK("spawned", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    CHECK("lands in the target under the project", file_is("deep-target/p2/.tc/f", "x\n"));
+    snprintf(path, sizeof(path), "%s/home/src/p3/.tc/y", g_root);
+    snprintf(want, sizeof(want), "%s/deep-target/p3/.tc/y", g_root);
+    CHECK("rewritten through the whole glob",
+          rmp_plan_rewrite(deep, path, out, sizeof(out)) == 1 && strcmp(out, want) == 0);
+    snprintf(path, sizeof(path), "%s/home/src/p3/.td", g_root);
+    CHECK("not when a later component differs",
+          rmp_plan_rewrite(deep, path, out, sizeof(out)) == 0);
+    rmp_plan_free(deep);
+
+    printf("--- shared user namespace ---\n");
+    int before = rmp_userns_count();
+    snprintf(path, sizeof(path), "%s/keeper", g_root);
+    int nsfd = rmp_userns_open(path, 0);
+    CHECK("keeper started", nsfd >= 0);
+    int nsfd2 = rmp_userns_open(path, 0);
+    struct stat ns1, ns2;
+    CHECK("joined again, not restarted", nsfd2 >= 0 && fstat(nsfd, &ns1) == 0 &&
+          fstat(nsfd2, &ns2) == 0 && ns1.st_ino == ns2.st_ino);
+    if (nsfd2 >= 0) close(nsfd2);
+    rmp_plan_set_userns(plan, nsfd);
+    snprintf(cmd, sizeof(cmd), "[ \"$(stat -Lc %%i /proc/self/ns/user)\" = %lu ] && "
+             "[ \"$(id -u)\" = 0 ] && [ -e '%s/home/.app/new' ]",
+             (unsigned long)ns1.st_ino, g_root);
+    pidfd = rmp_spawn(plan, sh_argv, NULL, NULL);
+    CHECK("spawned into it, mapped, as root", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    rmp_plan_t *shared = rmp_plan_clone(plan, target);
+    pidfd = shared ? rmp_spawn(shared, sh_argv, NULL, NULL) : -1;
+    CHECK("clones share it", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    rmp_plan_free(shared);
+    CHECK("counted once", before >= 0 && rmp_userns_count() == before + 1);
+    rmp_plan_set_userns(plan, -1);
+    close(nsfd);
+    char line[64] = "";
+    int kfd = open(path, O_RDONLY);
+    if (kfd >= 0 && read(kfd, line, sizeof(line) - 1) < 0) line[0] = '\0';
+    if (kfd >= 0) close(kfd);
+    pid_t keeper = (pid_t)atol(line);
+    CHECK("keeper recorded", keeper > 0 && kill(keeper, SIGTERM) == 0);
+    // Gone, or a zombie if nothing reaps it here
+    snprintf(want, sizeof(want), "/proc/%d/stat", (int)keeper);
+    for (int i = 0; i < 100; i++) {
+        FILE *fp = fopen(want, "r");
+        char state = 'Z';
+        if (fp && fscanf(fp, "%*d (%*[^)]) %c", &state) != 1) state = 'Z';
+        if (fp) fclose(fp);
+        if (state == 'Z') break;
+        usleep(10000);
+    }
+    nsfd = rmp_userns_open(path, 0);
+    if (nsfd >= 0) close(nsfd);
+    kfd = open(path, O_RDONLY);
+    memset(line, 0, sizeof(line));
+    if (kfd >= 0 && read(kfd, line, sizeof(line) - 1) < 0) line[0] = '\0';
+    if (kfd >= 0) close(kfd);
+    CHECK("a new keeper replaces a dead one", nsfd >= 0 && atol(line) > 0 &&
+          atol(line) != (long)keeper);
+    if (atol(line) > 0) kill((pid_t)atol(line), SIGTERM);
+
+    printf("--- cgroups ---\n");
+    rmp_cgroup_limits_t lim;
+    CHECK("limits parsed", rmp_cgroup_parse("cpu=250%,memory=64m,io=50,cpus=0", &lim) == 0 &&
+          lim.cpu_quota == 250000 && lim.memory_high == 64 << 20 && lim.io_weight == 50 &&
+          strcmp(lim.cpus, "0") == 0);
+    CHECK("none is fine", rmp_cgroup_parse("", &lim) == 0 && !lim.cpu_quota && !lim.cpus[0]);
+    CHECK("unknown limit refused", rmp_cgroup_parse("swap=1g", &lim) < 0 && errno == EINVAL);
+    CHECK("cpu needs a percentage", rmp_cgroup_parse("cpu=50", &lim) < 0);
+    CHECK("io weight range", rmp_cgroup_parse("io=0", &lim) < 0 &&
+          rmp_cgroup_parse("io=10001", &lim) < 0);
+    CHECK("cpus is a list", rmp_cgroup_parse("cpus=0;rm", &lim) < 0);
+    // Whether ours is delegated depends on where this runs: either way
+    // open() must say why, and if it is, an instance must land there
+    rmp_cgroup_parse("memory=256m", &lim);
+    char why[PATH_MAX + 64] = "";
+    int controllers;
+    int base = rmp_cgroup_open(&lim, &controllers, why, sizeof(why));
+    CHECK("open says where, or why not", why[0] && (base >= 0 || errno == ENOENT ||
+                                                    errno == EACCES));
+    if (base >= 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "rmp-test-%d", (int)getpid());
+        int cg = rmp_cgroup_create(base, name, &lim, controllers);
+        CHECK("instance cgroup created", cg >= 0);
+        rmp_plan_set_cgroup(plan, cg);
+        snprintf(cmd, sizeof(cmd), "grep -qx '0::.*/%s' /proc/self/cgroup", name);
+        pidfd = rmp_spawn(plan, sh_argv, NULL, NULL);
+        CHECK("spawned into it", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+        rmp_plan_set_cgroup(plan, -1);
+        long long psi[RMP_PSI_COUNT][2];
+        rmp_cgroup_pressure(cg, psi);
+        CHECK("pressure read where the kernel has it", psi[RMP_PSI_CPU][0] >= -1 &&
+              (psi[RMP_PSI_CPU][0] < 0 || psi[RMP_PSI_CPU][1] >= 0));
+        close(cg);
+        CHECK("removed once empty", rmp_cgroup_remove(base, name) == 0);
+        close(base);
+    } else {
+        printf("  (no delegated cgroup: %s)\n", why);
+    }
+
+    printf("--- no matches ---\n");
+    rmp_plan_t *empty = rmp_plan_new(target);
+    snprintf(path, sizeof(path), "%s/home/.nothing*", g_root);
+    rmp_plan_add_mapping(empty, path);
+    CHECK("resolves to no mounts", rmp_plan_resolve(empty) == 0);
+    pidfd = rmp_spawn(empty, true_argv, NULL, NULL);
+    CHECK("still spawns, unmapped", pidfd >= 0 && wait_pidfd(pidfd) == 0);
+    rmp_plan_free(empty);
+
+    rmp_plan_free(plan);
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -351,6 +351,819 @@ else
     fail "program runs even with no matches (got '$RESULT')"
 fi
 
+###############################################################################
+# Group 11: Cache garbage collection (unit)
+#   rmp_cache_gc() against a fixture cache tree: stale entries, temp files,
+#   LRU eviction to a size cap, and open copies surviving eviction
+###############################################################################
+echo "=== Group 11: Cache garbage collection ==="
+if "$BUILD/test_cache_gc" > "$TESTHOME/cache_gc.out" 2>&1; then
+    pass "rmp_cache_gc fixture tests"
+else
+    cat "$TESTHOME/cache_gc.out"
+    fail "rmp_cache_gc fixture tests"
+fi
+
+###############################################################################
+# Group 12: Background pre-signing scheduler (unit)
+#   Dedupe, bounded concurrency, single-flight hand-off to a spawn, and
+#   sibling discovery in a fixture .app bundle
+###############################################################################
+echo "=== Group 12: Background pre-signing ==="
+if "$BUILD/test_presign" > "$TESTHOME/presign.out" 2>&1; then
+    pass "rmp_presign scheduler tests"
+else
+    cat "$TESTHOME/presign.out"
+    fail "rmp_presign scheduler tests"
+fi
+
+###############################################################################
+# Group 13: Cache prewarm (unit)
+#   rmp_prewarm() over a fixture bundle with a stub signer: Mach-O
+#   classification, parallel builds, warm re-runs, signer failures
+###############################################################################
+echo "=== Group 13: Cache prewarm ==="
+if "$BUILD/test_prewarm" > "$TESTHOME/prewarm.out" 2>&1; then
+    pass "rmp_prewarm fixture tests"
+else
+    cat "$TESTHOME/prewarm.out"
+    fail "rmp_prewarm fixture tests"
+fi
+
+###############################################################################
+# Group 14: File clone primitive (unit)
+#   rmp_clone_file() through reflink, copy_file_range/sendfile and the
+#   buffered fallback: data, mode, timestamps and xattrs preserved
+###############################################################################
+echo "=== Group 14: File clone primitive ==="
+if "$BUILD/test_clone" > "$TESTHOME/clone.out" 2>&1; then
+    pass "rmp_clone_file tests"
+else
+    cat "$TESTHOME/clone.out"
+    fail "rmp_clone_file tests"
+fi
+
+###############################################################################
+# Group 15: Subprocess pipes (unit)
+#   rmp_pipe_open(): output capture, exit status, exec failure, and
+#   concurrent spawns from a multithreaded process
+###############################################################################
+echo "=== Group 15: Subprocess pipes ==="
+if "$BUILD/test_pipe" > "$TESTHOME/pipe.out" 2>&1; then
+    pass "rmp_pipe_open tests"
+else
+    cat "$TESTHOME/pipe.out"
+    fail "rmp_pipe_open tests"
+fi
+
+###############################################################################
+# Group 16: Zygote daemon (--serve / --connect)
+#   Launches through a daemon see the same remapping as cold launches, and
+#   get the caller's stdio, cwd, env and exit status; the zygote is reused
+###############################################################################
+echo "=== Group 16: Zygote daemon ==="
+TARGET16=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET16")
+SOCK16="$TARGET16/serve.sock"
+
+mkdir -p "$HOME/.dummy-serve" "$TARGET16/.dummy-serve"
+echo "serve-original" > "$HOME/.dummy-serve/file.txt"
+echo "serve-remapped" > "$TARGET16/.dummy-serve/file.txt"
+
+"$REMAPPER" --serve "$SOCK16" --debug-log "$TARGET16/serve.log" &
+SERVE_PID=$!
+for _ in $(seq 50); do [ -S "$SOCK16" ] && break; sleep 0.1; done
+
+RESULT=$("$REMAPPER" --connect "$SOCK16" "$TARGET16" "$HOME/.dummy-serve*" -- \
+    cat "$HOME/.dummy-serve/file.txt" 2>&1 || true)
+if [ "$RESULT" = "serve-remapped" ]; then
+    pass "launch via daemon sees remapped content"
+else
+    fail "launch via daemon sees remapped content (got '$RESULT')"
+fi
+
+set +e
+(cd "$TARGET16" && SERVE_VAR=from-client "$REMAPPER" --connect "$SOCK16" \
+    "$TARGET16" "$HOME/.dummy-serve*" -- \
+    sh -c 'echo "$PWD $SERVE_VAR" > out.txt; exit 7')
+RC=$?
+set -e
+if [ "$RC" -eq 7 ]; then
+    pass "exit status propagated"
+else
+    fail "exit status propagated (got $RC)"
+fi
+assert_file_content "$TARGET16/out.txt" "$TARGET16 from-client" \
+    "cwd and environment propagated"
+
+RESULT=$(echo "from-stdin" | "$REMAPPER" --connect "$SOCK16" "$TARGET16" \
+    "$HOME/.dummy-serve*" -- cat)
+if [ "$RESULT" = "from-stdin" ]; then
+    pass "stdin passed through"
+else
+    fail "stdin passed through (got '$RESULT')"
+fi
+
+if [ "$(grep -c "ready for" "$TARGET16/serve.log")" -eq 1 ]; then
+    pass "one zygote serves all launches of a profile"
+else
+    cat "$TARGET16/serve.log"
+    fail "one zygote serves all launches of a profile"
+fi
+
+kill "$SERVE_PID"
+wait "$SERVE_PID" 2>/dev/null || true
+if [ ! -e "$SOCK16" ]; then
+    pass "socket removed on shutdown"
+else
+    fail "socket removed on shutdown"
+fi
+
+# Past the TTL the old zygote keeps serving until its replacement is ready
+"$REMAPPER" --serve "$SOCK16" --zygote-ttl 1 --debug-log "$TARGET16/ttl.log" &
+SERVE_PID=$!
+for _ in $(seq 50); do [ -S "$SOCK16" ] && break; sleep 0.1; done
+TTL_OK=1
+for _ in $(seq 8); do
+    RESULT=$("$REMAPPER" --connect "$SOCK16" "$TARGET16" "$HOME/.dummy-serve*" -- \
+        cat "$HOME/.dummy-serve/file.txt" 2>&1 || true)
+    [ "$RESULT" = "serve-remapped" ] || TTL_OK=0
+    sleep 0.4
+done
+kill "$SERVE_PID"
+wait "$SERVE_PID" 2>/dev/null || true
+if [ "$TTL_OK" -eq 1 ] && [ "$(grep -c "ready for" "$TARGET16/ttl.log")" -ge 2 ] &&
+   awk '/ready for/ { ready++ } /retired zygote/ && ready < 2 { bad = 1 }
+        END { exit bad }' "$TARGET16/ttl.log"; then
+    pass "zygote rebuilt in the background, launches served throughout"
+else
+    cat "$TARGET16/ttl.log"
+    fail "zygote rebuilt in the background, launches served throughout"
+fi
+
+###############################################################################
+# Group 17: librmp launcher library (unit)
+#   Plans built and spawned in-process: remapped reads, pidfd exit status,
+#   envp, error codes instead of exits, concurrent spawns from one plan
+###############################################################################
+echo "=== Group 17: librmp ==="
+if "$BUILD/test_launch" > "$TESTHOME/launch.out" 2>&1; then
+    pass "librmp plan/spawn tests"
+else
+    cat "$TESTHOME/launch.out"
+    fail "librmp plan/spawn tests"
+fi
+
+###############################################################################
+# Group 18: Batch launch (--batch)
+#   Instances sharing mappings are scanned once, each runs in its own target,
+#   and every one gets a JSON line with its exit status
+###############################################################################
+echo "=== Group 18: Batch launch ==="
+TARGET18=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET18")
+
+mkdir -p "$HOME/.dummy-batch"
+echo "batch-original" > "$HOME/.dummy-batch/file.txt"
+
+cat > "$TARGET18/manifest" <<EOF
+# three instances, one mapping set
+$TARGET18/a '$HOME/.dummy-batch*' -- sh -c 'echo a > "$HOME/.dummy-batch/file.txt"'
+$TARGET18/b '$HOME/.dummy-batch*' -- sh -c 'echo b > "$HOME/.dummy-batch/file.txt"'
+$TARGET18/c '$HOME/.dummy-batch*' -- sh -c "exit 5"
+EOF
+
+set +e
+"$REMAPPER" --batch "$TARGET18/manifest" --jobs 2 --report "$TARGET18/report.jsonl" \
+    --debug-log "$TARGET18/batch.log"
+RC=$?
+set -e
+if [ "$RC" -eq 1 ]; then
+    pass "failing instance fails the batch"
+else
+    fail "failing instance fails the batch (got $RC)"
+fi
+
+if [ "$(grep -c '"exit":0' "$TARGET18/report.jsonl")" -eq 2 ] &&
+   grep -q "\"target\":\"$TARGET18/c\".*\"exit\":5" "$TARGET18/report.jsonl"; then
+    pass "one JSON line per instance with its exit status"
+else
+    cat "$TARGET18/report.jsonl"
+    fail "one JSON line per instance with its exit status"
+fi
+
+assert_file_content "$TARGET18/a/.dummy-batch/file.txt" "a" "first instance wrote its own target"
+assert_file_content "$TARGET18/b/.dummy-batch/file.txt" "b" "second instance wrote its own target"
+assert_file_content "$HOME/.dummy-batch/file.txt" "batch-original" "original untouched by batch"
+
+if [ "$(grep -c "scanning" "$TARGET18/batch.log")" -eq 1 ]; then
+    pass "shared mappings scanned once"
+else
+    cat "$TARGET18/batch.log"
+    fail "shared mappings scanned once"
+fi
+
+# A malformed =<target> fails the batch before anything runs
+cat > "$TARGET18/bad-manifest" <<EOF
+$TARGET18/d '$HOME/.dummy-batch*' -- true
+$TARGET18/e '$HOME/.dummy-batch*=tmpfs:bogus' -- touch "$TARGET18/ran"
+EOF
+set +e
+ERR=$("$REMAPPER" --batch "$TARGET18/bad-manifest" 2>&1)
+RC=$?
+set -e
+if [ "$RC" -ne 0 ] && echo "$ERR" | grep -q "bad-manifest:2:" && [ ! -e "$TARGET18/ran" ]; then
+    pass "malformed manifest mapping rejected with its line"
+else
+    echo "$ERR"
+    fail "malformed manifest mapping rejected with its line (got $RC)"
+fi
+
+###############################################################################
+# Group 19: Profile files (--profile)
+#   Mappings come from a file, with or without more on the command line
+###############################################################################
+echo "=== Group 19: Profile files ==="
+TARGET19=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET19")
+
+mkdir -p "$HOME/.dummy-prof-dir" "$TARGET19/.dummy-prof-dir"
+echo "prof-original" > "$HOME/.dummy-prof-dir/file.txt"
+echo "prof-remapped" > "$TARGET19/.dummy-prof-dir/file.txt"
+echo "json-original" > "$HOME/.dummy-prof.json"
+echo "json-remapped" > "$TARGET19/.dummy-prof.json"
+
+cat > "$TARGET19/profile" <<EOF
+# remapper profile
+~/.dummy-prof-dir*
+
+$HOME/.dummy-prof.json
+EOF
+
+RESULT=$("$REMAPPER" --profile "$TARGET19/profile" "$TARGET19" \
+    sh -c "cat '$HOME/.dummy-prof-dir/file.txt' '$HOME/.dummy-prof.json'" 2>&1 || true)
+if [ "$RESULT" = "$(printf 'prof-remapped\njson-remapped')" ]; then
+    pass "mappings read from profile"
+else
+    fail "mappings read from profile (got '$RESULT')"
+fi
+
+echo "extra-original" > "$HOME/.dummy-prof-extra"
+echo "extra-remapped" > "$TARGET19/.dummy-prof-extra"
+RESULT=$("$REMAPPER" --profile="$TARGET19/profile" "$TARGET19" "$HOME/.dummy-prof-extra" -- \
+    cat "$HOME/.dummy-prof-extra" "$HOME/.dummy-prof.json" 2>&1 || true)
+if [ "$RESULT" = "$(printf 'extra-remapped\njson-remapped')" ]; then
+    pass "profile combined with command-line mappings"
+else
+    fail "profile combined with command-line mappings (got '$RESULT')"
+fi
+
+echo "relative/.x*" > "$TARGET19/bad-profile"
+if ! "$REMAPPER" --profile "$TARGET19/bad-profile" "$TARGET19" true 2> "$TARGET19/err" &&
+   grep -q "bad-profile:1:" "$TARGET19/err"; then
+    pass "bad profile line reported"
+else
+    fail "bad profile line reported ($(cat "$TARGET19/err"))"
+fi
+
+###############################################################################
+# Group 20: Per-mapping targets
+#   '<mapping>=<dir>' uses its own target dir; '<mapping>=tmpfs:<size>' a
+#   capped tmpfs that is private to the run and starts empty
+###############################################################################
+echo "=== Group 20: Per-mapping targets ==="
+TARGET20=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET20")
+
+mkdir -p "$HOME/.dummy-own" "$HOME/.dummy-ram"
+echo "own-original" > "$HOME/.dummy-own/file.txt"
+echo "ram-original" > "$HOME/.dummy-ram/file.txt"
+
+"$REMAPPER" "$TARGET20/shared" "$HOME/.dummy-own*=$TARGET20/fast" \
+    "$HOME/.dummy-ram*=tmpfs:1m" -- sh -c "
+    echo own > '$HOME/.dummy-own/file.txt'
+    [ -e '$HOME/.dummy-ram/file.txt' ] && echo leaked > '$TARGET20/ram-leak'
+    echo ram > '$HOME/.dummy-ram/file.txt'
+    dd if=/dev/zero of='$HOME/.dummy-ram/big' bs=1k count=2048 2>/dev/null ||
+        touch '$TARGET20/capped'" || true
+
+assert_file_content "$TARGET20/fast/.dummy-own/file.txt" "own" "mapping wrote its own target"
+assert_dir_not_exists "$TARGET20/shared/.dummy-own" "shared target not used for it"
+assert_file_not_exists "$TARGET20/ram-leak" "tmpfs target starts empty"
+assert_file_exists "$TARGET20/capped" "tmpfs size cap enforced"
+assert_file_content "$HOME/.dummy-ram/file.txt" "ram-original" "tmpfs writes stay in the namespace"
+assert_file_content "$HOME/.dummy-own/file.txt" "own-original" "originals untouched"
+
+if ! "$REMAPPER" "$TARGET20" "$HOME/.dummy-ram*=tmpfs:lots" -- true 2> "$TARGET20/err" &&
+   grep -q "bad tmpfs size" "$TARGET20/err"; then
+    pass "bad tmpfs size rejected"
+else
+    fail "bad tmpfs size rejected"
+fi
+
+# Only the last '=' before a target splits; "=./" is relative to the cwd
+mkdir -p "$HOME/.dummy-eq=x/.conf"
+(cd "$TARGET20" && "$REMAPPER" "$TARGET20/shared" "$HOME/.dummy-eq=x/.con*=./eq" -- \
+    sh -c "echo eq > '$HOME/.dummy-eq=x/.conf/file.txt'") || true
+assert_file_content "$TARGET20/eq/.conf/file.txt" "eq" "'=' in a mapping's path kept"
+
+###############################################################################
+# Group 21: Staged runs (--stage)
+#   rmp_sync_tree() unit tests, then a run on tmpfs copies: the disk target
+#   is untouched while the program runs and gets its changes (including
+#   deletions) when it exits; checkpoints write back mid-run
+###############################################################################
+echo "=== Group 21: Staged runs ==="
+if "$BUILD/test_sync" > "$TESTHOME/sync.out" 2>&1; then
+    pass "rmp_sync_tree tests"
+else
+    cat "$TESTHOME/sync.out"
+    fail "rmp_sync_tree tests"
+fi
+
+TARGET21=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET21")
+STATUS21=0
+mkdir -p "$HOME/.dummy-stage" "$TARGET21/.dummy-stage"
+echo "seeded" > "$TARGET21/.dummy-stage/keep.txt"
+echo "old" > "$TARGET21/.dummy-stage/gone.txt"
+
+"$REMAPPER" --stage=8m "$TARGET21" "$HOME/.dummy-stage*" -- sh -c "
+    [ \"\$(cat '$HOME/.dummy-stage/keep.txt')\" = seeded ] || exit 5
+    echo staged > '$HOME/.dummy-stage/keep.txt'
+    rm '$HOME/.dummy-stage/gone.txt'
+    [ \"\$(cat '$TARGET21/.dummy-stage/keep.txt')\" = seeded ] || exit 6
+    exit 7" 2> "$TARGET21/err" || STATUS21=$?
+
+if [ "$STATUS21" -eq 7 ]; then
+    pass "staged copy seeded, disk untouched while running, exit status kept"
+else
+    fail "staged run exited $STATUS21 (5 = not seeded, 6 = disk written early)"
+fi
+assert_file_content "$TARGET21/.dummy-stage/keep.txt" "staged" "changes written back on exit"
+assert_file_not_exists "$TARGET21/.dummy-stage/gone.txt" "deletions written back"
+if grep -q "stage: wrote back 1 file(s), 7 bytes, removed 1" "$TARGET21/err"; then
+    pass "write-back reported"
+else
+    cat "$TARGET21/err"
+    fail "write-back reported"
+fi
+
+"$REMAPPER" --stage --checkpoint 1 "$TARGET21" "$HOME/.dummy-stage*" -- sh -c "
+    echo mid > '$HOME/.dummy-stage/mid.txt'
+    sleep 2.5" 2> "$TARGET21/err" &
+sleep 1.7
+assert_file_content "$TARGET21/.dummy-stage/mid.txt" "mid" "checkpoint writes back mid-run"
+wait
+
+if ! "$REMAPPER" --stage=lots "$TARGET21" "$HOME/.dummy-stage*" -- true 2> "$TARGET21/err" &&
+   grep -q "bad staging tmpfs size" "$TARGET21/err"; then
+    pass "bad staging size rejected"
+else
+    fail "bad staging size rejected"
+fi
+
+###############################################################################
+# Group 22: Target snapshots (--snapshot / --reset)
+#   A saved target comes back after a run dirties it, on its own or ahead
+#   of a launch; remapper's own .rmp-* dirs are left alone
+###############################################################################
+echo "=== Group 22: Target snapshots ==="
+TARGET22=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET22")
+mkdir -p "$HOME/.dummy-snap"
+
+"$REMAPPER" "$TARGET22" "$HOME/.dummy-snap*" -- sh -c "
+    echo good > '$HOME/.dummy-snap/config'"
+if "$REMAPPER" --snapshot clean "$TARGET22" 2> "$TARGET22/err" &&
+   grep -q "snapshot 'clean'" "$TARGET22/err"; then
+    pass "snapshot saved"
+else
+    cat "$TARGET22/err"
+    fail "snapshot saved"
+fi
+
+"$REMAPPER" "$TARGET22" "$HOME/.dummy-snap*" -- sh -c "
+    echo bad > '$HOME/.dummy-snap/config'
+    echo junk > '$HOME/.dummy-snap/extra'"
+"$REMAPPER" --reset clean "$TARGET22" 2> "$TARGET22/err" || true
+assert_file_content "$TARGET22/.dummy-snap/config" "good" "reset restores changed files"
+assert_file_not_exists "$TARGET22/.dummy-snap/extra" "reset removes new files"
+assert_dir_exists "$TARGET22/.rmp-snapshots/clean" "snapshot kept after reset"
+
+echo bad > "$TARGET22/.dummy-snap/config"
+OUT22=$("$REMAPPER" --reset clean "$TARGET22" "$HOME/.dummy-snap*" -- \
+    cat "$HOME/.dummy-snap/config" 2> "$TESTHOME/reset.err" || true)
+if [ "$OUT22" = "good" ]; then
+    pass "reset before launch"
+else
+    cat "$TESTHOME/reset.err"
+    fail "reset before launch (got '$OUT22')"
+fi
+
+if ! "$REMAPPER" --reset missing "$TARGET22" 2> "$TARGET22/err" &&
+   grep -q "no snapshot 'missing'" "$TARGET22/err"; then
+    pass "missing snapshot reported"
+else
+    fail "missing snapshot reported"
+fi
+
+###############################################################################
+# Group 23: Hot-added matches (--watch)
+#   A match the program creates mid-run is moved into the target and
+#   mounted back, so the program keeps using it (even mid-write) and it
+#   persists there
+###############################################################################
+echo "=== Group 23: Hot-added matches ==="
+TARGET23=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET23")
+
+OUT23=$("$REMAPPER" --watch "$TARGET23" "$HOME/.dummy-hot*" -- sh -c "
+    mkdir '$HOME/.dummy-hot'
+    echo first > '$HOME/.dummy-hot/a'
+    sleep 0.5
+    echo second > '$HOME/.dummy-hot/b'
+    cat '$HOME/.dummy-hot/a'" 2>/dev/null || true)
+if [ "$OUT23" = "first" ]; then
+    pass "program keeps its new dir"
+else
+    fail "program keeps its new dir (got '$OUT23')"
+fi
+assert_file_content "$TARGET23/.dummy-hot/a" "first" "new match moved into the target"
+assert_file_content "$TARGET23/.dummy-hot/b" "second" "later writes land in the target"
+assert_file_not_exists "$HOME/.dummy-hot/a" "only a stand-in left in place"
+
+"$REMAPPER" "$TARGET23" "$HOME/.dummy-hot*" -- sh -c "
+    echo third > '$HOME/.dummy-hot/c'"
+assert_file_content "$TARGET23/.dummy-hot/c" "third" "next run maps it as usual"
+
+# Writing into a new match while it is hot-added: its path never goes
+# missing, and nothing written is lost
+OUT23=$("$REMAPPER" --watch "$TARGET23" "$HOME/.dummy-busy*" -- sh -c "
+    mkdir '$HOME/.dummy-busy' || exit 1
+    i=0
+    while [ \$i -lt 2000 ]; do
+        echo \$i > '$HOME/.dummy-busy/f'\$i || exit 1
+        [ \$((i % 100)) -eq 0 ] && sleep 0.01
+        i=\$((i + 1))
+    done
+    ls '$HOME/.dummy-busy' | wc -l" 2>&1 || echo "status $?")
+if [ "$OUT23" = "2000" ] && [ "$(ls "$TARGET23/.dummy-busy" | wc -l)" = "2000" ]; then
+    pass "writes into a match being hot-added all land in the target"
+else
+    fail "writes into a match being hot-added all land in the target (got '$OUT23')"
+fi
+
+if ! "$REMAPPER" --watch --stage "$TARGET23" "$HOME/.dummy-hot*" -- true 2>/dev/null &&
+   ! "$REMAPPER" --watch "$TARGET23" "$HOME/.dummy-t*=tmpfs:1m" -- true 2>/dev/null; then
+    pass "--watch refused with --stage and tmpfs mappings"
+else
+    fail "--watch refused with --stage and tmpfs mappings"
+fi
+
+###############################################################################
+# Group 24: seccomp backend (--backend=seccomp)
+#   Paths that don't exist at launch are redirected too; the program's
+#   exit status comes through
+###############################################################################
+echo "=== Group 24: seccomp backend ==="
+TARGET24=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET24")
+
+STATUS24=0
+OUT24=$("$REMAPPER" --backend=seccomp "$TARGET24" "$HOME/.dummy-sc*" -- sh -c "
+    mkdir '$HOME/.dummy-sc'
+    echo made > '$HOME/.dummy-sc/f'
+    cat '$HOME/.dummy-sc/f'
+    exit 5" 2>/dev/null) || STATUS24=$?
+if [ "$OUT24" = "made" ] && [ "$STATUS24" -eq 5 ]; then
+    pass "new dir usable and exit status passed on"
+else
+    fail "new dir usable and exit status passed on (got '$OUT24', status $STATUS24)"
+fi
+assert_file_content "$TARGET24/.dummy-sc/f" "made" "created in the target"
+assert_dir_not_exists "$HOME/.dummy-sc" "nothing created in place"
+
+# Created under the program's umask, not the supervisor's
+(umask 022; "$REMAPPER" --backend=seccomp "$TARGET24" "$HOME/.dummy-sc*" -- sh -c "
+    umask 077
+    mkdir '$HOME/.dummy-sc-private'
+    : > '$HOME/.dummy-sc-private/secret'" 2>/dev/null)
+if [ "$(stat -c %a "$TARGET24/.dummy-sc-private" 2>/dev/null)" = 700 ] &&
+   [ "$(stat -c %a "$TARGET24/.dummy-sc-private/secret" 2>/dev/null)" = 600 ]; then
+    pass "program's umask applied"
+else
+    ls -la "$TARGET24/.dummy-sc-private" 2>&1
+    fail "program's umask applied"
+fi
+
+OUT24=$("$REMAPPER" "$TARGET24" "$HOME/.dummy-sc*" -- cat "$HOME/.dummy-sc/f" 2>/dev/null || true)
+if [ "$OUT24" = "" ]; then
+    pass "mount backend sees nothing to map yet"
+else
+    fail "mount backend sees nothing to map yet (got '$OUT24')"
+fi
+
+if ! "$REMAPPER" --backend=bogus "$TARGET24" "$HOME/.dummy-sc*" -- true 2>/dev/null; then
+    pass "unknown backend rejected"
+else
+    fail "unknown backend rejected"
+fi
+
+###############################################################################
+# Group 25: Globs across components
+#   rmp_glob unit tests, then mappings with a wildcard above the last
+#   component and with '**', walked through a symlink loop
+###############################################################################
+echo "=== Group 25: Globs across components ==="
+if "$BUILD/test_glob" > "$TESTHOME/glob.out" 2>&1; then
+    pass "rmp_glob tests"
+else
+    cat "$TESTHOME/glob.out"
+    fail "rmp_glob tests"
+fi
+
+TARGET25=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET25")
+mkdir -p "$HOME/.dummy-src/a/.tool-cache" "$HOME/.dummy-src/b/.tool-cache" \
+         "$HOME/.dummy-src/c/x/y/.deep"
+ln -s .. "$HOME/.dummy-src/c/loop"
+mkdir -p "$TARGET25/c/x/y/.deep"
+echo "deep" > "$TARGET25/c/x/y/.deep/f"
+
+"$REMAPPER" "$TARGET25" "$HOME/.dummy-src/*/.tool-cache" -- sh -c "
+    echo a > '$HOME/.dummy-src/a/.tool-cache/f'
+    echo b > '$HOME/.dummy-src/b/.tool-cache/f'" 2>/dev/null || true
+assert_file_content "$TARGET25/a/.tool-cache/f" "a" "mid-path glob: first match redirected"
+assert_file_content "$TARGET25/b/.tool-cache/f" "b" "mid-path glob: second match redirected"
+if [ ! -e "$HOME/.dummy-src/a/.tool-cache/f" ]; then
+    pass "originals untouched"
+else
+    fail "originals untouched"
+fi
+
+OUT25=$(timeout 20 "$REMAPPER" "$TARGET25" "$HOME/.dummy-src/**/.deep" -- \
+        cat "$HOME/.dummy-src/c/x/y/.deep/f" 2>/dev/null || true)
+if [ "$OUT25" = "deep" ]; then
+    pass "'**' match redirected, past a symlink loop"
+else
+    fail "'**' match redirected, past a symlink loop (got '$OUT25')"
+fi
+rm -rf "$HOME/.dummy-src"
+
+###############################################################################
+# Group 26: Shared user namespace (--shared-userns)
+#   Two launches and a batch land in the one user namespace the keeper
+#   holds, each with its own mounts; the keeper is stopped afterwards
+###############################################################################
+echo "=== Group 26: Shared user namespace ==="
+TARGET26=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET26")
+KEEPER26="$TARGET26/keeper"
+mkdir -p "$HOME/.dummy-us"
+
+NS26A=$("$REMAPPER" --shared-userns="$KEEPER26" "$TARGET26/a" "$HOME/.dummy-us*" -- \
+        sh -c "echo a > '$HOME/.dummy-us/f'; id -u; readlink /proc/self/ns/user" 2>/dev/null || true)
+NS26B=$("$REMAPPER" --shared-userns="$KEEPER26" "$TARGET26/b" "$HOME/.dummy-us*" -- \
+        sh -c "echo b > '$HOME/.dummy-us/f'; id -u; readlink /proc/self/ns/user" 2>/dev/null || true)
+assert_file_content "$TARGET26/a/.dummy-us/f" "a" "first instance redirected"
+assert_file_content "$TARGET26/b/.dummy-us/f" "b" "second instance has its own mounts"
+if [ -n "$NS26A" ] && [ "$NS26A" = "$NS26B" ] && [ "$(echo "$NS26A" | head -1)" = "0" ]; then
+    pass "both in one user namespace, as root"
+else
+    fail "both in one user namespace, as root (got '$NS26A' and '$NS26B')"
+fi
+
+printf '%s %s -- readlink /proc/self/ns/user\n' \
+    "$TARGET26/c" "$HOME/.dummy-us*" "$TARGET26/d" "$HOME/.dummy-us*" > "$TARGET26/manifest"
+"$REMAPPER" --batch "$TARGET26/manifest" --shared-userns="$KEEPER26" \
+    > "$TARGET26/batch.out" 2>/dev/null || true
+if [ "$(sort -u "$TARGET26/batch.out" | grep -c '^user:')" = "1" ] && \
+   [ "$(echo "$NS26A" | tail -1)" = "$(grep -m1 '^user:' "$TARGET26/batch.out")" ]; then
+    pass "batch instances join the same namespace"
+else
+    fail "batch instances join the same namespace"
+fi
+kill "$(cut -d' ' -f1 "$KEEPER26")" 2>/dev/null || true
+rm -rf "$HOME/.dummy-us"
+
+###############################################################################
+# Group 27: Resource accounting (--stats)
+#   remapper stays behind as the parent and writes one JSON line: the
+#   exit status passes through, and target growth and I/O are counted
+###############################################################################
+echo "=== Group 27: Resource accounting ==="
+TARGET27=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET27")
+mkdir -p "$HOME/.dummy-st"
+echo "old" > "$HOME/.dummy-st/keep"
+
+STATUS27=0
+"$REMAPPER" --stats="$TARGET27/stats.json" "$TARGET27/t" "$HOME/.dummy-st*" -- sh -c "
+    head -c 5000 /dev/zero > '$HOME/.dummy-st/a'
+    head -c 3000 /dev/zero > '$HOME/.dummy-st/b'
+    exit 4" 2>/dev/null || STATUS27=$?
+STATS27=$(cat "$TARGET27/stats.json" 2>/dev/null || true)
+if [ "$STATUS27" -eq 4 ] && echo "$STATS27" | grep -q '"exit":4'; then
+    pass "exit status passed on and reported"
+else
+    fail "exit status passed on and reported (status $STATUS27, got '$STATS27')"
+fi
+if echo "$STATS27" | grep -q '"files":2,"files_delta":2,"bytes":8000,"bytes_delta":8000'; then
+    pass "target growth counted"
+else
+    fail "target growth counted (got '$STATS27')"
+fi
+if echo "$STATS27" | grep -q '"user_ms":' && echo "$STATS27" | grep -q '"max_rss_kb":'; then
+    pass "rusage reported"
+else
+    fail "rusage reported (got '$STATS27')"
+fi
+if [ "$(echo "$STATS27" | wc -l)" -eq 1 ]; then
+    pass "one JSON line"
+else
+    fail "one JSON line"
+fi
+rm -rf "$HOME/.dummy-st"
+
+###############################################################################
+# Group 28: A cgroup per instance (--cgroup)
+#   Where our cgroup is delegated the program runs in a child of it and
+#   its pressure totals are reported; where not, it runs all the same
+###############################################################################
+echo "=== Group 28: A cgroup per instance ==="
+TARGET28=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET28")
+mkdir -p "$HOME/.dummy-cg"
+
+STATUS28=0
+OUT28=$("$REMAPPER" --debug-log "$TARGET28/debug.log" --cgroup=memory=256m,io=100 \
+    "$TARGET28/t" "$HOME/.dummy-cg*" -- sh -c 'cat /proc/self/cgroup; exit 5' 2>/dev/null) \
+    || STATUS28=$?
+if [ "$STATUS28" -eq 5 ]; then
+    pass "runs, exit status passed on"
+else
+    fail "runs, exit status passed on (status $STATUS28)"
+fi
+if grep -q 'cgroup: skipped' "$TARGET28/debug.log"; then
+    pass "in its own cgroup (skipped: $(sed -n 's/.*cgroup: skipped: //p' "$TARGET28/debug.log"))"
+    SKIP28=1
+elif echo "$OUT28" | grep -q '^0::.*/rmp-[0-9]*-0$'; then
+    pass "in its own cgroup"
+    SKIP28=0
+else
+    fail "in its own cgroup (got '$OUT28')"
+    SKIP28=1
+fi
+if [ "$SKIP28" -eq 0 ] && ! grep -q 'left behind' "$TARGET28/debug.log"; then
+    pass "cgroup removed after"
+elif [ "$SKIP28" -eq 0 ]; then
+    fail "cgroup removed after"
+fi
+
+printf '%s\n' "$TARGET28/b1 $HOME/.dummy-cg* -- true" \
+              "$TARGET28/b2 $HOME/.dummy-cg* -- true" > "$TARGET28/manifest"
+BATCH28=$("$REMAPPER" --batch "$TARGET28/manifest" --cgroup 2>/dev/null || true)
+if [ "$(echo "$BATCH28" | grep -c '"exit":0')" -eq 2 ]; then
+    pass "batch instances run"
+else
+    fail "batch instances run (got '$BATCH28')"
+fi
+# Kernels without PSI (or booted with psi=0) have nothing to report
+if [ "$SKIP28" -eq 1 ] || ! grep -q 'cgroup: rmp-.*"psi":' "$TARGET28/debug.log" ||
+   [ "$(echo "$BATCH28" | grep -c '"psi":{"cpu":{"some_us":')" -eq 2 ]; then
+    pass "pressure reported with the launch timings"
+else
+    fail "pressure reported with the launch timings (got '$BATCH28')"
+fi
+rm -rf "$HOME/.dummy-cg"
+
+###############################################################################
+# Group 29: Access heatmap (--heatmap)
+#   rmp_heat unit tests, then a program's opens, reads, writes and creates
+#   under a mapping, counted per path, hottest first
+###############################################################################
+echo "=== Group 29: Access heatmap ==="
+if "$BUILD/test_heat" > "$TESTHOME/heat.out" 2>&1; then
+    pass "rmp_heat tests"
+else
+    cat "$TESTHOME/heat.out"
+    fail "rmp_heat tests"
+fi
+
+TARGET29=$(mktemp -d)
+CLEANUP_DIRS+=("$TARGET29")
+mkdir -p "$HOME/.dummy-heat"
+
+"$REMAPPER" --heatmap="$TARGET29/heat.txt" "$TARGET29/t" "$HOME/.dummy-heat*" -- sh -c '
+    echo a > "$HOME/.dummy-heat/hot"
+    for i in 1 2 3; do cat "$HOME/.dummy-heat/hot" > /dev/null; done
+    mkdir "$HOME/.dummy-heat/d"
+    echo b > "$HOME/.dummy-heat/d/cold"' 2>/dev/null
+if head -1 "$TARGET29/heat.txt" 2>/dev/null | grep -q '^# remapper heatmap: 3 path(s), '; then
+    pass "report written to the file"
+else
+    fail "report written to the file (got '$(head -1 "$TARGET29/heat.txt" 2>/dev/null)')"
+fi
+if grep -v '^#' "$TARGET29/heat.txt" | head -1 | grep -q "^ *4 *3 *1 *1  $HOME/.dummy-heat/hot\$"; then
+    pass "hottest path first, counted by kind"
+else
+    fail "hottest path first, counted by kind"
+fi
+if grep -q "^ *0 *0 *0 *1  $HOME/.dummy-heat/d\$" "$TARGET29/heat.txt" &&
+   grep -q "  $HOME/.dummy-heat/d/cold\$" "$TARGET29/heat.txt"; then
+    pass "new directories watched"
+else
+    fail "new directories watched"
+fi
+
+OUT29=$("$REMAPPER" --heatmap "$TARGET29/t" "$HOME/.dummy-heat*" -- \
+    cat "$HOME/.dummy-heat/hot" 2>&1 >/dev/null)
+if echo "$OUT29" | grep -q "^ *1 *1 *0 *0  $HOME/.dummy-heat/hot\$"; then
+    pass "report on stderr without a file"
+else
+    fail "report on stderr without a file (got '$OUT29')"
+fi
+rm -rf "$HOME/.dummy-heat"
+
+###############################################################################
+# Group 30: Path traces
+#   rmp_trace unit tests, then a sample trace replayed through the
+#   interposer's matcher (the traces themselves are recorded on macOS)
+###############################################################################
+echo "=== Group 30: Path traces ==="
+if "$BUILD/test_trace" "$TESTHOME/sample.trace" > "$TESTHOME/trace.out" 2>&1; then
+    pass "rmp_trace tests"
+else
+    cat "$TESTHOME/trace.out"
+    fail "rmp_trace tests"
+fi
+if OUT30=$("$BUILD/bench_rewrite" "$TESTHOME/sample.trace" 1 2>&1) &&
+   echo "$OUT30" | grep -q '^1000 paths, 2 pattern(s)' &&
+   echo "$OUT30" | grep -q '^try_rewrite .* 636 *63.6%'; then
+    pass "trace replayed through try_rewrite"
+else
+    fail "trace replayed through try_rewrite (got '$OUT30')"
+fi
+
+###############################################################################
+# Group 31: Launch cache
+#   rmp_execcache unit tests (the macOS launcher's fast path; the format
+#   and the checks are portable)
+###############################################################################
+echo "=== Group 31: Launch cache ==="
+if "$BUILD/test_execcache" > "$TESTHOME/execcache.out" 2>&1; then
+    pass "rmp_execcache tests"
+else
+    cat "$TESTHOME/execcache.out"
+    fail "rmp_execcache tests"
+fi
+
+###############################################################################
+# Group 32: Dirfd paths
+#   bench_fdpath: the interposer's fd table joins dirfd-relative paths the
+#   same as asking the kernel (1200 of 3200 calls land in the mapping)
+###############################################################################
+echo "=== Group 32: Dirfd paths ==="
+if "$BUILD/bench_fdpath" 1 3200 > "$TESTHOME/fdpath.out" 2>&1; then
+    pass "fd table and /proc/self/fd agree"
+else
+    cat "$TESTHOME/fdpath.out"
+    fail "fd table and /proc/self/fd agree"
+fi
+if grep -q '^fd table .* 1200 *37.5%' "$TESTHOME/fdpath.out"; then
+    pass "dirfd-relative paths under the mapping rewritten"
+else
+    cat "$TESTHOME/fdpath.out"
+    fail "dirfd-relative paths under the mapping rewritten"
+fi
+
+###############################################################################
+# Group 33: Union listings
+#   bench_dirlist: a directory a mapping sits in lists its own entries less
+#   the redirected ones, plus the target's; cached, afresh, and after a change
+###############################################################################
+echo "=== Group 33: Union listings ==="
+if "$BUILD/bench_dirlist" 1 50 20 > "$TESTHOME/dirlist.out" 2>&1; then
+    pass "cached listing matches the merged one"
+else
+    cat "$TESTHOME/dirlist.out"
+    fail "cached listing matches the merged one"
+fi
+if grep -q '^cached .* 24 ' "$TESTHOME/dirlist.out" &&
+   grep -q '^after a change: 25 entries$' "$TESTHOME/dirlist.out"; then
+    pass "redirected names hidden, target's shown, change picked up"
+else
+    cat "$TESTHOME/dirlist.out"
+    fail "redirected names hidden, target's shown, change picked up"
+fi
+if grep -q '^below the parent: 23 entries$' "$TESTHOME/dirlist.out"; then
+    pass "mapping with components below its parent merged"
+else
+    cat "$TESTHOME/dirlist.out"
+    fail "mapping with components below its parent merged"
+fi
+
 ###############################################################################
 # Summary
 ###############################################################################
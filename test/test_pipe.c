@@ -0,0 +1,82 @@
+/*
+ * test_pipe.c - exercise rmp_pipe_open()/rmp_pipe_close()
+ *
+ * Output capture (stdout and stderr on one pipe), exit status, exec
+ * failure, and concurrent spawns from several threads -- the situation
+ * inside the interposer, where the host application is multithreaded.
+ *
+ * Usage:
+ *   ./test_pipe
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+#define THREADS 4
+#define SPAWNS  25
+
+static void *spawn_loop(void *arg) {
+    long id = (long)arg, ok = 0;
+    for (int i = 0; i < SPAWNS; i++) {
+        char want[32], line[64] = "";
+        snprintf(want, sizeof(want), "t%ld-%d", id, i);
+        const char *argv[] = {"echo", want, NULL};
+        rmp_pipe_t p = rmp_pipe_open("/bin/echo", argv);
+        if (!p.fp) continue;
+        if (fgets(line, sizeof(line), p.fp)) line[strcspn(line, "\n")] = '\0';
+        if (rmp_pipe_close(&p) == 0 && strcmp(line, want) == 0) ok++;
+    }
+    return (void *)ok;
+}
+
+int main(void) {
+    printf("--- capture ---\n");
+    const char *argv[] = {"sh", "-c", "echo out; echo err >&2; exit 3", NULL};
+    rmp_pipe_t p = rmp_pipe_open("/bin/sh", argv);
+    CHECK("spawned", p.fp != NULL && p.pid > 0);
+    char buf[256] = "", line[64];
+    while (p.fp && fgets(line, sizeof(line), p.fp))
+        strncat(buf, line, sizeof(buf) - strlen(buf) - 1);
+    CHECK("stdout captured", strstr(buf, "out\n") != NULL);
+    CHECK("stderr captured", strstr(buf, "err\n") != NULL);
+    CHECK("exit status returned", rmp_pipe_close(&p) == 3);
+    CHECK("second close rejected", rmp_pipe_close(&p) == -1);
+
+    printf("--- exec failure ---\n");
+    const char *bad_argv[] = {"nope", NULL};
+    p = rmp_pipe_open("/nonexistent/bin/nope", bad_argv);
+    int err = errno;
+    CHECK("no pipe for a missing program", p.fp == NULL && p.pid == -1);
+    CHECK("errno reports why", err == ENOENT);
+    CHECK("close of failed spawn rejected", rmp_pipe_close(&p) == -1);
+
+    printf("--- concurrent spawns from %d threads ---\n", THREADS);
+    pthread_t th[THREADS];
+    for (long i = 0; i < THREADS; i++)
+        pthread_create(&th[i], NULL, spawn_loop, (void *)i);
+    long total = 0;
+    for (int i = 0; i < THREADS; i++) {
+        void *ok;
+        pthread_join(th[i], &ok);
+        total += (long)ok;
+    }
+    CHECK("every spawn saw only its own output", total == THREADS * SPAWNS);
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
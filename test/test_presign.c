@@ -0,0 +1,252 @@
+/*
+ * test_presign.c - exercise the background pre-sign scheduler
+ *
+ * The signing callback is a stub that sleeps and counts, so this runs
+ * anywhere.  Bundle discovery runs against a fixture Foo.app whose
+ * "binaries" are just Mach-O headers.
+ *
+ * Usage:
+ *   ./test_presign
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+#include "rmp_presign.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+/*** Stub signer ****/
+
+#define MAX_SEEN 64
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_seen[MAX_SEEN][PATH_MAX];
+static int  g_nseen, g_running, g_max_running;
+static useconds_t g_delay;
+
+static void stub_sign(void *arg, const char *path) {
+    (void)arg;
+    pthread_mutex_lock(&g_lock);
+    if (g_nseen < MAX_SEEN)
+        snprintf(g_seen[g_nseen++], PATH_MAX, "%s", path);
+    if (++g_running > g_max_running) g_max_running = g_running;
+    pthread_mutex_unlock(&g_lock);
+
+    usleep(g_delay);
+
+    pthread_mutex_lock(&g_lock);
+    g_running--;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void reset_stub(useconds_t delay) {
+    g_nseen = g_running = g_max_running = 0;
+    g_delay = delay;
+}
+
+static int times_signed(const char *path) {
+    int n = 0;
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < g_nseen; i++)
+        if (strcmp(g_seen[i], path) == 0) n++;
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+/*** Fixture bundle ****/
+
+static char g_root[512];
+
+// Write a minimal Mach-O: thin 64-bit little-endian, or a one-slice fat
+// wrapper (big-endian header) around the same.
+static void write_macho(const char *rel, uint32_t filetype, int fat, mode_t mode) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    *strrchr(dir, '/') = '\0';
+    rmp_mkdirs(dir, 0755);
+
+    uint32_t thin[8] = { 0xfeedfacfu, 0x0100000cu, 0, filetype, 0, 0, 0, 0 };
+    unsigned char buf[4096];
+    size_t len;
+    memset(buf, 0, sizeof(buf));
+    if (fat) {
+        uint32_t hdr[7] = { 0xcafebabeu, 1, 0x0100000cu, 0, 4096 - 64, 64, 12 };
+        for (int i = 0; i < 7; i++) hdr[i] = __builtin_bswap32(hdr[i]);
+        memcpy(buf, hdr, sizeof(hdr));
+        memcpy(buf + 4096 - 64, thin, sizeof(thin));
+        len = sizeof(buf);
+    } else {
+        memcpy(buf, thin, sizeof(thin));
+        len = sizeof(thin);
+    }
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len) { perror(path); exit(2); }
+    close(fd);
+}
+
+static void write_script(const char *rel) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    *strrchr(dir, '/') = '\0';
+    rmp_mkdirs(dir, 0755);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0755);
+    if (fd < 0 || write(fd, "#!/bin/sh\n", 10) != 10) { perror(path); exit(2); }
+    close(fd);
+}
+
+#define MAX_SIBS 16
+static char g_sibs[MAX_SIBS][PATH_MAX];
+static int  g_nsibs;
+
+static void collect(void *arg, const char *sibling) {
+    (void)arg;
+    if (g_nsibs < MAX_SIBS)
+        snprintf(g_sibs[g_nsibs++], PATH_MAX, "%s", sibling);
+}
+
+static int found_sib(const char *rel) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    for (int i = 0; i < g_nsibs; i++)
+        if (strcmp(g_sibs[i], path) == 0) return 1;
+    return 0;
+}
+
+int main(void) {
+    rmp_presign_t *ps;
+
+    printf("--- dedupe and bounded concurrency ---\n");
+    reset_stub(50 * 1000);
+    ps = rmp_presign_create(2, stub_sign, NULL);
+    CHECK("scheduler created", ps != NULL);
+    CHECK("first submit queued", rmp_presign_submit(ps, "/x/a") == 1);
+    CHECK("duplicate submit ignored", rmp_presign_submit(ps, "/x/a") == 0);
+    rmp_presign_submit(ps, "/x/b");
+    rmp_presign_submit(ps, "/x/c");
+    rmp_presign_submit(ps, "/x/d");
+    rmp_presign_submit(ps, "/x/e");
+    rmp_presign_drain(ps);
+    CHECK("five distinct paths signed", g_nseen == 5);
+    CHECK("each exactly once", times_signed("/x/a") == 1 && times_signed("/x/e") == 1);
+    CHECK("at most 2 running at once", g_max_running <= 2);
+    CHECK("resubmit after done ignored", rmp_presign_submit(ps, "/x/a") == 0);
+    rmp_presign_drain(ps);
+    CHECK("done path not signed again", times_signed("/x/a") == 1);
+    CHECK("wait on finished path returns 0", rmp_presign_wait(ps, "/x/b") == 0);
+    CHECK("wait on unknown path returns 0", rmp_presign_wait(ps, "/x/zz") == 0);
+    rmp_presign_destroy(ps);
+
+    printf("--- single flight: spawn arrives while signing ---\n");
+    reset_stub(300 * 1000);
+    ps = rmp_presign_create(1, stub_sign, NULL);
+    rmp_presign_submit(ps, "/x/slow");
+    usleep(100 * 1000);  // let the worker pick it up
+    CHECK("wait blocks on running item", rmp_presign_wait(ps, "/x/slow") == 1);
+    CHECK("result ready after wait", g_running == 0 && times_signed("/x/slow") == 1);
+    rmp_presign_destroy(ps);
+
+    printf("--- spawn claims a queued item ---\n");
+    reset_stub(300 * 1000);
+    ps = rmp_presign_create(1, stub_sign, NULL);
+    rmp_presign_submit(ps, "/x/slow");
+    rmp_presign_submit(ps, "/x/queued");  // behind /x/slow on one thread
+    usleep(50 * 1000);
+    CHECK("claim returns without waiting", rmp_presign_wait(ps, "/x/queued") == 0);
+    rmp_presign_drain(ps);
+    CHECK("claimed item skipped by background", times_signed("/x/queued") == 0);
+    CHECK("claimed item not requeued", rmp_presign_submit(ps, "/x/queued") == 0);
+    rmp_presign_destroy(ps);
+
+    printf("--- bundle discovery ---\n");
+    snprintf(g_root, sizeof(g_root), "%s/rmp-presign-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+
+    write_macho("Foo.app/Contents/MacOS/Foo", 2, 0, 0755);
+    write_macho("Foo.app/Contents/MacOS/crashpad", 2, 1, 0755);  // fat
+    write_script("Foo.app/Contents/MacOS/launcher.sh");
+    write_macho("Foo.app/Contents/MacOS/not-exec", 2, 0, 0644);
+    write_macho("Foo.app/Contents/Frameworks/Foo Helper.app/Contents/MacOS/Foo Helper",
+                2, 0, 0755);
+    write_macho("Foo.app/Contents/Frameworks/Foo.framework/Versions/A/Foo",
+                6, 0, 0755);  // dylib
+    write_macho("Foo.app/Contents/Frameworks/Foo.framework/Versions/A/Helpers/tool",
+                2, 0, 0755);
+    write_macho("Foo.app/Contents/Resources/bin/ignored", 2, 0, 0755);
+    write_macho("Foo.app/Contents/MacOS/.hidden", 2, 0, 0755);
+
+    char self[PATH_MAX];
+    snprintf(self, sizeof(self), "%s/Foo.app/Contents/MacOS/Foo", g_root);
+    int n = rmp_bundle_siblings(self, MAX_SIBS, collect, NULL);
+    CHECK("three siblings found", n == 3 && g_nsibs == 3);
+    CHECK("fat executable found", found_sib("Foo.app/Contents/MacOS/crashpad"));
+    CHECK("nested helper app found",
+          found_sib("Foo.app/Contents/Frameworks/Foo Helper.app/Contents/MacOS/Foo Helper"));
+    CHECK("framework helper tool found",
+          found_sib("Foo.app/Contents/Frameworks/Foo.framework/Versions/A/Helpers/tool"));
+    CHECK("self not listed", !found_sib("Foo.app/Contents/MacOS/Foo"));
+
+    // Starting from the helper finds the same bundle, main binary included
+    g_nsibs = 0;
+    snprintf(self, sizeof(self),
+             "%s/Foo.app/Contents/Frameworks/Foo Helper.app/Contents/MacOS/Foo Helper",
+             g_root);
+    rmp_bundle_siblings(self, MAX_SIBS, collect, NULL);
+    CHECK("outermost bundle scanned from helper",
+          g_nsibs == 3 && found_sib("Foo.app/Contents/MacOS/Foo"));
+
+    g_nsibs = 0;
+    CHECK("max bounds the scan", rmp_bundle_siblings(self, 1, collect, NULL) == 1);
+    CHECK("not in a bundle", rmp_bundle_siblings("/usr/bin/true", MAX_SIBS,
+                                                 collect, NULL) == 0);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/crashpad", g_root);
+    CHECK("macho kind: fat executable", rmp_macho_kind(path) == RMP_MACHO_EXECUTE);
+    snprintf(path, sizeof(path),
+             "%s/Foo.app/Contents/Frameworks/Foo.framework/Versions/A/Foo", g_root);
+    CHECK("macho kind: dylib", rmp_macho_kind(path) == RMP_MACHO_DYLIB);
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/launcher.sh", g_root);
+    CHECK("macho kind: script", rmp_macho_kind(path) == RMP_MACHO_NONE);
+
+    printf("--- scheduler queues a bundle once ---\n");
+    reset_stub(10 * 1000);
+    ps = rmp_presign_create(2, stub_sign, NULL);
+    snprintf(self, sizeof(self), "%s/Foo.app/Contents/MacOS/Foo", g_root);
+    CHECK("bundle queues its siblings", rmp_presign_bundle(ps, self) == 3);
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/crashpad", g_root);
+    CHECK("second binary of same bundle queues nothing",
+          rmp_presign_bundle(ps, path) == 0);
+    rmp_presign_drain(ps);
+    CHECK("all siblings signed once", g_nseen == 3 && times_signed(path) == 1);
+    rmp_presign_destroy(ps);
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
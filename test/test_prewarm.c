@@ -0,0 +1,327 @@
+/*
+ * test_prewarm.c - exercise rmp_prewarm() with a stub signer
+ *
+ * Builds, under a scratch directory:
+ *   signer       shell stand-in for codesign (rmp_ctx_set_signer): "check"
+ *                says a binary is hardened if its name contains "hardened",
+ *                "sign" appends a marker, and fails for names with "fail"
+ *   Foo.app/     fake Mach-O executables, a dylib, a script, a symlink
+ *   cache/       where the entries should appear
+ *   system/      a machine-wide tier, prewarmed as an admin would, that a
+ *                second user's lookups use before their own (user/)
+ *
+ * Also checks that rmp_pool runs nested fan-out to completion and spreads
+ * it across workers.
+ *
+ * Usage:
+ *   ./test_prewarm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rmp_shared.h"
+#include "rmp_pool.h"
+#include "rmp_prewarm.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[512];
+static char g_signer[PATH_MAX + 16];
+
+static const char *STUB_SIGNER =
+    "#!/bin/sh\n"
+    "case \"$1\" in\n"
+    "check) case \"${2##*/}\" in *hardened*) exit 0 ;; *) exit 1 ;; esac ;;\n"
+    "sign)  case \"${3##*/}\" in *fail*) echo 'stub: refusing' ; exit 1 ;; esac\n"
+    "       printf 'SIGNED' >> \"$3\" ;;\n"
+    "*)     exit 2 ;;\n"
+    "esac\n";
+
+static void write_file(const char *rel, const void *data, size_t len, mode_t mode) {
+    char path[PATH_MAX], dir[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", g_root, rel);
+    snprintf(dir, sizeof(dir), "%s", path);
+    *strrchr(dir, '/') = '\0';
+    rmp_mkdirs(dir, 0755);
+
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    if (fd < 0 || write(fd, data, len) != (ssize_t)len) { perror(path); exit(2); }
+    close(fd);
+    chmod(path, mode);
+}
+
+static void write_macho(const char *rel, uint32_t filetype, mode_t mode) {
+    uint32_t hdr[8] = { 0xfeedfacfu, 0x0100000cu, 0, filetype, 0, 0, 0, 0 };
+    write_file(rel, hdr, sizeof(hdr), mode);
+}
+
+// Path of the cache entry for fixture file `rel`
+static void cached_path(const rmp_ctx_t *ctx, const char *rel, char *out) {
+    char orig[PATH_MAX];
+    snprintf(orig, sizeof(orig), "%s/%s", g_root, rel);
+    rmp_cache_path(ctx->cache_dir, orig, out, PATH_MAX);
+}
+
+// A context signing with the stub
+static void init_ctx(rmp_ctx_t *ctx, const char *config, const char *cache) {
+    rmp_ctx_init(ctx, config, cache, NULL);
+    rmp_ctx_set_signer(ctx, g_signer);
+}
+
+static int is_signed(const char *path) {
+    char buf[64];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = pread(fd, buf, sizeof(buf), 32);
+    close(fd);
+    return n == 6 && memcmp(buf, "SIGNED", 6) == 0;
+}
+
+/*** rmp_pool fan-out ****/
+
+static atomic_int g_tasks;
+static pthread_t g_threads[64];
+static atomic_int g_nthreads;
+static rmp_pool_t *g_pool;
+
+static void note_thread(void) {
+    pthread_t self = pthread_self();
+    int n = atomic_load(&g_nthreads);
+    for (int i = 0; i < n; i++)
+        if (pthread_equal(g_threads[i], self)) return;
+    n = atomic_fetch_add(&g_nthreads, 1);
+    if (n < 64) g_threads[n] = self;
+}
+
+// Binary tree of tasks, each submitting its children from the worker
+static void tree_task(void *arg) {
+    intptr_t depth = (intptr_t)arg;
+    atomic_fetch_add(&g_tasks, 1);
+    if (depth > 0) {
+        rmp_pool_submit(g_pool, tree_task, (void *)(depth - 1));
+        rmp_pool_submit(g_pool, tree_task, (void *)(depth - 1));
+    }
+}
+
+static pthread_mutex_t g_seen_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void slow_task(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_seen_lock);
+    note_thread();
+    pthread_mutex_unlock(&g_seen_lock);
+    usleep(20 * 1000);
+}
+
+static void fan_out_task(void *arg) {
+    (void)arg;
+    for (int i = 0; i < 16; i++)
+        rmp_pool_submit(g_pool, slow_task, NULL);
+}
+
+int main(void) {
+    printf("--- rmp_pool: nested fan-out ---\n");
+    g_pool = rmp_pool_create(4);
+    CHECK("pool created", g_pool != NULL);
+    rmp_pool_submit(g_pool, tree_task, (void *)(intptr_t)12);
+    rmp_pool_wait(g_pool);
+    CHECK("all 8191 nested tasks ran", atomic_load(&g_tasks) == 8191);
+
+    // Sixteen tasks queued on one worker's deque; idle workers steal them
+    rmp_pool_submit(g_pool, fan_out_task, NULL);
+    rmp_pool_wait(g_pool);
+    CHECK("work submitted by one worker is stolen by others",
+          atomic_load(&g_nthreads) > 1);
+    rmp_pool_destroy(g_pool);
+
+    snprintf(g_root, sizeof(g_root), "%s/rmp-prewarm-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(g_root)) { perror("mkdtemp"); return 2; }
+    // rmp_prewarm() keys entries by real path
+    char real[PATH_MAX];
+    if (!realpath(g_root, real)) { perror("realpath"); return 2; }
+    if ((size_t)snprintf(g_root, sizeof(g_root), "%s", real) >= sizeof(g_root)) {
+        fprintf(stderr, "%s: path too long\n", real);
+        return 2;
+    }
+
+    write_file("signer", STUB_SIGNER, strlen(STUB_SIGNER), 0755);
+    write_macho("Foo.app/Contents/MacOS/Foo-hardened", 2, 0755);
+    write_macho("Foo.app/Contents/MacOS/plain", 2, 0755);
+    write_macho("Foo.app/Contents/Frameworks/Foo.framework/Helpers/tool-hardened", 2, 0755);
+    write_macho("Foo.app/Contents/Frameworks/libfoo-hardened.dylib", 6, 0755);
+    write_macho("Foo.app/Contents/Resources/data-hardened", 2, 0644);  // not +x
+    write_file("Foo.app/Contents/Resources/run.sh", "#!/bin/sh\n", 10, 0755);
+
+    char path[PATH_MAX + 64], target[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/link-hardened", g_root);
+    snprintf(target, sizeof(target), "%s/Foo.app/Contents/MacOS/Foo-hardened", g_root);
+    if (symlink(target, path) != 0) { perror("symlink"); return 2; }
+
+    char config[PATH_MAX], cache[PATH_MAX + 16], *signer = g_signer;
+    snprintf(config, sizeof(config), "%s/config", g_root);
+    // Inside the walked tree, to check it is skipped
+    snprintf(cache, sizeof(cache), "%s/Foo.app/cache", g_root);
+    snprintf(g_signer, sizeof(g_signer), "%s/signer", g_root);
+    setenv("RMP_SIGNER", signer, 1);
+
+    rmp_ctx_t ctx;
+    rmp_ctx_init(&ctx, config, cache, NULL);
+    CHECK("$RMP_SIGNER ignored", strcmp(ctx.signer_path, signer) != 0);
+    unsetenv("RMP_SIGNER");
+    CHECK("signer set", rmp_ctx_set_signer(&ctx, signer) == 0 &&
+                        strcmp(ctx.signer_path, signer) == 0);
+    CHECK("context can sign", rmp_can_sign(&ctx));
+
+    printf("--- pass 1: cold cache ---\n");
+    snprintf(path, sizeof(path), "%s/Foo.app", g_root);
+    rmp_prewarm_stats_t st;
+    int ret = rmp_prewarm(&ctx, path, 4, &st);
+    CHECK("prewarm returns 0", ret == 0);
+    CHECK("5 executable files examined", st.files == 5);
+    CHECK("4 Mach-O", st.macho == 4);
+    CHECK("3 MH_EXECUTE", st.executables == 3);
+    CHECK("2 hardened", st.hardened == 2);
+    CHECK("2 entries built", st.created == 2 && st.failed == 0 && st.cached == 0);
+    CHECK("bytes counted", st.bytes == 2 * 32);
+
+    char cached[PATH_MAX];
+    cached_path(&ctx, "Foo.app/Contents/MacOS/Foo-hardened", cached);
+    CHECK("main binary cached and signed", is_signed(cached));
+    cached_path(&ctx, "Foo.app/Contents/Frameworks/Foo.framework/Helpers/tool-hardened",
+                cached);
+    CHECK("nested helper cached and signed", is_signed(cached));
+    struct stat sb;
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/Frameworks/Foo.framework/"
+             "Helpers/tool-hardened", g_root);
+    stat(path, &sb);
+    CHECK("entry valid for original", rmp_cache_valid(cached, sb.st_mtime, sb.st_size));
+    cached_path(&ctx, "Foo.app/Contents/MacOS/plain", cached);
+    CHECK("non-hardened binary not cached", access(cached, F_OK) != 0);
+    cached_path(&ctx, "Foo.app/Contents/MacOS/link-hardened", cached);
+    CHECK("symlink not followed", access(cached, F_OK) != 0);
+    cached_path(&ctx, "Foo.app/Contents/Frameworks/libfoo-hardened.dylib", cached);
+    CHECK("dylib not cached", access(cached, F_OK) != 0);
+
+    printf("--- pass 2: warm cache ---\n");
+    snprintf(path, sizeof(path), "%s/Foo.app", g_root);
+    ret = rmp_prewarm(&ctx, path, 2, &st);
+    CHECK("prewarm returns 0", ret == 0);
+    CHECK("nothing rebuilt", st.created == 0 && st.cached == 2);
+
+    printf("--- pass 3: one original updated, one signing failure ---\n");
+    write_macho("Foo.app/Contents/MacOS/Foo-hardened", 2, 0755);
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/Foo-hardened", g_root);
+    if (truncate(path, 64) != 0) { perror("truncate"); return 2; }
+    write_macho("Foo.app/Contents/MacOS/fail-hardened", 2, 0755);
+    snprintf(path, sizeof(path), "%s/Foo.app", g_root);
+    ret = rmp_prewarm(&ctx, path, 0, &st);
+    CHECK("prewarm returns 0", ret == 0);
+    CHECK("changed binary rebuilt", st.created == 1 && st.cached == 1);
+    CHECK("failure counted", st.failed == 1);
+    cached_path(&ctx, "Foo.app/Contents/MacOS/fail-hardened", cached);
+    CHECK("failed entry absent", access(cached, F_OK) != 0);
+
+    printf("--- single file ---\n");
+    cached_path(&ctx, "Foo.app/Contents/MacOS/Foo-hardened", cached);
+    unlink(cached);
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/Foo-hardened", g_root);
+    ret = rmp_prewarm(&ctx, path, 1, &st);
+    CHECK("single file built", ret == 0 && st.files == 1 && st.created == 1);
+    CHECK("missing root rejected", rmp_prewarm(&ctx, "/nonexistent/x", 1, &st) == -1);
+
+    printf("--- system tier ---\n");
+    char system_dir[PATH_MAX + 16], user_dir[PATH_MAX + 16];
+    snprintf(system_dir, sizeof(system_dir), "%s/system", g_root);
+    snprintf(user_dir, sizeof(user_dir), "%s/user", g_root);
+    mkdir(system_dir, 0755);
+    chmod(system_dir, 0755);
+    setenv("RMP_SYSTEM_CACHE", "", 1);
+    rmp_ctx_t admin, user;
+    init_ctx(&admin, config, system_dir);
+    CHECK("RMP_SYSTEM_CACHE='': no tier", admin.system_cache_dir[0] == '\0');
+    // Contents/ only: Foo.app/cache is not the tier being filled now
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents", g_root);
+    ret = rmp_prewarm(&admin, path, 2, &st);
+    CHECK("admin prewarm fills the system tier", ret == 0 && st.created == 2);
+
+    setenv("RMP_SYSTEM_CACHE", system_dir, 1);
+    init_ctx(&admin, config, system_dir);
+    CHECK("the tier being written is not also read", admin.system_cache_dir[0] == '\0');
+    init_ctx(&user, config, user_dir);
+    CHECK("tier picked up from RMP_SYSTEM_CACHE", strcmp(user.system_cache_dir, system_dir) == 0);
+
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/Frameworks/Foo.framework/"
+             "Helpers/tool-hardened", g_root);
+    int was_cached = 0;
+    const char *use = rmp_resolve_hardened(&user, path, &was_cached);
+    CHECK("first launch for a new user: the system copy",
+          was_cached && strncmp(use, system_dir, strlen(system_dir)) == 0 && is_signed(use));
+    if (was_cached) free((char *)use);
+    rmp_cache_path(user.cache_dir, path, cached, sizeof(cached));
+    CHECK("nothing copied into the user's cache", access(cached, F_OK) != 0);
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents", g_root);
+    ret = rmp_prewarm(&user, path, 2, &st);
+    CHECK("user prewarm finds both in the system tier",
+          ret == 0 && st.cached == 2 && st.created == 0);
+
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/Frameworks/Foo.framework/"
+             "Helpers/tool-hardened", g_root);
+    if (truncate(path, 96) != 0) { perror("truncate"); return 2; }
+    use = rmp_resolve_hardened(&user, path, &was_cached);
+    CHECK("stale system copy: the user tier builds its own",
+          was_cached && strcmp(use, cached) == 0 && access(cached, F_OK) == 0);
+    if (was_cached) free((char *)use);
+    rmp_cache_path(system_dir, path, cached, sizeof(cached));
+    stat(path, &sb);
+    CHECK("system tier left alone", !rmp_cache_valid(cached, sb.st_mtime, sb.st_size) &&
+                                    is_signed(cached));
+
+    // Nor is an entry others could have swapped in
+    snprintf(path, sizeof(path), "%s/Foo.app/Contents/MacOS/Foo-hardened", g_root);
+    stat(path, &sb);
+    CHECK("system entry found", rmp_cache_lookup(&user, path, sb.st_mtime, sb.st_size,
+                                                 cached, sizeof(cached)) == 1 &&
+                                strncmp(cached, system_dir, strlen(system_dir)) == 0);
+    chmod(cached, 0775);
+    CHECK("group-writable entry not used",
+          rmp_cache_lookup(&user, path, sb.st_mtime, sb.st_size, cached, sizeof(cached)) == 0);
+    rmp_cache_path(system_dir, path, cached, sizeof(cached));
+    chmod(cached, 0755);
+    *strrchr(cached, '/') = '\0';
+    chmod(cached, 0777);
+    CHECK("entry under a world-writable dir not used",
+          rmp_cache_lookup(&user, path, sb.st_mtime, sb.st_size, cached, sizeof(cached)) == 0);
+    rmp_cache_path(system_dir, path, cached, sizeof(cached));
+    *strrchr(cached, '/') = '\0';
+    chmod(cached, 0755);
+
+    chmod(system_dir, 0777);
+    init_ctx(&user, config, user_dir);
+    CHECK("world-writable tier ignored", user.system_cache_dir[0] == '\0');
+    unsetenv("RMP_SYSTEM_CACHE");
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", g_root);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * test_sync.c - exercise rmp_sync_tree() on a fixture tree
+ *
+ * Mirrors a small tree of files, a subdirectory and a symlink into an
+ * empty directory, then changes the source a piece at a time - content,
+ * mtime alone, mode alone, deletions, a file turned into a directory -
+ * and checks that each sync writes exactly what changed, replaces files
+ * by rename rather than in place, and leaves no temporaries behind.
+ * The whole sequence runs twice: copies inline, then on a pool.  Last,
+ * named snapshots of a target dir are saved, restored and updated.
+ *
+ * Usage:
+ *   ./test_sync
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "rmp_sync.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static char g_root[600];
+static int g_jobs;
+
+static const char *P(const char *rel) {
+    static char bufs[4][PATH_MAX];
+    static int next;
+    char *buf = bufs[next++ % 4];
+    snprintf(buf, PATH_MAX, "%s/%s", g_root, rel);
+    return buf;
+}
+
+static void write_file(const char *rel, const char *content) {
+    FILE *fp = fopen(P(rel), "w");
+    if (!fp) { perror(rel); exit(2); }
+    fputs(content, fp);
+    fclose(fp);
+}
+
+static int has_content(const char *rel, const char *want) {
+    char buf[256];
+    FILE *fp = fopen(P(rel), "r");
+    if (!fp) return 0;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    return strcmp(buf, want) == 0;
+}
+
+static int exists(const char *rel) {
+    struct stat sb;
+    return lstat(P(rel), &sb) == 0;
+}
+
+static ino_t inode(const char *rel) {
+    struct stat sb;
+    return lstat(P(rel), &sb) == 0 ? sb.st_ino : 0;
+}
+
+// Set a file's mtime to a fixed second, leaving the content alone
+static void set_mtime(const char *rel, time_t sec) {
+    struct timeval tv[2] = { { sec, 0 }, { sec, 0 } };
+    utimes(P(rel), tv);
+}
+
+// Any ".rmp-sync-" temporaries left in dir?
+static int temps_in(const char *rel) {
+    DIR *d = opendir(P(rel));
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)))
+        if (strstr(e->d_name, ".rmp-sync-")) n++;
+    closedir(d);
+    return n;
+}
+
+static rmp_sync_stats_t sync_once(const char *src, const char *dst, int *ret) {
+    rmp_sync_stats_t st;
+    memset(&st, 0, sizeof(st));
+    *ret = rmp_sync_tree(P(src), P(dst), 0, g_jobs, &st);
+    return st;
+}
+
+static void run_suite(void) {
+    mkdir(P("src"), 0755);
+    mkdir(P("src/sub"), 0750);
+    write_file("src/a.txt", "alpha");
+    write_file("src/sub/b.txt", "bravo!");
+    write_file("src/gone.txt", "x");
+    mkdir(P("src/gonedir"), 0755);
+    write_file("src/gonedir/c.txt", "c");
+    if (symlink("a.txt", P("src/link")) != 0) { perror("symlink"); exit(2); }
+
+    int r;
+    rmp_sync_stats_t st;
+
+    printf("=== Initial copy (jobs=%d) ===\n", g_jobs);
+    st = sync_once("src", "dst", &r);
+    CHECK("sync into a missing dir succeeds", r == 0);
+    CHECK("5 entries written (4 files, 1 symlink)", st.files == 5);
+    CHECK("bytes are the file sizes", st.bytes == 5 + 6 + 1 + 1);
+    CHECK("nothing removed or failed", st.removed == 0 && st.failed == 0);
+    CHECK("file content copied", has_content("dst/a.txt", "alpha"));
+    CHECK("nested file copied", has_content("dst/sub/b.txt", "bravo!"));
+    struct stat sb;
+    CHECK("directory mode follows src",
+          stat(P("dst/sub"), &sb) == 0 && (sb.st_mode & 07777) == 0750);
+    char link[64];
+    ssize_t n = readlink(P("dst/link"), link, sizeof(link) - 1);
+    CHECK("symlink copied as a symlink", n == 5 && memcmp(link, "a.txt", 5) == 0);
+
+    printf("\n=== Unchanged ===\n");
+    ino_t ino_a = inode("dst/a.txt");
+    st = sync_once("src", "dst", &r);
+    CHECK("second sync writes nothing", r == 0 && st.files == 0 && st.bytes == 0);
+    CHECK("and removes nothing", st.removed == 0);
+
+    printf("\n=== Changes ===\n");
+    write_file("src/a.txt", "alpha, longer");
+    set_mtime("src/sub/b.txt", 1000000000);
+    chmod(P("src/gone.txt"), 0600);
+    st = sync_once("src", "dst", &r);
+    CHECK("changed size and changed mtime are rewritten", r == 0 && st.files == 2);
+    CHECK("only the changed bytes are counted", st.bytes == 13 + 6);
+    CHECK("new content in place", has_content("dst/a.txt", "alpha, longer"));
+    CHECK("rewritten by rename, not in place", inode("dst/a.txt") != ino_a);
+    CHECK("mtime carried over",
+          stat(P("dst/sub/b.txt"), &sb) == 0 && sb.st_mtime == 1000000000);
+    CHECK("mode-only change is a chmod",
+          stat(P("dst/gone.txt"), &sb) == 0 && (sb.st_mode & 07777) == 0600);
+    CHECK("no temporaries left", temps_in("dst") == 0 && temps_in("dst/sub") == 0);
+
+    printf("\n=== Deletions and type changes ===\n");
+    unlink(P("src/gone.txt"));
+    unlink(P("src/gonedir/c.txt"));
+    rmdir(P("src/gonedir"));
+    unlink(P("src/link"));
+    mkdir(P("src/link"), 0755);
+    write_file("src/link/d.txt", "delta");
+    write_file("dst/.a.txt.rmp-sync-1", "stale");
+    st = sync_once("src", "dst", &r);
+    CHECK("sync succeeds", r == 0);
+    CHECK("deleted file removed", !exists("dst/gone.txt"));
+    CHECK("deleted dir removed whole", !exists("dst/gonedir"));
+    CHECK("stale temporary removed", !exists("dst/.a.txt.rmp-sync-1"));
+    CHECK("removals counted once per entry", st.removed == 4);
+    CHECK("symlink replaced by a directory",
+          lstat(P("dst/link"), &sb) == 0 && S_ISDIR(sb.st_mode) &&
+          has_content("dst/link/d.txt", "delta"));
+
+    printf("\n=== Single file ===\n");
+    st = sync_once("src/a.txt", "copy.txt", &r);
+    CHECK("a file syncs to a file", r == 0 && st.files == 1 &&
+          has_content("copy.txt", "alpha, longer"));
+    st = sync_once("src/a.txt", "copy.txt", &r);
+    CHECK("and only once", r == 0 && st.files == 0);
+
+    printf("\n=== Errors ===\n");
+    errno = 0;
+    r = rmp_sync_tree(P("missing"), P("dst"), 0, 1, NULL);
+    CHECK("missing src fails with ENOENT", r == -1 && errno == ENOENT);
+    CHECK("dst untouched", has_content("dst/a.txt", "alpha, longer"));
+    st = sync_once("src", "nodir/deeper/dst", &r);
+    CHECK("dst under a missing parent fails", r == -1 && st.failed > 0);
+
+}
+
+// Save a snapshot of a target-like dir, dirty it, and reset it
+static void run_snapshots(void) {
+    mkdir(P("t"), 0755);
+    mkdir(P("t/.app"), 0755);
+    mkdir(P("t/.rmp-stage"), 0700);
+    write_file("t/.app/config", "known-good");
+    write_file("t/.app.json", "{}");
+
+    rmp_sync_stats_t st;
+    memset(&st, 0, sizeof(st));
+    const char *method = NULL;
+    errno = 0;
+    CHECK("bad snapshot name rejected",
+          rmp_snapshot_save(P("t"), "../x", 0, NULL, NULL) == -1 && errno == EINVAL);
+    CHECK("snapshot saved", rmp_snapshot_save(P("t"), "base", 0, &st, &method) == 0);
+    CHECK("method reported", method && (!strcmp(method, "tree") || !strcmp(method, "subvolume")));
+    if (method && !strcmp(method, "tree")) {
+        CHECK("snapshot holds the files", st.files == 2 &&
+              has_content("t/.rmp-snapshots/base/.app/config", "known-good"));
+        CHECK("remapper's own dirs left out", !exists("t/.rmp-snapshots/base/.rmp-stage"));
+    }
+
+    write_file("t/.app/config", "dirty!");
+    write_file("t/.app/new", "junk");
+    unlink(P("t/.app.json"));
+    mkdir(P("t/.later"), 0755);
+    memset(&st, 0, sizeof(st));
+    CHECK("reset succeeds", rmp_snapshot_restore(P("t"), "base", 0, &st) == 0);
+    CHECK("changed file restored", has_content("t/.app/config", "known-good"));
+    CHECK("deleted file restored", has_content("t/.app.json", "{}"));
+    CHECK("new entries removed", !exists("t/.app/new") && !exists("t/.later"));
+    CHECK("only the differences rewritten", st.files == 2 && st.removed == 2);
+    CHECK("staging dir and snapshots survive the reset",
+          exists("t/.rmp-stage") && exists("t/.rmp-snapshots/base"));
+
+    memset(&st, 0, sizeof(st));
+    rmp_snapshot_restore(P("t"), "base", 0, &st);
+    CHECK("second reset writes nothing", st.files == 0 && st.removed == 0);
+
+    write_file("t/.app/config", "v2");
+    CHECK("existing snapshot updated in place",
+          rmp_snapshot_save(P("t"), "base", 0, NULL, &method) == 0 &&
+          has_content("t/.rmp-snapshots/base/.app/config", "v2"));
+    errno = 0;
+    CHECK("missing snapshot is ENOENT",
+          rmp_snapshot_restore(P("t"), "nope", 0, NULL) == -1 && errno == ENOENT);
+
+    // Copies run on the pool while the walk goes on: their temporaries
+    // must not be taken for entries the snapshot lacks
+    char name[64];
+    for (int i = 0; i < 50; i++) {
+        snprintf(name, sizeof(name), "t/.app/f%02d", i);
+        write_file(name, "good");
+    }
+    rmp_snapshot_save(P("t"), "many", 0, NULL, NULL);
+    int ok = 1;
+    for (int round = 0; round < 20 && ok; round++) {
+        for (int i = 0; i < 50; i++) {
+            snprintf(name, sizeof(name), "t/.app/f%02d", i);
+            write_file(name, "dirty");
+        }
+        ok = rmp_snapshot_restore(P("t"), "many", 8, NULL) == 0 &&
+             has_content("t/.app/f49", "good");
+    }
+    CHECK("parallel resets keep every copy", ok);
+}
+
+int main(void) {
+    char base[512];
+    snprintf(base, sizeof(base), "%s/rmp-test-sync-XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(base)) { perror("mkdtemp"); return 2; }
+
+    for (g_jobs = 1; g_jobs <= 4; g_jobs += 3) {
+        snprintf(g_root, sizeof(g_root), "%s/jobs-%d", base, g_jobs);
+        mkdir(g_root, 0755);
+        run_suite();
+        printf("\n");
+    }
+
+    printf("=== Snapshots ===\n");
+    snprintf(g_root, sizeof(g_root), "%s", base);
+    run_snapshots();
+
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", base);
+    if (system(cmd) != 0) fprintf(stderr, "warning: cleanup failed\n");
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * test_trace.c - exercise rmp_trace (the --trace files bench_rewrite replays)
+ *
+ * Writes traces and reads them back: records in order with their
+ * calls, across many chunks and past the call ids a chunk holds, from
+ * several writers on one file as several processes would be, from
+ * threads at once, across a fork, and from a copy cut off mid-chunk.
+ *
+ * Usage:
+ *   ./test_trace [sample]
+ *     sample: also leave a small trace there, for bench_rewrite
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "rmp_trace.h"
+
+static int failures = 0;
+static int passes   = 0;
+
+#define CHECK(label, cond) do { \
+    if (cond) { printf("  PASS: %s\n", label); passes++; } \
+    else      { printf("  FAIL: %s (errno=%d: %s)\n", label, errno, strerror(errno)); failures++; } \
+    errno = 0; \
+} while(0)
+
+static const char *TARGET   = "/tmp/rmp-test-trace-target";
+static const char *MAPPINGS = "/home/u/.app*:/home/u/src/*/.cache=/tmp/rmp-test-trace-cache";
+
+// The records of a trace written by fill(), as the sample for bench_rewrite
+static const char *g_calls[] = { "open", "stat", "lstat", "mkdir", "openat" };
+static const char *g_paths[] = {
+    "/home/u/.app/config.json", "/home/u/.app/cache/a", "/home/u/.app",
+    "/home/u/.apple", "/home/u/other", "/home/u/src/x/.cache/b",
+    "/home/u/src/x/.cache", "/usr/lib/libc.so", "relative/path", "/",
+    "/home/u/.app/cache/b",
+};
+#define NUM_PATHS (int)(sizeof(g_paths) / sizeof(g_paths[0]))
+
+static void fill(rmp_trace_t *t, int n) {
+    for (int i = 0; i < n; i++)
+        rmp_trace_add(t, g_calls[i % 5], g_paths[i % NUM_PATHS]);
+}
+
+// 1 if data holds n records from fill(), in order, starting at record from
+static int filled(const rmp_trace_data_t *d, size_t from, int n) {
+    if (from + (size_t)n > d->count) return 0;
+    for (int i = 0; i < n; i++)
+        if (strcmp(d->recs[from + i].call, g_calls[i % 5]) != 0 ||
+            strcmp(d->recs[from + i].path, g_paths[i % NUM_PATHS]) != 0) return 0;
+    return 1;
+}
+
+static rmp_trace_t *g_shared;
+
+static void *hammer(void *arg) {
+    char path[64];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(path, sizeof(path), "/home/u/.app/t%ld/%d", (long)arg, i);
+        rmp_trace_add(g_shared, "stat", path);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    char path[] = "/tmp/rmp-test-trace-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    rmp_trace_data_t d;
+
+    printf("=== Records ===\n");
+    CHECK("not a trace refused", rmp_trace_open(path) == NULL && errno == EINVAL);
+    CHECK("trace created", rmp_trace_create(path, TARGET, MAPPINGS) == 0);
+    rmp_trace_t *t = rmp_trace_open(path);
+    CHECK("opened to add to", t != NULL);
+    fill(t, 20);
+    rmp_trace_add(t, NULL, "/no/call");
+    rmp_trace_add(t, "open", NULL);
+    rmp_trace_close(t);
+    CHECK("read back", rmp_trace_load(path, &d) == 0);
+    CHECK("target and mappings kept", d.target && strcmp(d.target, TARGET) == 0 &&
+                                      strcmp(d.mappings, MAPPINGS) == 0);
+    CHECK("records in order, with their calls", d.count == 21 && filled(&d, 0, 20));
+    CHECK("no call: '?'", d.count == 21 && strcmp(d.recs[20].call, "?") == 0);
+    rmp_trace_data_free(&d);
+
+    printf("\n=== Chunks ===\n");
+    rmp_trace_create(path, TARGET, MAPPINGS);
+    t = rmp_trace_open(path);
+    fill(t, 20000);
+    char call[32], many[300][32];
+    for (int i = 0; i < 300; i++) {
+        snprintf(call, sizeof(call), "call%d", i);
+        strcpy(many[i], call);
+        rmp_trace_add(t, many[i], "/home/u/.app/x");
+    }
+    rmp_trace_close(t);
+    CHECK("many chunks read back", rmp_trace_load(path, &d) == 0 && filled(&d, 0, 20000));
+    int names_ok = d.count == 20300;
+    for (int i = 0; names_ok && i < 300; i++)
+        names_ok = strcmp(d.recs[20000 + i].call, many[i]) == 0;
+    CHECK("more calls than a chunk's ids", names_ok);
+    rmp_trace_data_free(&d);
+
+    FILE *fp = fopen(path, "r+");
+    long size = 0;
+    if (fp && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+    if (fp) fclose(fp);
+    long raw = 0;
+    for (int i = 0; i < 20000; i++) raw += strlen(g_calls[i % 5]) + strlen(g_paths[i % NUM_PATHS]);
+    CHECK("smaller than the paths and calls", size > 0 && size < raw);
+    CHECK("cut off copy", truncate(path, size - 10) == 0 && rmp_trace_load(path, &d) == 0 &&
+                          d.truncated > 0 && filled(&d, 0, (int)(d.count < 20000 ? d.count : 20000)));
+    rmp_trace_data_free(&d);
+
+    printf("\n=== Writers ===\n");
+    rmp_trace_create(path, TARGET, MAPPINGS);
+    rmp_trace_t *a = rmp_trace_open(path), *b = rmp_trace_open(path);
+    fill(a, 10);
+    rmp_trace_add(b, "rename", "/home/u/.app/b1");
+    rmp_trace_flush(b);
+    rmp_trace_flush(a);
+    fill(a, 10);
+    rmp_trace_add(b, "rename", "/home/u/.app/b2");
+    rmp_trace_close(a);
+    rmp_trace_close(b);
+    CHECK("two writers interleave whole chunks", rmp_trace_load(path, &d) == 0 && d.count == 22 &&
+          strcmp(d.recs[0].path, "/home/u/.app/b1") == 0 && filled(&d, 1, 10) &&
+          filled(&d, 11, 10) && strcmp(d.recs[21].path, "/home/u/.app/b2") == 0);
+    rmp_trace_data_free(&d);
+
+    rmp_trace_create(path, TARGET, MAPPINGS);
+    g_shared = rmp_trace_open(path);
+    pthread_t th[4];
+    for (long i = 0; i < 4; i++) pthread_create(&th[i], NULL, hammer, (void *)i);
+    for (int i = 0; i < 4; i++) pthread_join(th[i], NULL);
+    rmp_trace_close(g_shared);
+    int seen[4] = { 0 }, ordered = 1;
+    if (rmp_trace_load(path, &d) == 0) {
+        for (size_t i = 0; i < d.count; i++) {
+            long th_id;
+            int n;
+            if (sscanf(d.recs[i].path, "/home/u/.app/t%ld/%d", &th_id, &n) == 2 &&
+                th_id >= 0 && th_id < 4 && n == seen[th_id]) seen[th_id]++;
+            else ordered = 0;
+        }
+    }
+    CHECK("threads: every record, each thread's in order",
+          ordered && seen[0] + seen[1] + seen[2] + seen[3] == 20000);
+    rmp_trace_data_free(&d);
+
+    rmp_trace_create(path, TARGET, MAPPINGS);
+    t = rmp_trace_open(path);
+    fill(t, 10);
+    rmp_trace_lock(t);
+    pid_t pid = fork();
+    rmp_trace_unlock(t);
+    if (pid == 0) {
+        rmp_trace_add(t, "stat", "/home/u/.app/child");
+        rmp_trace_close(t);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    rmp_trace_add(t, "stat", "/home/u/.app/parent");
+    rmp_trace_close(t);
+    CHECK("fork: the parent's records once", rmp_trace_load(path, &d) == 0 && d.count == 12 &&
+          filled(&d, 0, 10) && strcmp(d.recs[10].path, "/home/u/.app/child") == 0 &&
+          strcmp(d.recs[11].path, "/home/u/.app/parent") == 0);
+    rmp_trace_data_free(&d);
+    unlink(path);
+
+    if (argc > 1) {
+        rmp_trace_create(argv[1], TARGET, MAPPINGS);
+        t = rmp_trace_open(argv[1]);
+        if (t) fill(t, 1000);
+        rmp_trace_close(t);
+    }
+
+    printf("\n%d passed, %d failed\n", passes, failures);
+    return failures ? 1 : 0;
+}
@@ -110,6 +110,13 @@ int main(int argc, char **argv) {
     CHECK("openat.txt exists", path_exists(path));
     CHECK("openat.txt content", file_contains(path, "openat-content\n"));
 
+    /* dirfd.txt, dirfd-dir/ (relative to a dirfd on $HOME) */
+    snprintf(path, sizeof(path), "%s/.dummy-test/dirfd.txt", target);
+    CHECK("dirfd.txt exists", path_exists(path));
+    CHECK("dirfd.txt content", file_contains(path, "dirfd-content\n"));
+    snprintf(path, sizeof(path), "%s/.dummy-test/dirfd-dir", target);
+    CHECK("dirfd-dir/ exists", path_exists(path));
+
     /* renamed.txt (was pre-rename.txt) */
     snprintf(path, sizeof(path), "%s/.dummy-test/renamed.txt", target);
     CHECK("renamed.txt exists", path_exists(path));